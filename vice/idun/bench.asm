@@ -0,0 +1,107 @@
+; Idun cartridge protocol benchmark workload.
+; Run against src/tools/idunsrv (see `make bench`). Exits through the
+; debug cartridge: 0 when every read-back matched, 1 otherwise.
+
+!if computer-64 {
+    BASICSTART = $1c01
+} else {
+    BASICSTART = $0801
+}
+
+;** Idun cartridge registers
+IdunData    = $de00     ; data channel
+IdunAvail   = $de01     ; bytes waiting in the data channel
+IdunPage    = $defe     ; ERAM page window select, bit 7 = write
+IdunBlock   = $deff     ; ERAM block select
+IdunWindow  = $df00     ; ERAM page window
+DebugCart   = $d7ff     ; write exit code here to quit the emulator
+
+;** workload size
+BLOCKS      = 8         ; blocks cycled through per pass
+PASSES      = 32        ; passes over all blocks
+CHUNKS      = 64        ; 256 byte chunks echoed through the data channel
+
+;** zero page
+passes      = $fb
+chunks      = $fc
+rcount      = $fd
+
+* = BASICSTART
+    !word basicEnd
+    !word 10
+    !byte $9e           ; SYS
+    !pet "0" + (entryPoint / 1000) % 10
+    !pet "0" + (entryPoint / 100) % 10
+    !pet "0" + (entryPoint / 10) % 10
+    !pet "0" + entryPoint % 10
+    !byte 0
+basicEnd
+    !word 0
+
+entryPoint = *
+    sei
+    ; ERAM: select each block, fill a page with the block number and read
+    ; it back. With a small emulator cache every switch is a write-back
+    ; and a block load.
+    lda #PASSES
+    sta passes
+nextPass
+    ldx #1
+nextBlock
+    stx IdunBlock
+    txa
+    ora #$80
+    sta IdunPage
+    ldy #0
+fill
+    txa
+    sta IdunWindow,y
+    iny
+    bne fill
+    stx IdunPage
+verify
+    txa
+    cmp IdunWindow,y
+    bne fail
+    iny
+    bne verify
+    inx
+    cpx #BLOCKS+1
+    bne nextBlock
+    dec passes
+    bne nextPass
+
+    ; data channel: send 256 bytes and wait for the service to echo them.
+    ; The values stay clear of the protocol's LISTEN/TALK/UNTALK bytes.
+    lda #CHUNKS
+    sta chunks
+nextChunk
+    ldy #0
+send
+    tya
+    and #$1f
+    ora #$60
+    sta IdunData
+    iny
+    bne send
+    sty rcount
+receive
+    lda IdunAvail
+    beq receive
+    lda rcount
+    and #$1f
+    ora #$60
+    cmp IdunData
+    bne fail
+    inc rcount
+    bne receive
+    dec chunks
+    bne nextChunk
+
+    lda #0
+    sta DebugCart
+    jmp *
+fail
+    lda #1
+    sta DebugCart
+    jmp *
@@ -0,0 +1,65 @@
+; Cartridge I/O dispatch benchmark.
+; Hammers $DE00-$DFFF with reads and stores from a tight loop, so the run
+; time is dominated by the emulator's I/O dispatch (see `make iobench`).
+; Exits through the debug cartridge with 0.
+
+!if computer-64 {
+    BASICSTART = $1c01
+} else {
+    BASICSTART = $0801
+}
+
+;** Idun cartridge registers
+IdunAvail   = $de01     ; bytes waiting in the data channel
+IdunPage    = $defe     ; ERAM page window select, bit 7 = write
+IdunBlock   = $deff     ; ERAM block select
+IdunWindow  = $df00     ; ERAM page window
+DebugCart   = $d7ff     ; write exit code here to quit the emulator
+
+;** workload size
+PASSES      = 4096      ; passes of 256 iterations, 3 I/O accesses each
+
+;** zero page
+passes      = $fb
+passes_hi   = $fc
+
+* = BASICSTART
+    !word basicEnd
+    !word 10
+    !byte $9e           ; SYS
+    !pet "0" + (entryPoint / 1000) % 10
+    !pet "0" + (entryPoint / 100) % 10
+    !pet "0" + (entryPoint / 10) % 10
+    !pet "0" + entryPoint % 10
+    !byte 0
+basicEnd
+    !word 0
+
+entryPoint = *
+    sei
+    lda #1
+    sta IdunBlock
+    lda #$80
+    sta IdunPage
+    lda #<PASSES
+    sta passes
+    lda #>PASSES
+    sta passes_hi
+    ldx #0
+loop
+    lda IdunAvail
+    lda IdunWindow,x
+    sta IdunWindow,x
+    inx
+    bne loop
+    lda passes
+    bne +
+    dec passes_hi
++   dec passes
+    bne loop
+    lda passes_hi
+    bne loop
+
+    lda #0
+    sta DebugCart
+    jmp *
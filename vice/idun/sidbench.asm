@@ -0,0 +1,119 @@
+; SID synthesis benchmark.
+; Plays a simple register stream on every address a multi-SID setup can use,
+; once per frame like a music player. It never exits; the run length is set
+; with -limitcycles (see `make sidbench`). Stores to SIDs that are not
+; configured go nowhere, so the same program serves every SID count.
+
+;** workload
+NUMSIDS     = 8
+
+;** zero page
+sidptr      = $fb       ; base of the SID being written
+frame       = $fd
+sidnum      = $fe
+
+* = $0801
+    !word basicEnd
+    !word 10
+    !byte $9e           ; SYS
+    !pet "0" + (entryPoint / 1000) % 10
+    !pet "0" + (entryPoint / 100) % 10
+    !pet "0" + (entryPoint / 10) % 10
+    !pet "0" + entryPoint % 10
+    !byte 0
+basicEnd
+    !word 0
+
+entryPoint = *
+    sei
+    lda #0
+    sta frame
+    ldx #NUMSIDS-1
+-   jsr selectSid
+    ldy #$18
+--  lda initRegs,y
+    sta (sidptr),y
+    dey
+    bpl --
+    dex
+    bpl -
+
+frameLoop
+    ; one update per frame, at the bottom of the screen
+-   lda $d012
+    cmp #$f8
+    bne -
+-   lda $d012
+    cmp #$f8
+    beq -
+    inc frame
+
+    ldx #NUMSIDS-1
+sidLoop
+    stx sidnum
+    jsr selectSid
+    ; sweep the three voices and the filter cutoff
+    lda frame
+    clc
+    adc sidnum
+    ldy #$01
+    sta (sidptr),y
+    asl
+    ldy #$08
+    sta (sidptr),y
+    eor #$5a
+    ldy #$0f
+    sta (sidptr),y
+    lda frame
+    ldy #$16
+    sta (sidptr),y
+    ; retrigger every 16 frames, alternating the waveforms
+    lda frame
+    and #$0f
+    bne +
+    lda frame
+    and #$10
+    asl
+    asl
+    ora #$20             ; sawtooth or sawtooth+pulse
+    ora #$01             ; gate
+    ldy #$04
+    sta (sidptr),y
+    ldy #$0b
+    sta (sidptr),y
+    ldy #$12
+    sta (sidptr),y
+    jmp ++
++   cmp #$0c
+    bne ++
+    lda #$40             ; pulse, gate off
+    ldy #$04
+    sta (sidptr),y
+    ldy #$0b
+    sta (sidptr),y
+    ldy #$12
+    sta (sidptr),y
+++  ldx sidnum
+    dex
+    bpl sidLoop
+    jmp frameLoop
+
+; point sidptr at SID number X
+selectSid
+    lda sidLo,x
+    sta sidptr
+    lda sidHi,x
+    sta sidptr+1
+    rts
+
+; default addresses of SID 1-8 on the C64
+sidLo
+    !byte $00, $00, $00, $80, $80, $40, $40, $c0
+sidHi
+    !byte $d4, $de, $df, $df, $de, $df, $de, $df
+
+initRegs
+    !byte $00, $10, $00, $08, $41, $09, $a9   ; voice 1
+    !byte $00, $18, $00, $04, $21, $0a, $a8   ; voice 2
+    !byte $00, $20, $00, $02, $11, $08, $c9   ; voice 3
+    !byte $00, $40, $f7, $1f                  ; filter: cutoff, resonance/routing, low pass/volume
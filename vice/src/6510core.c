@@ -129,6 +129,11 @@
 #define CPU_REFRESH_CLK
 #endif
 
+/* Called after a taken branch, used by the main CPU to detect idle loops.  */
+#ifndef CPU_IDLE_BRANCH
+#define CPU_IDLE_BRANCH()
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 #ifndef CYCLE_EXACT_ALARM
@@ -503,7 +508,8 @@ do {                                                                   \
                     monitor_check_icount((uint16_t)reg_pc);                                    \
                     IMPORT_REGISTERS();                                                        \
                 }                                                                              \
-                if (monitor_mask[CALLER] & (MI_BREAK)) {                                       \
+                if ((monitor_mask[CALLER] & (MI_BREAK)) &&                                     \
+                    MONITOR_CHECKPOINT_HIT(CALLER, MONITOR_CHECKPOINT_EXEC, reg_pc)) {         \
                     EXPORT_REGISTERS();                                                        \
                     if (monitor_check_breakpoints(CALLER, (uint16_t)reg_pc)) {                 \
                         monitor_startup(CALLER);                                               \
@@ -983,6 +989,7 @@ FIXME: perhaps we really have to add some randomness to (some) bits
                 OPCODE_DELAYS_INTERRUPT();                                \
             }                                                             \
             JUMP(dest_addr & 0xffff);                                     \
+            CPU_IDLE_BRANCH();                                            \
         }                                                                 \
     } while (0)
 #endif
@@ -430,7 +430,8 @@
                     monitor_check_icount((uint16_t)reg_pc);                    \
                     IMPORT_REGISTERS();                                        \
                 }                                                              \
-                if (monitor_mask[CALLER] & (MI_BREAK)) {                       \
+                if ((monitor_mask[CALLER] & (MI_BREAK)) &&                     \
+                    MONITOR_CHECKPOINT_HIT(CALLER, MONITOR_CHECKPOINT_EXEC, reg_pc)) { \
                     EXPORT_REGISTERS();                                        \
                     if (monitor_check_breakpoints(CALLER, (uint16_t)reg_pc)) { \
                         monitor_startup(CALLER);                               \
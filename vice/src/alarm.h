@@ -32,6 +32,17 @@
 
 #define ALARM_CONTEXT_MAX_PENDING_ALARMS 0x100
 
+/* With ALARM_HEAP the pending alarms are kept in a binary min-heap ordered
+   by clock, so the next alarm is always `pending_alarms[0]` and setting,
+   moving or removing an alarm costs O(log n) instead of a scan of all
+   pending alarms. With the handful of alarms usually pending per context
+   the linear scan is as fast or faster, so this is only enabled by
+   configure --enable-alarmheap. The ALARM_FORCE_* defines are for
+   src/tools/alarmbench, which builds both variants. */
+#if (defined(FEATURE_ALARM_HEAP) && !defined(ALARM_FORCE_LINEAR)) || defined(ALARM_FORCE_HEAP)
+#define ALARM_HEAP
+#endif
+
 typedef void (*alarm_callback_t)(CLOCK offset, void *data);
 
 /* An alarm.  */
@@ -45,8 +56,8 @@ struct alarm_s {
     /* Callback to be called when the alarm is dispatched.  */
     alarm_callback_t callback;
 
-    /* Index into the pending alarm list.  If < 0, the alarm is not
-       pending.  */
+    /* Index into the pending alarm list (the heap position with
+       ALARM_HEAP).  If < 0, the alarm is not pending.  */
     int pending_idx;
 
     /* Call data */
@@ -75,7 +86,7 @@ struct alarm_context_s {
     struct alarm_s *alarms;
 
     /* Pending alarm array.  Statically allocated because it's slightly
-       faster this way.  */
+       faster this way.  A min-heap with ALARM_HEAP, unsorted otherwise.  */
     pending_alarms_t pending_alarms[ALARM_CONTEXT_MAX_PENDING_ALARMS];
     unsigned int num_pending_alarms;
 
@@ -107,6 +118,79 @@ inline static CLOCK alarm_context_next_pending_clk(alarm_context_t *context)
     return context->next_pending_alarm_clk;
 }
 
+#ifdef ALARM_HEAP
+
+inline static void alarm_heap_swap(pending_alarms_t *heap, int a, int b)
+{
+    pending_alarms_t tmp = heap[a];
+
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    heap[a].alarm->pending_idx = a;
+    heap[b].alarm->pending_idx = b;
+}
+
+inline static void alarm_heap_sift_up(alarm_context_t *context, int idx)
+{
+    pending_alarms_t *heap = context->pending_alarms;
+
+    while (idx > 0) {
+        int parent = (idx - 1) >> 1;
+
+        if (heap[parent].clk <= heap[idx].clk) {
+            break;
+        }
+        alarm_heap_swap(heap, parent, idx);
+        idx = parent;
+    }
+}
+
+inline static void alarm_heap_sift_down(alarm_context_t *context, int idx)
+{
+    pending_alarms_t *heap = context->pending_alarms;
+    int n = (int)context->num_pending_alarms;
+
+    for (;;) {
+        int child = 2 * idx + 1;
+
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && heap[child + 1].clk < heap[child].clk) {
+            child++;
+        }
+        if (heap[idx].clk <= heap[child].clk) {
+            break;
+        }
+        alarm_heap_swap(heap, idx, child);
+        idx = child;
+    }
+}
+
+/* Restore the heap order around `idx` after its clock changed */
+inline static void alarm_heap_fix(alarm_context_t *context, int idx)
+{
+    if (idx > 0 && context->pending_alarms[(idx - 1) >> 1].clk > context->pending_alarms[idx].clk) {
+        alarm_heap_sift_up(context, idx);
+    } else {
+        alarm_heap_sift_down(context, idx);
+    }
+}
+
+/* The heap keeps the next alarm in front; this only copies it out. */
+inline static void alarm_context_update_next_pending(alarm_context_t *context)
+{
+    if (context->num_pending_alarms > 0) {
+        context->next_pending_alarm_clk = context->pending_alarms[0].clk;
+        context->next_pending_alarm_idx = 0;
+    } else {
+        context->next_pending_alarm_clk = CLOCK_MAX;
+        context->next_pending_alarm_idx = -1;
+    }
+}
+
+#else
+
 inline static void alarm_context_update_next_pending(alarm_context_t *context)
 {
     CLOCK next_pending_alarm_clk = CLOCK_MAX;
@@ -128,6 +212,8 @@ inline static void alarm_context_update_next_pending(alarm_context_t *context)
     context->next_pending_alarm_idx = next_pending_alarm_idx;
 }
 
+#endif
+
 inline static void alarm_context_dispatch(alarm_context_t *context,
                                           CLOCK cpu_clk)
 {
@@ -143,6 +229,48 @@ inline static void alarm_context_dispatch(alarm_context_t *context,
     (alarm->callback)(offset, alarm->data);
 }
 
+#ifdef ALARM_HEAP
+
+inline static void alarm_set(alarm_t *alarm, CLOCK cpu_clk)
+{
+    alarm_context_t *context;
+    int idx;
+
+    context = alarm->context;
+    idx = alarm->pending_idx;
+
+    if (idx < 0) {
+        /* Not pending yet: add.  */
+
+        idx = (int)(context->num_pending_alarms);
+        if (idx >= (int)ALARM_CONTEXT_MAX_PENDING_ALARMS) {
+            alarm_log_too_many_alarms();
+            return;
+        }
+
+        context->pending_alarms[idx].alarm = alarm;
+        context->pending_alarms[idx].clk = cpu_clk;
+        context->num_pending_alarms++;
+        alarm->pending_idx = idx;
+        alarm_heap_sift_up(context, idx);
+    } else {
+        /* Already pending: modify.  */
+
+        CLOCK old_clk = context->pending_alarms[idx].clk;
+
+        context->pending_alarms[idx].clk = cpu_clk;
+        if (cpu_clk < old_clk) {
+            alarm_heap_sift_up(context, idx);
+        } else if (cpu_clk > old_clk) {
+            alarm_heap_sift_down(context, idx);
+        }
+    }
+
+    alarm_context_update_next_pending(context);
+}
+
+#else
+
 inline static void alarm_set(alarm_t *alarm, CLOCK cpu_clk)
 {
     alarm_context_t *context;
@@ -185,3 +313,5 @@ inline static void alarm_set(alarm_t *alarm, CLOCK cpu_clk)
 }
 
 #endif
+
+#endif
@@ -34,10 +34,12 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "rewind.h"
 #include "uiactions.h"
 #include "uiapi.h"
 #include "uisnapshot.h"
 #include "vice-event.h"
+#include "vsync.h"
 
 #include "actions-snapshot.h"
 
@@ -138,6 +140,15 @@ static void history_milestone_reset_action(ui_action_map_t *self)
 {
     event_record_reset_milestone();
 }
+
+/** \brief  Step back one second in the rewind buffer action
+ *
+ * \param[in]   self    action map
+ */
+static void rewind_step_back_action(ui_action_map_t *self)
+{
+    rewind_step_back((int)(vsync_get_refresh_frequency() + 0.5));
+}
 /* }}} */
 
 
@@ -184,6 +195,9 @@ static const ui_action_map_t snapshot_actions[] = {
     {   .action  = ACTION_HISTORY_MILESTONE_RESET,
         .handler = history_milestone_reset_action
     },
+    {   .action  = ACTION_REWIND_STEP_BACK,
+        .handler = rewind_step_back_action
+    },
     UI_ACTION_MAP_TERMINATOR
 };
 
@@ -361,6 +361,8 @@ GtkWidget *statusbar_speed_widget_create(statusbar_speed_widget_state_t *state)
     state->last_shiftlock = -1;
     state->last_mode4080 = -1;
     state->last_diagnostic_pin = -1;
+    state->last_audio_fill_int = -1;
+    state->last_idle_int = -1;
 
     grid = gtk_grid_new();
     gtk_widget_set_valign(grid, GTK_ALIGN_START);
@@ -480,6 +482,8 @@ void statusbar_speed_widget_update(GtkWidget *widget,
     double vsync_metric_cpu_percent;
     double vsync_metric_emulated_fps;
     int vsync_metric_warp_enabled;
+    double vsync_metric_audio_fill;
+    double vsync_metric_idle_cycles;
     tick_t now;
 
     /*
@@ -536,7 +540,11 @@ void statusbar_speed_widget_update(GtkWidget *widget,
         }
     }
 
-    vsyncarch_get_metrics(&vsync_metric_cpu_percent, &vsync_metric_emulated_fps, &vsync_metric_warp_enabled);
+    vsyncarch_get_metrics(&vsync_metric_cpu_percent,
+                          &vsync_metric_emulated_fps,
+                          &vsync_metric_warp_enabled,
+                          &vsync_metric_audio_fill,
+                          &vsync_metric_idle_cycles);
 
     /*
      * Updating GTK labels is expensive and this is called each frame,
@@ -545,6 +553,8 @@ void statusbar_speed_widget_update(GtkWidget *widget,
 
     int this_cpu_int = (int)(vsync_metric_cpu_percent  * pow(10, CPU_DECIMAL_PLACES) + 0.5);
     int this_fps_int = (int)(vsync_metric_emulated_fps * pow(10, FPS_DECIMAL_PLACES) + 0.5);
+    int this_audio_fill_int = vsync_metric_audio_fill < 0 ? -1 : (int)(vsync_metric_audio_fill + 0.5);
+    int this_idle_int = (int)(vsync_metric_idle_cycles / 1000.0 + 0.5);
     bool is_paused = ui_pause_active();
     bool is_shiftlock = keyboard_get_shiftlock();
     bool is_mode4080 = false;
@@ -657,6 +667,25 @@ void statusbar_speed_widget_update(GtkWidget *widget,
 
             state->last_fps_int = this_fps_int;
         }
+
+        /* fill level of the sound thread's ring, if there is one, and the
+           cycles skipped in idle loops, if any */
+        if (state->last_audio_fill_int != this_audio_fill_int
+            || state->last_idle_int != this_idle_int) {
+            int len = 0;
+
+            buffer[0] = '\0';
+            if (this_audio_fill_int >= 0) {
+                len = g_snprintf(buffer, sizeof(buffer), "Audio buffer %d%%", this_audio_fill_int);
+            }
+            if (this_idle_int > 0) {
+                g_snprintf(buffer + len, sizeof(buffer) - (size_t)len, "%sIdle skip %dk cycles/s",
+                           len > 0 ? "\n" : "", this_idle_int);
+            }
+            gtk_widget_set_tooltip_text(widget, buffer[0] != '\0' ? buffer : NULL);
+            state->last_audio_fill_int = this_audio_fill_int;
+            state->last_idle_int = this_idle_int;
+        }
     }
 
 #   undef CPU_DECIMAL_PLACES
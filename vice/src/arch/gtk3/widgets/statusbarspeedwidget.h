@@ -45,6 +45,8 @@ typedef struct statusbar_speed_widget_state_s {
     int last_mode4080;
     int last_capslock;
     int last_diagnostic_pin;
+    int last_audio_fill_int;
+    int last_idle_int;
 } statusbar_speed_widget_state_t;
 
 GtkWidget *speed_menu_popup_create(void);
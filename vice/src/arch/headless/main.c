@@ -35,6 +35,7 @@
 #include "machine.h"
 #include "main.h"
 #include "video.h"
+#include "vsync.h"
 
 /* For the ugly hack below */
 #ifdef WINDOWS_COMPILE
@@ -69,5 +70,7 @@ void main_exit(void)
 
     log_message(LOG_DEFAULT, "\nExiting...");
 
+    vsync_batch_report();
+
     machine_shutdown();
 }
@@ -70,10 +70,31 @@
 #include "ui.h"
 
 
+/** \brief  Enable batch mode
+ *
+ * No rendering, no sound output and no speed limit, for running test
+ * programs until the debug cart, the monitor or -limitcycles ends them.
+ *
+ * \param[in]   param       unused
+ * \param[in]   extra_param unused
+ *
+ * \return  0 on success, -1 on failure
+ */
+static int set_batch_mode(const char *param, void *extra_param)
+{
+    vsync_set_batch_mode(1);
+
+    return resources_set_string("SoundDeviceName", "dummy");
+}
+
+
 /** \brief  Command line options shared between emu's, include VSID
  */
 static const cmdline_option_t cmdline_options_common[] =
 {
+    { "-batch", CALL_FUNCTION, CMDLINE_ATTRIB_NONE,
+      set_batch_mode, NULL, NULL, NULL,
+      NULL, "Batch mode: no rendering, no sound output and no speed limit" },
     CMDLINE_LIST_END
 };
 
@@ -51,6 +51,9 @@ static int save_disks = 1;
 static int save_roms = 0;
 
 UI_MENU_DEFINE_RADIO(EventStartMode)
+UI_MENU_DEFINE_TOGGLE(RewindEnable)
+UI_MENU_DEFINE_INT(RewindInterval)
+UI_MENU_DEFINE_INT(RewindMemory)
 
 static UI_MENU_CALLBACK(toggle_save_disk_images_callback)
 {
@@ -324,6 +327,28 @@ ui_menu_entry_t snapshot_menu[] = {
     },
     SDL_MENU_ITEM_SEPARATOR,
 
+    SDL_MENU_ITEM_TITLE("Rewind"),
+    {   .string   = "Keep recent states in memory",
+        .type     = MENU_ENTRY_RESOURCE_TOGGLE,
+        .callback = toggle_RewindEnable_callback
+    },
+    {   .string   = "Frames between states",
+        .type     = MENU_ENTRY_RESOURCE_INT,
+        .callback = int_RewindInterval_callback,
+        .data     = (ui_callback_data_t)"Capture the state every n frames (1-250)"
+    },
+    {   .string   = "Memory limit (MiB)",
+        .type     = MENU_ENTRY_RESOURCE_INT,
+        .callback = int_RewindMemory_callback,
+        .data     = (ui_callback_data_t)"Memory for the states in MiB (1-4096)"
+    },
+    {   .action    = ACTION_REWIND_STEP_BACK,
+        .string    = "Step back one second",
+        .type      = MENU_ENTRY_OTHER,
+        .activated = MENU_EXIT_UI_STRING
+    },
+    SDL_MENU_ITEM_SEPARATOR,
+
     SDL_MENU_ITEM_TITLE("Record start mode"),
     {   .string   = "Save new snapshot",
         .type     = MENU_ENTRY_RESOURCE_RADIO,
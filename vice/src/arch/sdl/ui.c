@@ -260,6 +260,12 @@ void ui_dispatch_events(void)
     int joynum;
 
     while (SDL_PollEvent(&e)) {
+#ifdef USE_SDL2UI
+        /* Hotkeys may change what the render threads use. */
+        if (e.type != SDL_MOUSEMOTION && e.type != SDL_JOYAXISMOTION) {
+            sdl_video_render_sync();
+        }
+#endif
         switch (e.type) {
             case SDL_KEYDOWN:
                 ui_display_kbd_status(&e);
@@ -49,6 +49,8 @@
 #include "vice.h"
 
 #include <stdio.h>
+#include <string.h>
+
 #include "vice_sdl.h"
 
 #include "archdep.h"
@@ -104,6 +106,15 @@ static char *sdl2_renderer_name = NULL;
 static Uint32 rmask = 0, gmask = 0, bmask = 0, amask = 0;
 static int texformat = 0;
 static int recreate_textures = 0;
+static int sdl_render_thread = 0;
+
+/* Time spent in video_canvas_refresh() on the emulation thread */
+static tick_t refresh_ticks = 0;
+static unsigned long refresh_frames = 0;
+
+/* Refreshes where nothing changed, and bytes uploaded to textures */
+static unsigned long unchanged_frames = 0;
+static uint64_t upload_bytes = 0;
 
 uint8_t *draw_buffer_vsid = NULL;
 /* ------------------------------------------------------------------------- */
@@ -111,6 +122,7 @@ uint8_t *draw_buffer_vsid = NULL;
 
 static void sdl_correct_logical_size(void);
 static void sdl_correct_logical_and_minimum_size(void);
+static void sdl_render_pipe_sync(video_canvas_t *canvas);
 
 static int set_sdl_bitdepth(int d, void *param)
 {
@@ -293,6 +305,10 @@ static void recreate_canvas_textures(video_canvas_t *canvas)
     width = surface->w;
     height = surface->h;
 
+    /* The new textures are empty, and the thread may hold a frame for the old ones */
+    sdl_render_pipe_sync(canvas);
+    canvas->full_refresh = 1;
+
     /* This hint controls the scaling mode of textures created afterwards */
     if (canvas->videoconfig->glfilter == VIDEO_GLFILTER_BILINEAR) {
         SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
@@ -360,6 +376,13 @@ static int set_sdl2_dual_window(int v, void *param)
     return 0;
 }
 
+/* called when SDLRenderThread was set */
+static int set_sdl_render_thread(int v, void *param)
+{
+    sdl_render_thread = v ? 1 : 0;
+    return 0;
+}
+
 /* called when <CHIP>VSync was set */
 int ui_set_vsync(int val, void *canvas)
 {
@@ -389,6 +412,8 @@ static const resource_int_t resources_int[] = {
       &sdl_bitdepth, set_sdl_bitdepth, NULL },
     { "DualWindow", 0, RES_EVENT_NO, NULL,
       &sdl2_dual_window, set_sdl2_dual_window, NULL },
+    { "SDLRenderThread", 0, RES_EVENT_NO, NULL,
+      &sdl_render_thread, set_sdl_render_thread, NULL },
     /* FIXME: this is a generic (not SDL specific) resource */
     { "Window0Width", 0, RES_EVENT_NO, NULL,
       &sdl_initial_width[0], set_sdl_initial_width, (void*)0 },
@@ -473,6 +498,12 @@ static const cmdline_option_t cmdline_options[] =
     { "+dualwindow", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
       NULL, NULL, "DualWindow", (void *)0,
       NULL, "Disable dual window rendering"},
+    { "-sdlrenderthread", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "SDLRenderThread", (void *)1,
+      NULL, "Render the emulated screen on a separate thread"},
+    { "+sdlrenderthread", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "SDLRenderThread", (void *)0,
+      NULL, "Render the emulated screen on the emulation thread"},
     /* Note: the following options are common/the same in GTK port */
     { "-windowwidth", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "Window0Width", NULL,
@@ -538,6 +569,15 @@ void video_shutdown(void)
 {
     DBG(("%s", __func__));
 
+    if (refresh_frames) {
+        log_message(sdlvideo_log, "%lu frames, %.1f us per frame spent in video on the emulation thread%s.",
+                    refresh_frames,
+                    (double)refresh_ticks * 1000000.0 / tick_per_second() / refresh_frames,
+                    sdl_render_thread ? " (render thread)" : "");
+        log_message(sdlvideo_log, "%lu frames unchanged, %.1f KiB per frame uploaded.",
+                    unchanged_frames, (double)upload_bytes / 1024.0 / refresh_frames);
+    }
+
     if (draw_buffer_vsid) {
         lib_free(draw_buffer_vsid);
     }
@@ -772,89 +812,270 @@ static int sdl_canvas_is_visible(struct video_canvas_s *canvas)
 }
 
 /* ------------------------------------------------------------------------- */
-/* Main API */
+/* Render thread */
 
-/* called from raster/raster.c:realize_canvas */
-video_canvas_t *video_canvas_create(video_canvas_t *canvas, unsigned int *width, unsigned int *height, int mapped)
+/*
+ * With SDLRenderThread enabled video_canvas_refresh() only copies the draw
+ * buffer, and a thread per canvas converts the copy into canvas->screen
+ * (palette lookup, CRT emulation) while the emulation continues. The SDL
+ * renderer may only be used from the thread that created it, so uploading
+ * the texture and presenting stay on the emulation thread: a frame is shown
+ * by the next refresh, one frame later than without the thread.
+ *
+ * Everything that touches canvas->screen, the palette or the render config
+ * calls sdl_render_pipe_sync() first.
+ */
+typedef struct sdl_render_pipe_s {
+    video_canvas_t *canvas;
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;             /* signalled whenever queued changes */
+    int quit;
+    int queued;                 /* source holds a frame for the thread */
+    int ready;                  /* canvas->screen holds a frame not yet shown */
+    uint8_t *source;            /* copy of the draw buffer */
+    size_t source_size;
+    unsigned int xs, ys;
+    SDL_Rect rect;              /* changed area of canvas->screen */
+} sdl_render_pipe_t;
+
+static int sdl_render_pipe_main(void *data)
 {
-    /* nothing to do here, the real work is done in sdl_ui_init_finalize */
-    return canvas;
+    sdl_render_pipe_t *pipe = data;
+    video_canvas_t *canvas = pipe->canvas;
+
+    SDL_LockMutex(pipe->lock);
+    while (!pipe->quit) {
+        if (!pipe->queued) {
+            SDL_CondWait(pipe->cond, pipe->lock);
+            continue;
+        }
+        SDL_UnlockMutex(pipe->lock);
+
+        video_canvas_render_from(canvas, pipe->source, (uint8_t *)canvas->screen->pixels,
+                                 pipe->rect.w, pipe->rect.h, pipe->xs, pipe->ys,
+                                 pipe->rect.x, pipe->rect.y, canvas->screen->pitch);
+
+        SDL_LockMutex(pipe->lock);
+        pipe->queued = 0;
+        pipe->ready = 1;
+        SDL_CondBroadcast(pipe->cond);
+    }
+    SDL_UnlockMutex(pipe->lock);
+
+    return 0;
 }
 
-void video_canvas_refresh(struct video_canvas_s *canvas,
-                          unsigned int xs, unsigned int ys,
-                          unsigned int xi, unsigned int yi,
-                          unsigned int w, unsigned int h)
+static void sdl_render_pipe_destroy(video_canvas_t *canvas)
 {
-    SDL_Texture *texture_swap;
-    uint8_t *backup;
-    SDL_RendererFlip flip = 0;
-    double angle = 0;
+    sdl_render_pipe_t *pipe = canvas->render_pipe;
 
-    /* If the canvas isn't initialized, skip this */
-    if ((canvas == NULL) || (canvas->screen == NULL)) {
+    if (pipe == NULL) {
         return;
     }
 
-    if (sdl_canvas_is_visible(canvas) == 0) {
-        return;
+    if (pipe->thread) {
+        SDL_LockMutex(pipe->lock);
+        pipe->quit = 1;
+        SDL_CondBroadcast(pipe->cond);
+        SDL_UnlockMutex(pipe->lock);
+        SDL_WaitThread(pipe->thread, NULL);
+    }
+    if (pipe->cond) {
+        SDL_DestroyCond(pipe->cond);
     }
+    if (pipe->lock) {
+        SDL_DestroyMutex(pipe->lock);
+    }
+    lib_free(pipe->source);
+    lib_free(pipe);
+    canvas->render_pipe = NULL;
+}
 
-    if (sdl_vsid_state & SDL_VSID_ACTIVE) {
-        sdl_vsid_draw();
+static sdl_render_pipe_t *sdl_render_pipe_create(video_canvas_t *canvas)
+{
+    sdl_render_pipe_t *pipe = lib_calloc(1, sizeof(sdl_render_pipe_t));
+
+    pipe->canvas = canvas;
+    canvas->render_pipe = pipe;
+
+    pipe->lock = SDL_CreateMutex();
+    pipe->cond = SDL_CreateCond();
+    if (pipe->lock && pipe->cond) {
+        pipe->thread = SDL_CreateThread(sdl_render_pipe_main, "VICE render", pipe);
+    }
+    if (pipe->thread == NULL) {
+        log_error(sdlvideo_log, "Could not start the render thread: %s", SDL_GetError());
+        sdl_render_pipe_destroy(canvas);
+        resources_set_int("SDLRenderThread", 0);
+        return NULL;
     }
 
-    if (sdl_vkbd_state & SDL_VKBD_ACTIVE) {
-        sdl_vkbd_draw();
+    log_message(sdlvideo_log, "%s: rendering on a separate thread.", canvas->videoconfig->chip_name);
+
+    /* canvas->screen is not up to date when the texture was rendered directly */
+    canvas->full_refresh = 1;
+    return pipe;
+}
+
+/* Wait until the thread is idle. Returns nonzero if it left a frame in
+   canvas->screen that was not shown yet. */
+static int sdl_render_pipe_wait(sdl_render_pipe_t *pipe)
+{
+    int ready;
+
+    SDL_LockMutex(pipe->lock);
+    while (pipe->queued) {
+        SDL_CondWait(pipe->cond, pipe->lock);
     }
+    ready = pipe->ready;
+    pipe->ready = 0;
+    SDL_UnlockMutex(pipe->lock);
 
-    if (uistatusbar_state & (UISTATUSBAR_ACTIVE|UISTATUSBAR_ACTIVE_VDC)) {
-        uistatusbar_draw();
+    return ready;
+}
+
+static void sdl_render_pipe_sync(video_canvas_t *canvas)
+{
+    if (canvas && canvas->render_pipe) {
+        if (sdl_render_pipe_wait(canvas->render_pipe)) {
+            /* The dropped frame never reached the texture */
+            canvas->full_refresh = 1;
+        }
     }
+}
 
-    xi *= canvas->videoconfig->scalex;
-    w *= canvas->videoconfig->scalex;
+/* Hand a copy of the draw buffer to the idle thread, to render the source
+   area starting at xs/ys into rect of canvas->screen. */
+static void sdl_render_pipe_queue(sdl_render_pipe_t *pipe, uint8_t *src,
+                                  unsigned int xs, unsigned int ys,
+                                  const SDL_Rect *rect)
+{
+    draw_buffer_t *draw_buffer = pipe->canvas->draw_buffer;
+    size_t size = (size_t)draw_buffer->draw_buffer_width * draw_buffer->draw_buffer_height;
+
+    if (size > pipe->source_size) {
+        lib_free(pipe->source);
+        pipe->source = lib_malloc(size);
+        pipe->source_size = size;
+    }
+    memcpy(pipe->source, src, size);
+
+    SDL_LockMutex(pipe->lock);
+    pipe->xs = xs;
+    pipe->ys = ys;
+    pipe->rect = *rect;
+    pipe->queued = 1;
+    SDL_CondBroadcast(pipe->cond);
+    SDL_UnlockMutex(pipe->lock);
+}
 
-    yi *= canvas->videoconfig->scaley;
-    h *= canvas->videoconfig->scaley;
+void sdl_video_render_sync(void)
+{
+    int i;
 
-    w = MIN(w, canvas->width);
-    h = MIN(h, canvas->height);
+    for (i = 0; i < sdl_num_screens; ++i) {
+        sdl_render_pipe_sync(sdl_canvaslist[i]);
+    }
+}
 
-    /* FIXME attempt to draw outside canvas */
-    if ((xi + w > canvas->width) || (yi + h > canvas->height)) {
+/* ------------------------------------------------------------------------- */
+/* Main API */
+
+/* called from raster/raster.c:realize_canvas */
+video_canvas_t *video_canvas_create(video_canvas_t *canvas, unsigned int *width, unsigned int *height, int mapped)
+{
+    /* nothing to do here, the real work is done in sdl_ui_init_finalize */
+    return canvas;
+}
+
+/* Compare the shown area of the draw buffer with the copy from the last
+   refresh and update the copy. Sets *first and *last to the first and last
+   changed line, or to -1 if nothing changed. */
+static void sdl_canvas_find_changes(video_canvas_t *canvas, const uint8_t *src,
+                                    unsigned int xs, unsigned int ys,
+                                    unsigned int cols, unsigned int rows,
+                                    int *first, int *last)
+{
+    draw_buffer_t *draw_buffer = canvas->draw_buffer;
+    size_t pitch = draw_buffer->draw_buffer_width;
+    size_t size = pitch * draw_buffer->draw_buffer_height;
+    unsigned int y;
+
+    *first = -1;
+    *last = -1;
+
+    if (size != canvas->last_frame_size) {
+        lib_free(canvas->last_frame);
+        canvas->last_frame = lib_calloc(1, size);
+        canvas->last_frame_size = size;
+        canvas->full_refresh = 1;
+    }
+
+    if (ys >= draw_buffer->draw_buffer_height || xs >= pitch) {
         return;
     }
+    rows = MIN(rows, draw_buffer->draw_buffer_height - ys);
+    cols = MIN(cols, (unsigned int)pitch - xs);
 
-    if (machine_class == VICE_MACHINE_VSID) {
-        canvas->draw_buffer_vsid->draw_buffer_width = canvas->draw_buffer->draw_buffer_width;
-        canvas->draw_buffer_vsid->draw_buffer_height = canvas->draw_buffer->draw_buffer_height;
-        canvas->draw_buffer_vsid->draw_buffer_pitch = canvas->draw_buffer->draw_buffer_pitch;
-        canvas->draw_buffer_vsid->canvas_physical_width = canvas->draw_buffer->canvas_physical_width;
-        canvas->draw_buffer_vsid->canvas_physical_height = canvas->draw_buffer->canvas_physical_height;
-        canvas->draw_buffer_vsid->canvas_width = canvas->draw_buffer->canvas_width;
-        canvas->draw_buffer_vsid->canvas_height = canvas->draw_buffer->canvas_height;
-        canvas->draw_buffer_vsid->visible_width = canvas->draw_buffer->visible_width;
-        canvas->draw_buffer_vsid->visible_height = canvas->draw_buffer->visible_height;
+    for (y = ys; y < ys + rows; y++) {
+        const uint8_t *line = src + y * pitch + xs;
+        uint8_t *copy = canvas->last_frame + y * pitch + xs;
 
-        backup = canvas->draw_buffer->draw_buffer;
-        canvas->draw_buffer->draw_buffer = canvas->draw_buffer_vsid->draw_buffer;
-        video_canvas_render(canvas, (uint8_t *)canvas->screen->pixels, w, h, xs, ys, xi, yi, canvas->screen->pitch);
-        canvas->draw_buffer->draw_buffer = backup;
-    } else {
-        video_canvas_render(canvas, (uint8_t *)canvas->screen->pixels, w, h, xs, ys, xi, yi, canvas->screen->pitch);
+        if (memcmp(line, copy, cols) != 0) {
+            memcpy(copy, line, cols);
+            if (*first < 0) {
+                *first = (int)y;
+            }
+            *last = (int)y;
+        }
     }
+}
 
-    if (recreate_textures) {
-        recreate_all_textures();
-        recreate_textures = 0;
-        /* NOTE: The texture isn't holding the screen's values
-         *       here. We can get away with that because the call to
-         *       SDL_UpdateTexture below updates the entire canvas */
-    }
+/* Render the source area starting at xs/ys into rect of the texture. The
+   renderers depend on the parity of the target position, so only an even
+   rect is rendered straight into the locked texture, anything else goes
+   through canvas->screen. */
+static void sdl_canvas_render_rect(video_canvas_t *canvas, uint8_t *src,
+                                   unsigned int xs, unsigned int ys,
+                                   const SDL_Rect *rect)
+{
+    void *pixels;
+    int pitch;
+    int bpp = canvas->screen->format->BytesPerPixel;
+
+    if (((rect->x | rect->y) & 1) == 0
+        && SDL_LockTexture(canvas->texture, rect, &pixels, &pitch) == 0) {
+        video_canvas_render_from(canvas, src, pixels, rect->w, rect->h, xs, ys, 0, 0, pitch);
+        SDL_UnlockTexture(canvas->texture);
+    } else {
+        video_canvas_render_from(canvas, src, (uint8_t *)canvas->screen->pixels,
+                                 rect->w, rect->h, xs, ys, rect->x, rect->y,
+                                 canvas->screen->pitch);
+        SDL_UpdateTexture(canvas->texture, rect,
+                          (uint8_t *)canvas->screen->pixels
+                          + rect->y * canvas->screen->pitch + rect->x * bpp,
+                          canvas->screen->pitch);
+    }
+    upload_bytes += (uint64_t)rect->w * rect->h * bpp;
+}
+
+/* Upload rect of canvas->screen to the texture, if given, and show it. */
+static void sdl_canvas_present(video_canvas_t *canvas, const SDL_Rect *rect)
+{
+    SDL_Texture *texture_swap;
+    SDL_RendererFlip flip = 0;
+    double angle = 0;
+
+    if (rect) {
+        int bpp = canvas->screen->format->BytesPerPixel;
 
-    /* Upload the new frame to the GPU texture. TODO: use SDL_LockTexture for this as the docs day it's faster. */
-    SDL_UpdateTexture(canvas->texture, NULL, canvas->screen->pixels, canvas->screen->pitch);
+        SDL_UpdateTexture(canvas->texture, rect,
+                          (uint8_t *)canvas->screen->pixels
+                          + rect->y * canvas->screen->pitch + rect->x * bpp,
+                          canvas->screen->pitch);
+        upload_bytes += (uint64_t)rect->w * rect->h * bpp;
+    }
 
     /* Render. */
     SDL_RenderClear(canvas->container->renderer);
@@ -911,10 +1132,15 @@ void video_canvas_refresh(struct video_canvas_s *canvas,
 
     SDL_RenderPresent(canvas->container->renderer);
 
-    /* Swap the textures references so we can easily re-render this frame under the next frame. */
-    texture_swap = canvas->previous_frame_texture;
-    canvas->previous_frame_texture = canvas->texture;
-    canvas->texture = texture_swap;
+    if (canvas->videoconfig->interlaced) {
+        /* Swap the textures references so we can easily re-render this frame
+           under the next frame. The new texture is two frames old, so the
+           next frame and the first one after interlacing must be complete. */
+        texture_swap = canvas->previous_frame_texture;
+        canvas->previous_frame_texture = canvas->texture;
+        canvas->texture = texture_swap;
+        canvas->full_refresh = 1;
+    }
 
     if (canvas->container->leaving_fullscreen) {
         int curr_w, curr_h, flags;
@@ -932,6 +1158,148 @@ void video_canvas_refresh(struct video_canvas_s *canvas,
             SDL_SetWindowSize(canvas->container->window, last_width, last_height);
         }
     }
+}
+
+void video_canvas_refresh(struct video_canvas_s *canvas,
+                          unsigned int xs, unsigned int ys,
+                          unsigned int xi, unsigned int yi,
+                          unsigned int w, unsigned int h)
+{
+    uint8_t *src;
+    tick_t start;
+    int first, last;
+    int threaded;
+    SDL_Rect rect = { 0, 0, 0, 0 };
+
+    /* If the canvas isn't initialized, skip this */
+    if ((canvas == NULL) || (canvas->screen == NULL)) {
+        return;
+    }
+
+    if (sdl_canvas_is_visible(canvas) == 0) {
+        return;
+    }
+
+    start = tick_now();
+
+    if (sdl_vsid_state & SDL_VSID_ACTIVE) {
+        sdl_vsid_draw();
+    }
+
+    if (sdl_vkbd_state & SDL_VKBD_ACTIVE) {
+        sdl_vkbd_draw();
+    }
+
+    if (uistatusbar_state & (UISTATUSBAR_ACTIVE|UISTATUSBAR_ACTIVE_VDC)) {
+        uistatusbar_draw();
+    }
+
+    xi *= canvas->videoconfig->scalex;
+    w *= canvas->videoconfig->scalex;
+
+    yi *= canvas->videoconfig->scaley;
+    h *= canvas->videoconfig->scaley;
+
+    w = MIN(w, canvas->width);
+    h = MIN(h, canvas->height);
+
+    /* FIXME attempt to draw outside canvas */
+    if ((xi + w > canvas->width) || (yi + h > canvas->height)) {
+        return;
+    }
+
+    if (recreate_textures) {
+        recreate_all_textures();
+        recreate_textures = 0;
+    }
+
+    threaded = sdl_render_thread && !sdl_menu_state
+               && (canvas->render_pipe || sdl_render_pipe_create(canvas));
+    if (!threaded) {
+        sdl_render_pipe_sync(canvas);
+    }
+
+    /*
+     * The palette is only ever recalculated here, never by the render
+     * thread. The color tables change before video_canvas_set_palette()
+     * waits for the thread, so it must be idle first.
+     */
+    if (canvas->viewport->crt_type != canvas->crt_type
+        || !canvas->videoconfig->color_tables.updated) {
+        sdl_render_pipe_sync(canvas);
+        video_canvas_check_palette(canvas);
+        canvas->full_refresh = 1;
+    }
+
+    if (machine_class == VICE_MACHINE_VSID) {
+        canvas->draw_buffer_vsid->draw_buffer_width = canvas->draw_buffer->draw_buffer_width;
+        canvas->draw_buffer_vsid->draw_buffer_height = canvas->draw_buffer->draw_buffer_height;
+        canvas->draw_buffer_vsid->draw_buffer_pitch = canvas->draw_buffer->draw_buffer_pitch;
+        canvas->draw_buffer_vsid->canvas_physical_width = canvas->draw_buffer->canvas_physical_width;
+        canvas->draw_buffer_vsid->canvas_physical_height = canvas->draw_buffer->canvas_physical_height;
+        canvas->draw_buffer_vsid->canvas_width = canvas->draw_buffer->canvas_width;
+        canvas->draw_buffer_vsid->canvas_height = canvas->draw_buffer->canvas_height;
+        canvas->draw_buffer_vsid->visible_width = canvas->draw_buffer->visible_width;
+        canvas->draw_buffer_vsid->visible_height = canvas->draw_buffer->visible_height;
+        src = canvas->draw_buffer_vsid->draw_buffer;
+    } else {
+        src = canvas->draw_buffer->draw_buffer;
+    }
+
+    /*
+     * Only the lines that changed since the last refresh are converted and
+     * uploaded. Everything is redone after the textures or the screen were
+     * recreated, when the colors or render settings changed, and in
+     * interlaced mode, which alternates between two textures.
+     */
+    sdl_canvas_find_changes(canvas, src, xs, ys,
+                            w / canvas->videoconfig->scalex,
+                            h / canvas->videoconfig->scaley,
+                            &first, &last);
+
+    if (canvas->full_refresh
+        || canvas->videoconfig->interlaced
+        || !canvas->videoconfig->color_tables.updated) {
+        first = (int)ys;
+        last = (int)(ys + h / canvas->videoconfig->scaley) - 1;
+        canvas->full_refresh = 0;
+    }
+
+    if (first >= 0) {
+        if (canvas->videoconfig->filter == VIDEO_FILTER_CRT) {
+            /* the blur and scanlines also touch the lines around */
+            first = MAX(first - 1, (int)ys);
+            last = MIN(last + 1, (int)(ys + h / canvas->videoconfig->scaley) - 1);
+        }
+        rect.x = (int)xi;
+        rect.w = (int)w;
+        rect.y = (int)yi + (first - (int)ys) * canvas->videoconfig->scaley;
+        rect.h = MIN((last - first + 1) * canvas->videoconfig->scaley, (int)(yi + h) - rect.y);
+    } else {
+        unchanged_frames++;
+    }
+
+    if (threaded) {
+        sdl_render_pipe_t *pipe = canvas->render_pipe;
+
+        /* Show the frame rendered meanwhile and queue this one. */
+        if (sdl_render_pipe_wait(pipe)) {
+            sdl_canvas_present(canvas, &pipe->rect);
+        } else {
+            sdl_canvas_present(canvas, NULL);
+        }
+        if (first >= 0) {
+            sdl_render_pipe_queue(pipe, src, xs, (unsigned int)first, &rect);
+        }
+    } else {
+        if (first >= 0) {
+            sdl_canvas_render_rect(canvas, src, xs, (unsigned int)first, &rect);
+        }
+        sdl_canvas_present(canvas, NULL);
+    }
+
+    refresh_ticks += tick_now_delta(start);
+    refresh_frames++;
 
     ui_autohide_mouse_cursor();
 }
@@ -948,6 +1316,9 @@ int video_canvas_set_palette(struct video_canvas_s *canvas, struct palette_s *pa
         return 0; /* no palette, nothing to do */
     }
 
+    sdl_render_pipe_sync(canvas);
+    canvas->full_refresh = 1;
+
     canvas->palette = palette;
 
     if (canvas->screen == NULL) {
@@ -1085,6 +1456,8 @@ void video_canvas_resize(struct video_canvas_s *canvas, char resize_canvas)
     if (canvas->container->renderer) {
         SDL_Surface *new_screen;
 
+        sdl_render_pipe_sync(canvas);
+
         new_screen = SDL_CreateRGBSurface(0, width, height, sdl_bitdepth, rmask, gmask, bmask, amask);
         if (!new_screen) {
             log_error(sdlvideo_log, "SDL_CreateRGBSurface() failed: %s\n", SDL_GetError());
@@ -1205,6 +1578,10 @@ void video_arch_canvas_init(struct video_canvas_s *canvas)
 
 #ifdef USE_SDL2UI
     canvas->container = NULL;
+    canvas->render_pipe = NULL;
+    canvas->last_frame = NULL;
+    canvas->last_frame_size = 0;
+    canvas->full_refresh = 1;
 #endif
 
     /*
@@ -1220,6 +1597,11 @@ void video_canvas_destroy(struct video_canvas_s *canvas)
 
     DBG(("%s: (%p, %i)", __func__, canvas, canvas->index));
 
+    sdl_render_pipe_destroy(canvas);
+    lib_free(canvas->last_frame);
+    canvas->last_frame = NULL;
+    canvas->last_frame_size = 0;
+
     for (i = 0; i < sdl_num_screens; ++i) {
         if (sdl_canvaslist[i] == canvas) {
 #ifdef USE_SDL2UI
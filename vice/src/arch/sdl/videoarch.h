@@ -107,6 +107,16 @@ struct video_canvas_s {
 
     /** \brief The SDL2 objects that this canvas can output to. */
     video_container_t* container;
+
+    /** \brief Render thread of this canvas, if SDLRenderThread is enabled. */
+    struct sdl_render_pipe_s *render_pipe;
+
+    /** \brief Copy of the draw buffer at the last refresh, to find the changed lines. */
+    uint8_t *last_frame;
+    size_t last_frame_size;
+
+    /** \brief Nonzero if the next refresh must convert and upload everything. */
+    int full_refresh;
 #endif
 
     struct video_render_config_s *videoconfig;
@@ -139,6 +149,9 @@ void sdl_video_restore_size(void);
 #ifdef USE_SDL2UI
 /* special case handling for the SDL window resize event */
 void sdl2_video_resize_event(int canvas_id, unsigned int w, unsigned int h);
+
+/* wait until the render threads are idle */
+void sdl_video_render_sync(void);
 #else
 /* special case handling for the SDL window resize event */
 void sdl_video_resize_event(unsigned int w, unsigned int h);
@@ -272,6 +272,7 @@ enum {
     ACTION_RESET_DRIVE_11_CONFIG,
     ACTION_RESET_DRIVE_11_INSTALL,
     ACTION_RESTORE_DISPLAY,
+    ACTION_REWIND_STEP_BACK,
     ACTION_SCREENSHOT_QUICKSAVE,
     ACTION_SETTINGS_DEFAULT,
     ACTION_SETTINGS_DIALOG,
@@ -69,6 +69,9 @@ int c128_snapshot_write(const char *name, int save_roms, int save_disks, int eve
 
     sound_snapshot_prepare();
 
+    /* no drive worker thread may run while the drive state is saved */
+    drive_cpu_park_all();
+
     if (maincpu_snapshot_write_module(s) < 0
         || c128_snapshot_write_module(s, save_roms) < 0
         || ciacore_snapshot_write_module(machine_context.cia1, s) < 0
@@ -112,6 +115,9 @@ int c128_snapshot_read(const char *name, int event_mode)
 
     joyport_clear_devices();
 
+    /* no drive worker thread may run while the machine state is replaced */
+    drive_cpu_park_all();
+
     if (maincpu_snapshot_read_module(s) < 0
         || c128_snapshot_read_module(s) < 0
         || ciacore_snapshot_read_module(machine_context.cia1, s) < 0
@@ -30,6 +30,8 @@
 
 #include "maincpu.h"
 #include "mem.h"
+#include "c128mem.h"
+#include "cartio.h"
 #include "vicii.h"
 #include "viciitypes.h"
 #include "z80.h"
@@ -111,6 +113,16 @@ inline static void c128cpu_memory_refresh_alarm_handler(void)
 
 #define CPU_ADDITIONAL_RESET() c128cpu_memory_refresh_clk = 11
 
+/* Polling loops can be skipped, except in 2 MHz mode where the stretching
+   depends on the cycle the access happens in */
+#define IDLE_SKIP_ALLOWED() (vicii.fastmode == 0)
+
+/* Cartridges can tell when polling their registers changes nothing */
+#define IDLE_IO_READ(addr, value)                                \
+    ((_mem_read_tab_ptr[(addr) >> 8] == c128_c64io_de00_read     \
+      || _mem_read_tab_ptr[(addr) >> 8] == c128_c64io_df00_read) \
+     ? c64io_idle_read((uint16_t)(addr), (value)) : -1)
+
 #ifdef FEATURE_CPUMEMHISTORY
 
 /* FIXME: the following functions should handle IO/RAM/ROM and -dummy accesses
@@ -28,6 +28,7 @@
 #include "maincpu.h"
 #include "mem.h"
 
+#include "cartio.h"
 #include "cpmcart.h"
 
 #ifdef FEATURE_CPUMEMHISTORY
@@ -140,4 +141,13 @@ static void check_and_run_alternate_cpu(void)
 
 #define HAVE_Z80_REGS
 
+/* Polling loops can be skipped, cycle stealing is done from alarms */
+#define IDLE_SKIP_ALLOWED() 1
+
+/* Cartridges can tell when polling their registers changes nothing */
+#define IDLE_IO_READ(addr, value)                           \
+    ((_mem_read_tab_ptr[(addr) >> 8] == c64io_de00_read     \
+      || _mem_read_tab_ptr[(addr) >> 8] == c64io_df00_read) \
+     ? c64io_idle_read((uint16_t)(addr), (value)) : -1)
+
 #include "../maincpu.c"
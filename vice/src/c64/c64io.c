@@ -78,6 +78,95 @@ static io_source_list_t c64io_dd00_head = { NULL, NULL, NULL };
 static io_source_list_t c64io_de00_head = { NULL, NULL, NULL };
 static io_source_list_t c64io_df00_head = { NULL, NULL, NULL };
 
+/* Per-address dispatch cache of an I/O page, rebuilt whenever a device is
+   registered or unregistered. An entry is NULL when no device covers the
+   address, the device itself when exactly one does, and &io_source_multiple
+   when the address needs the collision handling of io_read()/io_store(). */
+typedef struct io_source_cache_s {
+    io_source_t *read[0x100];
+    io_source_t *store[0x100];
+} io_source_cache_t;
+
+static io_source_t io_source_multiple;
+
+static io_source_cache_t c64io_d000_cache;
+static io_source_cache_t c64io_d100_cache;
+static io_source_cache_t c64io_d200_cache;
+static io_source_cache_t c64io_d300_cache;
+static io_source_cache_t c64io_d400_cache;
+static io_source_cache_t c64io_d500_cache;
+static io_source_cache_t c64io_d600_cache;
+static io_source_cache_t c64io_d700_cache;
+static io_source_cache_t c64io_dd00_cache;
+static io_source_cache_t c64io_de00_cache;
+static io_source_cache_t c64io_df00_cache;
+
+static const struct {
+    io_source_list_t *head;
+    io_source_cache_t *cache;
+    uint16_t page;
+} c64io_pages[] = {
+    { &c64io_d000_head, &c64io_d000_cache, 0xd000 },
+    { &c64io_d100_head, &c64io_d100_cache, 0xd100 },
+    { &c64io_d200_head, &c64io_d200_cache, 0xd200 },
+    { &c64io_d300_head, &c64io_d300_cache, 0xd300 },
+    { &c64io_d400_head, &c64io_d400_cache, 0xd400 },
+    { &c64io_d500_head, &c64io_d500_cache, 0xd500 },
+    { &c64io_d600_head, &c64io_d600_cache, 0xd600 },
+    { &c64io_d700_head, &c64io_d700_cache, 0xd700 },
+    { &c64io_dd00_head, &c64io_dd00_cache, 0xdd00 },
+    { &c64io_de00_head, &c64io_de00_cache, 0xde00 },
+    { &c64io_df00_head, &c64io_df00_cache, 0xdf00 },
+    { NULL, NULL, 0 }
+};
+
+static void io_source_cache_add(io_source_t **entry, io_source_t *device)
+{
+    *entry = (*entry == NULL) ? device : &io_source_multiple;
+}
+
+/* Rebuild the dispatch cache of the page whose list starts at `head` */
+static void io_source_cache_update(io_source_list_t *head)
+{
+    io_source_list_t *current;
+    io_source_cache_t *cache = NULL;
+    unsigned int page = 0;
+    unsigned int start, end, addr;
+    int i;
+
+    for (i = 0; c64io_pages[i].head != NULL; i++) {
+        if (c64io_pages[i].head == head) {
+            cache = c64io_pages[i].cache;
+            page = c64io_pages[i].page;
+            break;
+        }
+    }
+    if (cache == NULL) {
+        return;
+    }
+
+    memset(cache, 0, sizeof(io_source_cache_t));
+
+    for (current = head->next; current != NULL; current = current->next) {
+        start = current->device->start_address;
+        end = current->device->end_address;
+        if (start < page) {
+            start = page;
+        }
+        if (end > page + 0xff) {
+            end = page + 0xff;
+        }
+        for (addr = start; addr <= end; addr++) {
+            if (current->device->read != NULL) {
+                io_source_cache_add(&cache->read[addr & 0xff], current->device);
+            }
+            if (current->device->store != NULL) {
+                io_source_cache_add(&cache->store[addr & 0xff], current->device);
+            }
+        }
+    }
+}
+
 static void io_source_detach(io_source_detach_t *source)
 {
     switch (source->det_id) {
@@ -292,9 +381,10 @@ static void io_source_log_collisions(uint16_t addr, int amount, io_source_list_t
     }
 }
 
-static inline uint8_t io_read(io_source_list_t *list, uint16_t addr)
+static inline uint8_t io_read(io_source_list_t *list, io_source_cache_t *cache, uint16_t addr)
 {
     io_source_list_t *current = list->next;
+    io_source_t *device = cache->read[addr & 0xff];
     int io_source_counter = 0;
     int io_source_valid = 0;
     uint8_t realval = 0;
@@ -304,6 +394,15 @@ static inline uint8_t io_read(io_source_list_t *list, uint16_t addr)
 
     vicii_handle_pending_alarms_external(0);
 
+    /* a single device (or none) can not collide, skip the list walk */
+    if (device == NULL) {
+        return vicii_read_phi1();
+    }
+    if (device != &io_source_multiple) {
+        retval = device->read((uint16_t)(addr & device->address_mask));
+        return device->io_source_valid ? retval : vicii_read_phi1();
+    }
+
     while (current) {
         if (current->device->read != NULL) {
             if ((addr >= current->device->start_address) && (addr <= current->device->end_address)) {
@@ -390,15 +489,24 @@ static inline uint8_t io_peek(io_source_list_t *list, uint16_t addr)
     return vicii_read_phi1();
 }
 
-static inline void io_store(io_source_list_t *list, uint16_t addr, uint8_t value)
+static inline void io_store(io_source_list_t *list, io_source_cache_t *cache, uint16_t addr, uint8_t value)
 {
     int writes = 0;
     uint16_t addy = 0xffff;
     io_source_list_t *current = list->next;
+    io_source_t *device = cache->store[addr & 0xff];
     void (*store)(uint16_t address, uint8_t data) = NULL;
 
     vicii_handle_pending_alarms_external_write();
 
+    if (device == NULL) {
+        return;
+    }
+    if (device != &io_source_multiple) {
+        device->store((uint16_t)(addr & device->address_mask), value);
+        return;
+    }
+
     while (current) {
         if (current->device->store != NULL) {
             if (addr >= current->device->start_address && addr <= current->device->end_address) {
@@ -482,12 +590,18 @@ io_source_list_t *io_source_register(io_source_t *device)
     retval->next = NULL;
     retval->device->order = order++;
 
+    while (current->previous != NULL) {
+        current = current->previous;
+    }
+    io_source_cache_update(current);
+
     return retval;
 }
 
 void io_source_unregister(io_source_list_t *device)
 {
     io_source_list_t *prev;
+    io_source_list_t *head;
 
     assert(device != NULL);
     DBG(("IO: unregister id:%d name:%s", device->device->cart_id, device->device->name));
@@ -505,6 +619,13 @@ void io_source_unregister(io_source_list_t *device)
         }
     }
 
+    /* the device may have been moved already, so find the page by its list */
+    head = prev;
+    while (head->previous != NULL) {
+        head = head->previous;
+    }
+    io_source_cache_update(head);
+
     lib_free(device);
 }
 
@@ -589,7 +710,7 @@ void cartio_set_highest_order(unsigned int nr)
 uint8_t c64io_d000_read(uint16_t addr)
 {
     DBGRW(("IO: io-d000 r %04x", addr));
-    return io_read(&c64io_d000_head, addr);
+    return io_read(&c64io_d000_head, &c64io_d000_cache, addr);
 }
 
 uint8_t c64io_d000_peek(uint16_t addr)
@@ -601,13 +722,13 @@ uint8_t c64io_d000_peek(uint16_t addr)
 void c64io_d000_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-d000 w %04x %02x", addr, value));
-    io_store(&c64io_d000_head, addr, value);
+    io_store(&c64io_d000_head, &c64io_d000_cache, addr, value);
 }
 
 uint8_t c64io_d100_read(uint16_t addr)
 {
     DBGRW(("IO: io-d100 r %04x", addr));
-    return io_read(&c64io_d100_head, addr);
+    return io_read(&c64io_d100_head, &c64io_d100_cache, addr);
 }
 
 uint8_t c64io_d100_peek(uint16_t addr)
@@ -619,13 +740,13 @@ uint8_t c64io_d100_peek(uint16_t addr)
 void c64io_d100_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-d100 w %04x %02x", addr, value));
-    io_store(&c64io_d100_head, addr, value);
+    io_store(&c64io_d100_head, &c64io_d100_cache, addr, value);
 }
 
 uint8_t c64io_d200_read(uint16_t addr)
 {
     DBGRW(("IO: io-d200 r %04x", addr));
-    return io_read(&c64io_d200_head, addr);
+    return io_read(&c64io_d200_head, &c64io_d200_cache, addr);
 }
 
 uint8_t c64io_d200_peek(uint16_t addr)
@@ -637,13 +758,13 @@ uint8_t c64io_d200_peek(uint16_t addr)
 void c64io_d200_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-d200 w %04x %02x", addr, value));
-    io_store(&c64io_d200_head, addr, value);
+    io_store(&c64io_d200_head, &c64io_d200_cache, addr, value);
 }
 
 uint8_t c64io_d300_read(uint16_t addr)
 {
     DBGRW(("IO: io-d300 r %04x", addr));
-    return io_read(&c64io_d300_head, addr);
+    return io_read(&c64io_d300_head, &c64io_d300_cache, addr);
 }
 
 uint8_t c64io_d300_peek(uint16_t addr)
@@ -655,13 +776,13 @@ uint8_t c64io_d300_peek(uint16_t addr)
 void c64io_d300_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-d300 w %04x %02x", addr, value));
-    io_store(&c64io_d300_head, addr, value);
+    io_store(&c64io_d300_head, &c64io_d300_cache, addr, value);
 }
 
 uint8_t c64io_d400_read(uint16_t addr)
 {
     DBGRW(("IO: io-d400 r %04x", addr));
-    return io_read(&c64io_d400_head, addr);
+    return io_read(&c64io_d400_head, &c64io_d400_cache, addr);
 }
 
 uint8_t c64io_d400_peek(uint16_t addr)
@@ -673,13 +794,13 @@ uint8_t c64io_d400_peek(uint16_t addr)
 void c64io_d400_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-d400 w %04x %02x", addr, value));
-    io_store(&c64io_d400_head, addr, value);
+    io_store(&c64io_d400_head, &c64io_d400_cache, addr, value);
 }
 
 uint8_t c64io_d500_read(uint16_t addr)
 {
     DBGRW(("IO: io-d500 r %04x", addr));
-    return io_read(&c64io_d500_head, addr);
+    return io_read(&c64io_d500_head, &c64io_d500_cache, addr);
 }
 
 uint8_t c64io_d500_peek(uint16_t addr)
@@ -691,13 +812,13 @@ uint8_t c64io_d500_peek(uint16_t addr)
 void c64io_d500_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-d500 w %04x %02x", addr, value));
-    io_store(&c64io_d500_head, addr, value);
+    io_store(&c64io_d500_head, &c64io_d500_cache, addr, value);
 }
 
 uint8_t c64io_d600_read(uint16_t addr)
 {
     DBGRW(("IO: io-d600 r %04x", addr));
-    return io_read(&c64io_d600_head, addr);
+    return io_read(&c64io_d600_head, &c64io_d600_cache, addr);
 }
 
 uint8_t c64io_d600_peek(uint16_t addr)
@@ -709,13 +830,13 @@ uint8_t c64io_d600_peek(uint16_t addr)
 void c64io_d600_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-d600 w %04x %02x", addr, value));
-    io_store(&c64io_d600_head, addr, value);
+    io_store(&c64io_d600_head, &c64io_d600_cache, addr, value);
 }
 
 uint8_t c64io_d700_read(uint16_t addr)
 {
     DBGRW(("IO: io-d700 r %04x", addr));
-    return io_read(&c64io_d700_head, addr);
+    return io_read(&c64io_d700_head, &c64io_d700_cache, addr);
 }
 
 uint8_t c64io_d700_peek(uint16_t addr)
@@ -727,13 +848,13 @@ uint8_t c64io_d700_peek(uint16_t addr)
 void c64io_d700_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-d700 w %04x %02x", addr, value));
-    io_store(&c64io_d700_head, addr, value);
+    io_store(&c64io_d700_head, &c64io_d700_cache, addr, value);
 }
 
 uint8_t c64io_dd00_read(uint16_t addr)
 {
     DBGRW(("IO: io-dd00 r %04x", addr));
-    return io_read(&c64io_dd00_head, addr);
+    return io_read(&c64io_dd00_head, &c64io_dd00_cache, addr);
 }
 
 uint8_t c64io_dd00_peek(uint16_t addr)
@@ -745,13 +866,13 @@ uint8_t c64io_dd00_peek(uint16_t addr)
 void c64io_dd00_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-dd00 w %04x %02x", addr, value));
-    io_store(&c64io_dd00_head, addr, value);
+    io_store(&c64io_dd00_head, &c64io_dd00_cache, addr, value);
 }
 
 uint8_t c64io_de00_read(uint16_t addr)
 {
     DBGRW(("IO: io-de00 r %04x", addr));
-    return io_read(&c64io_de00_head, addr);
+    return io_read(&c64io_de00_head, &c64io_de00_cache, addr);
 }
 
 uint8_t c64io_de00_peek(uint16_t addr)
@@ -763,13 +884,69 @@ uint8_t c64io_de00_peek(uint16_t addr)
 void c64io_de00_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-de00 w %04x %02x", addr, value));
-    io_store(&c64io_de00_head, addr, value);
+    io_store(&c64io_de00_head, &c64io_de00_cache, addr, value);
+}
+
+/* Devices that can tell when reading a register again changes nothing */
+#define IDLE_READ_DEVICES_MAX 4
+
+static struct {
+    io_source_t *device;
+    int (*idle_read)(uint16_t address, uint8_t *value);
+} idle_read_devices[IDLE_READ_DEVICES_MAX];
+
+/* Let the idle loop detector read `device' through `idle_read', which
+   returns -1 when the read has side effects or could change */
+void c64io_idle_read_register(io_source_t *device, int (*idle_read)(uint16_t address, uint8_t *value))
+{
+    int i;
+
+    for (i = 0; i < IDLE_READ_DEVICES_MAX; i++) {
+        if (idle_read_devices[i].device == NULL || idle_read_devices[i].device == device) {
+            idle_read_devices[i].device = device;
+            idle_read_devices[i].idle_read = idle_read;
+            return;
+        }
+    }
+    DBG(("IO: no room for the idle read of '%s'", device->name));
+}
+
+void c64io_idle_read_unregister(io_source_t *device)
+{
+    int i;
+
+    for (i = 0; i < IDLE_READ_DEVICES_MAX; i++) {
+        if (idle_read_devices[i].device == device) {
+            idle_read_devices[i].device = NULL;
+            idle_read_devices[i].idle_read = NULL;
+        }
+    }
+}
+
+/* Read $de00-$dfff for the idle loop detector of the main CPU. Only a
+   single device that registered an idle read can answer, anything else
+   is left to the real read.  */
+int c64io_idle_read(uint16_t addr, uint8_t *value)
+{
+    io_source_cache_t *cache = (addr & 0x100) ? &c64io_df00_cache : &c64io_de00_cache;
+    io_source_t *device = cache->read[addr & 0xff];
+    int i;
+
+    if (addr < 0xde00 || addr > 0xdfff || device == NULL || device == &io_source_multiple) {
+        return -1;
+    }
+    for (i = 0; i < IDLE_READ_DEVICES_MAX; i++) {
+        if (idle_read_devices[i].device == device) {
+            return idle_read_devices[i].idle_read((uint16_t)(addr & device->address_mask), value);
+        }
+    }
+    return -1;
 }
 
 uint8_t c64io_df00_read(uint16_t addr)
 {
     DBGRW(("IO: io-df00 r %04x", addr));
-    return io_read(&c64io_df00_head, addr);
+    return io_read(&c64io_df00_head, &c64io_df00_cache, addr);
 }
 
 uint8_t c64io_df00_peek(uint16_t addr)
@@ -781,7 +958,7 @@ uint8_t c64io_df00_peek(uint16_t addr)
 void c64io_df00_store(uint16_t addr, uint8_t value)
 {
     DBGRW(("IO: io-df00 w %04x %02x", addr, value));
-    io_store(&c64io_df00_head, addr, value);
+    io_store(&c64io_df00_head, &c64io_df00_cache, addr, value);
 }
 
 /* ---------------------------------------------------------------------------------------------------------- */
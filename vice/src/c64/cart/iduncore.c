@@ -26,14 +26,26 @@
 
 #include "vice.h"
 
+#include "archdep.h"
 #include "iduncore.h"
+#include "iduntrace.h"
 #include "lib.h"
 #include "monitor.h"
 #include "log.h"
+#include "vsync.h"
 
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifdef UNIX_COMPILE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /* This module is currently used in the following emulated hardware:
    - C64/C128 Idun cartridge
@@ -46,114 +58,1177 @@
 #define MAX_PIPE_MSG_BYTES 293
 #define SYSTEM_BLOCK 255
 #define PAGES_PER_BLOCK 64
+#define ERAM_BLOCK_SIZE (PAGES_PER_BLOCK * 256)
+#define ERAM_BLOCKS 256
 #define CMD_LOAD_BLOCK 0xfc
 #define CMD_UPDATE_PAGE 0xfd
 #define CMD_FREEMAP 0xf7
+#define LISTEN0 0x20
+#define UNLISTEN 0x3f
+
+// Bulk block transfer: a service that can stream a whole block in answer to
+// a single TALK on BULK_TALK_SA advertises it by setting BULK_PAGES_FLAG in
+// the page count it sends for a regular TALK #0.
+#define BULK_TALK_SA 0x7e
+#define BULK_PAGES_FLAG 0x80
+// Such a service also takes CMD_UPDATE_RUN <first page> <count> followed by
+// the data of `count` adjacent pages.
+#define CMD_UPDATE_RUN 0xfe
+
+/* Receive ring between the socket reader thread and the emulation thread.
+   Must be a power of two and hold several maximum sized pipe messages. */
+#define RECV_RING_SIZE 8192
+#define RECV_RING_MASK (RECV_RING_SIZE - 1)
+
+/* Stores to $DE00 are staged here and sent in one go once this many bytes
+   are pending, at the end of the frame, or before the 6502 reads back. */
+#define SEND_BUF_SIZE 1024
+#define SEND_FLUSH_THRESHOLD 512
+
+/* Largest encoding of a block's page updates: one header per page */
+#define UPDATE_BUF_SIZE (PAGES_PER_BLOCK * (5 + 256))
+
+/* Reconnect delays double from the minimum up to the maximum. A waiting
+   connect thread checks every CONNECT_POLL_MS whether it was abandoned. */
+#define CONNECT_BACKOFF_MIN_MS 250
+#define CONNECT_BACKOFF_MAX_MS 16000
+#define CONNECT_POLL_MS 50
+
+/* How long an ERAM exchange waits for the service to answer before the
+   connection is given up. */
+#define ERAM_TIMEOUT_MS 5000
 
 /* ---------------------------------------------------------------------------------------------------- */
-static uint8_t recvBuf[MAX_PIPE_MSG_BYTES];
-static uint8_t blockMem[16384];
-static io_iduncart_t iduncart = {NULL, NULL, NULL, NULL, 0, SYSTEM_BLOCK, 0, 0, blockMem};
+/* Stand-in for the current block while no cache is allocated */
+static uint8_t blockMem[ERAM_BLOCK_SIZE];
+static io_iduncart_t iduncart = {NULL, NULL, 0, SYSTEM_BLOCK, blockMem, NULL, NULL, 0, 1, 0, -1, 0,
+                                 IDUN_STATE_DEGRADED, {0}};
+
+/* Sink for block data that is fetched only to re-select a block */
+static uint8_t cache_scratch[ERAM_BLOCK_SIZE];
+
+/* ERAM shared with a service on the same host: a file of ERAM_BLOCKS blocks
+   mapped into both processes. While mapped, $DF00 accesses go straight to
+   it and no blocks are loaded or written back. */
+static char *eram_shm_path = NULL;
+static uint8_t *eram_shm = NULL;
+
+/* Replay of a trace recorded with iduntrace: no service is connected and
+   reads and ERAM loads are answered from the trace instead. */
+static char *replay_path = NULL;
+static int replaying = 0;
+
+/* Single-producer/single-consumer ring: `recv_head` is only advanced by the
+   reader thread, `recv_tail` only by the emulation thread. */
+static uint8_t recvRing[RECV_RING_SIZE];
+static atomic_size_t recv_head;
+static atomic_size_t recv_tail;
+
+/* Ring position up to which received bytes are in the trace */
+static size_t trace_recv_seen = 0;
+
+/* Last $DE01 value in the trace, -1 if none yet. Polling $DE01 would fill
+   the ring within seconds, so only changes are recorded. */
+static int trace_de01_last = -1;
+
+static pthread_t recv_thread;
+static int recv_thread_started = 0;
+static atomic_int recv_thread_running = 0;
+
+/* Held by the reader thread while it receives, and by the emulation thread
+   for the duration of a synchronous ERAM exchange, so that ERAM replies are
+   never swallowed into the $DE00 data ring. */
+static pthread_mutex_t recv_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Output staging buffer, only touched by the emulation thread. A flush at
+   the next vsync is queued whenever a frame produces output. */
+static uint8_t sendBuf[SEND_BUF_SIZE];
+static size_t send_len = 0;
+static int send_flush_queued = 0;
 
-static void iduncart_eram_read()
+/* Set while the 6502 is between messages: after it sent UNLISTEN and until
+   the next LISTEN. ERAM updates of the flush thread share the socket and
+   are only handed over then, as they would split a message otherwise. */
+static int send_at_boundary = 1;
+
+/* Serializes socket writes of the emulation thread and the flush thread */
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Background write-back of dirty ERAM pages. At the end of a frame the
+   emulation thread copies the dirty pages of the current block into
+   `flushData` and leaves sending them to the flush thread. Block switches,
+   reset and shutdown wait for it before writing back what is left. */
+static uint8_t flushData[ERAM_BLOCK_SIZE];
+static uint8_t flushUpdateBuf[UPDATE_BUF_SIZE];
+static uint8_t syncUpdateBuf[UPDATE_BUF_SIZE];
+static uint64_t flush_pages = 0;     /* pages of the job in flight, 0 when idle */
+static int flush_bulk = 0;           /* service takes CMD_UPDATE_RUN, per job */
+static tick_t flush_queued_at;
+static int eram_flush_queued = 0;
+static int eram_flush_deferred = 0;  /* held back until the next message boundary */
+
+static pthread_t flush_thread;
+static int flush_thread_started = 0;
+static int flush_thread_running = 0;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+
+/* Connecting happens on a detached thread, which also loads SYSTEM_BLOCK
+   and then hands the socket over through `connect_result`. The emulation
+   thread takes it over on its next cartridge access. Bumping `connect_gen`
+   abandons an attempt still in progress; it closes its socket on its own,
+   so reset and shutdown never wait for a slow connect. */
+typedef struct iduncart_connect_s {
+    char *host;
+    unsigned int gen;
+    int delay_ms;               /* wait before the next attempt */
+    vice_network_socket_t *socket;
+    int bulk;
+    tick_t ticks;
+    uint8_t data[ERAM_BLOCK_SIZE];
+} iduncart_connect_t;
+
+static pthread_mutex_t connect_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int connect_gen = 0;
+static iduncart_connect_t *connect_result = NULL;
+static uint64_t connect_failures = 0;
+
+/* Set by the connect and reader threads when the emulation thread has to
+   look at the connection: connected, attempt failed, or connection lost. */
+static atomic_int connect_event = 0;
+static atomic_int recv_lost = 0;
+
+/* A restored snapshot is brought in line with the service on the next
+   connect: its dirty pages are written back and the selected block is
+   made current on the service again. `resync_load` is set when the
+   snapshot did not hold the data of the selected block. */
+static int resync_pending = 0;
+static int resync_load = 0;
+
+static void iduncart_disconnect(void);
+static void iduncart_connection_lost(void);
+
+/* Send all staged $DE00 output. The client socket is opened with TCP_NODELAY,
+   so the coalescing happens here rather than in Nagle's algorithm and every
+   flush leaves the host immediately. */
+static void iduncart_send_flush(void)
+{
+    size_t offset = 0;
+
+    if (send_len == 0) {
+        return;
+    }
+    if (!iduncart.socket) {
+        send_len = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&send_lock);
+    while (offset < send_len) {
+        ssize_t n = vice_network_send(iduncart.socket, &sendBuf[offset], send_len - offset, 0);
+        if (n <= 0) {
+            break;
+        }
+        offset += (size_t)n;
+        iduncart.stats.send_calls++;
+    }
+    pthread_mutex_unlock(&send_lock);
+
+    if (iduntrace_active && offset > 0) {
+        iduntrace_data(IDUNTRACE_SEND, 0, 0, sendBuf, offset);
+    }
+    iduncart.stats.bytes_sent += offset;
+    if (offset < send_len) {
+        log_error(LOG_DEFAULT, "Error writing: %d.", vice_network_get_errorcode());
+        iduncart_connection_lost();
+    }
+    send_len = 0;
+}
+
+static void iduncart_trace_update(int block, uint64_t pages)
+{
+    uint8_t map[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        map[i] = (uint8_t)(pages >> (i * 8));
+    }
+    iduntrace_data(IDUNTRACE_ERAM_UPDATE, (uint8_t)block, CMD_UPDATE_PAGE, map, sizeof(map));
+}
+
+static void iduncart_vsync_flush(void *unused)
+{
+    send_flush_queued = 0;
+    iduncart.stats.send_frames++;
+    iduncart_send_flush();
+}
+
+/* Encode the pages set in `pages` as update commands. Runs of adjacent pages
+   become a single CMD_UPDATE_RUN when the service supports it. */
+static size_t iduncart_eram_encode_pages(const uint8_t *data, uint64_t pages, int bulk, uint8_t *out)
+{
+    size_t len = 0;
+    int page = 0;
+
+    while (page < PAGES_PER_BLOCK) {
+        int count = 1;
+        int i;
+
+        if (!(pages & ((uint64_t)1 << page))) {
+            page++;
+            continue;
+        }
+        while (page + count < PAGES_PER_BLOCK && (pages & ((uint64_t)1 << (page + count)))) {
+            count++;
+        }
+
+        if (bulk && count > 1) {
+            out[len++] = LISTEN0;
+            out[len++] = 0x7f;
+            out[len++] = CMD_UPDATE_RUN;
+            out[len++] = (uint8_t)page;
+            out[len++] = (uint8_t)count;
+            memcpy(&out[len], &data[page * 256], (size_t)count * 256);
+            len += (size_t)count * 256;
+        } else {
+            for (i = page; i < page + count; i++) {
+                out[len++] = LISTEN0;
+                out[len++] = 0x7f;
+                out[len++] = CMD_UPDATE_PAGE;
+                out[len++] = (uint8_t)i;
+                memcpy(&out[len], &data[i * 256], 256);
+                len += 256;
+            }
+        }
+        page += count;
+    }
+    return len;
+}
+
+/* Send encoded page updates in as few calls as the socket allows */
+static int iduncart_eram_send_updates(const uint8_t *buf, size_t len)
+{
+    size_t offset = 0;
+
+    pthread_mutex_lock(&send_lock);
+    while (offset < len) {
+        ssize_t n = vice_network_send(iduncart.socket, &buf[offset], len - offset, 0);
+        if (n <= 0) {
+            break;
+        }
+        offset += (size_t)n;
+    }
+    pthread_mutex_unlock(&send_lock);
+
+    return offset == len ? 0 : -1;
+}
+
+static int popcount64(uint64_t v)
+{
+    int c = 0;
+
+    for (; v; v &= v - 1) {
+        c++;
+    }
+    return c;
+}
+
+static void *iduncart_flush_main(void *unused)
+{
+    pthread_mutex_lock(&flush_lock);
+    while (flush_thread_running) {
+        uint64_t pages = flush_pages;
+        int bulk = flush_bulk;
+        size_t len;
+        tick_t delta;
+
+        if (pages == 0) {
+            pthread_cond_wait(&flush_cond, &flush_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&flush_lock);
+
+        len = iduncart_eram_encode_pages(flushData, pages, bulk, flushUpdateBuf);
+        if (iduncart_eram_send_updates(flushUpdateBuf, len) < 0) {
+            log_error(LOG_DEFAULT, "Idun ERAM write-back failed: %d.", vice_network_get_errorcode());
+        }
+
+        pthread_mutex_lock(&flush_lock);
+        delta = tick_now_delta(flush_queued_at);
+        iduncart.stats.flushes++;
+        iduncart.stats.flushed_pages += (uint64_t)popcount64(pages);
+        iduncart.stats.flush_ticks += delta;
+        if (delta > iduncart.stats.flush_max) {
+            iduncart.stats.flush_max = delta;
+        }
+        flush_pages = 0;
+        pthread_cond_broadcast(&flush_cond);
+    }
+    pthread_mutex_unlock(&flush_lock);
+    return NULL;
+}
+
+static void iduncart_flush_start(void)
+{
+    flush_pages = 0;
+    flush_thread_running = 1;
+    if (pthread_create(&flush_thread, NULL, iduncart_flush_main, NULL)) {
+        flush_thread_running = 0;
+        log_error(LOG_DEFAULT, "Failed to start Idun ERAM flush thread.");
+        return;
+    }
+    flush_thread_started = 1;
+}
+
+static void iduncart_flush_stop(void)
+{
+    if (flush_thread_started) {
+        pthread_mutex_lock(&flush_lock);
+        flush_thread_running = 0;
+        pthread_cond_broadcast(&flush_cond);
+        pthread_mutex_unlock(&flush_lock);
+        pthread_join(flush_thread, NULL);
+        flush_thread_started = 0;
+    }
+}
+
+/* Sync point: wait until the flush thread has sent everything handed to it */
+static void iduncart_flush_wait(void)
+{
+    pthread_mutex_lock(&flush_lock);
+    while (flush_pages != 0 && flush_thread_running) {
+        pthread_cond_wait(&flush_cond, &flush_lock);
+    }
+    pthread_mutex_unlock(&flush_lock);
+}
+
+/* vsync callback: hand the dirty pages of the current block to the flush
+   thread. If it is still busy the pages simply stay dirty until the next
+   flush or sync point. While the 6502 is in the middle of a message the
+   hand-over waits for its UNLISTEN. */
+static void iduncart_eram_flush_async(void *unused)
+{
+    iduncart_block_t *blk = iduncart.cur;
+    uint64_t pages;
+    int page;
+
+    eram_flush_queued = 0;
+    if (!flush_thread_started || blk == NULL || blk->dirty == 0) {
+        return;
+    }
+    /* after a cache hit the service must first re-select the block, which
+       is left to the synchronous write-back */
+    if (iduncart.svc_block != blk->block) {
+        return;
+    }
+    if (!send_at_boundary) {
+        eram_flush_deferred = 1;
+        return;
+    }
+    eram_flush_deferred = 0;
+
+    /* the staged output ends with a complete message; it goes first */
+    iduncart_send_flush();
+    if (!flush_thread_started) {
+        return;
+    }
+
+    pthread_mutex_lock(&flush_lock);
+    if (flush_pages != 0) {
+        pthread_mutex_unlock(&flush_lock);
+        return;
+    }
+    pages = blk->dirty;
+    for (page = 0; page < PAGES_PER_BLOCK; page++) {
+        if (pages & ((uint64_t)1 << page)) {
+            memcpy(&flushData[page * 256], &blk->data[page * 256], 256);
+        }
+    }
+    flush_pages = pages;
+    flush_bulk = iduncart.eram_bulk;
+    flush_queued_at = tick_now();
+    if (iduntrace_active) {
+        iduncart_trace_update(blk->block, pages);
+    }
+    pthread_cond_signal(&flush_cond);
+    pthread_mutex_unlock(&flush_lock);
+
+    blk->dirty = 0;
+    /* a page still selected for writing can change after the copy */
+    if (iduncart.m_page & 0x80) {
+        blk->dirty |= (uint64_t)1 << (iduncart.m_page & 0x3f);
+    }
+}
+
+/* Wait until the service starts answering. Returns -1 if it does not
+   within ERAM_TIMEOUT_MS or the socket failed. */
+static int iduncart_eram_wait(vice_network_socket_t *sock)
+{
+    vice_network_socket_t *socks[2] = { sock, NULL };
+    int waited;
+
+    /* vice_network_select_multiple() blocks for at most 250ms */
+    for (waited = 0; waited < ERAM_TIMEOUT_MS; waited += 250) {
+        int n = vice_network_select_multiple(socks);
+
+        if (n > 0) {
+            return 0;
+        }
+        if (n < 0) {
+            log_error(LOG_DEFAULT, "Idun socket select failed: %d.", vice_network_get_errorcode());
+            return -1;
+        }
+    }
+    log_error(LOG_DEFAULT, "Idun service did not answer within %d ms.", ERAM_TIMEOUT_MS);
+    return -1;
+}
+
+/* Fetch a block with one request: the service streams the page count and
+   all pages back to back, and a single UNTALK acknowledges the lot. */
+static int iduncart_eram_read_bulk(vice_network_socket_t *sock, uint8_t *dest)
+{
+    uint8_t pages = 0;
+    uint8_t talk[] = {0x40, BULK_TALK_SA};
+    uint8_t untalk[] = {0x5f};
+
+    if (vice_network_send(sock, &talk, 2, 0) != 2) {
+        log_error(LOG_DEFAULT, "Idun socket write failed: %d.", vice_network_get_errorcode());
+        return -1;
+    }
+    if (iduncart_eram_wait(sock) < 0) {
+        return -1;
+    }
+    if (vice_network_receive(sock, &pages, 1, 0) != 1) {
+        log_error(LOG_DEFAULT, "Idun bulk transfer failed: %d.", vice_network_get_errorcode());
+        return -1;
+    }
+    pages &= ~BULK_PAGES_FLAG;
+    if (pages >= PAGES_PER_BLOCK) {
+        log_error(LOG_DEFAULT, "Idun service sent %d pages for a block.", pages);
+        return -1;
+    }
+
+    log_debug(LOG_DEFAULT, "Read %d pages for block %d (bulk)", pages, iduncart.m_block);
+
+    if (pages > 0 && vice_network_receive(sock, dest, pages * 256,
+                                          0x100) != pages * 256) {    /* flags=MSG_WAITALL*/
+        log_error(LOG_DEFAULT, "Idun bulk transfer failed: %d.", vice_network_get_errorcode());
+        return -1;
+    }
+    vice_network_send(sock, &untalk, 1, 0);
+    return 0;
+}
+
+/* Receive the answer to an ERAM command into `dest`. `*bulk` selects bulk
+   transfer and is set once the service advertises it. */
+static int iduncart_eram_read(vice_network_socket_t *sock, int *bulk, uint8_t *dest)
 {
     size_t offset = 0;
     uint8_t pages = 0;
     uint8_t talk[] = {0x40, 0x7f};
     uint8_t untalk[] = {0x5f};
 
+    if (*bulk) {
+        return iduncart_eram_read_bulk(sock, dest);
+    }
+
     // TALK #0
-    size_t n = vice_network_send(iduncart.socket, &talk, 2, 0);
-    assert(n==2);
+    if (vice_network_send(sock, &talk, 2, 0) != 2) {
+        return -1;
+    }
     // First byte is num pages
-    while (vice_network_select_poll_one(iduncart.socket) == 0);
-    n = vice_network_receive(iduncart.socket, &pages, 1, 0);
-    assert(n==1);
-    assert(pages < PAGES_PER_BLOCK);
-    
+    if (iduncart_eram_wait(sock) < 0) {
+        return -1;
+    }
+    if (vice_network_receive(sock, &pages, 1, 0) != 1) {
+        return -1;
+    }
+    if (pages & BULK_PAGES_FLAG) {
+        log_message(LOG_DEFAULT, "Idun service supports bulk ERAM transfer");
+        *bulk = 1;
+        pages &= ~BULK_PAGES_FLAG;
+    }
+    if (pages >= PAGES_PER_BLOCK) {
+        log_error(LOG_DEFAULT, "Idun service sent %d pages for a block.", pages);
+        return -1;
+    }
+
     log_debug(LOG_DEFAULT, "Read %d pages for block %d", pages, iduncart.m_block);
 
     while (pages > 0) {
-        size_t n = vice_network_receive(iduncart.socket, &blockMem[offset], 256,
-                                        0x100);    /* flags=MSG_WAITALL*/
-        assert(n == 256);
-        
-        uint8_t *a = blockMem;
-        log_debug(LOG_DEFAULT, "page #%d", offset/256);
-        for (int i=0;i < 16; i++) {
-            uint16_t b = offset + (16 * i);
-            log_debug(LOG_DEFAULT, "%02x: %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x",
-                i*16, a[b],a[b+1],a[b+2],a[b+3],a[b+4],a[b+5],a[b+6],a[b+7],a[b+8],a[b+9],a[b+10],a[b+11],a[b+12],a[b+13],a[b+14],a[b+15]);
+        ssize_t n = vice_network_receive(sock, &dest[offset], 256,
+                                         0x100);    /* flags=MSG_WAITALL*/
+        if (n != 256) {
+            return -1;
         }
 
+
         offset += 256;
         // UNTALK
-        vice_network_send(iduncart.socket, &untalk, 1, 0);
-        if (--pages == 0) return;
+        vice_network_send(sock, &untalk, 1, 0);
+        if (--pages == 0) return 0;
         // TALK #0
-        vice_network_send(iduncart.socket, &talk, 2, 0);
+        vice_network_send(sock, &talk, 2, 0);
     }
     // UNTALK
-    vice_network_send(iduncart.socket, &untalk, 1, 0);
+    vice_network_send(sock, &untalk, 1, 0);
+    return 0;
 }
 
-static void iduncart_eram_loadblock()
+/* Issue an ERAM command that the service answers with block data. This also
+   makes `block` the service's current block for later CMD_UPDATE_PAGE. */
+static void iduncart_eram_command(uint8_t command, uint8_t block, uint8_t *dest)
 {
-    uint8_t cmd[] = {0x20, 0x7f, CMD_LOAD_BLOCK, iduncart.m_block};
+    uint8_t cmd[] = {0x20, 0x7f, command, block};
+    tick_t start;
+    int failed = 0;
 
+    if (replaying) {
+        if (iduntrace_replay_eram(block, dest, ERAM_BLOCK_SIZE) == 0) {
+            iduncart.svc_block = block;
+        }
+        return;
+    }
+    if (!iduncart.socket) {
+        return;
+    }
+    iduncart_flush_wait();
+    iduncart_send_flush();
+    if (!iduncart.socket) {
+        return;
+    }
+    pthread_mutex_lock(&recv_lock);
+    start = tick_now();
     int n = vice_network_send(iduncart.socket, &cmd, 4, 0);
     if (n < 0) {
         log_error(LOG_DEFAULT, "Idun socket write failed: %d.", vice_network_get_errorcode());
+        failed = 1;
+    } else if (iduncart_eram_read(iduncart.socket, &iduncart.eram_bulk, dest) < 0) {
+        log_error(LOG_DEFAULT, "Idun ERAM transfer failed: %d.", vice_network_get_errorcode());
+        failed = 1;
     } else {
-        iduncart_eram_read();
-        log_debug(LOG_DEFAULT, "ERAM block %d loaded", iduncart.m_block);
+        tick_t delta;
+
+        iduncart.svc_block = block;
+        if (iduntrace_active) {
+            iduntrace_data(IDUNTRACE_ERAM_LOAD, block, command, dest, ERAM_BLOCK_SIZE);
+        }
+
+        delta = tick_now_delta(start);
+        iduncart.stats.block_loads++;
+        iduncart.stats.block_load_ticks += delta;
+        if (delta > iduncart.stats.block_load_max) {
+            iduncart.stats.block_load_max = delta;
+        }
     }
+    pthread_mutex_unlock(&recv_lock);
+
+    /* the reader thread is joined on disconnect, so not under recv_lock */
+    if (failed) {
+        iduncart_connection_lost();
+    }
+}
+
+static void iduncart_eram_loadblock()
+{
+    iduncart_eram_command(CMD_LOAD_BLOCK, iduncart.m_block, iduncart.block_data);
+    log_debug(LOG_DEFAULT, "ERAM block %d loaded", iduncart.m_block);
 }
 
 static void iduncart_eram_freemap()
 {
-    uint8_t cmd[] = {0x20, 0x7f, CMD_FREEMAP, iduncart.m_block};
+    /* with shared ERAM the service updates the free map in place */
+    iduncart_eram_command(CMD_FREEMAP, iduncart.m_block, eram_shm ? cache_scratch : iduncart.block_data);
+    log_debug(LOG_DEFAULT, "ERAM system block re-loaded");
+}
 
-    int n = vice_network_send(iduncart.socket, &cmd, 4, 0);
-    if (n < 0) {
-        log_error(LOG_DEFAULT, "Idun socket write failed: %d.", vice_network_get_errorcode());
+/* Synchronous write-back, used at sync points only */
+static void iduncart_eram_writeback(iduncart_block_t *blk)
+{
+    size_t len;
+    tick_t start;
+
+    iduncart_flush_wait();
+    if (blk == NULL || blk->dirty == 0 || !iduncart.socket) return;
+    iduncart_send_flush();
+    if (!iduncart.socket) return;
+    log_debug(LOG_DEFAULT, "Update dirty pages: 0x%016"PRIx64, blk->dirty);
+
+    /* CMD_UPDATE_PAGE applies to the service's current block; after a cache
+       hit that is still the previously loaded one, so select it again. */
+    if (iduncart.svc_block != blk->block) {
+        iduncart_eram_command(CMD_LOAD_BLOCK, (uint8_t)blk->block, cache_scratch);
+        iduncart.stats.reselects++;
+        if (!iduncart.socket) return;
+    }
+
+    if (iduntrace_active) {
+        iduncart_trace_update(blk->block, blk->dirty);
+    }
+    start = tick_now();
+    len = iduncart_eram_encode_pages(blk->data, blk->dirty, iduncart.eram_bulk, syncUpdateBuf);
+    if (iduncart_eram_send_updates(syncUpdateBuf, len) < 0) {
+        log_error(LOG_DEFAULT, "Idun ERAM write-back failed: %d.", vice_network_get_errorcode());
+    }
+    iduncart.stats.sync_flushes++;
+    iduncart.stats.sync_flush_ticks += tick_now_delta(start);
+    iduncart.stats.flushed_pages += (uint64_t)popcount64(blk->dirty);
+    blk->dirty = 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void iduncart_cache_free(void)
+{
+    int i;
+
+    if (iduncart.cache) {
+        for (i = 0; i < iduncart.cache_size; i++) {
+            lib_free(iduncart.cache[i].data);
+        }
+        lib_free(iduncart.cache);
+        iduncart.cache = NULL;
+    }
+    iduncart.cache_size = 0;
+    iduncart.cur = NULL;
+    iduncart.block_data = blockMem;
+}
+
+static void iduncart_cache_alloc(int blocks)
+{
+    int i;
+
+    iduncart_cache_free();
+
+    iduncart.cache = lib_calloc((size_t)blocks, sizeof(iduncart_block_t));
+    for (i = 0; i < blocks; i++) {
+        iduncart.cache[i].block = -1;
+        iduncart.cache[i].data = lib_calloc(1, ERAM_BLOCK_SIZE);
+    }
+    iduncart.cache_size = blocks;
+}
+
+static iduncart_block_t *iduncart_cache_lookup(int block)
+{
+    int i;
+
+    for (i = 0; i < iduncart.cache_size; i++) {
+        if (iduncart.cache[i].block == block) {
+            return &iduncart.cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* Pick a free slot, or else the least recently used one other than the
+   current block. */
+static iduncart_block_t *iduncart_cache_victim(void)
+{
+    iduncart_block_t *victim = NULL;
+    int i;
+
+    for (i = 0; i < iduncart.cache_size; i++) {
+        iduncart_block_t *blk = &iduncart.cache[i];
+        if (blk->block < 0) {
+            return blk;
+        }
+        if (blk != iduncart.cur && (victim == NULL || blk->last_used < victim->last_used)) {
+            victim = blk;
+        }
+    }
+    return victim ? victim : iduncart.cur;
+}
+
+/* Make `block` the current ERAM block, fetching it from the service unless
+   it is cached. The system block holds the free map, which the service
+   changes on its own, so it is always re-fetched. While disconnected the
+   block is not loaded, see iduncart_reconnect_resync(). */
+static void iduncart_cache_select(uint8_t block)
+{
+    iduncart_block_t *blk;
+
+    if (eram_shm) {
+        iduncart.cur = NULL;
+        iduncart.block_data = &eram_shm[block * ERAM_BLOCK_SIZE];
+        return;
+    }
+    if (iduncart.cache == NULL) {
+        return;
+    }
+
+    blk = iduncart_cache_lookup(block);
+    if (blk != NULL && blk->loaded && block != SYSTEM_BLOCK) {
+        iduncart.stats.cache_hits++;
     } else {
-        iduncart_eram_read();
-        log_debug(LOG_DEFAULT, "ERAM system block re-loaded");
+        iduncart.stats.cache_misses++;
+        if (blk == NULL) {
+            blk = iduncart_cache_victim();
+            if (blk->block >= 0) {
+                iduncart.stats.cache_evictions++;
+                iduncart_eram_writeback(blk);
+            }
+            blk->block = block;
+        }
+        blk->dirty = 0;
+        iduncart.cur = blk;
+        iduncart.block_data = blk->data;
+        iduncart_eram_loadblock();
+        blk->loaded = (iduncart.svc_block == block);
+    }
+    blk->last_used = ++iduncart.lru_clock;
+    iduncart.cur = blk;
+    iduncart.block_data = blk->data;
+}
+
+void iduncart_set_cache_blocks(int blocks)
+{
+    iduncart.cache_blocks = blocks;
+
+    /* takes effect on the next connect when not connected yet */
+    if (iduncart.cache) {
+        int block = iduncart.m_block;
+        iduncart_eram_writeback(iduncart.cur);
+        iduncart_cache_alloc(blocks);
+        if (iduncart.socket) {
+            iduncart_cache_select((uint8_t)block);
+        }
+    }
+}
+
+/* Map the shared ERAM file, if one is configured. Falls back to the block
+   cache when it cannot be mapped. */
+static void iduncart_shm_map(void)
+{
+#ifdef UNIX_COMPILE
+    size_t size = (size_t)ERAM_BLOCKS * ERAM_BLOCK_SIZE;
+    struct stat st;
+    void *p;
+    int fd;
+
+    if (eram_shm_path == NULL || *eram_shm_path == '\0') {
+        return;
+    }
+    fd = open(eram_shm_path, O_RDWR);
+    if (fd < 0) {
+        log_error(LOG_DEFAULT, "Cannot open Idun ERAM mapping '%s'.", eram_shm_path);
+        return;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < size) {
+        log_error(LOG_DEFAULT, "Idun ERAM mapping '%s' is smaller than %lu bytes.",
+                  eram_shm_path, (unsigned long)size);
+        close(fd);
+        return;
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        log_error(LOG_DEFAULT, "Cannot map Idun ERAM from '%s'.", eram_shm_path);
+        return;
+    }
+    eram_shm = p;
+    log_message(LOG_DEFAULT, "Idun ERAM shared with the service through '%s'.", eram_shm_path);
+#else
+    if (eram_shm_path != NULL && *eram_shm_path != '\0') {
+        log_error(LOG_DEFAULT, "Shared Idun ERAM is not supported on this platform.");
+    }
+#endif
+}
+
+static void iduncart_shm_unmap(void)
+{
+#ifdef UNIX_COMPILE
+    if (eram_shm) {
+        munmap(eram_shm, (size_t)ERAM_BLOCKS * ERAM_BLOCK_SIZE);
+        eram_shm = NULL;
+        iduncart.block_data = blockMem;
+    }
+#endif
+}
+
+/* Takes effect on the next connect */
+void iduncart_set_eram_shm(const char *path)
+{
+    lib_free(eram_shm_path);
+    eram_shm_path = (path && *path) ? lib_strdup(path) : NULL;
+}
+
+void iduncart_set_replay(const char *path)
+{
+    lib_free(replay_path);
+    replay_path = (path && *path) ? lib_strdup(path) : NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void *iduncart_recv_main(void *unused)
+{
+    vice_network_socket_t *socks[2] = { iduncart.socket, NULL };
+
+    while (atomic_load(&recv_thread_running)) {
+        /* blocks for at most 250ms, so a stop request is noticed quickly */
+        if (vice_network_select_multiple(socks) <= 0) {
+            continue;
+        }
+
+        size_t head = atomic_load_explicit(&recv_head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&recv_tail, memory_order_acquire);
+        size_t used = head - tail;
+        if (used == RECV_RING_SIZE) {
+            /* 6502 is not keeping up; let it drain the ring */
+            archdep_usleep(1000);
+            continue;
+        }
+        /* only fill up to the physical end of the ring, wrap on next pass */
+        size_t space = RECV_RING_SIZE - used;
+        size_t contig = RECV_RING_SIZE - (head & RECV_RING_MASK);
+        if (space > contig) {
+            space = contig;
+        }
+
+        pthread_mutex_lock(&recv_lock);
+        /* an ERAM exchange may have consumed the pending data meanwhile */
+        if (vice_network_select_poll_one(iduncart.socket) > 0) {
+            ssize_t n = vice_network_receive(iduncart.socket, &recvRing[head & RECV_RING_MASK], space, 0);
+            iduncart.stats.recv_calls++;
+            if (n <= 0) {
+                pthread_mutex_unlock(&recv_lock);
+                log_error(LOG_DEFAULT, "Idun connection closed by service (%d).", vice_network_get_errorcode());
+                atomic_store(&recv_lost, 1);
+                atomic_store_explicit(&connect_event, 1, memory_order_release);
+                break;
+            }
+            atomic_store_explicit(&recv_head, head + (size_t)n, memory_order_release);
+            iduncart.stats.bytes_buffered += (size_t)n;
+            if (used + (size_t)n > iduncart.stats.high_water) {
+                iduncart.stats.high_water = (uint32_t)(used + (size_t)n);
+            }
+        }
+        pthread_mutex_unlock(&recv_lock);
+    }
+    return NULL;
+}
+
+/* Bytes still in the ring stay readable; it is only emptied by init and
+   by restoring a snapshot. */
+static void iduncart_recv_start(void)
+{
+    if (!iduncart.socket) {
+        return;
+    }
+    atomic_store(&recv_thread_running, 1);
+    if (pthread_create(&recv_thread, NULL, iduncart_recv_main, NULL)) {
+        atomic_store(&recv_thread_running, 0);
+        log_error(LOG_DEFAULT, "Failed to start Idun socket reader thread.");
+        return;
+    }
+    recv_thread_started = 1;
+}
+
+static void iduncart_recv_stop(void)
+{
+    /* the thread may already have ended on its own, but is joined anyway */
+    if (recv_thread_started) {
+        atomic_store(&recv_thread_running, 0);
+        pthread_join(recv_thread, NULL);
+        recv_thread_started = 0;
+    }
+}
+
+/* Stop the helper threads before the socket goes away */
+static void iduncart_disconnect(void)
+{
+    iduncart_recv_stop();
+    iduncart_flush_stop();
+    if (iduncart.socket) {
+        vice_network_socket_close(iduncart.socket);
+        iduncart.socket = NULL;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static int iduncart_connect_current(iduncart_connect_t *c)
+{
+    int current;
+
+    pthread_mutex_lock(&connect_lock);
+    current = (c->gen == connect_gen);
+    pthread_mutex_unlock(&connect_lock);
+    return current;
+}
+
+/* Connect thread: try until connected and SYSTEM_BLOCK is loaded, waiting
+   longer after each failure, or until the attempt is abandoned. */
+static void *iduncart_connect_main(void *arg)
+{
+    iduncart_connect_t *c = arg;
+    int failures = 0;
+
+    for (;;) {
+        vice_network_socket_address_t *ad;
+        uint8_t cmd[] = {0x20, 0x7f, CMD_LOAD_BLOCK, SYSTEM_BLOCK};
+        tick_t start;
+        int delay;
+
+        for (delay = c->delay_ms; delay > 0 && iduncart_connect_current(c); delay -= CONNECT_POLL_MS) {
+            archdep_usleep(CONNECT_POLL_MS * 1000);
+        }
+        if (!iduncart_connect_current(c)) {
+            break;
+        }
+
+        start = tick_now();
+        ad = vice_network_address_generate(c->host, 0);
+        if (ad) {
+            c->socket = vice_network_client(ad);
+            vice_network_address_close(ad);
+        }
+        if (c->socket) {
+            if (vice_network_send(c->socket, &cmd, 4, 0) == 4
+                && iduncart_eram_read(c->socket, &c->bulk, c->data) == 0) {
+                c->ticks = tick_now_delta(start);
+                pthread_mutex_lock(&connect_lock);
+                if (c->gen == connect_gen) {
+                    connect_result = c;
+                    atomic_store_explicit(&connect_event, 1, memory_order_release);
+                    pthread_mutex_unlock(&connect_lock);
+                    return NULL;
+                }
+                pthread_mutex_unlock(&connect_lock);
+                break;
+            }
+            vice_network_socket_close(c->socket);
+            c->socket = NULL;
+        }
+
+        if (failures++ == 0) {
+            log_error(LOG_DEFAULT, "Cant open connection to %s, retrying.", c->host);
+        }
+        pthread_mutex_lock(&connect_lock);
+        if (c->gen == connect_gen) {
+            connect_failures++;
+            atomic_store_explicit(&connect_event, 1, memory_order_release);
+        }
+        pthread_mutex_unlock(&connect_lock);
+
+        c->delay_ms = c->delay_ms ? c->delay_ms * 2 : CONNECT_BACKOFF_MIN_MS;
+        if (c->delay_ms > CONNECT_BACKOFF_MAX_MS) {
+            c->delay_ms = CONNECT_BACKOFF_MAX_MS;
+        }
+    }
+
+    if (c->socket) {
+        vice_network_socket_close(c->socket);
+    }
+    lib_free(c->host);
+    lib_free(c);
+    return NULL;
+}
+
+/* Start connecting in the background after `delay_ms` */
+static void iduncart_connect_start(int delay_ms)
+{
+    iduncart_connect_t *c = lib_calloc(1, sizeof(iduncart_connect_t));
+    pthread_t thread;
+
+    c->host = lib_strdup(iduncart.host);
+    c->delay_ms = delay_ms;
+    pthread_mutex_lock(&connect_lock);
+    c->gen = ++connect_gen;
+    pthread_mutex_unlock(&connect_lock);
+
+    if (pthread_create(&thread, NULL, iduncart_connect_main, c)) {
+        log_error(LOG_DEFAULT, "Failed to start Idun connect thread.");
+        lib_free(c->host);
+        lib_free(c);
+        iduncart.state = IDUN_STATE_DEGRADED;
+        return;
     }
+    pthread_detach(thread);
 }
 
-static void iduncart_eram_writeback()
+/* Abandon a connect in progress and drop a connection not yet taken over */
+static void iduncart_connect_cancel(void)
 {
-    uint8_t cmd[] = {0x20, 0x7f, CMD_UPDATE_PAGE, 0};
-    int8_t c = 63;
+    iduncart_connect_t *c;
 
-    if ((iduncart.dirty0 | iduncart.dirty1)==0) return;
-    log_debug(LOG_DEFAULT, "Update dirty pages: 0x%08x%08x", iduncart.dirty1, iduncart.dirty0);
+    pthread_mutex_lock(&connect_lock);
+    connect_gen++;
+    c = connect_result;
+    connect_result = NULL;
+    pthread_mutex_unlock(&connect_lock);
 
-    while (c >= 0) {
-        uint32_t pg = (c < 32) ? 1<<c : 1<<(c-32);
-        uint32_t cmp = (c < 32) ? iduncart.dirty0 : iduncart.dirty1;
-        if (cmp & pg) {
-            uint16_t offset = c * 256;
-            cmd[3] = c;
-            size_t n = vice_network_send(iduncart.socket, &cmd, 4, 0);
-            assert(n==4);
-            n = vice_network_send(iduncart.socket, &iduncart.block_data[offset], 256, 0);
-            assert(n==256);
+    if (c) {
+        vice_network_socket_close(c->socket);
+        lib_free(c->host);
+        lib_free(c);
+    }
+}
+
+/* Resync after a snapshot restore, see `resync_pending` */
+static void iduncart_snapshot_resync(void)
+{
+    uint64_t pages = 0;
+    int i;
+
+    resync_pending = 0;
+    for (i = 0; i < iduncart.cache_size && iduncart.socket; i++) {
+        iduncart_block_t *blk = &iduncart.cache[i];
+        if (blk->block >= 0 && blk->dirty) {
+            pages += (uint64_t)popcount64(blk->dirty);
+            iduncart_eram_writeback(blk);
+        }
+    }
+    if (resync_load) {
+        iduncart_eram_loadblock();
+        if (iduncart.cur != NULL) {
+            iduncart.cur->loaded = (iduncart.svc_block == iduncart.m_block);
+        }
+        resync_load = 0;
+    } else if (!eram_shm && iduncart.svc_block != iduncart.m_block) {
+        iduncart_eram_command(CMD_LOAD_BLOCK, iduncart.m_block, cache_scratch);
+        iduncart.stats.reselects++;
+    }
+    iduncart.stats.restored_pages += pages;
+    log_message(LOG_DEFAULT, "Idun snapshot state resynced, %u dirty pages written back.",
+                (unsigned int)pages);
+}
+
+/* Resync the cache kept across a reconnect: the pages the 6502 stored to
+   while the link was down are written back, and a current block that
+   could not be loaded then is loaded now. Other blocks that were never
+   loaded are dropped from the cache. */
+static void iduncart_reconnect_resync(void)
+{
+    uint64_t pages = 0;
+    uint64_t lost = 0;
+    int i;
 
-            uint8_t *a = iduncart.block_data;
-            log_debug(LOG_DEFAULT, "UPDATE #%d", c);
-            for (int i=0;i < 16; i++) {
-                uint16_t b = offset + (16 * i);
-                log_debug(LOG_DEFAULT, "%02x: %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x",
-                    i*16, a[b],a[b+1],a[b+2],a[b+3],a[b+4],a[b+5],a[b+6],a[b+7],a[b+8],a[b+9],a[b+10],a[b+11],a[b+12],a[b+13],a[b+14],a[b+15]);
+    for (i = 0; i < iduncart.cache_size && iduncart.socket; i++) {
+        iduncart_block_t *blk = &iduncart.cache[i];
+        if (blk->block < 0) {
+            continue;
+        }
+        if (!blk->loaded) {
+            /* stores into a block that was never loaded hit stale data */
+            lost += (uint64_t)popcount64(blk->dirty);
+            blk->dirty = 0;
+            if (blk != iduncart.cur) {
+                blk->block = -1;
             }
+        } else if (blk->dirty) {
+            pages += (uint64_t)popcount64(blk->dirty);
+            iduncart_eram_writeback(blk);
+        }
+    }
+    if (iduncart.cur != NULL && !iduncart.cur->loaded && iduncart.socket) {
+        iduncart_eram_loadblock();
+        iduncart.cur->loaded = (iduncart.svc_block == iduncart.m_block);
+    }
+    if (pages > 0) {
+        log_message(LOG_DEFAULT, "Idun reconnected, %u dirty pages written back.",
+                    (unsigned int)pages);
+    }
+    if (lost > 0) {
+        log_error(LOG_DEFAULT, "Idun: %u pages stored to ERAM blocks that were never loaded are lost.",
+                  (unsigned int)lost);
+    }
+}
+
+/* Take over a connection made by the connect thread. The cache is kept:
+   a clean copy of SYSTEM_BLOCK is replaced by the one the thread loaded,
+   then the cache is brought in line with the service. Shared ERAM needs
+   neither. */
+static void iduncart_connect_adopt(iduncart_connect_t *c)
+{
+    iduncart_block_t *blk;
+
+    iduncart.socket = c->socket;
+    iduncart.eram_bulk = c->bulk;
+    iduncart.svc_block = SYSTEM_BLOCK;
+
+    if (!eram_shm) {
+        /* the free map is the service's; take it unless the 6502 wrote to it */
+        blk = iduncart_cache_lookup(SYSTEM_BLOCK);
+        if (blk != NULL && blk->dirty == 0) {
+            memcpy(blk->data, c->data, ERAM_BLOCK_SIZE);
+            blk->loaded = 1;
         }
-        c--;
     }
-    iduncart.dirty0 = iduncart.dirty1 = 0;
+
+    if (iduntrace_active) {
+        iduntrace_event(IDUNTRACE_CONNECT, 0, (uint8_t)c->bulk);
+        iduntrace_data(IDUNTRACE_ERAM_LOAD, SYSTEM_BLOCK, CMD_LOAD_BLOCK, c->data, ERAM_BLOCK_SIZE);
+    }
+    iduncart.stats.connects++;
+    iduncart.stats.connect_ticks += c->ticks;
+    if (c->ticks > iduncart.stats.connect_max) {
+        iduncart.stats.connect_max = (uint32_t)c->ticks;
+    }
+    log_message(LOG_DEFAULT, "Idun connected to %s in %u us.", c->host,
+                (unsigned int)TICK_TO_MICRO(c->ticks));
+    lib_free(c->host);
+    lib_free(c);
+
+    iduncart.state = IDUN_STATE_READY;
+    if (!resync_pending) {
+        send_len = 0;
+    }
+    iduncart_recv_start();
+    iduncart_flush_start();
+    if (resync_pending) {
+        iduncart_snapshot_resync();
+    } else if (!eram_shm) {
+        iduncart_reconnect_resync();
+    }
 }
+
+/* The service went away: keep the cached ERAM for the 6502 and reconnect */
+static void iduncart_connection_lost(void)
+{
+    if (!iduncart.socket) {
+        return;
+    }
+    log_error(LOG_DEFAULT, "Idun connection lost, reconnecting.");
+    IDUNTRACE_EVENT(IDUNTRACE_DISCONNECT, 0, 0);
+    iduncart_disconnect();
+    atomic_store(&recv_lost, 0);
+    iduncart.svc_block = -1;
+    iduncart.state = IDUN_STATE_DEGRADED;
+    iduncart.stats.disconnects++;
+    iduncart_connect_start(CONNECT_BACKOFF_MIN_MS);
+}
+
+static void iduncart_connect_poll(void)
+{
+    iduncart_connect_t *c;
+
+    atomic_store(&connect_event, 0);
+    if (atomic_exchange(&recv_lost, 0)) {
+        iduncart_connection_lost();
+    }
+
+    pthread_mutex_lock(&connect_lock);
+    c = connect_result;
+    connect_result = NULL;
+    iduncart.stats.connect_failures = connect_failures;
+    pthread_mutex_unlock(&connect_lock);
+
+    if (c) {
+        iduncart_connect_adopt(c);
+    } else if (iduncart.state == IDUN_STATE_CONNECTING && iduncart.stats.connect_failures > 0) {
+        iduncart.state = IDUN_STATE_DEGRADED;
+    }
+}
+
+/* Called on every cartridge register access; cheap unless something happened */
+static inline void iduncart_connect_check(void)
+{
+    if (atomic_load_explicit(&connect_event, memory_order_acquire)) {
+        iduncart_connect_poll();
+    }
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 void iduncart_io_reset(io_iduncart_t *context)
 {
@@ -165,32 +1240,66 @@ void iduncart_io_reset(io_iduncart_t *context)
 
 io_iduncart_t *iduncart_init(const char *host)
 {
+    vice_network_socket_address_t *ad;
+
     log_message(LOG_DEFAULT, "Idun connect: %s", host);
 
-    iduncart.host = host;
-    iduncart.pfirst = iduncart.plast = recvBuf;
+    if (host != iduncart.host) {
+        lib_free(iduncart.host);
+        iduncart.host = lib_strdup(host);
+    }
+
+    iduncart.svc_block = -1;
+    iduncart.eram_bulk = 0;
+    iduncart.m_block = SYSTEM_BLOCK;
+    iduncart.m_page = 0x40;
+    atomic_store(&recv_head, 0);
+    atomic_store(&recv_tail, 0);
+    send_len = 0;
+    send_at_boundary = 1;
+    eram_flush_deferred = 0;
+    resync_pending = 0;
+    resync_load = 0;
+    trace_recv_seen = 0;
+    trace_de01_last = -1;
+
+    if (replay_path) {
+        /* no service; SYSTEM_BLOCK comes from the trace like all ERAM loads */
+        iduncart_cache_alloc(iduncart.cache_blocks);
+        iduncart.cur = &iduncart.cache[0];
+        iduncart.cur->block = SYSTEM_BLOCK;
+        iduncart.block_data = iduncart.cur->data;
+        if (iduntrace_replay_open(replay_path) < 0) {
+            iduncart.state = IDUN_STATE_DEGRADED;
+            return &iduncart;
+        }
+        replaying = 1;
+        iduncart_eram_loadblock();
+        iduncart.state = IDUN_STATE_READY;
+        return &iduncart;
+    }
 
-    /* parse the address */
-    vice_network_socket_address_t *ad = NULL;
+    /* only the address is checked here; connecting and loading SYSTEM_BLOCK
+       happen in the background, see iduncart_connect_main() */
     ad = vice_network_address_generate(host, 0);
     if (!ad) {
         log_error(LOG_DEFAULT, "Bad idunhost. Should be ipaddr:port, but is '%s'.", host);
+        iduncart.state = IDUN_STATE_DEGRADED;
+        return &iduncart;
     }
-    else {
-        /* connect socket */
-        iduncart.socket = vice_network_client(ad);
-        if (!iduncart.socket) {
-            log_error(LOG_DEFAULT, "Cant open connection.");
-        }
-        /* init the block cache by loading SYSTEM_BLOCK */
-        iduncart.m_block = SYSTEM_BLOCK;
-        iduncart_eram_loadblock();
-        iduncart.m_page = 0x40;
-    }
+    vice_network_address_close(ad);
 
-    if (ad) {
-        vice_network_address_close(ad);
+    iduncart_shm_map();
+    if (eram_shm) {
+        iduncart_cache_select(SYSTEM_BLOCK);
+    } else {
+        iduncart_cache_alloc(iduncart.cache_blocks);
+        iduncart.cur = &iduncart.cache[0];
+        iduncart.cur->block = SYSTEM_BLOCK;
+        iduncart.block_data = iduncart.cur->data;
     }
+    iduncart.state = IDUN_STATE_CONNECTING;
+    iduncart_connect_start(0);
 
     return &iduncart;
 }
@@ -199,33 +1308,60 @@ void iduncart_io_destroy(io_iduncart_t *context)
 {
     log_message(LOG_DEFAULT, "Idun disconnect");
 
-    do {
-        if (!context->socket) {
-            log_error(LOG_DEFAULT, "Attempt to close non-open socket");
-            break;
-        }    
-
-        vice_network_socket_close(context->socket);
-        context->socket = NULL;
-    } while (0);
+    if (context->socket) {
+        iduncart_eram_writeback(context->cur);
+        iduncart_send_flush();
+    }
+    iduncart_cache_free();
+    iduncart_shm_unmap();
+    iduncart_disconnect();
+    if (replaying) {
+        iduntrace_replay_close();
+        replaying = 0;
+    }
+    /* last, as a failing write-back above starts reconnecting */
+    iduncart_connect_cancel();
+    atomic_store(&connect_event, 0);
+    atomic_store(&recv_lost, 0);
+    iduncart.state = IDUN_STATE_DEGRADED;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
 void iduncart_io_store_data(io_iduncart_t *context, uint8_t data)
 {
+    IDUNTRACE_EVENT(IDUNTRACE_WRITE, 0x00, data);
+    if (replaying) {
+        iduntrace_replay_write(0x00, data);
+        context->stats.stores++;
+        return;
+    }
+    iduncart_connect_check();
     if (!context->socket) {
-        log_error(LOG_DEFAULT, "Attempt to write to non-open socket");
+        /* no service (yet); the 6502 sees $DE01 empty meanwhile */
+        context->stats.stores_dropped++;
         return;
     }
 
     IDUN_VERBOSE_DEBUG(("Output 0x%02x '%c'.", data, isgraph(data) ? data : '.'));
 
-    int n = vice_network_send(context->socket, &data, 1, 0);
-    if (n < 0) {
-        log_error(LOG_DEFAULT, "Error writing: %d.", vice_network_get_errorcode());
-        vice_network_socket_close(context->socket);
-        context->socket = NULL;
+    sendBuf[send_len++] = data;
+    context->stats.stores++;
+    if (data == LISTEN0) {
+        send_at_boundary = 0;
+    } else if (data == UNLISTEN) {
+        send_at_boundary = 1;
+        if (eram_flush_deferred && !eram_flush_queued) {
+            eram_flush_queued = 1;
+            vsync_on_vsync_do(iduncart_eram_flush_async, NULL);
+        }
+    }
+    if (send_len >= SEND_FLUSH_THRESHOLD) {
+        iduncart_send_flush();
+    } else if (!send_flush_queued) {
+        /* make sure nothing lingers longer than a frame */
+        send_flush_queued = 1;
+        vsync_on_vsync_do(iduncart_vsync_flush, NULL);
     }
 }
 
@@ -233,6 +1369,8 @@ uint8_t iduncart_reg_read(io_iduncart_t *context, uint16_t addr) {
     assert(context!=NULL);
     assert(addr==0xfe);
 
+    iduncart_connect_check();
+    IDUNTRACE_EVENT(IDUNTRACE_READ, 0xfe, context->m_page);
     return context->m_page;
 }
 
@@ -240,13 +1378,17 @@ void iduncart_reg_write(io_iduncart_t *context, uint16_t addr, uint8_t byte)
 {
     assert(context!=NULL);
 
+    IDUNTRACE_EVENT(IDUNTRACE_WRITE, (uint8_t)addr, byte);
+    if (replaying) {
+        iduntrace_replay_write((uint8_t)addr, byte);
+    }
+    iduncart_connect_check();
     if (addr == 0xff) {
-        log_debug(LOG_DEFAULT, "Dirty pages=0x%08x%08x", iduncart.dirty1, iduncart.dirty0);
-        iduncart_eram_writeback();
+        iduncart_eram_writeback(context->cur);
         if (context->m_block != byte) {
             context->m_block = byte;
             context->m_page = 0;
-            iduncart_eram_loadblock();
+            iduncart_cache_select(byte);
             context->m_page |= 0x40;
         } else if (byte == SYSTEM_BLOCK) {
             context->m_page = 0;
@@ -255,11 +1397,13 @@ void iduncart_reg_write(io_iduncart_t *context, uint16_t addr, uint8_t byte)
         }
     } else if (addr == 0xfe) {
         if (byte & 0x80) {
-            uint8_t sh = byte & 0x3f;
-            if (sh < 32)
-                context->dirty0 |= 1<<sh;
-            else
-                context->dirty1 |= 1<<(sh-32);
+            if (context->cur) {
+                context->cur->dirty |= (uint64_t)1 << (byte & 0x3f);
+                if (!eram_flush_queued) {
+                    eram_flush_queued = 1;
+                    vsync_on_vsync_do(iduncart_eram_flush_async, NULL);
+                }
+            }
         }
         context->m_page = byte | 0x40;
     }
@@ -284,51 +1428,434 @@ uint8_t iduncart_page_read(uint16_t addr)
     }
 }
 
-uint8_t iduncart_io_read(io_iduncart_t *context, uint16_t ioaddr)
+/* Trace the service data that arrived since the last look at the ring */
+static void iduncart_trace_recv(void)
 {
-    assert(ioaddr <= 0x02); // $de00-$de02 only!
+    size_t head = atomic_load_explicit(&recv_head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&recv_tail, memory_order_relaxed);
+    size_t from = trace_recv_seen;
 
-    if (ioaddr == 0x02) {
-        // I am an Emulator and I am Ok.
-        return 0x9b;        // ~0x64 ;)
+    /* bytes already read or dropped are not in the ring anymore */
+    if (from - tail > head - tail) {
+        from = tail;
     }
-    else if (ioaddr == 0x00) {
+    while (from != head) {
+        size_t n = RECV_RING_SIZE - (from & RECV_RING_MASK);
+        if (n > head - from) {
+            n = head - from;
+        }
+        iduntrace_data(IDUNTRACE_RECV, 0x00, 0, &recvRing[from & RECV_RING_MASK], n);
+        from += n;
+    }
+    trace_recv_seen = head;
+}
+
+static uint8_t iduncart_io_read_live(io_iduncart_t *context, uint16_t ioaddr)
+{
+    iduncart_connect_check();
+
+    // the service only answers what it has received, so pending output
+    // must go out before the 6502 looks for a reply
+    if (send_len > 0) {
+        iduncart_send_flush();
+    }
+
+    if (iduntrace_active && context->state == IDUN_STATE_READY) {
+        iduncart_trace_recv();
+    }
+
+    if (ioaddr == 0x00) {
         // read data byte from $de00
         uint8_t b = 0x42;   // no data; false read flag
+        size_t tail = atomic_load_explicit(&recv_tail, memory_order_relaxed);
 
-        if (context->pfirst < context->plast)
-            b = *(++context->pfirst);
+        if (context->state == IDUN_STATE_READY
+            && atomic_load_explicit(&recv_head, memory_order_acquire) != tail) {
+            b = recvRing[tail & RECV_RING_MASK];
+            atomic_store_explicit(&recv_tail, tail + 1, memory_order_release);
+        }
 
         IDUN_VERBOSE_DEBUG(("Idun($de00)=%x", b));
         
         return b;
     }
     else {
-        // read bytes available from $de01
-        size_t c = context->plast - context->pfirst;
-
-        // simple case
-        if (c > 0) 
-            return (c < 256)? c : 255;
-
-        // no buffered data available; need to poll socket
-#pragma GCC diagnostic ignored "-Warray-bounds"
-        if (vice_network_select_poll_one(context->socket) > 0) {
-            // socket ready; fetch data to buffer
-            context->pfirst = recvBuf-1;
-            c = vice_network_receive(context->socket, recvBuf, MAX_PIPE_MSG_BYTES, 0);
-            context->plast = context->pfirst + c;
-        }
-#pragma GCC diagnostic pop
-        
+        // read bytes available from $de01; the reader thread keeps the
+        // ring filled, so this never touches the socket. Nothing is
+        // available until the service is ready.
+        size_t c = 0;
+
+        if (context->state == IDUN_STATE_READY) {
+            c = atomic_load_explicit(&recv_head, memory_order_acquire)
+                - atomic_load_explicit(&recv_tail, memory_order_relaxed);
+        }
+
+        if (c == 0) {
+            context->stats.polls_avoided++;
+        }
+
         IDUN_VERBOSE_DEBUG(("Idun($de01)=%x", (unsigned int)c));
 
         return (c < 256)? c : 255;
     }
 }
 
+uint8_t iduncart_io_read(io_iduncart_t *context, uint16_t ioaddr)
+{
+    uint8_t b;
+
+    assert(ioaddr <= 0x02); // $de00-$de02 only!
+
+    if (ioaddr == 0x02) {
+        // I am an Emulator and I am Ok.
+        b = 0x9b;           // ~0x64 ;)
+    } else if (replaying) {
+        // past the end of the trace the service has nothing more to say
+        if (iduntrace_replay_read((uint8_t)ioaddr, &b) < 0) {
+            b = (ioaddr == 0x00) ? 0x42 : 0;
+        }
+    } else {
+        b = iduncart_io_read_live(context, ioaddr);
+    }
+
+    /* $DE02 is constant and $DE01 is only of interest when it changes */
+    if (iduntrace_active) {
+        if (ioaddr == 0x00) {
+            iduntrace_event(IDUNTRACE_READ, 0x00, b);
+        } else if (ioaddr == 0x01 && b != trace_de01_last) {
+            iduntrace_event(IDUNTRACE_READ, 0x01, b);
+            trace_de01_last = b;
+        }
+    }
+    return b;
+}
+
+/* What a read of $DE01 or $DE02 would return, when reading it again changes
+   nothing. This lets the main CPU skip loops polling $DE01 for a reply:
+   the reply comes from the reader thread at no particular clock, so the
+   next real read after the skip picks it up just as well.
+
+   It fails whenever the read would do more than report an empty ring:
+   flush staged output, handle a connection event, trace or replay. */
+int iduncart_io_idle_read(io_iduncart_t *context, uint16_t ioaddr, uint8_t *value)
+{
+    size_t head;
+
+    if (ioaddr == 0x02) {
+        *value = 0x9b;
+        return 0;
+    }
+
+    if (ioaddr != 0x01 || replaying || send_len > 0
+        || atomic_load_explicit(&connect_event, memory_order_acquire)) {
+        return -1;
+    }
+
+    head = atomic_load_explicit(&recv_head, memory_order_acquire);
+    if (context->state == IDUN_STATE_READY
+        && head != atomic_load_explicit(&recv_tail, memory_order_relaxed)) {
+        return -1;
+    }
+    if (iduntrace_active && (trace_de01_last != 0
+                             || (context->state == IDUN_STATE_READY && head != trace_recv_seen))) {
+        return -1;
+    }
+
+    *value = 0;
+    return 0;
+}
+
 int iduncart_io_dump()
 {
+    static const char *states[] = { "connecting", "ready", "degraded" };
+    size_t c = atomic_load(&recv_head) - atomic_load(&recv_tail);
+
     mon_out("4096K avail bytes\n");
+    mon_out("Connection: %s (%s), connects: %lu, lost: %lu, failed attempts: %lu\n",
+            states[iduncart.state], iduncart.host ? iduncart.host : "-",
+            (unsigned long)iduncart.stats.connects,
+            (unsigned long)iduncart.stats.disconnects,
+            (unsigned long)iduncart.stats.connect_failures);
+    mon_out("Connect latency: avg %u us, max %u us; $DE00 stores dropped while offline: %lu\n",
+            iduncart.stats.connects ? (unsigned int)TICK_TO_MICRO(iduncart.stats.connect_ticks / iduncart.stats.connects) : 0,
+            (unsigned int)TICK_TO_MICRO(iduncart.stats.connect_max),
+            (unsigned long)iduncart.stats.stores_dropped);
+    mon_out("Receive ring: %u/%u bytes pending, high-water %u\n",
+            (unsigned int)c, (unsigned int)RECV_RING_SIZE, iduncart.stats.high_water);
+    mon_out("Bytes buffered: %lu, recv calls: %lu, $DE01 polls without syscall: %lu\n",
+            (unsigned long)iduncart.stats.bytes_buffered,
+            (unsigned long)iduncart.stats.recv_calls,
+            (unsigned long)iduncart.stats.polls_avoided);
+    mon_out("$DE00 stores: %lu, sends: %lu (%.1f bytes avg), %.1f sends per frame with output\n",
+            (unsigned long)iduncart.stats.stores,
+            (unsigned long)iduncart.stats.send_calls,
+            iduncart.stats.send_calls ? (double)iduncart.stats.bytes_sent / iduncart.stats.send_calls : 0.0,
+            iduncart.stats.send_frames ? (double)iduncart.stats.send_calls / iduncart.stats.send_frames : 0.0);
+    if (replaying) {
+        mon_out("Replaying trace '%s' instead of a service\n", replay_path);
+    }
+    iduntrace_dump();
+    if (iduncart.stats.restores) {
+        mon_out("Snapshots restored: %lu, dirty pages written back on resync: %lu\n",
+                (unsigned long)iduncart.stats.restores,
+                (unsigned long)iduncart.stats.restored_pages);
+    }
+    if (eram_shm) {
+        mon_out("ERAM shared with the service through '%s'\n", eram_shm_path);
+    }
+    mon_out("ERAM cache: %d blocks, hits: %lu, misses: %lu, evictions: %lu, re-selects: %lu\n",
+            iduncart.cache_size,
+            (unsigned long)iduncart.stats.cache_hits,
+            (unsigned long)iduncart.stats.cache_misses,
+            (unsigned long)iduncart.stats.cache_evictions,
+            (unsigned long)iduncart.stats.reselects);
+    mon_out("Block loads: %lu (%s), avg %u us, max %u us\n",
+            (unsigned long)iduncart.stats.block_loads,
+            iduncart.eram_bulk ? "bulk" : "per page",
+            iduncart.stats.block_loads ? (unsigned int)TICK_TO_MICRO(iduncart.stats.block_load_ticks / iduncart.stats.block_loads) : 0,
+            (unsigned int)TICK_TO_MICRO(iduncart.stats.block_load_max));
+    pthread_mutex_lock(&flush_lock);
+    mon_out("ERAM write-back: %lu background flushes, %lu at sync points, %.1f pages per flush\n",
+            (unsigned long)iduncart.stats.flushes,
+            (unsigned long)iduncart.stats.sync_flushes,
+            (iduncart.stats.flushes + iduncart.stats.sync_flushes)
+                ? (double)iduncart.stats.flushed_pages / (iduncart.stats.flushes + iduncart.stats.sync_flushes) : 0.0);
+    mon_out("Flush latency: avg %u us, max %u us; sync point stalls avg %u us\n",
+            iduncart.stats.flushes ? (unsigned int)TICK_TO_MICRO(iduncart.stats.flush_ticks / iduncart.stats.flushes) : 0,
+            (unsigned int)TICK_TO_MICRO(iduncart.stats.flush_max),
+            iduncart.stats.sync_flushes ? (unsigned int)TICK_TO_MICRO(iduncart.stats.sync_flush_ticks / iduncart.stats.sync_flushes) : 0);
+    pthread_mutex_unlock(&flush_lock);
+    if (iduncart.cur) {
+        mon_out("Current block: %d, dirty pages: 0x%016"PRIx64"\n", iduncart.cur->block, iduncart.cur->dirty);
+    }
     return 0;
 }
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* IDUNCART snapshot module format:
+
+   type   | name         | description
+   -----------------------------------
+   BYTE   | block        | selected ERAM block ($DEFF)
+   BYTE   | page         | ERAM page register ($DEFE)
+   DWORD  | recv length  | bytes received from the service but not read at $DE00 yet
+   ARRAY  | recv data    | recv length BYTES
+   DWORD  | send length  | bytes stored to $DE00 but not sent yet
+   ARRAY  | send data    | send length BYTES
+   BYTE   | shared       | ERAM was shared with the service through a file
+   DWORD  | blocks       | number of cached ERAM blocks, the current one first
+
+   for each cached block:
+
+   BYTE   | number       | ERAM block number
+   QWORD  | dirty        | pages not written back to the service yet
+   ARRAY  | data         | 16384 BYTES of block data
+
+   On restore the cached blocks are written back to the service whole,
+   as it may have changed them since the snapshot was taken; only the
+   free map in SYSTEM_BLOCK is left to the service. Shared ERAM lives in
+   its file and is not saved.
+ */
+
+static const char snap_module_name[] = "IDUNCART";
+#define SNAP_MAJOR   0
+#define SNAP_MINOR   0
+
+int iduncart_write_snapshot(io_iduncart_t *context, snapshot_t *s)
+{
+    snapshot_module_t *m;
+    uint8_t *pending;
+    size_t head, tail, n, i;
+    uint32_t blocks = 0;
+    int rc = 0;
+
+    /* pages in flight are on the service once this returns */
+    iduncart_flush_wait();
+
+    for (i = 0; i < (size_t)context->cache_size; i++) {
+        if (context->cache[i].block >= 0) {
+            blocks++;
+        }
+    }
+
+    /* the reader thread only appends beyond `head` */
+    head = atomic_load_explicit(&recv_head, memory_order_acquire);
+    tail = atomic_load_explicit(&recv_tail, memory_order_relaxed);
+    n = head - tail;
+    pending = lib_malloc(RECV_RING_SIZE);
+    for (i = 0; i < n; i++) {
+        pending[i] = recvRing[(tail + i) & RECV_RING_MASK];
+    }
+
+    m = snapshot_module_create(s, snap_module_name, SNAP_MAJOR, SNAP_MINOR);
+    if (m == NULL) {
+        lib_free(pending);
+        return -1;
+    }
+
+    if (0
+        || (SMW_B(m, context->m_block) < 0)
+        || (SMW_B(m, context->m_page) < 0)
+        || (SMW_DW(m, (uint32_t)n) < 0)
+        || (SMW_BA(m, pending, (unsigned int)n) < 0)
+        || (SMW_DW(m, (uint32_t)send_len) < 0)
+        || (SMW_BA(m, sendBuf, (unsigned int)send_len) < 0)
+        || (SMW_B(m, (uint8_t)(eram_shm != NULL)) < 0)
+        || (SMW_DW(m, blocks) < 0)) {
+        rc = -1;
+    }
+    lib_free(pending);
+
+    for (i = 0; rc == 0 && i <= (size_t)context->cache_size; i++) {
+        /* the current block goes first, then the others */
+        iduncart_block_t *blk = (i == 0) ? context->cur : &context->cache[i - 1];
+
+        if (blk == NULL || blk->block < 0 || (i > 0 && blk == context->cur)) {
+            continue;
+        }
+        if (0
+            || (SMW_B(m, (uint8_t)blk->block) < 0)
+            || (SMW_QW(m, blk->dirty) < 0)
+            || (SMW_BA(m, blk->data, ERAM_BLOCK_SIZE) < 0)) {
+            rc = -1;
+        }
+    }
+
+    if (rc < 0) {
+        snapshot_module_close(m);
+        return -1;
+    }
+    return snapshot_module_close(m);
+}
+
+/* The live connection is dropped and a new one made, which resyncs with
+   the service once it is taken over; see iduncart_snapshot_resync(). */
+int iduncart_read_snapshot(io_iduncart_t *context, snapshot_t *s)
+{
+    uint8_t vmajor, vminor;
+    snapshot_module_t *m;
+    vice_network_socket_address_t *ad;
+    uint8_t block, page, shared;
+    uint32_t recv_len, sent_len, blocks, i;
+    iduncart_block_t *blk;
+    int rc = -1;
+
+    m = snapshot_module_open(s, snap_module_name, &vmajor, &vminor);
+    if (m == NULL) {
+        return -1;
+    }
+
+    /* Do not accept versions higher than current */
+    if (snapshot_version_is_bigger(vmajor, vminor, SNAP_MAJOR, SNAP_MINOR)) {
+        snapshot_set_error(SNAPSHOT_MODULE_HIGHER_VERSION);
+        snapshot_module_close(m);
+        return -1;
+    }
+
+    /* the threads touch the ring and the cache, so stop them first */
+    trace_recv_seen = 0;
+    iduncart_disconnect();
+    iduncart_connect_cancel();
+    atomic_store(&connect_event, 0);
+    atomic_store(&recv_lost, 0);
+    iduncart.svc_block = -1;
+    resync_pending = 0;
+    resync_load = 0;
+    send_len = 0;
+    send_at_boundary = 1;
+    eram_flush_deferred = 0;
+    atomic_store(&recv_head, 0);
+    atomic_store(&recv_tail, 0);
+
+    if (0
+        || (SMR_B(m, &block) < 0)
+        || (SMR_B(m, &page) < 0)
+        || (SMR_DW(m, &recv_len) < 0)
+        || (recv_len > RECV_RING_SIZE)
+        || (SMR_BA(m, recvRing, recv_len) < 0)
+        || (SMR_DW(m, &sent_len) < 0)
+        || (sent_len > SEND_BUF_SIZE)
+        || (SMR_BA(m, sendBuf, sent_len) < 0)
+        || (SMR_B(m, &shared) < 0)
+        || (SMR_DW(m, &blocks) < 0)
+        || (blocks > ERAM_BLOCKS)) {
+        goto fail;
+    }
+    atomic_store(&recv_head, (size_t)recv_len);
+    send_len = sent_len;
+    context->m_block = block;
+    context->m_page = page;
+
+    if (eram_shm) {
+        /* pages the service has not seen go straight into the shared file */
+        for (i = 0; i < blocks; i++) {
+            uint64_t dirty;
+            int p;
+
+            if (0
+                || (SMR_B(m, &block) < 0)
+                || (SMR_QW(m, &dirty) < 0)
+                || (SMR_BA(m, cache_scratch, ERAM_BLOCK_SIZE) < 0)) {
+                goto fail;
+            }
+            for (p = 0; p < PAGES_PER_BLOCK; p++) {
+                if (dirty & ((uint64_t)1 << p)) {
+                    memcpy(&eram_shm[block * ERAM_BLOCK_SIZE + p * 256], &cache_scratch[p * 256], 256);
+                }
+            }
+        }
+        iduncart_cache_select(context->m_block);
+    } else {
+        /* one spare slot for the selected block in case it was not saved */
+        iduncart_cache_alloc((int)blocks < context->cache_blocks ? context->cache_blocks : (int)blocks + 1);
+        for (i = 0; i < blocks; i++) {
+            blk = &context->cache[i];
+            if (0
+                || (SMR_B(m, &block) < 0)
+                || (SMR_QW(m, &blk->dirty) < 0)
+                || (SMR_BA(m, blk->data, ERAM_BLOCK_SIZE) < 0)) {
+                goto fail;
+            }
+            blk->block = block;
+            blk->loaded = 1;
+            blk->last_used = blocks - i;
+            if (block != SYSTEM_BLOCK) {
+                blk->dirty = ~(uint64_t)0;
+            }
+        }
+        context->lru_clock = blocks + 1;
+
+        blk = iduncart_cache_lookup(context->m_block);
+        if (blk == NULL) {
+            blk = iduncart_cache_victim();
+            blk->block = context->m_block;
+            blk->dirty = 0;
+            blk->loaded = 0;
+            resync_load = 1;
+        }
+        blk->last_used = ++context->lru_clock;
+        context->cur = blk;
+        context->block_data = blk->data;
+    }
+    rc = 0;
+    context->stats.restores++;
+
+fail:
+    snapshot_module_close(m);
+
+    if (replaying) {
+        context->state = IDUN_STATE_READY;
+        return rc;
+    }
+    ad = context->host ? vice_network_address_generate(context->host, 0) : NULL;
+    if (ad) {
+        vice_network_address_close(ad);
+        resync_pending = (rc == 0);
+        context->state = IDUN_STATE_CONNECTING;
+        iduncart_connect_start(0);
+    } else {
+        context->state = IDUN_STATE_DEGRADED;
+    }
+    return rc;
+}
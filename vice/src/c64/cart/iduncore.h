@@ -32,25 +32,89 @@
 #include "types.h"
 #include "vicesocket.h"
 
+/* Traffic counters, shown by the monitor `io` command */
+typedef struct iduncart_stats_s {
+    uint64_t bytes_buffered;    /* total bytes moved from the socket into the ring */
+    uint64_t recv_calls;        /* receive syscalls made by the reader thread */
+    uint64_t polls_avoided;     /* $DE01 polls on an empty ring, formerly a select() each */
+    uint32_t high_water;        /* maximum ring fill level seen */
+    uint64_t stores;            /* 6502 stores to $DE00 */
+    uint64_t bytes_sent;        /* staged bytes actually sent */
+    uint64_t send_calls;        /* send syscalls for staged output */
+    uint64_t send_frames;       /* frames in which the 6502 stored to $DE00 */
+    uint64_t cache_hits;        /* block switches served from the ERAM cache */
+    uint64_t cache_misses;      /* block switches that fetched the block */
+    uint64_t cache_evictions;   /* cached blocks dropped to make room */
+    uint64_t reselects;         /* block loads needed only to write back pages */
+    uint64_t block_loads;       /* ERAM block transfers from the service */
+    uint64_t block_load_ticks;  /* total time spent in them */
+    uint32_t block_load_max;    /* slowest one, in ticks */
+    uint64_t flushes;           /* dirty page sets sent by the flush thread */
+    uint64_t sync_flushes;      /* write-backs done at a sync point */
+    uint64_t flushed_pages;     /* pages written back either way */
+    uint64_t flush_ticks;       /* time from hand-off to sent, summed */
+    uint32_t flush_max;         /* slowest background flush, in ticks */
+    uint64_t sync_flush_ticks;  /* time the emulation thread spent in sync write-backs */
+    uint64_t connects;          /* connections established */
+    uint64_t disconnects;       /* connections lost while in use */
+    uint64_t connect_failures;  /* connect attempts that failed */
+    uint64_t connect_ticks;     /* time from attempt to SYSTEM_BLOCK loaded, summed */
+    uint32_t connect_max;       /* slowest successful connect, in ticks */
+    uint64_t stores_dropped;    /* $DE00 stores while no service was connected */
+    uint64_t restores;          /* snapshots restored */
+    uint64_t restored_pages;    /* dirty pages from snapshots written back to the service */
+} iduncart_stats_t;
+
+/* Connection state. Connecting runs in the background; until the service
+   is ready, $DE00/$DE01 read as empty and stores to $DE00 are dropped. */
+enum {
+    IDUN_STATE_CONNECTING = 0,  /* first attempt in progress */
+    IDUN_STATE_READY,           /* connected and SYSTEM_BLOCK loaded */
+    IDUN_STATE_DEGRADED         /* no service; retrying with backoff */
+};
+
+/* One cached 16K ERAM block */
+typedef struct iduncart_block_s {
+    int block;                  /* ERAM block number, -1 if the slot is unused */
+    uint64_t dirty;             /* one bit per page stored to by the 6502 */
+    int loaded;                 /* data came from the service or a snapshot */
+    unsigned int last_used;     /* LRU stamp */
+    uint8_t *data;
+} iduncart_block_t;
+
 typedef struct io_iduncart_s {
-    const char *host;
+    char *host;
     vice_network_socket_t *socket;
-    uint8_t *pfirst, *plast;
     uint8_t m_page, m_block;
-    uint32_t dirty0, dirty1;
-    uint8_t *block_data;
+    uint8_t *block_data;        /* data of the current block */
+    iduncart_block_t *cur;      /* cache slot of the current block */
+    iduncart_block_t *cache;
+    int cache_size;
+    int cache_blocks;           /* configured cache size (IDUNERAMCacheBlocks) */
+    unsigned int lru_clock;
+    int svc_block;              /* block the service applies page updates to */
+    int eram_bulk;              /* service streams whole blocks on request */
+    int state;                  /* IDUN_STATE_* */
+    iduncart_stats_t stats;
 } io_iduncart_t;
 
 extern void iduncart_io_reset(io_iduncart_t *context);
 extern io_iduncart_t *iduncart_init(const char *device);
 extern void iduncart_io_destroy(io_iduncart_t *context);
+extern void iduncart_set_cache_blocks(int blocks);
+extern void iduncart_set_eram_shm(const char *path);
+extern void iduncart_set_replay(const char *path);
 
 extern void iduncart_io_store_data(io_iduncart_t *context, uint8_t data);
 extern uint8_t iduncart_io_read(io_iduncart_t *context, uint16_t addr);
+extern int iduncart_io_idle_read(io_iduncart_t *context, uint16_t addr, uint8_t *value);
 extern uint8_t iduncart_reg_read(io_iduncart_t *context, uint16_t addr);
 extern void iduncart_reg_write(io_iduncart_t *context, uint16_t addr, uint8_t byte);
 extern void iduncart_page_store(uint16_t addr, uint8_t byte);
 extern uint8_t iduncart_page_read(uint16_t addr);
 extern int iduncart_io_dump();
 
+extern int iduncart_write_snapshot(io_iduncart_t *context, snapshot_t *s);
+extern int iduncart_read_snapshot(io_iduncart_t *context, snapshot_t *s);
+
 #endif
@@ -35,6 +35,7 @@
 #include "cmdline.h"
 #include "iduncore.h"
 #include "idunio.h"
+#include "iduntrace.h"
 #include "export.h"
 #include "lib.h"
 #include "machine.h"
@@ -67,12 +68,28 @@ static int idunio_accessed = 0;
 
 static char *idunio_host = NULL;
 
+/* Number of 16K ERAM blocks kept locally */
+static int idunio_eram_cache_blocks = 1;
+
+/* ERAM file shared with a service on the same host, empty if none */
+static char *idunio_eram_shm = NULL;
+
+/* Size of the traffic trace ring in KB, 0 if not tracing */
+static int idunio_trace_size = 0;
+
+/* Where the trace is saved: when this is set and on detach or exit */
+static char *idunio_trace_file = NULL;
+
+/* Trace replayed instead of connecting to a service, empty if none */
+static char *idunio_replay = NULL;
+
 /* ---------------------------------------------------------------------*/
 
 /* Some prototypes are needed */
 static uint8_t idunio_read(uint16_t addr);
 static void idunio_store(uint16_t addr, uint8_t byte);
 static int idunio_dump(void);
+static int idunio_idle_read(uint16_t addr, uint8_t *value);
 
 static io_source_t idunio_device = {
     CARTRIDGE_NAME_IDUNIO,      /* name of the device */
@@ -87,7 +104,8 @@ static io_source_t idunio_device = {
     idunio_dump,                /* device state information dump function */
     CARTRIDGE_IDUNIO,           /* cartridge ID */
     IO_PRIO_NORMAL,             /* normal priority, device read needs to be checked for collisions */
-    0                           /* insertion order, gets filled in by the registration function */
+    0,                          /* insertion order, gets filled in by the registration function */
+    IO_MIRROR_NONE              /* NO mirroring */
 };
 
 static io_source_list_t *idunio_list_item = NULL;
@@ -99,6 +117,13 @@ static export_resource_t export_res = {
 /* idunio context */
 static io_iduncart_t *idunio_context = NULL;
 
+static void idunio_trace_save(void)
+{
+    if (idunio_trace_file != NULL && *idunio_trace_file != '\0') {
+        iduntrace_save(idunio_trace_file);
+    }
+}
+
 /* ---------------------------------------------------------------------*/
 
 int idunio_cart_enabled(void)
@@ -115,14 +140,18 @@ static int set_idunio_enabled(int value, void *param)
             return -1;
         }
         idunio_list_item = io_source_register(&idunio_device);
+        /* $DE01 polls can be skipped while nothing arrives */
+        c64io_idle_read_register(&idunio_device, idunio_idle_read);
         idunio_context = iduncart_init(idunio_host);
         idunio_enabled = 1;
     } else if (idunio_enabled && !val) {
         if (idunio_list_item != NULL) {
             export_remove(&export_res);
+            c64io_idle_read_unregister(&idunio_device);
             io_source_unregister(idunio_list_item);
             idunio_list_item = NULL;
             if (idunio_context) {
+                idunio_trace_save();
                 iduncart_io_destroy(idunio_context);
                 idunio_context = NULL;
             }
@@ -162,13 +191,77 @@ static int set_idunio_host(const char *name, void *param)
 
     if (name != NULL && *name != '\0') {
         util_string_set(&idunio_host, name);
-        if (idunio_enabled) {
-            idunio_reset();
+        if (idunio_context) {
+            iduncart_io_destroy(idunio_context);
+            idunio_context = iduncart_init(idunio_host);
         }
     }
     return 0;
 }
 
+static int set_idunio_eram_shm(const char *name, void *param)
+{
+    if (idunio_eram_shm != NULL && name != NULL && strcmp(name, idunio_eram_shm) == 0) {
+        return 0;
+    }
+
+    util_string_set(&idunio_eram_shm, name ? name : "");
+    iduncart_set_eram_shm(idunio_eram_shm);
+    if (idunio_context) {
+        iduncart_io_destroy(idunio_context);
+        idunio_context = iduncart_init(idunio_host);
+    }
+    return 0;
+}
+
+static int set_idunio_replay(const char *name, void *param)
+{
+    if (idunio_replay != NULL && name != NULL && strcmp(name, idunio_replay) == 0) {
+        return 0;
+    }
+
+    util_string_set(&idunio_replay, name ? name : "");
+    iduncart_set_replay(idunio_replay);
+    if (idunio_context) {
+        iduncart_io_destroy(idunio_context);
+        idunio_context = iduncart_init(idunio_host);
+    }
+    return 0;
+}
+
+static int set_idunio_trace_size(int value, void *param)
+{
+    if (value < 0 || value > IDUN_TRACE_SIZE_MAX) {
+        return -1;
+    }
+
+    idunio_trace_size = value;
+    iduntrace_set_size(value);
+    return 0;
+}
+
+/* Setting the file saves the trace right away, so it can be taken on
+   demand, e.g. with the monitor's `resourceset` */
+static int set_idunio_trace_file(const char *name, void *param)
+{
+    util_string_set(&idunio_trace_file, name ? name : "");
+    if (idunio_context) {
+        idunio_trace_save();
+    }
+    return 0;
+}
+
+static int set_idunio_eram_cache_blocks(int value, void *param)
+{
+    if (value < 1 || value > IDUN_ERAM_CACHE_MAX) {
+        return -1;
+    }
+
+    idunio_eram_cache_blocks = value;
+    iduncart_set_cache_blocks(value);
+    return 0;
+}
+
 /* ---------------------------------------------------------------------*/
 static int idunio_dump(void)
 {
@@ -189,6 +282,14 @@ static uint8_t idunio_read(uint16_t addr)
     }
 }
 
+static int idunio_idle_read(uint16_t addr, uint8_t *value)
+{
+    if (addr > 0x02) {
+        return -1;
+    }
+    return iduncart_io_idle_read(idunio_context, addr, value);
+}
+
 static void idunio_store(uint16_t addr, uint8_t byte)
 {
     if (addr == 0x00) {
@@ -204,11 +305,21 @@ static void idunio_store(uint16_t addr, uint8_t byte)
 static resource_int_t resources_int[] = {
     { "IDUNIO", 0, RES_EVENT_STRICT, (resource_value_t)0,
       &idunio_enabled, set_idunio_enabled, NULL },
+    { "IDUNERAMCacheBlocks", 1, RES_EVENT_NO, NULL,
+      &idunio_eram_cache_blocks, set_idunio_eram_cache_blocks, NULL },
+    { "IDUNTraceSize", 0, RES_EVENT_NO, NULL,
+      &idunio_trace_size, set_idunio_trace_size, NULL },
     RESOURCE_INT_LIST_END
 };
 static const resource_string_t resources_string[] = {
     { "IDUNHOST", "localhost:25232", RES_EVENT_NO, NULL,
       &idunio_host, set_idunio_host, NULL },
+    { "IDUNERAMShm", "", RES_EVENT_NO, NULL,
+      &idunio_eram_shm, set_idunio_eram_shm, NULL },
+    { "IDUNTraceFile", "", RES_EVENT_NO, NULL,
+      &idunio_trace_file, set_idunio_trace_file, NULL },
+    { "IDUNReplay", "", RES_EVENT_NO, NULL,
+      &idunio_replay, set_idunio_replay, NULL },
     RESOURCE_STRING_LIST_END
 };
 
@@ -223,6 +334,7 @@ int idunio_resources_init(void)
 void idunio_resources_shutdown(void)
 {
     if (idunio_context) {
+        idunio_trace_save();
         iduncart_io_destroy(idunio_context);
         idunio_context = NULL;
     }
@@ -239,7 +351,22 @@ static const cmdline_option_t cmdline_options[] =
       NULL, "Disable the Idun cartridge I/O" },
     { "-idunhost", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "IDUNHOST", NULL,
-      "<host:port>", "Set host/port of Idun cartridge to connect" },
+      "<host:port>", "Set host/port of Idun cartridge to connect, or unix:<path> for a local socket" },
+    { "-iduneramcache", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "IDUNERAMCacheBlocks", NULL,
+      "<blocks>", "Set number of 16K ERAM blocks cached by the emulator (1-64)" },
+    { "-iduneramshm", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "IDUNERAMShm", NULL,
+      "<file>", "Map Idun ERAM from a file shared with a local service instead of transferring blocks" },
+    { "-iduntracesize", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "IDUNTraceSize", NULL,
+      "<KB>", "Record Idun cartridge traffic in a ring of this size (0: off)" },
+    { "-iduntracefile", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "IDUNTraceFile", NULL,
+      "<file>", "Save the Idun traffic trace to this file on exit" },
+    { "-idunreplay", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "IDUNReplay", NULL,
+      "<file>", "Replay a saved Idun traffic trace instead of connecting to a service" },
     CMDLINE_LIST_END
 };
 
@@ -252,12 +379,20 @@ int idunio_cmdline_options_init(void)
 }
 
 /* ---------------------------------------------------------------------*/
+/* The state is all in iduncore, see iduncart_write_snapshot() */
+
 int idunio_snapshot_write_module(snapshot_t *s)
 {
-    return -1;
+    if (idunio_context == NULL) {
+        return -1;
+    }
+    return iduncart_write_snapshot(idunio_context, s);
 }
 
 int idunio_snapshot_read_module(snapshot_t *s)
 {
-    return -1;
+    if (idunio_enable() < 0 || idunio_context == NULL) {
+        return -1;
+    }
+    return iduncart_read_snapshot(idunio_context, s);
 }
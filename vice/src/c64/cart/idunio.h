@@ -32,6 +32,10 @@
 
 #define MAX_IDUN_HOST_NAME 255
 
+#define IDUN_ERAM_CACHE_MAX 64
+
+#define IDUN_TRACE_SIZE_MAX 262144
+
 extern int idunio_cart_enabled(void);
 
 extern void idunio_reset(void);
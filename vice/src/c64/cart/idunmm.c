@@ -79,7 +79,8 @@ static io_source_t idunmm_device = {
     idunmm_dump,                /* device state information dump function */
     CARTRIDGE_IDUNMM,           /* cartridge ID */
     IO_PRIO_NORMAL,             /* normal priority, device read needs to be checked for collisions */
-    0                           /* insertion order, gets filled in by the registration function */
+    0,                          /* insertion order, gets filled in by the registration function */
+    IO_MIRROR_NONE              /* NO mirroring */
 };
 
 static io_source_list_t *idunmm_list_item = NULL;
@@ -193,12 +194,49 @@ int idunmm_cmdline_options_init(void)
 
 /* ---------------------------------------------------------------------*/
 
+/* CARTIDUNMM snapshot module format:
+
+   type  | name | description
+   --------------------------
+   (no data, the ERAM window state is saved with the Idun I/O registers)
+ */
+
+static const char snap_module_name[] = "CARTIDUNMM";
+#define SNAP_MAJOR   0
+#define SNAP_MINOR   0
+
 int idunmm_snapshot_write_module(snapshot_t *s)
 {
-    return -1;
+    snapshot_module_t *m;
+
+    m = snapshot_module_create(s, snap_module_name, SNAP_MAJOR, SNAP_MINOR);
+
+    if (m == NULL) {
+        return -1;
+    }
+
+    return snapshot_module_close(m);
 }
 
 int idunmm_snapshot_read_module(snapshot_t *s)
 {
-    return -1;
+    uint8_t vmajor, vminor;
+    snapshot_module_t *m;
+
+    m = snapshot_module_open(s, snap_module_name, &vmajor, &vminor);
+
+    if (m == NULL) {
+        return -1;
+    }
+
+    /* Do not accept versions higher than current */
+    if (snapshot_version_is_bigger(vmajor, vminor, SNAP_MAJOR, SNAP_MINOR)) {
+        snapshot_set_error(SNAPSHOT_MODULE_HIGHER_VERSION);
+        snapshot_module_close(m);
+        return -1;
+    }
+
+    snapshot_module_close(m);
+
+    return idunmm_enable();
 }
@@ -0,0 +1,373 @@
+/*
+ * iduntrace.c - Idun cartridge traffic trace and replay.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "archdep.h"
+#include "iduntrace.h"
+#include "lib.h"
+#include "log.h"
+#include "maincpu.h"
+#include "monitor.h"
+
+/*
+    The trace is a byte ring of serialized records, in the same layout as
+    the trace file, so saving it is a plain copy. When the ring is full
+    the oldest records are dropped. All events come from the emulation
+    thread, so there is no locking.
+
+    Replay loads a trace and answers the 6502's $DE00/$DE01 reads and the
+    ERAM block loads from it in recorded order, without a service. Writes
+    are compared with the recorded ones to tell when the run diverges.
+*/
+
+static const uint8_t trace_magic[8] = { 'I', 'D', 'U', 'N', 'T', 'R', 'C', 1 };
+
+int iduntrace_active = 0;
+
+static uint8_t *trace_buf = NULL;
+static size_t trace_size = 0;
+static uint64_t trace_start = 0;    /* stream offset of the oldest record */
+static uint64_t trace_end = 0;      /* stream offset after the newest record */
+static uint64_t trace_events = 0;
+static uint64_t trace_overwritten = 0;
+static uint64_t trace_oversize = 0;
+
+static uint8_t *replay_buf = NULL;
+static size_t replay_len = 0;
+static size_t replay_read_cursor[256];
+static size_t replay_write_cursor = 0;
+static size_t replay_eram_cursor = 0;
+static uint8_t replay_available = 0;
+static uint64_t replay_reads = 0;
+static uint64_t replay_exhausted = 0;
+static uint64_t replay_divergences = 0;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void trace_copy_in(uint64_t pos, const uint8_t *src, size_t n)
+{
+    size_t offset = (size_t)(pos % trace_size);
+    size_t first = trace_size - offset;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(&trace_buf[offset], src, first);
+    memcpy(trace_buf, src + first, n - first);
+}
+
+static void trace_copy_out(uint64_t pos, uint8_t *dest, size_t n)
+{
+    size_t offset = (size_t)(pos % trace_size);
+    size_t first = trace_size - offset;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(dest, &trace_buf[offset], first);
+    memcpy(dest + first, trace_buf, n - first);
+}
+
+static uint32_t get_dword(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void trace_header(uint8_t *h, int kind, uint8_t addr, uint8_t value, size_t len)
+{
+    CLOCK clk = maincpu_clk;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        h[i] = (uint8_t)(clk >> (i * 8));
+    }
+    h[8] = (uint8_t)kind;
+    h[9] = addr;
+    h[10] = value;
+    h[11] = 0;
+    for (i = 0; i < 4; i++) {
+        h[12 + i] = (uint8_t)(len >> (i * 8));
+    }
+}
+
+/* Set the ring size; 0 stops tracing and drops what was recorded */
+void iduntrace_set_size(int kbytes)
+{
+    lib_free(trace_buf);
+    trace_buf = NULL;
+    trace_size = 0;
+    trace_start = trace_end = 0;
+    trace_events = trace_overwritten = trace_oversize = 0;
+    iduntrace_active = 0;
+
+    if (kbytes > 0) {
+        trace_size = (size_t)kbytes * 1024;
+        trace_buf = lib_malloc(trace_size);
+        iduntrace_active = 1;
+    }
+}
+
+void iduntrace_data(int kind, uint8_t addr, uint8_t value, const uint8_t *data, size_t len)
+{
+    uint8_t h[IDUNTRACE_HEADER_SIZE];
+    size_t size = IDUNTRACE_HEADER_SIZE + len;
+
+    if (!iduntrace_active) {
+        return;
+    }
+    if (size > trace_size) {
+        trace_oversize++;
+        return;
+    }
+    while (trace_end - trace_start + size > trace_size) {
+        trace_copy_out(trace_start, h, IDUNTRACE_HEADER_SIZE);
+        trace_start += IDUNTRACE_HEADER_SIZE + get_dword(&h[12]);
+        trace_overwritten++;
+    }
+
+    trace_header(h, kind, addr, value, len);
+    trace_copy_in(trace_end, h, IDUNTRACE_HEADER_SIZE);
+    if (len > 0) {
+        trace_copy_in(trace_end + IDUNTRACE_HEADER_SIZE, data, len);
+    }
+    trace_end += size;
+    trace_events++;
+}
+
+void iduntrace_event(int kind, uint8_t addr, uint8_t value)
+{
+    iduntrace_data(kind, addr, value, NULL, 0);
+}
+
+/* Write what the ring holds to `path` */
+int iduntrace_save(const char *path)
+{
+    uint8_t chunk[4096];
+    uint64_t pos;
+    FILE *fd;
+
+    if (!iduntrace_active || path == NULL || *path == 0) {
+        return -1;
+    }
+    fd = fopen(path, MODE_WRITE);
+    if (fd == NULL) {
+        log_error(LOG_DEFAULT, "Cannot write Idun trace to '%s'.", path);
+        return -1;
+    }
+    if (fwrite(trace_magic, sizeof(trace_magic), 1, fd) != 1) {
+        goto fail;
+    }
+    for (pos = trace_start; pos < trace_end; ) {
+        size_t n = (trace_end - pos > sizeof(chunk)) ? sizeof(chunk) : (size_t)(trace_end - pos);
+        trace_copy_out(pos, chunk, n);
+        if (fwrite(chunk, n, 1, fd) != 1) {
+            goto fail;
+        }
+        pos += n;
+    }
+    fclose(fd);
+    log_message(LOG_DEFAULT, "Idun trace written to '%s': %lu bytes.", path,
+                (unsigned long)(trace_end - trace_start));
+    return 0;
+
+fail:
+    fclose(fd);
+    log_error(LOG_DEFAULT, "Cannot write Idun trace to '%s'.", path);
+    return -1;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+void iduntrace_replay_close(void)
+{
+    lib_free(replay_buf);
+    replay_buf = NULL;
+    replay_len = 0;
+}
+
+int iduntrace_replay_open(const char *path)
+{
+    FILE *fd;
+    size_t n, i;
+    uint8_t chunk[4096];
+
+    iduntrace_replay_close();
+
+    fd = fopen(path, MODE_READ);
+    if (fd == NULL) {
+        log_error(LOG_DEFAULT, "Cannot open Idun trace '%s'.", path);
+        return -1;
+    }
+    if (fread(chunk, sizeof(trace_magic), 1, fd) != 1
+        || memcmp(chunk, trace_magic, sizeof(trace_magic)) != 0) {
+        log_error(LOG_DEFAULT, "'%s' is not an Idun trace.", path);
+        fclose(fd);
+        return -1;
+    }
+    while ((n = fread(chunk, 1, sizeof(chunk), fd)) > 0) {
+        replay_buf = lib_realloc(replay_buf, replay_len + n);
+        memcpy(&replay_buf[replay_len], chunk, n);
+        replay_len += n;
+    }
+    fclose(fd);
+
+    for (i = 0; i < 256; i++) {
+        replay_read_cursor[i] = 0;
+    }
+    replay_write_cursor = 0;
+    replay_eram_cursor = 0;
+    replay_available = 0;
+    replay_reads = replay_exhausted = replay_divergences = 0;
+
+    log_message(LOG_DEFAULT, "Idun replaying '%s': %lu bytes.", path, (unsigned long)replay_len);
+    return 0;
+}
+
+/* Find the next record of `kind`, for register or block `addr` unless it
+   is negative, from `*cursor` on and move the cursor past it. Returns the
+   offset of the record, or -1. */
+static long replay_next(size_t *cursor, int kind, int addr)
+{
+    size_t pos = *cursor;
+
+    while (pos + IDUNTRACE_HEADER_SIZE <= replay_len) {
+        const uint8_t *h = &replay_buf[pos];
+        size_t next = pos + IDUNTRACE_HEADER_SIZE + get_dword(&h[12]);
+
+        if (next > replay_len) {
+            break;
+        }
+        if (h[8] == kind && (addr < 0 || h[9] == addr)) {
+            *cursor = next;
+            return (long)pos;
+        }
+        pos = next;
+    }
+    *cursor = replay_len;
+    return -1;
+}
+
+/* $DE01 is only recorded when it changed. A change is served once the
+   6502 has consumed every $DE00 read and register write recorded before
+   it, so data never shows up before the requests that asked for it. */
+static int replay_read_available(uint8_t *value)
+{
+    size_t cursor = replay_read_cursor[0];
+    long limit = replay_next(&cursor, IDUNTRACE_READ, 0x00);
+    long pos;
+
+    if (limit < 0) {
+        return -1;
+    }
+    cursor = replay_write_cursor;
+    pos = replay_next(&cursor, IDUNTRACE_WRITE, -1);
+    if (pos >= 0 && pos < limit) {
+        limit = pos;
+    }
+    for (;;) {
+        cursor = replay_read_cursor[0x01];
+        pos = replay_next(&cursor, IDUNTRACE_READ, 0x01);
+        if (pos < 0 || pos > limit) {
+            break;
+        }
+        replay_available = replay_buf[pos + 10];
+        replay_read_cursor[0x01] = cursor;
+    }
+    *value = replay_available;
+    replay_reads++;
+    return 0;
+}
+
+int iduntrace_replay_read(uint8_t addr, uint8_t *value)
+{
+    long pos;
+
+    if (addr == 0x01) {
+        return replay_read_available(value);
+    }
+    pos = replay_next(&replay_read_cursor[addr], IDUNTRACE_READ, addr);
+
+    if (pos < 0) {
+        replay_exhausted++;
+        return -1;
+    }
+    *value = replay_buf[pos + 10];
+    replay_reads++;
+    return 0;
+}
+
+void iduntrace_replay_write(uint8_t addr, uint8_t value)
+{
+    long pos = replay_next(&replay_write_cursor, IDUNTRACE_WRITE, -1);
+
+    if (pos < 0 || replay_buf[pos + 9] != addr || replay_buf[pos + 10] != value) {
+        replay_divergences++;
+    }
+}
+
+/* Serve an ERAM block load. A load of another block than recorded next
+   counts as divergence; the next recorded load of `block` is used then. */
+int iduntrace_replay_eram(uint8_t block, uint8_t *dest, size_t len)
+{
+    size_t cursor = replay_eram_cursor;
+    long pos = replay_next(&cursor, IDUNTRACE_ERAM_LOAD, -1);
+    size_t n;
+
+    if (pos >= 0 && replay_buf[pos + 9] == block) {
+        replay_eram_cursor = cursor;
+    } else {
+        replay_divergences++;
+        pos = replay_next(&replay_eram_cursor, IDUNTRACE_ERAM_LOAD, block);
+        if (pos < 0) {
+            replay_exhausted++;
+            return -1;
+        }
+    }
+    n = get_dword(&replay_buf[pos + 12]);
+    memcpy(dest, &replay_buf[pos + IDUNTRACE_HEADER_SIZE], n < len ? n : len);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+void iduntrace_dump(void)
+{
+    if (iduntrace_active) {
+        mon_out("Trace: %luK ring, %lu events, %lu bytes held, %lu overwritten, %lu too large\n",
+                (unsigned long)(trace_size / 1024),
+                (unsigned long)trace_events,
+                (unsigned long)(trace_end - trace_start),
+                (unsigned long)trace_overwritten,
+                (unsigned long)trace_oversize);
+    }
+    if (replay_buf) {
+        mon_out("Replay: %lu reads served, %lu past the end of the trace, %lu divergences\n",
+                (unsigned long)replay_reads,
+                (unsigned long)replay_exhausted,
+                (unsigned long)replay_divergences);
+    }
+}
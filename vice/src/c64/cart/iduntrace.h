@@ -0,0 +1,76 @@
+/*
+ * iduntrace.h - Idun cartridge traffic trace and replay.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_IDUNTRACE_H
+#define VICE_IDUNTRACE_H
+
+#include <stddef.h>
+#include "types.h"
+
+/* Trace file format, all numbers little endian:
+
+   "IDUNTRC" followed by a version BYTE (1), then records of
+
+   type   | name    | description
+   -------------------------------
+   QWORD  | clock   | main CPU clock of the event
+   BYTE   | kind    | IDUNTRACE_*
+   BYTE   | addr    | register ($DExx low byte) or ERAM block
+   BYTE   | value   | byte read or written, or ERAM command
+   BYTE   | -       | reserved, 0
+   DWORD  | length  | number of payload bytes that follow
+   ARRAY  | payload | length BYTES
+ */
+enum {
+    IDUNTRACE_READ = 1,         /* 6502 read of $DE00, or $DE01 when it changed */
+    IDUNTRACE_WRITE,            /* 6502 write to a $DE00 register */
+    IDUNTRACE_SEND,             /* $DE00 output sent to the service */
+    IDUNTRACE_RECV,             /* service data that became readable at $DE00 */
+    IDUNTRACE_ERAM_LOAD,        /* ERAM block received, payload is the 16K block */
+    IDUNTRACE_ERAM_UPDATE,      /* dirty pages written back, payload is the QWORD page map */
+    IDUNTRACE_CONNECT,          /* connection to the service taken over */
+    IDUNTRACE_DISCONNECT        /* connection to the service lost */
+};
+
+#define IDUNTRACE_HEADER_SIZE 16
+
+/* Non-zero while a trace ring is allocated; checked before every event */
+extern int iduntrace_active;
+
+#define IDUNTRACE_EVENT(_kind, _addr, _value) \
+    do { if (iduntrace_active) { iduntrace_event(_kind, _addr, _value); } } while (0)
+
+extern void iduntrace_set_size(int kbytes);
+extern void iduntrace_event(int kind, uint8_t addr, uint8_t value);
+extern void iduntrace_data(int kind, uint8_t addr, uint8_t value, const uint8_t *data, size_t len);
+extern int iduntrace_save(const char *path);
+
+extern int iduntrace_replay_open(const char *path);
+extern void iduntrace_replay_close(void);
+extern int iduntrace_replay_read(uint8_t addr, uint8_t *value);
+extern void iduntrace_replay_write(uint8_t addr, uint8_t value);
+extern int iduntrace_replay_eram(uint8_t block, uint8_t *dest, size_t len);
+
+extern void iduntrace_dump(void);
+
+#endif
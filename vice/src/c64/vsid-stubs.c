@@ -953,6 +953,10 @@ void drive_cpu_execute_all(CLOCK clk_value)
 {
 }
 
+void drive_cpu_park_all(void)
+{
+}
+
 int drive_num_leds(unsigned int dnr)
 {
     return 1;
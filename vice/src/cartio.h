@@ -82,6 +82,7 @@ void c64io_de00_store(uint16_t addr, uint8_t value);
 uint8_t c64io_df00_read(uint16_t addr);
 uint8_t c64io_df00_peek(uint16_t addr);
 void c64io_df00_store(uint16_t addr, uint8_t value);
+int c64io_idle_read(uint16_t addr, uint8_t *value);
 
 uint8_t vic20io0_read(uint16_t addr);
 uint8_t vic20io0_peek(uint16_t addr);
@@ -280,6 +281,9 @@ typedef struct io_source_detach_s {
 io_source_list_t *io_source_register(io_source_t *device);
 void io_source_unregister(io_source_list_t *device);
 
+void c64io_idle_read_register(io_source_t *device, int (*idle_read)(uint16_t address, uint8_t *value));
+void c64io_idle_read_unregister(io_source_t *device);
+
 void cartio_shutdown(void);
 
 void c64io_vicii_init(void);
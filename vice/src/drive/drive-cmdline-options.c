@@ -55,6 +55,15 @@ static const cmdline_option_t cmdline_options[] =
     { "-drivesoundvolume", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "DriveSoundEmulationVolume", NULL,
       "<Volume>", "Set volume for disk drive sound emulation (0-4000)" },
+    { "-drivethreads", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DriveThreads", (void *)1,
+      NULL, "Run 1541 drive emulation on worker threads" },
+    { "+drivethreads", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DriveThreads", (void *)0,
+      NULL, "Run drive emulation on the main thread" },
+    { "-drivethreadslice", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "DriveThreadSlice", NULL,
+      "<cycles>", "Hand main CPU cycles to the drive threads in slices of this size (100-100000)" },
     CMDLINE_LIST_END
 };
 
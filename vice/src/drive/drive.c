@@ -56,6 +56,7 @@
 #include "drivecpu65c02.h"
 #include "driveimage.h"
 #include "drivesync.h"
+#include "drivethread.h"
 #include "driverom.h"
 #include "drivetypes.h"
 #include "gcr.h"
@@ -174,6 +175,7 @@ int drive_init(void)
     drive_image_init();
 
     drive_log = log_open("Drive");
+    drivethread_init();
 
     for (unit = 0; unit < NUM_DISK_UNITS; unit++) {
         diskunit_context_t *diskunit =  diskunit_context[unit];
@@ -301,6 +303,8 @@ void drive_shutdown(void)
         return;
     }
 
+    drivethread_shutdown();
+
     for (unr = 0; unr < NUM_DISK_UNITS; unr++) {
         diskunit_context_t *unit = diskunit_context[unr];
 
@@ -410,6 +414,8 @@ int drive_set_disk_drive_type(unsigned int type, struct diskunit_context_s *drv)
         return -1;
     }
 
+    drivethread_park_all();
+
     drive0 = drv->drives[0];
     drive1 = drv->drives[1];
 
@@ -490,6 +496,8 @@ int drive_enable(diskunit_context_t *drv)
         return -1;
     }
 
+    drivethread_park_all();
+
     DBG(("drive_enable unit: %d", 8 + drv->mynumber));
     resources_get_int_sprintf("Drive%uTrueEmulation", &drive_true_emulation, 8 + drv->mynumber);
 
@@ -515,9 +523,9 @@ int drive_enable(diskunit_context_t *drv)
     if (drv->type == DRIVE_TYPE_2000 ||
         drv->type == DRIVE_TYPE_4000 ||
         drv->type == DRIVE_TYPE_CMDHD) {
-        drivecpu65c02_wake_up(drv);
+        drivecpu65c02_wake_up(drv, maincpu_clk);
     } else {
-        drivecpu_wake_up(drv);
+        drivecpu_wake_up(drv, maincpu_clk);
     }
 
     /* Make sure the UI is updated.  */
@@ -531,6 +539,8 @@ void drive_disable(diskunit_context_t *drv)
     int drive_true_emulation = 0;
     unsigned int drive;
 
+    drivethread_park_all();
+
     /* This must come first, because this might be called before the true
        drive initialization.  */
     drv->enable = 0;
@@ -600,6 +610,8 @@ void drive_cpu_trigger_reset(unsigned int dnr)
 void drive_reset(void)
 {
     unsigned int dnr;
+
+    drivethread_park_all();
     for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
         drive_cpu_trigger_reset(dnr);
     }
@@ -984,6 +996,8 @@ void drive_cpu_execute_one(diskunit_context_t *drv, CLOCK clk_value)
     if (drv->type == DRIVE_TYPE_2000 || drv->type == DRIVE_TYPE_4000 ||
         drv->type == DRIVE_TYPE_CMDHD) {
         drivecpu65c02_execute(drv, clk_value);
+    } else if (drivethread_active(drv)) {
+        drivethread_sync(drv, clk_value);
     } else {
         drivecpu_execute(drv, clk_value);
     }
@@ -1002,6 +1016,12 @@ void drive_cpu_execute_all(CLOCK clk_value)
     }
 }
 
+/* Wait until no drive worker thread is running, see drivethread.c */
+void drive_cpu_park_all(void)
+{
+    drivethread_park_all();
+}
+
 void drive_cpu_set_overflow(diskunit_context_t *drv)
 {
     if (drv->type == DRIVE_TYPE_2000 || drv->type == DRIVE_TYPE_4000 ||
@@ -1017,6 +1037,9 @@ void drive_vsync_hook(void)
 {
     unsigned int dnr;
 
+    drivethread_park_all();
+    drivethread_update();
+
     drive_update_ui_status();
 
     for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
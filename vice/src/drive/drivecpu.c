@@ -40,6 +40,7 @@
 #include "drivecpu.h"
 #include "drive-check.h"
 #include "drivemem.h"
+#include "drivethread.h"
 #include "drivetypes.h"
 #include "interrupt.h"
 #include "lib.h"
@@ -252,14 +253,16 @@ void drivecpu_init(diskunit_context_t *drv, int type)
     drivecpu_reset(drv);
 }
 
-inline void drivecpu_wake_up(diskunit_context_t *drv)
+inline void drivecpu_wake_up(diskunit_context_t *drv, CLOCK clk_value)
 {
+    /* clk_value is the main CPU clock the drive is woken up at. On a drive
+       thread maincpu_clk is changed by the main CPU and must not be read. */
     /* FIXME: this value could break some programs, or be way too high for
        others.  Maybe we should put it into a user-definable resource.  */
-    if (maincpu_clk - drv->cpu->last_clk > 0xffffff
+    if (clk_value - drv->cpu->last_clk > 0xffffff
         && *(drv->clk_ptr) > 934639) {
         log_message(drv->log, "Skipping cycles.");
-        drv->cpu->last_clk = maincpu_clk;
+        drv->cpu->last_clk = clk_value;
     }
 }
 
@@ -371,7 +374,7 @@ void drivecpu_execute(diskunit_context_t *drv, CLOCK clk_value)
 
     cpu = drv->cpu;
 
-    drivecpu_wake_up(drv);
+    drivecpu_wake_up(drv, clk_value);
 
     /* Calculate number of main CPU clocks to emulate */
     if (clk_value > cpu->last_clk) {
@@ -460,6 +463,18 @@ static void drivecpu_set_bank_base(void *context)
 
 /* Inlining this fuction makes no sense and would only bloat the code.  */
 static void drivecpu_jam(diskunit_context_t *drv)
+{
+    if (drivethread_is_worker()) {
+        /* The JAM action may need the UI or the monitor, so it is left to
+           the main thread when it next syncs this unit.  */
+        drivethread_defer_jam(drv);
+        CLK++;
+        return;
+    }
+    drivecpu_handle_jam(drv);
+}
+
+void drivecpu_handle_jam(diskunit_context_t *drv)
 {
     unsigned int tmp;
     char *dname = "  Drive";
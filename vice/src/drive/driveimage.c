@@ -33,6 +33,7 @@
 #include "diskimage.h"
 #include "drive.h"
 #include "driveimage.h"
+#include "drivethread.h"
 #include "drivetypes.h"
 #include "gcr.h"
 #include "log.h"
@@ -178,6 +179,8 @@ int drive_image_attach(disk_image_t *image, unsigned int unit, unsigned int drv)
     dnr = unit - 8;
     drive = diskunit_context[dnr]->drives[drv];
 
+    drivethread_park_all();
+
     if (drive_check_image_format(image->type, dnr) < 0) {
         return -1;
     }
@@ -241,6 +244,8 @@ int drive_image_detach(disk_image_t *image, unsigned int unit, unsigned int drv)
     diskunit = diskunit_context[dnr];
     drive = diskunit->drives[drv];
 
+    drivethread_park_all();
+
     if (drive->image != NULL) {
         switch (image->type) {
             case DISK_IMAGE_TYPE_D64:
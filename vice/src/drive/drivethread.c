@@ -0,0 +1,487 @@
+/*
+ * drivethread.c - Run true drive emulation on worker threads.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/*
+    Normally a drive CPU is caught up with the main CPU lazily, on the main
+    thread, whenever the machine touches the bus (drive_cpu_execute_one()).
+    With DriveThreads enabled each drive unit gets a worker thread. Every
+    DriveThreadSlice main CPU cycles an alarm hands the elapsed cycles to the
+    idle workers, so the drives catch up in the background while the main
+    CPU continues.
+
+    The drives never run ahead of the main CPU: they only see bus state the
+    main CPU has already produced, so no rollback is needed. When the main
+    CPU touches the bus it syncs the unit: a queued slice is taken back, a
+    running one is waited for (a stall), and the remaining cycles are run
+    on the main thread like before. A unit is only handed to its worker while
+    that is idle, so the drive state is never touched by two threads at once.
+
+    Workers are parked (idle with nothing queued) at every vsync, before the
+    UI can take the main lock, when the monitor starts, and before drives
+    are reset, reconfigured or get an image attached.
+
+    Only drives that talk to the machine over the plain IEC bus are threaded:
+    the 1540/1541/1541-II without a parallel cable on the C64, C128 and
+    SCPU64. Fast serial, parallel cables and TCBM write straight into the
+    machine's chips. Units with monitor checkpoints, drive sound, or an
+    image that may need the "extend image?" dialog also run on the main
+    thread, as do all units while the main CPU has not handed them a slice.
+*/
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_WORKER_THREADS
+#include <pthread.h>
+#endif
+
+#include "alarm.h"
+#include "archdep.h"
+#include "cmdline.h"
+#include "diskimage.h"
+#include "drive-resources.h"
+#include "drive.h"
+#include "drivecpu.h"
+#include "drivethread.h"
+#include "drivetypes.h"
+#include "interrupt.h"
+#include "log.h"
+#include "machine.h"
+#include "maincpu.h"
+#include "resources.h"
+#include "types.h"
+
+#define DRIVETHREAD_SLICE_MIN     100
+#define DRIVETHREAD_SLICE_MAX     100000
+
+static int drivethread_enabled = 0;
+static int drivethread_slice = 2000;
+
+static int set_drivethread_enabled(int val, void *param)
+{
+    drivethread_enabled = val ? 1 : 0;
+
+    return 0;
+}
+
+static int set_drivethread_slice(int val, void *param)
+{
+    if (val < DRIVETHREAD_SLICE_MIN || val > DRIVETHREAD_SLICE_MAX) {
+        return -1;
+    }
+    drivethread_slice = val;
+
+    return 0;
+}
+
+static const resource_int_t resources_int[] = {
+    { "DriveThreads", 0, RES_EVENT_NO, NULL,
+      &drivethread_enabled, set_drivethread_enabled, NULL },
+    { "DriveThreadSlice", 2000, RES_EVENT_NO, NULL,
+      &drivethread_slice, set_drivethread_slice, NULL },
+    RESOURCE_INT_LIST_END
+};
+
+int drivethread_resources_init(void)
+{
+    return resources_register_int(resources_int);
+}
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef HAVE_WORKER_THREADS
+
+typedef struct drivethread_s {
+    diskunit_context_t *unit;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   /* main -> worker: a slice is queued */
+    pthread_cond_t idle_cond;   /* worker -> main: the slice is done */
+
+    int running;
+    int quit;
+    int pending;                /* a slice up to target is queued */
+    int busy;                   /* the worker is executing a slice */
+    int jam_deferred;           /* the drive JAMmed on the worker */
+    CLOCK target;
+
+    /* statistics, reported when the worker stops */
+    tick_t start_tick;
+    uint64_t busy_ticks;
+    uint64_t stall_ticks;
+    unsigned long slices;
+    unsigned long syncs;
+    unsigned long stalls;
+} drivethread_t;
+
+static drivethread_t drivethreads[NUM_DISK_UNITS];
+static int drivethreads_running = 0;
+
+static pthread_mutex_t bus_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static alarm_t *drivethread_alarm = NULL;
+static log_t drivethread_log = LOG_DEFAULT;
+
+/* Can the unit's next slice run on the worker? Only call while it is idle. */
+static int drivethread_eligible(diskunit_context_t *unit)
+{
+    drive_t *drive = unit->drives[0];
+
+    if (!unit->enable || unit->parallel_cable != DRIVE_PC_NONE) {
+        return 0;
+    }
+    if (unit->cpu->int_status->global_pending_int & IK_MONITOR) {
+        return 0;
+    }
+    if (drive_sound_emulation) {
+        return 0;
+    }
+    if (drive->image != NULL && !drive->image->read_only
+        && drive->extend_image_policy == DRIVE_EXTEND_ASK) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Does the unit talk to the machine over the plain IEC bus only? */
+static int drivethread_supported(diskunit_context_t *unit)
+{
+    switch (machine_class) {
+        case VICE_MACHINE_C64:
+        case VICE_MACHINE_C64SC:
+        case VICE_MACHINE_C128:
+        case VICE_MACHINE_SCPU64:
+            break;
+        default:
+            return 0;
+    }
+    switch (unit->type) {
+        case DRIVE_TYPE_1540:
+        case DRIVE_TYPE_1541:
+        case DRIVE_TYPE_1541II:
+            return unit->enable;
+        default:
+            return 0;
+    }
+}
+
+static void *drivethread_main(void *arg)
+{
+    drivethread_t *t = arg;
+    tick_t start;
+    CLOCK target;
+
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        while (!t->quit && !t->pending) {
+            pthread_cond_wait(&t->work_cond, &t->lock);
+        }
+        if (t->quit) {
+            break;
+        }
+        target = t->target;
+        t->pending = 0;
+        t->busy = 1;
+        pthread_mutex_unlock(&t->lock);
+
+        start = tick_now();
+        drivecpu_execute(t->unit, target);
+
+        pthread_mutex_lock(&t->lock);
+        t->busy_ticks += tick_now_delta(start);
+        t->slices++;
+        t->busy = 0;
+        pthread_cond_broadcast(&t->idle_cond);
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    return NULL;
+}
+
+/* Take back a queued slice and wait for a running one. Call with t->lock. */
+static void drivethread_wait_idle(drivethread_t *t)
+{
+    tick_t start;
+
+    t->pending = 0;
+    if (t->busy) {
+        start = tick_now();
+        t->stalls++;
+        while (t->busy) {
+            pthread_cond_wait(&t->idle_cond, &t->lock);
+        }
+        t->stall_ticks += tick_now_delta(start);
+    }
+}
+
+static void drivethread_start(drivethread_t *t, diskunit_context_t *unit)
+{
+    memset(t, 0, sizeof(drivethread_t));
+    t->unit = unit;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->work_cond, NULL);
+    pthread_cond_init(&t->idle_cond, NULL);
+
+    if (pthread_create(&t->thread, NULL, drivethread_main, t) != 0) {
+        log_error(drivethread_log, "Unit %u: cannot create thread, running on the main thread.",
+                  unit->mynumber + 8);
+        pthread_cond_destroy(&t->idle_cond);
+        pthread_cond_destroy(&t->work_cond);
+        pthread_mutex_destroy(&t->lock);
+        return;
+    }
+    t->start_tick = tick_now();
+    t->running = 1;
+    drivethreads_running++;
+}
+
+static void drivethread_stop(drivethread_t *t)
+{
+    double elapsed;
+
+    pthread_mutex_lock(&t->lock);
+    drivethread_wait_idle(t);
+    t->quit = 1;
+    pthread_cond_signal(&t->work_cond);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+
+    elapsed = (double)tick_now_delta(t->start_tick) / tick_per_second();
+    log_message(drivethread_log,
+                "Unit %u: %.1f%% busy over %.1f s, %lu slices, %lu syncs,"
+                " %lu stalls (%.1f ms stalled).",
+                t->unit->mynumber + 8,
+                elapsed > 0.0 ? 100.0 * t->busy_ticks / tick_per_second() / elapsed : 0.0,
+                elapsed, t->slices, t->syncs, t->stalls,
+                1000.0 * t->stall_ticks / tick_per_second());
+
+    pthread_cond_destroy(&t->idle_cond);
+    pthread_cond_destroy(&t->work_cond);
+    pthread_mutex_destroy(&t->lock);
+    t->running = 0;
+    drivethreads_running--;
+}
+
+/* Hand the cycles up to now to every idle worker */
+static void drivethread_alarm_handler(CLOCK offset, void *data)
+{
+    unsigned int dnr;
+
+    for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
+        drivethread_t *t = &drivethreads[dnr];
+
+        if (!t->running) {
+            continue;
+        }
+        pthread_mutex_lock(&t->lock);
+        if (t->busy || drivethread_eligible(t->unit)) {
+            t->target = maincpu_clk;
+            t->pending = 1;
+            pthread_cond_signal(&t->work_cond);
+        }
+        pthread_mutex_unlock(&t->lock);
+    }
+
+    alarm_set(drivethread_alarm, maincpu_clk + (CLOCK)drivethread_slice);
+}
+
+void drivethread_init(void)
+{
+    drivethread_log = log_open("DriveThread");
+    drivethread_alarm = alarm_new(maincpu_alarm_context, "DriveThread",
+                                  drivethread_alarm_handler, NULL);
+}
+
+void drivethread_update(void)
+{
+    unsigned int dnr;
+    int was_running = drivethreads_running;
+
+    for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
+        drivethread_t *t = &drivethreads[dnr];
+        int want = drivethread_enabled && drivethread_supported(diskunit_context[dnr]);
+
+        if (t->running && !want) {
+            drivethread_stop(t);
+        }
+        if (!t->running && want) {
+            drivethread_start(t, diskunit_context[dnr]);
+        }
+    }
+
+    if (drivethread_alarm == NULL) {
+        return;
+    }
+    if (drivethreads_running && !was_running) {
+        alarm_set(drivethread_alarm, maincpu_clk + (CLOCK)drivethread_slice);
+    } else if (!drivethreads_running && was_running) {
+        alarm_unset(drivethread_alarm);
+    }
+}
+
+void drivethread_shutdown(void)
+{
+    unsigned int dnr;
+
+    for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
+        if (drivethreads[dnr].running) {
+            drivethread_stop(&drivethreads[dnr]);
+        }
+    }
+    if (drivethread_alarm != NULL) {
+        alarm_destroy(drivethread_alarm);
+        drivethread_alarm = NULL;
+    }
+}
+
+int drivethread_active(diskunit_context_t *drv)
+{
+    return drivethreads[drv->mynumber].running;
+}
+
+/* Bring the unit to `clk_value' on the calling (main) thread */
+void drivethread_sync(diskunit_context_t *drv, CLOCK clk_value)
+{
+    drivethread_t *t = &drivethreads[drv->mynumber];
+    int jam;
+
+    pthread_mutex_lock(&t->lock);
+    drivethread_wait_idle(t);
+    t->syncs++;
+    jam = t->jam_deferred;
+    t->jam_deferred = 0;
+    pthread_mutex_unlock(&t->lock);
+
+    if (jam) {
+        drivecpu_handle_jam(drv);
+    }
+    drivecpu_execute(drv, clk_value);
+}
+
+void drivethread_park_all(void)
+{
+    unsigned int dnr;
+
+    if (!drivethreads_running) {
+        return;
+    }
+    for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
+        drivethread_t *t = &drivethreads[dnr];
+
+        if (t->running) {
+            pthread_mutex_lock(&t->lock);
+            drivethread_wait_idle(t);
+            pthread_mutex_unlock(&t->lock);
+        }
+    }
+}
+
+int drivethread_is_worker(void)
+{
+    unsigned int dnr;
+
+    for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
+        if (drivethreads[dnr].running
+            && pthread_equal(drivethreads[dnr].thread, pthread_self())) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void drivethread_defer_jam(diskunit_context_t *drv)
+{
+    drivethread_t *t = &drivethreads[drv->mynumber];
+
+    pthread_mutex_lock(&t->lock);
+    t->jam_deferred = 1;
+    pthread_mutex_unlock(&t->lock);
+}
+
+/* Serializes the drive side updates of the shared IEC bus lines. Any unit
+   may write them, on its worker or on the main thread. */
+void drivethread_bus_lock(void)
+{
+    if (drivethreads_running) {
+        pthread_mutex_lock(&bus_lock);
+    }
+}
+
+void drivethread_bus_unlock(void)
+{
+    if (drivethreads_running) {
+        pthread_mutex_unlock(&bus_lock);
+    }
+}
+
+#else /* HAVE_WORKER_THREADS */
+
+/* Without threads every unit runs on the main thread */
+
+void drivethread_init(void)
+{
+}
+
+void drivethread_update(void)
+{
+}
+
+void drivethread_shutdown(void)
+{
+}
+
+int drivethread_active(diskunit_context_t *drv)
+{
+    return 0;
+}
+
+void drivethread_sync(diskunit_context_t *drv, CLOCK clk_value)
+{
+    drivecpu_execute(drv, clk_value);
+}
+
+void drivethread_park_all(void)
+{
+}
+
+int drivethread_is_worker(void)
+{
+    return 0;
+}
+
+void drivethread_defer_jam(diskunit_context_t *drv)
+{
+}
+
+void drivethread_bus_lock(void)
+{
+}
+
+void drivethread_bus_unlock(void)
+{
+}
+
+#endif /* HAVE_WORKER_THREADS */
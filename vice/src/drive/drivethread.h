@@ -0,0 +1,48 @@
+/*
+ * drivethread.h - Run true drive emulation on worker threads.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_DRIVETHREAD_H
+#define VICE_DRIVETHREAD_H
+
+#include "types.h"
+
+struct diskunit_context_s;
+
+int drivethread_resources_init(void);
+void drivethread_init(void);
+void drivethread_shutdown(void);
+
+/* Start or stop the workers as configured. Only call this while parked. */
+void drivethread_update(void);
+
+int drivethread_active(struct diskunit_context_s *drv);
+void drivethread_sync(struct diskunit_context_s *drv, CLOCK clk_value);
+void drivethread_park_all(void);
+
+int drivethread_is_worker(void);
+void drivethread_defer_jam(struct diskunit_context_s *drv);
+
+void drivethread_bus_lock(void);
+void drivethread_bus_unlock(void);
+
+#endif
@@ -34,6 +34,7 @@
 #include "debug.h"
 #include "drive.h"
 #include "drivesync.h"
+#include "drivethread.h"
 #include "drivetypes.h"
 #include "glue1571.h"
 #include "iecbus.h"
@@ -223,6 +224,9 @@ static void store_prb(via_context_t *via_context, uint8_t byte, uint8_t p_oldpb,
             uint8_t *drive_data, *drive_bus;
             unsigned int unit;
 
+            /* other units may update the bus from their own threads */
+            drivethread_bus_lock();
+
             drive_bus = &(iecbus->drv_bus[via1p->number + 8]);
             drive_data = &(iecbus->drv_data[via1p->number + 8]);
 
@@ -240,6 +244,8 @@ static void store_prb(via_context_t *via_context, uint8_t byte, uint8_t p_oldpb,
                                 | (iecbus->cpu_port >> 7)
                                 | ((iecbus->cpu_bus << 3) & 0x80));
 
+            drivethread_bus_unlock();
+
             DEBUG_IEC_BUS_WRITE(iecbus->drv_port);
         } else {
             iec_drive_write((uint8_t)(~byte), via1p->number);
@@ -51,6 +51,7 @@
 #include "maincpu.h"
 #include "network.h"
 #include "resources.h"
+#include "rewind.h"
 #include "snapshot.h"
 #include "tape.h"
 #include "tapeport.h"
@@ -381,6 +382,8 @@ void event_record(unsigned int type, void *data, unsigned int size)
     if (record_active == 1) {
         event_record_in_list(event_list, type, data, size);
     }
+
+    rewind_event_record(type, data, size);
 }
 
 
@@ -1018,9 +1021,10 @@ int event_record_active(void)
     return record_active;
 }
 
+/* The input of the user is also ignored while the rewind buffer replays */
 int event_playback_active(void)
 {
-    return playback_active;
+    return playback_active || rewind_replay_active();
 }
 
 /*-----------------------------------------------------------------------*/
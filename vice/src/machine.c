@@ -62,8 +62,10 @@
 #include "printer.h"
 #include "profiler.h"
 #include "resources.h"
+#include "rewind.h"
 #include "romset.h"
 #include "screenshot.h"
+#include "snapshot.h"
 #include "sound.h"
 #include "sysfile.h"
 #include "tape.h"
@@ -267,6 +269,8 @@ void machine_reset(void)
 
     event_reset_ack();
 
+    rewind_reset();
+
     /* Give the monitor a chance to break immediately */
     monitor_reset_hook();
 
@@ -368,6 +372,8 @@ void machine_shutdown(void)
     screenshot_at_exit();
     screenshot_shutdown();
 
+    rewind_shutdown();
+
     file_system_detach_disk_shutdown();
 
     machine_specific_shutdown();
@@ -454,6 +460,129 @@ void machine_shutdown(void)
     archdep_shutdown();
 }
 
+/* --------------------------------------------------------- */
+/* Snapshots in memory */
+
+/* Write a snapshot into mem, as a delta against base if base is not NULL */
+int machine_write_snapshot_mem(snapshot_mem_t *mem, snapshot_mem_t *base, int save_roms, int save_disks, int event_mode)
+{
+    int err;
+
+    snapshot_mem_select(mem);
+    err = machine_write_snapshot(SNAPSHOT_MEM_NAME, save_roms, save_disks, event_mode);
+    snapshot_mem_select(NULL);
+
+    if (err == 0 && base != NULL) {
+        err = snapshot_mem_make_delta(mem, base);
+    }
+
+    return err;
+}
+
+int machine_read_snapshot_mem(snapshot_mem_t *mem, int event_mode)
+{
+    int err;
+
+    snapshot_mem_select(mem);
+    err = machine_read_snapshot(SNAPSHOT_MEM_NAME, event_mode);
+    snapshot_mem_select(NULL);
+
+    return err;
+}
+
+/*
+ * -snapshotbench: save and restore the machine in memory once per frame,
+ * full and as a delta against the first snapshot, then log the average
+ * latencies and exit.
+ */
+static int snapshot_bench_rounds = 0;
+static int snapshot_bench_round = 0;
+static snapshot_mem_t *snapshot_bench_base = NULL;
+static snapshot_mem_t *snapshot_bench_full = NULL;
+static snapshot_mem_t *snapshot_bench_delta = NULL;
+static uint64_t snapshot_bench_ticks[4];
+static uint64_t snapshot_bench_delta_bytes;
+
+static void snapshot_bench_vsync(void *unused);
+
+static void snapshot_bench_trap(uint16_t addr, void *unused)
+{
+    tick_t t[5];
+    int err;
+    int i;
+
+    if (snapshot_bench_base == NULL) {
+        snapshot_bench_base = snapshot_mem_new();
+        snapshot_bench_full = snapshot_mem_new();
+        snapshot_bench_delta = snapshot_mem_new();
+        if (machine_write_snapshot_mem(snapshot_bench_base, NULL, 0, 0, 0) < 0) {
+            log_error(LOG_DEFAULT, "Snapshot benchmark: cannot write the base snapshot.");
+            archdep_vice_exit(EXIT_FAILURE);
+        }
+        vsync_on_vsync_do(snapshot_bench_vsync, NULL);
+        return;
+    }
+
+    t[0] = tick_now();
+    err = machine_write_snapshot_mem(snapshot_bench_full, NULL, 0, 0, 0);
+    t[1] = tick_now();
+    err |= machine_read_snapshot_mem(snapshot_bench_full, 0);
+    t[2] = tick_now();
+    err |= machine_write_snapshot_mem(snapshot_bench_delta, snapshot_bench_base, 0, 0, 0);
+    t[3] = tick_now();
+    err |= machine_read_snapshot_mem(snapshot_bench_delta, 0);
+    t[4] = tick_now();
+
+    if (err) {
+        log_error(LOG_DEFAULT, "Snapshot benchmark: snapshot failed in round %d.", snapshot_bench_round);
+        archdep_vice_exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < 4; i++) {
+        snapshot_bench_ticks[i] += (tick_t)(t[i + 1] - t[i]);
+    }
+    snapshot_bench_delta_bytes += snapshot_mem_get_size(snapshot_bench_delta);
+
+    if (++snapshot_bench_round < snapshot_bench_rounds) {
+        vsync_on_vsync_do(snapshot_bench_vsync, NULL);
+        return;
+    }
+
+    log_message(LOG_DEFAULT, "Snapshot benchmark (%s, %d rounds): full %"PRI_SIZE_T" bytes, delta %"PRIu64" bytes",
+                machine_get_name(), snapshot_bench_rounds,
+                snapshot_mem_get_size(snapshot_bench_full),
+                snapshot_bench_delta_bytes / (uint64_t)snapshot_bench_rounds);
+    log_message(LOG_DEFAULT, "Snapshot benchmark: full save %.1f us, restore %.1f us; delta save %.1f us, restore %.1f us",
+                (double)TICK_TO_MICRO(snapshot_bench_ticks[0]) / snapshot_bench_rounds,
+                (double)TICK_TO_MICRO(snapshot_bench_ticks[1]) / snapshot_bench_rounds,
+                (double)TICK_TO_MICRO(snapshot_bench_ticks[2]) / snapshot_bench_rounds,
+                (double)TICK_TO_MICRO(snapshot_bench_ticks[3]) / snapshot_bench_rounds);
+
+    /* the deltas refer to the base, free them first */
+    snapshot_mem_free(snapshot_bench_delta);
+    snapshot_mem_free(snapshot_bench_full);
+    snapshot_mem_free(snapshot_bench_base);
+
+    archdep_vice_exit(EXIT_SUCCESS);
+}
+
+static void snapshot_bench_vsync(void *unused)
+{
+    interrupt_maincpu_trigger_trap(snapshot_bench_trap, NULL);
+}
+
+static int set_snapshot_bench(const char *param, void *extra_param)
+{
+    snapshot_bench_rounds = atoi(param);
+    if (snapshot_bench_rounds <= 0) {
+        return -1;
+    }
+
+    vsync_on_vsync_do(snapshot_bench_vsync, NULL);
+
+    return 0;
+}
+
 /* --------------------------------------------------------- */
 /* Resources & cmdline */
 
@@ -544,6 +673,9 @@ static const cmdline_option_t cmdline_options_c128[] =
     { "-exitscreenshotvicii", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "ExitScreenshotName1", NULL,
       "<Name>", "Set name of screenshot to save when emulator exits." },
+    { "-snapshotbench", CALL_FUNCTION, CMDLINE_ATTRIB_NEED_ARGS,
+      set_snapshot_bench, NULL, NULL, NULL,
+      "<rounds>", "Measure saving and restoring snapshots in memory, then quit." },
     CMDLINE_LIST_END
 };
 
@@ -555,6 +687,9 @@ static const cmdline_option_t cmdline_options[] =
     { "-exitscreenshot", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "ExitScreenshotName", NULL,
       "<Name>", "Set name of screenshot to save when emulator exits." },
+    { "-snapshotbench", CALL_FUNCTION, CMDLINE_ATTRIB_NEED_ARGS,
+      set_snapshot_bench, NULL, NULL, NULL,
+      "<rounds>", "Measure saving and restoring snapshots in memory, then quit." },
     CMDLINE_LIST_END
 };
 
@@ -147,6 +147,11 @@ int machine_write_snapshot(const char *name, int save_roms, int save_disks, int
 /* Read a snapshot.  */
 int machine_read_snapshot(const char *name, int even_mode);
 
+/* Write and read a snapshot in memory, see snapshot_mem_new().  */
+struct snapshot_mem_s;
+int machine_write_snapshot_mem(struct snapshot_mem_s *mem, struct snapshot_mem_s *base, int save_roms, int save_disks, int event_mode);
+int machine_read_snapshot_mem(struct snapshot_mem_s *mem, int event_mode);
+
 /* handle pending interrupts - needed by libsid.a.  */
 void machine_handle_pending_alarms(CLOCK num_write_cycles);
 
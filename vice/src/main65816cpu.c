@@ -131,6 +131,8 @@ int maincpu_rmw_flag = 0;
 CLOCK maincpu_clk = 0L;
 /* if != 0, exit when this many cycles have been executed */
 CLOCK maincpu_clk_limit = 0L;
+/* this core has no idle loop detection */
+CLOCK maincpu_idle_skipped = 0;
 
 /* Information about the last executed opcode.  This is used to know the
    number of write cycles in the last executed opcode and to delay interrupts
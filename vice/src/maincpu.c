@@ -42,6 +42,7 @@
 #include "mainlock.h"
 #include "mem.h"
 #include "monitor.h"
+#include "profiler.h"
 #ifdef C64DTV
 #include "mos6510dtv.h"
 #else
@@ -70,6 +71,8 @@ log_t maincpu_log = LOG_DEFAULT;
  - PAGE_ONE
  - STORE_IND
  - LOAD_IND
+ - IDLE_SKIP_ALLOWED
+ - IDLE_IO_READ
 
 */
 
@@ -317,11 +320,28 @@ static int set_lxa_log_level(int val, void *param)
     return 0;
 }
 
+/* Cycles skipped by the idle loop detector, for the speed metrics.  */
+CLOCK maincpu_idle_skipped = 0;
+
+#ifdef IDLE_SKIP_ALLOWED
+static int idle_skip_enabled = 0;
+
+static int set_idle_skip_enabled(int val, void *param)
+{
+    idle_skip_enabled = val ? 1 : 0;
+    return 0;
+}
+#endif
+
 static const resource_int_t maincpu_resources_int[] = {
     { "LogLevelANE", 0, RES_EVENT_NO, NULL,
       &ane_log_level, set_ane_log_level, NULL },
     { "LogLevelLXA", 0, RES_EVENT_NO, NULL,
       &lxa_log_level, set_lxa_log_level, NULL },
+#ifdef IDLE_SKIP_ALLOWED
+    { "CPUIdleSkip", 0, RES_EVENT_NO, NULL,
+      &idle_skip_enabled, set_idle_skip_enabled, NULL },
+#endif
     RESOURCE_INT_LIST_END
 };
 
@@ -338,6 +358,14 @@ static const cmdline_option_t cmdline_options_maincpu[] =
     { "-lxaloglevel", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "LogLevelLXA", NULL,
       "<Type>", "Set LXA log level: (0: None, 1: Unstable, 2: All)" },
+#ifdef IDLE_SKIP_ALLOWED
+    { "-cpuidleskip", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "CPUIdleSkip", (resource_value_t)1,
+      NULL, "Skip ahead to the next pending event while the CPU waits in a polling loop" },
+    { "+cpuidleskip", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "CPUIdleSkip", (resource_value_t)0,
+      NULL, "Always emulate polling loops cycle by cycle" },
+#endif
     CMDLINE_LIST_END
 };
 
@@ -523,6 +551,508 @@ void maincpu_resync_limits(void)
     }
 }
 
+/* ------------------------------------------------------------------------- */
+
+#ifdef IDLE_SKIP_ALLOWED
+
+/*
+    Idle loop detection.
+
+    Programs often wait for an interrupt in a tight loop like
+
+        loop:   lda $c6
+                beq loop
+
+    Every taken branch passes its target to maincpu_idle_branch(). Once the
+    same target was reached twice in a row, one iteration of the loop is
+    run on a copy of the registers, without touching the machine. If it
+    only reads plain memory (no I/O), only writes values that are already
+    there, and comes back to the target with the same registers, then
+    every further iteration does exactly the same until something else
+    changes the machine. Nothing else can happen before the next pending
+    alarm, so whole iterations are skipped up to it by advancing the clock.
+
+    The iteration length is taken from the 6502 cycle counts and must match
+    what the last real iteration took, which also catches clock stretching
+    the table does not know about. Loops that touch I/O are not skipped,
+    unless the machine defines IDLE_IO_READ and the device confirms that
+    the read changes nothing. A cartridge register polled for a reply from
+    the host is such a case: the reply comes at no particular clock, so
+    the first real read after the skip sees it.
+
+    x64sc does not use this core. Its VIC-II is clocked by the CPU every
+    cycle rather than by alarms, so there is no pending alarm to skip to.
+*/
+
+/* Instructions one iteration may take at most.  */
+#define IDLE_MAX_INSNS  32
+
+/* Iterations to wait before analysing a loop that was rejected again.  */
+#define IDLE_BACKOFF    256
+
+static unsigned int idle_pc = 0x10000;
+static CLOCK idle_clk;
+static int idle_hits;
+static int idle_backoff;
+
+/* Read a byte that is plain memory in the current configuration.  */
+static int idle_read(unsigned int addr, uint8_t *value)
+{
+    uint8_t *base = NULL;
+    int start = 0, limit = 0;
+
+    addr &= 0xffff;
+
+    /* 6510 port */
+    if (addr < 2) {
+        return -1;
+    }
+    /* zero page and stack are RAM in every configuration */
+    if (addr < 0x200) {
+        *value = (*_mem_read_tab_ptr[addr >> 8])((uint16_t)addr);
+        return 0;
+    }
+
+#ifdef IDLE_IO_READ
+    /* I/O registers whose device knows that reading them again changes
+       nothing until the host does */
+    if (IDLE_IO_READ(addr, value) == 0) {
+        return 0;
+    }
+#endif
+
+    mem_mmu_translate(addr, &base, &start, &limit);
+    if (base == NULL || (int)addr < start || (int)addr >= limit) {
+        return -1;
+    }
+    *value = base[addr];
+    return 0;
+}
+
+/* Only accept stores that do not change anything.  */
+static int idle_write(unsigned int addr, uint8_t value)
+{
+    uint8_t old;
+
+    if (idle_read(addr, &old) < 0 || old != value) {
+        return -1;
+    }
+    return 0;
+}
+
+#define IDLE_NZ(val) (p = (uint8_t)((p & ~(P_SIGN | P_ZERO)) | ((val) & P_SIGN) | ((val) ? 0 : P_ZERO)))
+
+#define IDLE_COMPARE(reg)                                           \
+    do {                                                            \
+        p = (uint8_t)(((reg) >= v) ? (p | P_CARRY) : (p & ~P_CARRY)); \
+        IDLE_NZ((uint8_t)((reg) - v));                              \
+    } while (0)
+
+enum {
+    IDLE_IMP, IDLE_IMM, IDLE_ZP, IDLE_ZPX, IDLE_ZPY,
+    IDLE_ABS, IDLE_ABX, IDLE_ABY, IDLE_INX, IDLE_INY
+};
+
+/* Return the length in cycles of one iteration of the loop at `loop_pc', or
+   0 if the loop does anything that could make the next iteration differ.  */
+static CLOCK idle_loop_cycles(unsigned int loop_pc, uint8_t a, uint8_t x,
+                              uint8_t y, uint8_t sp, uint8_t p)
+{
+    const uint8_t a0 = a, x0 = x, y0 = y, sp0 = sp, p0 = p;
+    unsigned int pc = loop_pc;
+    CLOCK cycles = 0;
+    int n;
+
+    for (n = 0; n < IDLE_MAX_INSNS; n++) {
+        uint8_t op, lo, hi, v = 0, tmp;
+        unsigned int ea = 0, base;
+        int mode, len, cost, cross = 0;
+        int branch = 0;
+
+        if (idle_read(pc, &op) < 0 || idle_read(pc + 1, &lo) < 0 || idle_read(pc + 2, &hi) < 0) {
+            return 0;
+        }
+
+        /* addressing mode and base cycle count of the allowed opcodes */
+        if ((op & 0x03) == 0x01) {
+            /* ORA, AND, EOR, STA, LDA, CMP */
+            static const int modes[8] = {
+                IDLE_INX, IDLE_ZP, IDLE_IMM, IDLE_ABS, IDLE_INY, IDLE_ZPX, IDLE_ABY, IDLE_ABX
+            };
+            static const int costs[8] = { 6, 3, 2, 4, 5, 4, 4, 4 };
+
+            if (op == 0x89 || (op >> 5) == 3 || (op >> 5) == 7) {
+                return 0;
+            }
+            mode = modes[(op >> 2) & 7];
+            cost = costs[(op >> 2) & 7];
+        } else {
+            switch (op) {
+                case 0xa2: case 0xa0: case 0xe0: case 0xc0:
+                    mode = IDLE_IMM; cost = 2;
+                    break;
+                case 0xa6: case 0xa4: case 0xe4: case 0xc4: case 0x24:
+                case 0x86: case 0x84:
+                    mode = IDLE_ZP; cost = 3;
+                    break;
+                case 0xb4: case 0x94:
+                    mode = IDLE_ZPX; cost = 4;
+                    break;
+                case 0xb6: case 0x96:
+                    mode = IDLE_ZPY; cost = 4;
+                    break;
+                case 0xae: case 0xac: case 0xec: case 0xcc: case 0x2c:
+                case 0x8e: case 0x8c: case 0x4c:
+                    mode = IDLE_ABS; cost = (op == 0x4c) ? 3 : 4;
+                    break;
+                case 0xbc:
+                    mode = IDLE_ABX; cost = 4;
+                    break;
+                case 0xbe:
+                    mode = IDLE_ABY; cost = 4;
+                    break;
+                case 0x20: case 0x60:
+                    mode = (op == 0x20) ? IDLE_ABS : IDLE_IMP; cost = 6;
+                    break;
+                case 0x48: case 0x08:
+                    mode = IDLE_IMP; cost = 3;
+                    break;
+                case 0x68: case 0x28:
+                    mode = IDLE_IMP; cost = 4;
+                    break;
+                case 0xaa: case 0xa8: case 0x8a: case 0x98: case 0xba: case 0x9a:
+                case 0xe8: case 0xc8: case 0xca: case 0x88:
+                case 0x18: case 0x38: case 0x58: case 0x78: case 0xb8: case 0xd8: case 0xf8:
+                case 0x0a: case 0x4a: case 0x2a: case 0x6a: case 0xea:
+                    mode = IDLE_IMP; cost = 2;
+                    break;
+                case 0x10: case 0x30: case 0x50: case 0x70:
+                case 0x90: case 0xb0: case 0xd0: case 0xf0:
+                    mode = IDLE_IMM; cost = 2; branch = 1;
+                    break;
+                default:
+                    return 0;
+            }
+        }
+
+        /* effective address; indexed modes also check the page of the
+           dummy read the CPU may do */
+        len = 3;
+        switch (mode) {
+            case IDLE_IMP:
+                len = 1;
+                break;
+            case IDLE_IMM:
+                len = 2;
+                break;
+            case IDLE_ZP:
+                ea = lo;
+                len = 2;
+                break;
+            case IDLE_ZPX:
+                ea = (lo + x) & 0xff;
+                len = 2;
+                break;
+            case IDLE_ZPY:
+                ea = (lo + y) & 0xff;
+                len = 2;
+                break;
+            case IDLE_ABS:
+                ea = lo | (hi << 8);
+                break;
+            case IDLE_ABX:
+            case IDLE_ABY:
+                base = lo | (hi << 8);
+                ea = (base + (mode == IDLE_ABX ? x : y)) & 0xffff;
+                cross = ((base ^ ea) & 0xff00) != 0;
+                if (idle_read((base & 0xff00) | (ea & 0xff), &tmp) < 0) {
+                    return 0;
+                }
+                break;
+            case IDLE_INX:
+                if (idle_read((lo + x) & 0xff, &tmp) < 0 || idle_read((lo + x + 1) & 0xff, &v) < 0) {
+                    return 0;
+                }
+                ea = tmp | (v << 8);
+                len = 2;
+                break;
+            case IDLE_INY:
+                if (idle_read(lo, &tmp) < 0 || idle_read((lo + 1) & 0xff, &v) < 0) {
+                    return 0;
+                }
+                base = tmp | (v << 8);
+                ea = (base + y) & 0xffff;
+                cross = ((base ^ ea) & 0xff00) != 0;
+                if (idle_read((base & 0xff00) | (ea & 0xff), &tmp) < 0) {
+                    return 0;
+                }
+                len = 2;
+                break;
+        }
+
+        /* stores and control flow take care of their own operand */
+        if (mode == IDLE_IMM) {
+            v = lo;
+        } else if (mode != IDLE_IMP
+                   && op != 0x85 && op != 0x95 && op != 0x8d && op != 0x9d && op != 0x99
+                   && op != 0x81 && op != 0x91 && op != 0x86 && op != 0x96 && op != 0x8e
+                   && op != 0x84 && op != 0x94 && op != 0x8c && op != 0x4c && op != 0x20) {
+            if (idle_read(ea, &v) < 0) {
+                return 0;
+            }
+            /* page crossing costs a cycle on reads */
+            cost += cross;
+        } else if (op == 0x9d || op == 0x99 || op == 0x91) {
+            /* indexed stores always take the extra cycle */
+            cost++;
+        }
+
+        pc = (pc + len) & 0xffff;
+
+        switch (op) {
+            case 0x01: case 0x05: case 0x09: case 0x0d: case 0x11: case 0x15: case 0x19: case 0x1d:
+                a |= v;
+                IDLE_NZ(a);
+                break;
+            case 0x21: case 0x25: case 0x29: case 0x2d: case 0x31: case 0x35: case 0x39: case 0x3d:
+                a &= v;
+                IDLE_NZ(a);
+                break;
+            case 0x41: case 0x45: case 0x49: case 0x4d: case 0x51: case 0x55: case 0x59: case 0x5d:
+                a ^= v;
+                IDLE_NZ(a);
+                break;
+            case 0xa1: case 0xa5: case 0xa9: case 0xad: case 0xb1: case 0xb5: case 0xb9: case 0xbd:
+                a = v;
+                IDLE_NZ(a);
+                break;
+            case 0xa2: case 0xa6: case 0xb6: case 0xae: case 0xbe:
+                x = v;
+                IDLE_NZ(x);
+                break;
+            case 0xa0: case 0xa4: case 0xb4: case 0xac: case 0xbc:
+                y = v;
+                IDLE_NZ(y);
+                break;
+            case 0xc1: case 0xc5: case 0xc9: case 0xcd: case 0xd1: case 0xd5: case 0xd9: case 0xdd:
+                IDLE_COMPARE(a);
+                break;
+            case 0xe0: case 0xe4: case 0xec:
+                IDLE_COMPARE(x);
+                break;
+            case 0xc0: case 0xc4: case 0xcc:
+                IDLE_COMPARE(y);
+                break;
+            case 0x24: case 0x2c:
+                p = (uint8_t)((p & ~(P_SIGN | P_OVERFLOW | P_ZERO))
+                              | (v & (P_SIGN | P_OVERFLOW)) | ((a & v) ? 0 : P_ZERO));
+                break;
+            case 0x81: case 0x85: case 0x8d: case 0x91: case 0x95: case 0x99: case 0x9d:
+                if (idle_write(ea, a) < 0) {
+                    return 0;
+                }
+                break;
+            case 0x86: case 0x8e: case 0x96:
+                if (idle_write(ea, x) < 0) {
+                    return 0;
+                }
+                break;
+            case 0x84: case 0x8c: case 0x94:
+                if (idle_write(ea, y) < 0) {
+                    return 0;
+                }
+                break;
+            case 0xaa: x = a; IDLE_NZ(x); break;
+            case 0xa8: y = a; IDLE_NZ(y); break;
+            case 0x8a: a = x; IDLE_NZ(a); break;
+            case 0x98: a = y; IDLE_NZ(a); break;
+            case 0xba: x = sp; IDLE_NZ(x); break;
+            case 0x9a: sp = x; break;
+            case 0xe8: x++; IDLE_NZ(x); break;
+            case 0xc8: y++; IDLE_NZ(y); break;
+            case 0xca: x--; IDLE_NZ(x); break;
+            case 0x88: y--; IDLE_NZ(y); break;
+            case 0x18: p &= ~P_CARRY; break;
+            case 0x38: p |= P_CARRY; break;
+            case 0x58: p &= ~P_INTERRUPT; break;
+            case 0x78: p |= P_INTERRUPT; break;
+            case 0xb8: p &= ~P_OVERFLOW; break;
+            case 0xd8: p &= ~P_DECIMAL; break;
+            case 0xf8: p |= P_DECIMAL; break;
+            case 0x0a:
+                p = (uint8_t)((p & ~P_CARRY) | (a >> 7));
+                a <<= 1;
+                IDLE_NZ(a);
+                break;
+            case 0x4a:
+                p = (uint8_t)((p & ~P_CARRY) | (a & 1));
+                a >>= 1;
+                IDLE_NZ(a);
+                break;
+            case 0x2a:
+                tmp = (uint8_t)((a << 1) | (p & P_CARRY));
+                p = (uint8_t)((p & ~P_CARRY) | (a >> 7));
+                a = tmp;
+                IDLE_NZ(a);
+                break;
+            case 0x6a:
+                tmp = (uint8_t)((a >> 1) | ((p & P_CARRY) << 7));
+                p = (uint8_t)((p & ~P_CARRY) | (a & 1));
+                a = tmp;
+                IDLE_NZ(a);
+                break;
+            case 0xea:
+                break;
+            case 0x48:
+            case 0x08:
+                if (idle_write(0x100 + sp, op == 0x48 ? a : (uint8_t)(p | P_BREAK | P_UNUSED)) < 0) {
+                    return 0;
+                }
+                sp--;
+                break;
+            case 0x68:
+            case 0x28:
+                sp++;
+                if (idle_read(0x100 + sp, &v) < 0) {
+                    return 0;
+                }
+                if (op == 0x68) {
+                    a = v;
+                    IDLE_NZ(a);
+                } else {
+                    p = (uint8_t)((v & ~P_BREAK) | P_UNUSED);
+                }
+                break;
+            case 0x20:
+                tmp = (uint8_t)((pc - 1) >> 8);
+                if (idle_write(0x100 + sp, tmp) < 0) {
+                    return 0;
+                }
+                sp--;
+                if (idle_write(0x100 + sp, (uint8_t)(pc - 1)) < 0) {
+                    return 0;
+                }
+                sp--;
+                pc = ea;
+                break;
+            case 0x60:
+                sp++;
+                if (idle_read(0x100 + sp, &v) < 0) {
+                    return 0;
+                }
+                sp++;
+                if (idle_read(0x100 + sp, &tmp) < 0) {
+                    return 0;
+                }
+                pc = ((v | (tmp << 8)) + 1) & 0xffff;
+                break;
+            case 0x4c:
+                pc = ea;
+                break;
+            default:
+                /* conditional branches */
+                {
+                    static const uint8_t flags[4] = { P_SIGN, P_OVERFLOW, P_CARRY, P_ZERO };
+                    int set = (p & flags[op >> 6]) != 0;
+
+                    if (set == ((op >> 5) & 1)) {
+                        unsigned int dest = (pc + (signed char)lo) & 0xffff;
+
+                        cost += ((pc ^ dest) & 0xff00) ? 2 : 1;
+                        pc = dest;
+                    } else {
+                        branch = 0;
+                    }
+                }
+                break;
+        }
+
+        cycles += (CLOCK)cost;
+
+        if (pc == loop_pc) {
+            /* only a branch back to the start is seen by maincpu_idle_branch() */
+            if (!branch
+                || a != a0 || x != x0 || y != y0 || sp != sp0
+                || ((p ^ p0) & ~(P_BREAK | P_UNUSED))) {
+                return 0;
+            }
+            return cycles;
+        }
+    }
+
+    return 0;
+}
+
+/* Called after every taken branch, with the registers after it.  */
+static void maincpu_idle_branch(unsigned int pc, uint8_t a, uint8_t x,
+                                uint8_t y, uint8_t sp, uint8_t p)
+{
+    CLOCK delta, cycles, next_clk;
+
+    if (pc != idle_pc) {
+        idle_pc = pc;
+        idle_clk = maincpu_clk;
+        idle_hits = 0;
+        idle_backoff = 0;
+        return;
+    }
+
+    delta = maincpu_clk - idle_clk;
+    idle_clk = maincpu_clk;
+
+    if (++idle_hits < 2) {
+        return;
+    }
+    if (idle_backoff > 0) {
+        idle_backoff--;
+        return;
+    }
+
+    /* anything that has to see every instruction, or could change the
+       machine without an alarm */
+    if (maincpu_int_status->global_pending_int != IK_NONE
+        || maincpu_jammed
+        || monitor_mask[e_comp_space] != MI_NONE
+        || maincpu_profiling
+#ifdef DEBUG
+        || debug.maincpu_traceflg
+#endif
+        || !IDLE_SKIP_ALLOWED()) {
+        return;
+    }
+
+    cycles = idle_loop_cycles(pc, a, x, y, sp, p);
+    if (cycles == 0 || cycles != delta) {
+        idle_backoff = IDLE_BACKOFF;
+        return;
+    }
+
+    /* Stop at the boundary the pending alarm would be dispatched at
+       anyway, so it happens at the same clock as without skipping.  */
+    next_clk = alarm_context_next_pending_clk(maincpu_alarm_context);
+    if (maincpu_clk_limit && next_clk > maincpu_clk_limit) {
+        next_clk = maincpu_clk_limit;
+    }
+    if (next_clk <= maincpu_clk) {
+        return;
+    }
+
+    cycles *= (next_clk - maincpu_clk) / cycles;
+    maincpu_clk += cycles;
+    maincpu_idle_skipped += cycles;
+    idle_clk = maincpu_clk;
+}
+
+#define CPU_IDLE_BRANCH()                                                            \
+    do {                                                                             \
+        if (idle_skip_enabled) {                                                     \
+            maincpu_idle_branch(reg_pc, reg_a_read, reg_x_read, reg_y_read, reg_sp, \
+                                (uint8_t)LOCAL_STATUS());                            \
+        }                                                                            \
+    } while (0)
+
+#endif /* IDLE_SKIP_ALLOWED */
+
 void maincpu_mainloop(void)
 {
 #define ORIGIN_MEMSPACE (e_comp_space)
@@ -59,6 +59,9 @@ extern int maincpu_rmw_flag;
 extern CLOCK maincpu_clk;
 extern CLOCK maincpu_clk_limit;
 
+/* Cycles skipped by the idle loop detector, 0 if there is none.  */
+extern CLOCK maincpu_idle_skipped;
+
 /* 8502 cycle stretch indicator */
 extern int maincpu_stretch;
 
@@ -42,6 +42,14 @@ enum mon_int {
     MI_STEP = 1 << 2
 };
 
+/* Kinds of checkpoints, each has its own address bitmap per memspace.  */
+enum mon_checkpoint_kind {
+    MONITOR_CHECKPOINT_EXEC = 0,
+    MONITOR_CHECKPOINT_LOAD,
+    MONITOR_CHECKPOINT_STORE,
+    MONITOR_CHECKPOINT_KINDS
+};
+
 enum t_memspace {
     e_default_space = 0,
     e_comp_space,
@@ -161,6 +169,14 @@ typedef struct monitor_interface_s monitor_interface_t;
 /* Externals */
 extern unsigned monitor_mask[NUM_MEMSPACES];
 
+/* One bit per address and kind, set when a checkpoint (enabled or not)
+   covers that address. The CPU cores test it before calling into the
+   monitor, so only addresses that may hit walk the checkpoint lists.  */
+extern uint32_t monitor_checkpoint_bitmap[NUM_MEMSPACES][MONITOR_CHECKPOINT_KINDS][0x10000 / 32];
+
+#define MONITOR_CHECKPOINT_HIT(mem, kind, addr) \
+    (monitor_checkpoint_bitmap[(mem)][(kind)][((addr) & 0xffff) >> 5] & (1U << ((addr) & 31)))
+
 
 /* Prototypes */
 monitor_cpu_type_t* monitor_find_cpu_type_from_string(const char *cpu_type);
@@ -188,8 +204,23 @@ void monitor_check_watchpoints(unsigned int lastpc, unsigned int pc);
 void monitor_cpu_type_set(const char *cpu_type);
 void monitor_cpu_type_set_value(int searchcpu);
 
-void monitor_watch_push_load_addr(uint16_t addr, MEMSPACE mem);
-void monitor_watch_push_store_addr(uint16_t addr, MEMSPACE mem);
+void monitor_watch_record_load_addr(uint16_t addr, MEMSPACE mem);
+void monitor_watch_record_store_addr(uint16_t addr, MEMSPACE mem);
+
+/* Called by the memory access functions while watchpoints are active.  */
+inline static void monitor_watch_push_load_addr(uint16_t addr, MEMSPACE mem)
+{
+    if (MONITOR_CHECKPOINT_HIT(mem, MONITOR_CHECKPOINT_LOAD, addr)) {
+        monitor_watch_record_load_addr(addr, mem);
+    }
+}
+
+inline static void monitor_watch_push_store_addr(uint16_t addr, MEMSPACE mem)
+{
+    if (MONITOR_CHECKPOINT_HIT(mem, MONITOR_CHECKPOINT_STORE, addr)) {
+        monitor_watch_record_store_addr(addr, mem);
+    }
+}
 
 monitor_interface_t *monitor_interface_new(void);
 void monitor_interface_destroy(monitor_interface_t *monitor_interface);
@@ -60,6 +60,7 @@ static checkpoint_list_t *breakpoints[NUM_MEMSPACES];
 static checkpoint_list_t *watchpoints_load[NUM_MEMSPACES];
 static checkpoint_list_t *watchpoints_store[NUM_MEMSPACES];
 
+uint32_t monitor_checkpoint_bitmap[NUM_MEMSPACES][MONITOR_CHECKPOINT_KINDS][0x10000 / 32];
 
 void mon_breakpoint_init(void)
 {
@@ -148,8 +149,41 @@ mon_checkpoint_t *mon_breakpoint_find_checkpoint(int brknum)
     return NULL;
 }
 
+static void set_checkpoint_bits(uint32_t *bitmap, checkpoint_list_t *ptr)
+{
+    unsigned int start, end, addr;
+
+    while (ptr) {
+        start = addr_location(ptr->checkpt->start_addr);
+        end = start;
+        if (mon_is_valid_addr(ptr->checkpt->end_addr)) {
+            end = addr_location(ptr->checkpt->end_addr);
+        }
+        /* ranges with end < start wrap around at $ffff */
+        addr = start;
+        while (1) {
+            bitmap[addr >> 5] |= 1U << (addr & 31);
+            if (addr == end) {
+                break;
+            }
+            addr = (addr + 1) & 0xffff;
+        }
+        ptr = ptr->next;
+    }
+}
+
+static void update_checkpoint_bitmaps(MEMSPACE mem)
+{
+    memset(monitor_checkpoint_bitmap[mem], 0, sizeof(monitor_checkpoint_bitmap[mem]));
+    set_checkpoint_bits(monitor_checkpoint_bitmap[mem][MONITOR_CHECKPOINT_EXEC], breakpoints[mem]);
+    set_checkpoint_bits(monitor_checkpoint_bitmap[mem][MONITOR_CHECKPOINT_LOAD], watchpoints_load[mem]);
+    set_checkpoint_bits(monitor_checkpoint_bitmap[mem][MONITOR_CHECKPOINT_STORE], watchpoints_store[mem]);
+}
+
 static void update_checkpoint_state(MEMSPACE mem)
 {
+    update_checkpoint_bitmaps(mem);
+
     /* calls mem_toggle_watchpoints() */
     if (watchpoints_load[mem] != NULL ||
         watchpoints_store[mem] != NULL) {
@@ -720,6 +754,7 @@ void mon_breakpoint_unset(MON_ADDR address)
         /* there's a breakpoint, so remove it */
         remove_checkpoint_from_list( &all_checkpoints, ptr->checkpt );
         remove_checkpoint_from_list( &breakpoints[mem], ptr->checkpt );
+        update_checkpoint_state(mem);
     }
 }
 
@@ -497,7 +497,7 @@ char *uimon_in(const char *prompt)
 
         if (!monitor_is_binary()) {
             monitor_check_binary();
-        } else {
+        } else if (!monitor_binary_has_io_thread()) {
             sockfd[sockfd_index] = monitor_binary_get_connected_socket();
             sockfd_index++;
         }
@@ -506,7 +506,12 @@ char *uimon_in(const char *prompt)
 
         if (monitor_is_remote() || monitor_is_binary()) {
 
-            vice_network_select_multiple(sockfd);
+            if (monitor_binary_has_io_thread()) {
+                /* the binary monitor wakes us up, the remote one is polled */
+                monitor_binary_wait_command(monitor_is_remote() ? 10000 : 250000);
+            } else {
+                vice_network_select_multiple(sockfd);
+            }
 
             if (monitor_is_binary()) {
                 if (!monitor_binary_get_command_line()) {
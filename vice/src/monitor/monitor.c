@@ -2792,7 +2792,7 @@ int mon_read_snapshot(const char *name, int even_mode)
 /* *** WATCHPOINTS *** */
 
 
-void monitor_watch_push_load_addr(uint16_t addr, MEMSPACE mem)
+void monitor_watch_record_load_addr(uint16_t addr, MEMSPACE mem)
 {
     if (inside_monitor) {
         return;
@@ -2807,7 +2807,7 @@ void monitor_watch_push_load_addr(uint16_t addr, MEMSPACE mem)
     watch_load_count[mem]++;
 }
 
-void monitor_watch_push_store_addr(uint16_t addr, MEMSPACE mem)
+void monitor_watch_record_store_addr(uint16_t addr, MEMSPACE mem)
 {
     if (inside_monitor) {
         return;
@@ -2932,6 +2932,9 @@ void monitor_check_icount_interrupt(void)
  */
 int monitor_check_breakpoints(MEMSPACE mem, uint16_t addr)
 {
+    if (!MONITOR_CHECKPOINT_HIT(mem, MONITOR_CHECKPOINT_EXEC, addr)) {
+        return 0;
+    }
     return mon_breakpoint_check_checkpoint(mem, addr, 0, e_exec); /* FIXME */
 }
 
@@ -3294,6 +3297,9 @@ void monitor_startup(MEMSPACE mem)
         return;
     }
 
+    /* the monitor must not look at a drive while its thread runs it */
+    drive_cpu_park_all();
+
     if (ui_pause_active()) {
         should_pause_on_exit_mon = true;
 
@@ -33,6 +33,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_WORKER_THREADS
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#endif
+
 #include "archdep_defs.h"
 #include "cmdline.h"
 #include "drive.h"
@@ -77,12 +84,15 @@ static vice_network_socket_t * connected_socket = NULL;
 
 static char *monitor_binary_server_address = NULL;
 static int monitor_binary_enabled = 0;
+static int monitor_binary_thread_enabled = 1;
 
 enum t_binary_command {
     e_MON_CMD_INVALID = 0x00,
 
     e_MON_CMD_MEM_GET = 0x01,
     e_MON_CMD_MEM_SET = 0x02,
+    e_MON_CMD_MEM_GET_MULTI = 0x03,
+    e_MON_CMD_MEM_SUBSCRIBE = 0x04,
 
     e_MON_CMD_CHECKPOINT_GET = 0x11,
     e_MON_CMD_CHECKPOINT_SET = 0x12,
@@ -128,6 +138,9 @@ enum t_binary_response {
     e_MON_RESPONSE_INVALID = 0x00,
     e_MON_RESPONSE_MEM_GET = 0x01,
     e_MON_RESPONSE_MEM_SET = 0x02,
+    e_MON_RESPONSE_MEM_GET_MULTI = 0x03,
+    e_MON_RESPONSE_MEM_SUBSCRIBE = 0x04,
+    e_MON_RESPONSE_MEM_UPDATE = 0x05,
 
     e_MON_RESPONSE_CHECKPOINT_INFO = 0x11,
 
@@ -204,14 +217,144 @@ struct binary_command_s {
 };
 typedef struct binary_command_s binary_command_t;
 
+enum t_mem_subscribe_mode {
+    e_MEM_SUBSCRIBE_MODE_FULL = 0x00,
+    e_MEM_SUBSCRIBE_MODE_CHANGES = 0x01,
+};
+typedef enum t_mem_subscribe_mode MEM_SUBSCRIBE_MODE;
+
+/* memspace (1), bank (2), start (2), end (2) */
+#define MON_MEM_RANGE_SIZE 7
+
+/* Unchanged bytes between two changed ones that are still sent as one run,
+   cheaper than the 6 byte header of another run. */
+#define MON_MEM_UPDATE_MAX_GAP 6
+
+/* A run in a memory update can't be longer than its 16 bit length field. */
+#define MON_MEM_UPDATE_MAX_RUN 0xffff
+
+struct mon_mem_range_s {
+    MEMSPACE memspace;
+    int banknum;
+    uint16_t start;
+    uint32_t length;
+};
+typedef struct mon_mem_range_s mon_mem_range_t;
+
+/* The ranges pushed at every vsync to the connected client */
+static mon_mem_range_t *subscription_ranges = NULL;
+static unsigned int subscription_count = 0;
+static uint32_t subscription_size = 0;
+static MEM_SUBSCRIBE_MODE subscription_mode = e_MEM_SUBSCRIBE_MODE_FULL;
+static uint32_t subscription_sequence = 0;
+static int subscription_drive = 0;
+
+/* Contents sent with the last update, and the buffer for the next one */
+static uint8_t *subscription_shadow = NULL;
+static uint8_t *subscription_current = NULL;
+static int subscription_shadow_valid = 0;
+
+/* The end of an update the socket did not take yet. Updates are sent
+   without blocking, so a slow client costs frames, not emulation time. */
+static unsigned char *subscription_pending = NULL;
+static size_t subscription_pending_length = 0;
+static size_t subscription_pending_offset = 0;
+
+/* Reused for the larger responses instead of allocating one per command */
+static unsigned char *response_buffer = NULL;
+static size_t response_buffer_size = 0;
+
+/*! \internal \brief Get the response buffer, with room for at least size bytes */
+static unsigned char *monitor_binary_response_buffer(size_t size)
+{
+    if (response_buffer_size < size) {
+        response_buffer = lib_realloc(response_buffer, size);
+        response_buffer_size = size;
+    }
+
+    return response_buffer;
+}
+
+static void monitor_binary_subscription_clear(void)
+{
+    lib_free(subscription_ranges);
+    lib_free(subscription_shadow);
+    lib_free(subscription_current);
+    subscription_ranges = NULL;
+    subscription_shadow = NULL;
+    subscription_current = NULL;
+    subscription_count = 0;
+    subscription_size = 0;
+    subscription_drive = 0;
+    subscription_shadow_valid = 0;
+}
+
+static void monitor_binary_send_failed(void);
+
+/*! \internal \brief Forget the unsent end of the last update */
+static void monitor_binary_pending_clear(void)
+{
+    lib_free(subscription_pending);
+    subscription_pending = NULL;
+    subscription_pending_length = 0;
+    subscription_pending_offset = 0;
+}
+
+/*! \internal \brief Send what is left of the last update
+
+ \param wait non-zero to block until everything is sent
+
+ \return non-zero if some of the update is still unsent
+*/
+static int monitor_binary_pending_flush(int wait)
+{
+    const unsigned char *buffer;
+    size_t length;
+    ssize_t sent;
+
+    if (subscription_pending == NULL) {
+        return 0;
+    }
+
+    buffer = &subscription_pending[subscription_pending_offset];
+    length = subscription_pending_length - subscription_pending_offset;
+
+    if (connected_socket == NULL) {
+        sent = -1;
+    } else if (wait) {
+        sent = vice_network_send(connected_socket, buffer, length, 0);
+    } else {
+        sent = vice_network_send_nonblocking(connected_socket, buffer, length);
+    }
+
+    if (sent < 0 || (wait && (size_t)sent != length)) {
+        log_error(LOG_DEFAULT, "monitor_binary_pending_flush(): sending the memory update failed, breaking connection");
+        monitor_binary_send_failed();
+        return 0;
+    }
+
+    subscription_pending_offset += (size_t)sent;
+    if (subscription_pending_offset == subscription_pending_length) {
+        monitor_binary_pending_clear();
+        return 0;
+    }
+
+    return 1;
+}
+
 int monitor_binary_transmit(const unsigned char *buffer, size_t buffer_length)
 {
     int error = 0;
 
+    /* finish the update in flight first, the client would lose the framing otherwise */
+    monitor_binary_pending_flush(1);
+
     if (connected_socket) {
         size_t len = (size_t)vice_network_send(connected_socket, buffer, buffer_length, 0);
 
         if (len != buffer_length) {
+            log_error(LOG_DEFAULT, "monitor_binary_transmit(): sending the response failed, breaking connection");
+            monitor_binary_send_failed();
             error = -1;
         } else {
             error = (int)len;
@@ -221,10 +364,54 @@ int monitor_binary_transmit(const unsigned char *buffer, size_t buffer_length)
     return error;
 }
 
+#ifdef HAVE_WORKER_THREADS
+/* The start of a frame the I/O thread was reading when it was stopped.
+   Whoever reads the connection next takes these bytes first. */
+static unsigned char *io_leftover = NULL;
+static size_t io_leftover_length = 0;
+static size_t io_leftover_offset = 0;
+
+/*! \internal \brief Forget the bytes left over by the I/O thread */
+static void monitor_binary_leftover_clear(void)
+{
+    lib_free(io_leftover);
+    io_leftover = NULL;
+    io_leftover_length = 0;
+    io_leftover_offset = 0;
+}
+
+/*! \internal \brief Take up to length bytes left over by the I/O thread
+
+ \return the number of bytes copied to buffer
+*/
+static size_t monitor_binary_leftover_take(unsigned char *buffer, size_t length)
+{
+    size_t n = io_leftover_length - io_leftover_offset;
+
+    if (n > length) {
+        n = length;
+    }
+    if (n > 0) {
+        memcpy(buffer, &io_leftover[io_leftover_offset], n);
+        io_leftover_offset += n;
+        if (io_leftover_offset == io_leftover_length) {
+            monitor_binary_leftover_clear();
+        }
+    }
+
+    return n;
+}
+#endif
+
 static void monitor_binary_quit(void)
 {
     vice_network_socket_close(connected_socket);
     connected_socket = NULL;
+    monitor_binary_subscription_clear();
+    monitor_binary_pending_clear();
+#ifdef HAVE_WORKER_THREADS
+    monitor_binary_leftover_clear();
+#endif
 }
 
 ssize_t monitor_binary_receive(unsigned char *buffer, size_t buffer_length)
@@ -232,6 +419,12 @@ ssize_t monitor_binary_receive(unsigned char *buffer, size_t buffer_length)
     ssize_t bytes_received = 0;
     ssize_t total_bytes_received = 0;
 
+#ifdef HAVE_WORKER_THREADS
+    total_bytes_received = (ssize_t)monitor_binary_leftover_take(buffer, buffer_length);
+    buffer += total_bytes_received;
+    buffer_length -= (size_t)total_bytes_received;
+#endif
+
     while (buffer_length && connected_socket) {
         bytes_received = vice_network_receive(connected_socket, buffer, buffer_length, 0);
 
@@ -261,6 +454,12 @@ static int monitor_binary_data_available(void)
 {
     int available = 0;
 
+#ifdef HAVE_WORKER_THREADS
+    if (io_leftover_offset < io_leftover_length) {
+        return 1;
+    }
+#endif
+
     if (connected_socket != NULL) {
         available = vice_network_select_poll_one(connected_socket);
     } else if (listen_socket != NULL) {
@@ -268,6 +467,7 @@ static int monitor_binary_data_available(void)
 
         if (vice_network_select_poll_one(listen_socket)) {
             connected_socket = vice_network_accept(listen_socket);
+            monitor_binary_subscription_clear();
         }
     }
 
@@ -275,11 +475,57 @@ static int monitor_binary_data_available(void)
     return available;
 }
 
+static void monitor_binary_subscription_update(void);
+
+#ifdef HAVE_WORKER_THREADS
+static atomic_int io_thread_running = 0;
+
+static int monitor_binary_queue_command_ready(void);
+static void monitor_binary_queue_clear(void);
+static void monitor_binary_io_start(void);
+static void monitor_binary_io_stop(void);
+#endif
+
+/*! \internal \brief Drop the connection after a send failed
+
+ Part of a frame is missing then, so the client cannot make sense of
+ anything that follows on this connection.
+*/
+static void monitor_binary_send_failed(void)
+{
+#ifdef HAVE_WORKER_THREADS
+    if (atomic_load(&io_thread_running)) {
+        /* the thread still reads from the connection, it has to let go first */
+        monitor_binary_io_stop();
+        monitor_binary_queue_clear();
+        monitor_binary_quit();
+        monitor_binary_io_start();
+        return;
+    }
+#endif
+    monitor_binary_quit();
+}
+
 void monitor_check_binary(void)
 {
-    if (monitor_binary_data_available()) {
+    int ready;
+
+#ifdef HAVE_WORKER_THREADS
+    ready = monitor_binary_queue_command_ready();
+    if (!ready && !atomic_load(&io_thread_running)) {
+        ready = monitor_binary_data_available();
+    }
+#else
+    ready = monitor_binary_data_available();
+#endif
+
+    if (ready) {
         monitor_startup_trap();
     }
+
+    if (subscription_count > 0 && connected_socket != NULL) {
+        monitor_binary_subscription_update();
+    }
 }
 
 #define ASC_STX 0x02
@@ -324,16 +570,21 @@ static uint16_t little_endian_to_uint16(unsigned char *input) {
     return (input[1] << 8) + input[0];
 }
 
-static void monitor_binary_response(uint32_t length, BINARY_RESPONSE response_type, BINARY_ERROR errorcode, uint32_t request_id, unsigned char *body)
+static void monitor_binary_response_header(uint32_t length, BINARY_RESPONSE response_type, BINARY_ERROR errorcode, uint32_t request_id, unsigned char *response)
 {
-    unsigned char response[12];
-
     response[0] = ASC_STX;
     response[1] = MON_BINARY_API_VERSION;
     write_uint32(length, &response[2]);
     response[6] = (uint8_t)response_type;
     response[7] = (uint8_t)errorcode;
     write_uint32(request_id, &response[8]);
+}
+
+static void monitor_binary_response(uint32_t length, BINARY_RESPONSE response_type, BINARY_ERROR errorcode, uint32_t request_id, unsigned char *body)
+{
+    unsigned char response[12];
+
+    monitor_binary_response_header(length, response_type, errorcode, request_id, response);
 
     monitor_binary_transmit(response, sizeof response);
 
@@ -1465,7 +1716,7 @@ static void monitor_binary_process_mem_get(binary_command_t *command)
 
     response_size += length;
 
-    response = lib_malloc(response_size);
+    response = monitor_binary_response_buffer(response_size);
     response_cursor = response;
 
     response_cursor = write_uint16(length, response_cursor);
@@ -1477,8 +1728,6 @@ static void monitor_binary_process_mem_get(binary_command_t *command)
     response_cursor += length;
 
     monitor_binary_response(response_size, e_MON_RESPONSE_MEM_GET, e_MON_ERR_OK, command->request_id, response);
-
-    lib_free(response);
 }
 
 static void monitor_binary_process_mem_set(binary_command_t *command)
@@ -1542,6 +1791,328 @@ static void monitor_binary_process_mem_set(binary_command_t *command)
     monitor_binary_response(0, e_MON_RESPONSE_MEM_SET, e_MON_ERR_OK, command->request_id, NULL);
 }
 
+/*! \internal \brief Parse and validate the list of ranges of a command
+
+ \param cursor    first range in the command body
+ \param count     number of ranges
+ \param ranges    filled with the parsed ranges
+ \param total     set to the number of bytes covered by all ranges
+
+ \return e_MON_ERR_OK, or the error to report to the client
+*/
+static BINARY_ERROR monitor_binary_parse_ranges(unsigned char *cursor, unsigned int count,
+                                                mon_mem_range_t *ranges, uint32_t *total)
+{
+    unsigned int i;
+
+    *total = 0;
+
+    for (i = 0; i < count; i++) {
+        uint8_t requested_memspace = cursor[0];
+        uint16_t requested_banknum = little_endian_to_uint16(&cursor[1]);
+        uint16_t startaddress = little_endian_to_uint16(&cursor[3]);
+        uint16_t endaddress = little_endian_to_uint16(&cursor[5]);
+        MEMSPACE memspace;
+
+        if (startaddress > endaddress) {
+            log_message(LOG_DEFAULT, "monitor binary range %u: wrong start and/or end address %04x - %04x",
+                        i, startaddress, endaddress);
+            return e_MON_ERR_INVALID_PARAMETER;
+        }
+
+        memspace = get_requested_memspace(requested_memspace);
+
+        if (memspace == e_invalid_space) {
+            log_message(LOG_DEFAULT, "monitor binary range %u: Unknown memspace %u", i, requested_memspace);
+            return e_MON_ERR_INVALID_MEMSPACE;
+        }
+
+        if (mon_banknum_validate(memspace, requested_banknum) == 0) {
+            log_message(LOG_DEFAULT, "monitor binary range %u: Unknown bank %u", i, requested_banknum);
+            return e_MON_ERR_INVALID_PARAMETER;
+        }
+
+        ranges[i].memspace = memspace;
+        ranges[i].banknum = requested_banknum;
+        ranges[i].start = startaddress;
+        ranges[i].length = (endaddress + 1) - startaddress;
+
+        *total += ranges[i].length;
+        cursor += MON_MEM_RANGE_SIZE;
+    }
+
+    return e_MON_ERR_OK;
+}
+
+/*! \internal \brief Read all ranges one after the other into data */
+static void monitor_binary_read_ranges(const mon_mem_range_t *ranges, unsigned int count,
+                                       int new_sidefx, uint8_t *data)
+{
+    unsigned int i;
+    int old_sidefx = sidefx;
+
+    sidefx = new_sidefx;
+    for (i = 0; i < count; i++) {
+        mon_get_mem_block_ex(ranges[i].memspace, ranges[i].banknum, ranges[i].start,
+                             (uint16_t)(ranges[i].length - 1), data);
+        data += ranges[i].length;
+    }
+    sidefx = old_sidefx;
+}
+
+static void monitor_binary_process_mem_get_multi(binary_command_t *command)
+{
+    unsigned char *response;
+    mon_mem_range_t *ranges;
+    BINARY_ERROR err;
+    uint32_t total;
+
+    unsigned char *body = command->body;
+    uint8_t new_sidefx;
+    uint16_t count;
+
+    if (command->length < 3) {
+        monitor_binary_error(e_MON_ERR_CMD_INVALID_LENGTH, command->request_id);
+        return;
+    }
+
+    new_sidefx = body[0];
+    count = little_endian_to_uint16(&body[1]);
+
+    if (count == 0 || command->length < 3 + count * MON_MEM_RANGE_SIZE) {
+        monitor_binary_error(e_MON_ERR_CMD_INVALID_LENGTH, command->request_id);
+        return;
+    }
+
+    ranges = lib_malloc(count * sizeof(mon_mem_range_t));
+
+    err = monitor_binary_parse_ranges(&body[3], count, ranges, &total);
+    if (err != e_MON_ERR_OK) {
+        monitor_binary_error(err, command->request_id);
+        lib_free(ranges);
+        return;
+    }
+
+    response = monitor_binary_response_buffer(4 + total);
+    write_uint32(total, response);
+    monitor_binary_read_ranges(ranges, count, !!new_sidefx, &response[4]);
+
+    monitor_binary_response(4 + total, e_MON_RESPONSE_MEM_GET_MULTI, e_MON_ERR_OK, command->request_id, response);
+
+    lib_free(ranges);
+}
+
+static void monitor_binary_process_mem_subscribe(binary_command_t *command)
+{
+    mon_mem_range_t *ranges;
+    BINARY_ERROR err;
+    uint32_t total;
+    unsigned int i;
+
+    unsigned char *body = command->body;
+    uint8_t mode;
+    uint16_t count;
+
+    if (command->length < 3) {
+        monitor_binary_error(e_MON_ERR_CMD_INVALID_LENGTH, command->request_id);
+        return;
+    }
+
+    mode = body[0];
+    count = little_endian_to_uint16(&body[1]);
+
+    if (command->length < 3 + count * MON_MEM_RANGE_SIZE) {
+        monitor_binary_error(e_MON_ERR_CMD_INVALID_LENGTH, command->request_id);
+        return;
+    }
+
+    if (mode != e_MEM_SUBSCRIBE_MODE_FULL && mode != e_MEM_SUBSCRIBE_MODE_CHANGES) {
+        monitor_binary_error(e_MON_ERR_INVALID_PARAMETER, command->request_id);
+        log_message(LOG_DEFAULT, "monitor binary memsubscribe: Unknown mode %u", mode);
+        return;
+    }
+
+    ranges = NULL;
+    total = 0;
+
+    if (count > 0) {
+        ranges = lib_malloc(count * sizeof(mon_mem_range_t));
+
+        err = monitor_binary_parse_ranges(&body[3], count, ranges, &total);
+        if (err != e_MON_ERR_OK) {
+            monitor_binary_error(err, command->request_id);
+            lib_free(ranges);
+            return;
+        }
+    }
+
+    monitor_binary_subscription_clear();
+
+    subscription_ranges = ranges;
+    subscription_count = count;
+    subscription_size = total;
+    subscription_mode = mode;
+    subscription_sequence = 0;
+
+    for (i = 0; i < count; i++) {
+        if (ranges[i].memspace != e_comp_space) {
+            subscription_drive = 1;
+        }
+    }
+
+    if (count > 0 && mode == e_MEM_SUBSCRIBE_MODE_CHANGES) {
+        subscription_current = lib_malloc(total);
+        subscription_shadow = lib_malloc(total);
+    }
+
+    monitor_binary_response(0, e_MON_RESPONSE_MEM_SUBSCRIBE, e_MON_ERR_OK, command->request_id, NULL);
+}
+
+/*! \internal \brief Append the runs of bytes that differ from the last update
+
+ Runs never cross the end of a range, unchanged gaps shorter than
+ MON_MEM_UPDATE_MAX_GAP are sent along rather than starting a new run.
+
+ \return the byte after the last run written
+*/
+static unsigned char *monitor_binary_subscription_changes(unsigned char *output, uint32_t *runs)
+{
+    const uint8_t *current = subscription_current;
+    const uint8_t *shadow = subscription_shadow;
+    unsigned int i;
+
+    for (i = 0; i < subscription_count; i++) {
+        uint32_t length = subscription_ranges[i].length;
+        uint32_t offset = 0;
+
+        while (offset < length) {
+            uint32_t start;
+            uint32_t end;
+            uint32_t gap;
+
+            if (subscription_shadow_valid && current[offset] == shadow[offset]) {
+                offset++;
+                continue;
+            }
+
+            /* extend the run up to the last change followed by a long enough gap */
+            start = offset;
+            end = offset + 1;
+            gap = 0;
+            offset++;
+            while (offset < length && offset - start < MON_MEM_UPDATE_MAX_RUN) {
+                if (subscription_shadow_valid && current[offset] == shadow[offset]) {
+                    if (++gap > MON_MEM_UPDATE_MAX_GAP) {
+                        break;
+                    }
+                } else {
+                    gap = 0;
+                    end = offset + 1;
+                }
+                offset++;
+            }
+            offset = end;
+
+            output = write_uint16((uint16_t)i, output);
+            output = write_uint16((uint16_t)start, output);
+            output = write_uint16((uint16_t)(end - start), output);
+            memcpy(output, &current[start], end - start);
+            output += end - start;
+            (*runs)++;
+        }
+
+        current += length;
+        shadow += length;
+    }
+
+    return output;
+}
+
+/*! \internal \brief Send a memory update without blocking
+
+ The response buffer holds the frame, with room for the header in its
+ first 12 bytes. Whatever the socket does not take now is kept and sent
+ before anything else.
+*/
+static void monitor_binary_subscription_send(uint32_t length)
+{
+    unsigned char *frame = response_buffer;
+    size_t frame_length = 12 + (size_t)length;
+    ssize_t sent;
+
+    if (connected_socket == NULL) {
+        return;
+    }
+
+    monitor_binary_response_header(length, e_MON_RESPONSE_MEM_UPDATE, e_MON_ERR_OK, MON_EVENT_ID, frame);
+
+    sent = vice_network_send_nonblocking(connected_socket, frame, frame_length);
+    if (sent < 0) {
+        log_error(LOG_DEFAULT, "monitor_binary_subscription_send(): sending the memory update failed, breaking connection");
+        monitor_binary_send_failed();
+        return;
+    }
+
+    if ((size_t)sent < frame_length) {
+        subscription_pending_length = frame_length - (size_t)sent;
+        subscription_pending_offset = 0;
+        subscription_pending = lib_malloc(subscription_pending_length);
+        memcpy(subscription_pending, &frame[sent], subscription_pending_length);
+    }
+}
+
+/*! \internal \brief Push the subscribed ranges to the client, called at vsync
+
+ The update is skipped while the client has not taken the last one yet.
+ In changes mode the next update then carries the skipped changes.
+*/
+static void monitor_binary_subscription_update(void)
+{
+    unsigned char *response;
+    unsigned char *response_cursor;
+    uint8_t *swap;
+    uint32_t runs = 0;
+
+    /* a failed send drops the connection and the subscription with it */
+    if (monitor_binary_pending_flush(0) || connected_socket == NULL) {
+        return;
+    }
+
+    if (subscription_drive) {
+        drive_cpu_execute_all(maincpu_clk);
+    }
+
+    if (subscription_mode == e_MEM_SUBSCRIBE_MODE_FULL) {
+        response = monitor_binary_response_buffer(12 + 4 + subscription_size) + 12;
+        write_uint32(subscription_sequence++, response);
+        monitor_binary_read_ranges(subscription_ranges, subscription_count, 0, &response[4]);
+        monitor_binary_subscription_send(4 + subscription_size);
+        return;
+    }
+
+    monitor_binary_read_ranges(subscription_ranges, subscription_count, 0, subscription_current);
+
+    /* Every run needs at least one byte and a gap after it, besides the
+       one that may be cut at the end of a range or the run limit. */
+    response = monitor_binary_response_buffer(12 + 8 + subscription_size
+                                              + 6 * (subscription_size / (MON_MEM_UPDATE_MAX_GAP + 1)
+                                                     + 2 * subscription_count)) + 12;
+    response_cursor = monitor_binary_subscription_changes(&response[8], &runs);
+
+    swap = subscription_shadow;
+    subscription_shadow = subscription_current;
+    subscription_current = swap;
+    subscription_shadow_valid = 1;
+
+    if (runs == 0) {
+        return;
+    }
+
+    write_uint32(subscription_sequence++, response);
+    write_uint32(runs, &response[4]);
+    monitor_binary_subscription_send((uint32_t)(response_cursor - response));
+}
+
 
 static void monitor_binary_process_command(unsigned char * pbuffer)
 {
@@ -1574,6 +2145,10 @@ static void monitor_binary_process_command(unsigned char * pbuffer)
         monitor_binary_process_mem_get(&command);
     } else if (command_type == e_MON_CMD_MEM_SET) {
         monitor_binary_process_mem_set(&command);
+    } else if (command_type == e_MON_CMD_MEM_GET_MULTI) {
+        monitor_binary_process_mem_get_multi(&command);
+    } else if (command_type == e_MON_CMD_MEM_SUBSCRIBE) {
+        monitor_binary_process_mem_subscribe(&command);
 
     } else if (command_type == e_MON_CMD_CHECKPOINT_GET) {
         monitor_binary_process_checkpoint_get(&command);
@@ -1649,6 +2224,386 @@ static void monitor_binary_process_command(unsigned char * pbuffer)
     pbuffer[0] = 0;
 }
 
+#ifdef HAVE_WORKER_THREADS
+
+/*
+    With BinaryMonitorServerThread enabled the emulation thread doesn't poll
+    the sockets. An I/O thread accepts the connection and reads the commands,
+    and queues every complete frame. At vsync monitor_check_binary() then
+    only looks at the length of the queue, and while the machine is stopped
+    in the monitor uimon_in() sleeps until a command is queued.
+
+    The connection and its loss are queued as well, so connected_socket is
+    still only changed by the emulation thread, in order with the commands.
+    Responses are sent from the emulation thread as before.
+
+    The thread checks whether it should stop whenever select() times out,
+    and leaves the connection to the polling code when it does.
+*/
+
+enum t_queue_item_type {
+    e_QUEUE_OPENED,
+    e_QUEUE_CLOSED,
+    e_QUEUE_COMMAND,
+};
+
+struct queue_item_s {
+    enum t_queue_item_type type;
+    vice_network_socket_t *socket;
+    unsigned char *frame;
+    struct queue_item_s *next;
+};
+typedef struct queue_item_s queue_item_t;
+
+static pthread_t io_thread;
+static atomic_int queue_length = 0;
+static queue_item_t *queue_head = NULL;
+static queue_item_t *queue_tail = NULL;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static void monitor_binary_queue_push(enum t_queue_item_type type, vice_network_socket_t *socket,
+                                      unsigned char *frame)
+{
+    queue_item_t *item = lib_malloc(sizeof(queue_item_t));
+
+    item->type = type;
+    item->socket = socket;
+    item->frame = frame;
+    item->next = NULL;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail != NULL) {
+        queue_tail->next = item;
+    } else {
+        queue_head = item;
+    }
+    queue_tail = item;
+    atomic_fetch_add(&queue_length, 1);
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+/*! \internal \brief Remove the head of the queue
+
+ \param commands  if zero, only a connection event is removed
+
+ \return the item, or NULL
+*/
+static queue_item_t *monitor_binary_queue_pop(int commands)
+{
+    queue_item_t *item;
+
+    if (atomic_load(&queue_length) == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    item = queue_head;
+    if (item != NULL && (commands || item->type != e_QUEUE_COMMAND)) {
+        queue_head = item->next;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+        atomic_fetch_sub(&queue_length, 1);
+    } else {
+        item = NULL;
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    return item;
+}
+
+static void monitor_binary_queue_free(queue_item_t *item)
+{
+    lib_free(item->frame);
+    lib_free(item);
+}
+
+/*! \internal \brief Drop everything queued, the thread must not run */
+static void monitor_binary_queue_clear(void)
+{
+    queue_item_t *item;
+
+    while ((item = monitor_binary_queue_pop(1)) != NULL) {
+        if (item->type == e_QUEUE_OPENED) {
+            vice_network_socket_close(item->socket);
+        }
+        monitor_binary_queue_free(item);
+    }
+}
+
+/*! \internal \brief Take over a connection accepted or lost by the thread */
+static void monitor_binary_queue_connection(queue_item_t *item)
+{
+    if (item->type == e_QUEUE_OPENED) {
+        if (connected_socket != NULL) {
+            monitor_binary_quit();
+        }
+        connected_socket = item->socket;
+        monitor_binary_subscription_clear();
+    } else if (item->type == e_QUEUE_CLOSED && connected_socket == item->socket) {
+        monitor_binary_quit();
+    }
+}
+
+/*! \internal \brief Handle the connection events at the head of the queue
+
+ \return non-zero if a command is waiting
+*/
+static int monitor_binary_queue_command_ready(void)
+{
+    queue_item_t *item;
+
+    while ((item = monitor_binary_queue_pop(0)) != NULL) {
+        monitor_binary_queue_connection(item);
+        monitor_binary_queue_free(item);
+    }
+
+    return atomic_load(&queue_length) > 0;
+}
+
+/*! \internal \brief Process the queued commands
+
+ \return 0 if the connection was lost or the monitor is left, else 1
+*/
+static int monitor_binary_process_queue(void)
+{
+    queue_item_t *item;
+
+    while ((item = monitor_binary_queue_pop(1)) != NULL) {
+        if (item->type == e_QUEUE_COMMAND) {
+            monitor_binary_process_command(item->frame);
+        } else {
+            monitor_binary_queue_connection(item);
+        }
+
+        if (item->type == e_QUEUE_CLOSED) {
+            monitor_binary_queue_free(item);
+            return 0;
+        }
+        monitor_binary_queue_free(item);
+
+        /* a failed response drops the connection */
+        if (exit_mon || connected_socket == NULL) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*! \internal \brief Fill buffer up to length bytes on the I/O thread
+
+ \param received  bytes already in buffer, updated as more arrive
+
+ \return 0 on success, -1 if the connection is gone or the thread stops
+*/
+static int monitor_binary_io_receive(vice_network_socket_t *socket, unsigned char *buffer, size_t length,
+                                     size_t *received)
+{
+    vice_network_socket_t *sockets[2] = { socket, NULL };
+
+    *received += monitor_binary_leftover_take(&buffer[*received], length - *received);
+
+    while (*received < length) {
+        ssize_t n;
+
+        if (!atomic_load(&io_thread_running)) {
+            return -1;
+        }
+
+        if (vice_network_select_multiple(sockets) <= 0) {
+            continue;
+        }
+
+        n = vice_network_receive(socket, &buffer[*received], length - *received, 0);
+        if (n <= 0) {
+            return -1;
+        }
+
+        *received += (size_t)n;
+    }
+
+    return 0;
+}
+
+/*! \internal \brief Keep the part of a frame read when the thread was stopped
+
+ The polling code then completes the frame instead of starting in the
+ middle of it.
+*/
+static void monitor_binary_io_keep(const unsigned char *bytes, size_t length)
+{
+    unsigned char *leftover;
+    size_t rest = io_leftover_length - io_leftover_offset;
+
+    if (length == 0 || atomic_load(&io_thread_running)) {
+        return;
+    }
+
+    /* bytes not taken from an earlier leftover still follow */
+    leftover = lib_malloc(length + rest);
+    memcpy(leftover, bytes, length);
+    if (rest > 0) {
+        memcpy(&leftover[length], &io_leftover[io_leftover_offset], rest);
+    }
+    monitor_binary_leftover_clear();
+    io_leftover = leftover;
+    io_leftover_length = length + rest;
+}
+
+/*! \internal \brief Read the next command, laid out as monitor_binary_process_command() expects
+
+ \return 1 with a frame, 0 if a byte that doesn't start a frame was skipped,
+         -1 if the connection is gone or the thread stops
+*/
+static int monitor_binary_io_read_frame(vice_network_socket_t *socket, unsigned char **frame)
+{
+    unsigned char header[6];
+    size_t received = 0;
+    uint32_t body_length;
+    unsigned char *buffer;
+
+    *frame = NULL;
+
+    if (monitor_binary_io_receive(socket, header, 1, &received) < 0) {
+        return -1;
+    }
+
+    if (header[0] != ASC_STX) {
+        return 0;
+    }
+
+    /* API version and body length */
+    if (monitor_binary_io_receive(socket, header, sizeof(header), &received) < 0) {
+        monitor_binary_io_keep(header, received);
+        return -1;
+    }
+
+    if (header[1] < 0x01 || header[1] > 0x02) {
+        return 0;
+    }
+
+    body_length = little_endian_to_uint32(&header[2]);
+
+    /* request ID and command type follow the length */
+    buffer = lib_malloc(sizeof(header) + 5 + body_length + 1);
+    memcpy(buffer, header, sizeof(header));
+
+    if (monitor_binary_io_receive(socket, buffer, sizeof(header) + 5 + body_length, &received) < 0) {
+        monitor_binary_io_keep(buffer, received);
+        lib_free(buffer);
+        return -1;
+    }
+
+    *frame = buffer;
+
+    return 1;
+}
+
+static void *monitor_binary_io_main(void *arg)
+{
+    vice_network_socket_t *socket = arg;
+    vice_network_socket_t *sockets[2] = { listen_socket, NULL };
+
+    while (atomic_load(&io_thread_running)) {
+        unsigned char *frame;
+        int result;
+
+        if (socket == NULL) {
+            if (vice_network_select_multiple(sockets) > 0) {
+                socket = vice_network_accept(listen_socket);
+                if (socket != NULL) {
+                    monitor_binary_queue_push(e_QUEUE_OPENED, socket, NULL);
+                }
+            }
+            continue;
+        }
+
+        result = monitor_binary_io_read_frame(socket, &frame);
+        if (result > 0) {
+            monitor_binary_queue_push(e_QUEUE_COMMAND, NULL, frame);
+        } else if (result < 0 && atomic_load(&io_thread_running)) {
+            monitor_binary_queue_push(e_QUEUE_CLOSED, socket, NULL);
+            socket = NULL;
+        }
+    }
+
+    return NULL;
+}
+
+static void monitor_binary_io_start(void)
+{
+    if (atomic_load(&io_thread_running)) {
+        return;
+    }
+
+    /* process what was queued before the thread was stopped first */
+    monitor_binary_queue_command_ready();
+
+    atomic_store(&io_thread_running, 1);
+    if (pthread_create(&io_thread, NULL, monitor_binary_io_main, connected_socket) != 0) {
+        atomic_store(&io_thread_running, 0);
+        log_error(LOG_DEFAULT, "monitor_binary_io_start(): could not start the I/O thread, polling instead");
+    }
+}
+
+static void monitor_binary_io_stop(void)
+{
+    if (!atomic_load(&io_thread_running)) {
+        return;
+    }
+
+    atomic_store(&io_thread_running, 0);
+    pthread_join(io_thread, NULL);
+
+    pthread_mutex_lock(&queue_lock);
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+/*! \brief Wait until the I/O thread queued something, or usec have passed */
+void monitor_binary_wait_command(unsigned long usec)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)(usec / 1000000);
+    deadline.tv_nsec += (long)(usec % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    while (atomic_load(&queue_length) == 0 && atomic_load(&io_thread_running)) {
+        if (pthread_cond_timedwait(&queue_cond, &queue_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+/*! \brief Non-zero if the connected client is served by the I/O thread */
+int monitor_binary_has_io_thread(void)
+{
+    return connected_socket != NULL && atomic_load(&io_thread_running);
+}
+
+#else
+
+void monitor_binary_wait_command(unsigned long usec)
+{
+}
+
+int monitor_binary_has_io_thread(void)
+{
+    return 0;
+}
+
+#endif
+
 static int monitor_binary_activate(void)
 {
     vice_network_socket_address_t * server_addr = NULL;
@@ -1671,6 +2626,12 @@ static int monitor_binary_activate(void)
             break;
         }
 
+#ifdef HAVE_WORKER_THREADS
+        if (monitor_binary_thread_enabled) {
+            monitor_binary_io_start();
+        }
+#endif
+
         error = 0;
     } while (0);
 
@@ -1686,6 +2647,16 @@ int monitor_binary_get_command_line(void)
     static size_t buffer_size = 0;
     static unsigned char *buffer;
 
+#ifdef HAVE_WORKER_THREADS
+    if (!monitor_binary_process_queue()) {
+        return 0;
+    }
+
+    if (atomic_load(&io_thread_running)) {
+        return 1;
+    }
+#endif
+
     while (monitor_binary_data_available()) {
         uint32_t body_length;
         uint8_t api_version;
@@ -1762,6 +2733,10 @@ int monitor_binary_get_command_line(void)
 
 static int monitor_binary_deactivate(void)
 {
+#ifdef HAVE_WORKER_THREADS
+    monitor_binary_io_stop();
+#endif
+
     if (listen_socket) {
         vice_network_socket_close(listen_socket);
         listen_socket = NULL;
@@ -1837,6 +2812,39 @@ static int set_binary_server_address(const char *name, void *param)
     return 0;
 }
 
+/*! \internal \brief read the binary monitor sockets on a separate thread
+
+ \param val
+   if 0, poll the sockets at vsync; else, use the I/O thread.
+
+ \param param
+   unused
+
+ \return
+   0 on success.
+*/
+static int set_binary_monitor_thread(int value, void *param)
+{
+    int val = value ? 1 : 0;
+
+    if (val == monitor_binary_thread_enabled) {
+        return 0;
+    }
+    monitor_binary_thread_enabled = val;
+
+#ifdef HAVE_WORKER_THREADS
+    if (listen_socket != NULL) {
+        if (val) {
+            monitor_binary_io_start();
+        } else {
+            monitor_binary_io_stop();
+        }
+    }
+#endif
+
+    return 0;
+}
+
 /*! \brief string resources used by the binary monitor module */
 static const resource_string_t resources_string[] = {
     { "BinaryMonitorServerAddress", "ip4://127.0.0.1:6502", RES_EVENT_NO, NULL,
@@ -1848,6 +2856,8 @@ static const resource_string_t resources_string[] = {
 static const resource_int_t resources_int[] = {
     { "BinaryMonitorServer", 0, RES_EVENT_STRICT, (resource_value_t)0,
       &monitor_binary_enabled, set_binary_monitor_enabled, NULL },
+    { "BinaryMonitorServerThread", 1, RES_EVENT_NO, NULL,
+      &monitor_binary_thread_enabled, set_binary_monitor_thread, NULL },
     RESOURCE_INT_LIST_END
 };
 
@@ -1871,9 +2881,15 @@ int monitor_binary_resources_init(void)
 void monitor_binary_resources_shutdown(void)
 {
     monitor_binary_deactivate();
+#ifdef HAVE_WORKER_THREADS
+    monitor_binary_queue_clear();
+#endif
     monitor_binary_quit();
 
     lib_free(monitor_binary_server_address);
+    lib_free(response_buffer);
+    response_buffer = NULL;
+    response_buffer_size = 0;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -1889,6 +2905,12 @@ static const cmdline_option_t cmdline_options[] =
     { "-binarymonitoraddress", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "BinaryMonitorServerAddress", NULL,
       "<Name>", "The local address the binary monitor should bind to" },
+    { "-binarymonitorthread", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "BinaryMonitorServerThread", (resource_value_t)1,
+      NULL, "Read the binary monitor connection on a separate thread" },
+    { "+binarymonitorthread", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "BinaryMonitorServerThread", (resource_value_t)0,
+      NULL, "Poll the binary monitor connection at every frame" },
     CMDLINE_LIST_END
 };
 
@@ -50,6 +50,8 @@ int monitor_binary_get_command_line(void);
 
 int monitor_is_binary(void);
 vice_network_socket_t *monitor_binary_get_connected_socket(void);
+int monitor_binary_has_io_thread(void);
+void monitor_binary_wait_command(unsigned long usec);
 
 ui_jam_action_t monitor_binary_ui_jam_dialog(const char *format, ...) VICE_ATTR_PRINTF;
 
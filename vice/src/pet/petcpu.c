@@ -66,6 +66,9 @@
 
 #define HAVE_6809_REGS
 
+/* Polling loops can be skipped */
+#define IDLE_SKIP_ALLOWED() 1
+
 #ifdef FEATURE_CPUMEMHISTORY
 
 /* FIXME: the following functions should handle IO/RAM/ROM and -dummy accesses
@@ -0,0 +1,209 @@
+//  ---------------------------------------------------------------------------
+//  This file is part of reSID, a MOS6581 SID emulator engine.
+//  Copyright (C) 2010  Dag Lem <resid@nimrod.no>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//  ---------------------------------------------------------------------------
+
+#include "convolve.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define RESID_CONVOLVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RESID_CONVOLVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace reSID
+{
+
+// ----------------------------------------------------------------------------
+// Scalar reference.
+// ----------------------------------------------------------------------------
+static int convolve_scalar(const short* a, const short* b, int n)
+{
+  int out = 0;
+  for (int i = 0; i < n; i++) {
+    out += a[i]*b[i];
+  }
+  return out;
+}
+
+#if RESID_CONVOLVE_X86
+// ----------------------------------------------------------------------------
+// SSE2 and AVX2: pmaddwd multiplies pairs of shorts and adds each pair into
+// a 32-bit lane. The lanes are summed at the end; the sum wraps exactly like
+// the scalar int accumulator does.
+// ----------------------------------------------------------------------------
+__attribute__((target("sse2")))
+static int convolve_sse2(const short* a, const short* b, int n)
+{
+  __m128i acc = _mm_setzero_si128();
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+  }
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  int out = _mm_cvtsi128_si32(acc);
+  for (; i < n; i++) {
+    out += a[i]*b[i];
+  }
+  return out;
+}
+
+__attribute__((target("avx2")))
+static int convolve_avx2(const short* a, const short* b, int n)
+{
+  __m256i acc = _mm256_setzero_si256();
+  int i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+  }
+
+  __m128i acc4 = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                               _mm256_extracti128_si256(acc, 1));
+  if (i + 8 <= n) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+    acc4 = _mm_add_epi32(acc4, _mm_madd_epi16(va, vb));
+    i += 8;
+  }
+  acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  int out = _mm_cvtsi128_si32(acc4);
+  for (; i < n; i++) {
+    out += a[i]*b[i];
+  }
+  return out;
+}
+#endif
+
+#if RESID_CONVOLVE_NEON
+// ----------------------------------------------------------------------------
+// NEON: widening multiply-accumulate into four 32-bit lanes.
+// ----------------------------------------------------------------------------
+static int convolve_neon(const short* a, const short* b, int n)
+{
+  int32x4_t acc = vdupq_n_s32(0);
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t va = vld1q_s16(a + i);
+    int16x8_t vb = vld1q_s16(b + i);
+    acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+    acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+  }
+
+#if defined(__aarch64__)
+  int out = vaddvq_s32(acc);
+#else
+  int32x2_t sum2 = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+  int out = vget_lane_s32(vpadd_s32(sum2, sum2), 0);
+#endif
+  for (; i < n; i++) {
+    out += a[i]*b[i];
+  }
+  return out;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Runtime selection.
+// ----------------------------------------------------------------------------
+typedef struct {
+  const char* name;
+  convolve_func func;
+  bool (*available)();
+} convolve_impl;
+
+static bool always() { return true; }
+
+#if RESID_CONVOLVE_X86
+// These run during static initialization, possibly before libgcc has set up
+// the CPU model, hence the explicit __builtin_cpu_init().
+static bool have_sse2() { __builtin_cpu_init(); return __builtin_cpu_supports("sse2"); }
+static bool have_avx2() { __builtin_cpu_init(); return __builtin_cpu_supports("avx2"); }
+#endif
+
+// Fastest first.
+static const convolve_impl impls[] = {
+#if RESID_CONVOLVE_X86
+  { "avx2", convolve_avx2, have_avx2 },
+  { "sse2", convolve_sse2, have_sse2 },
+#endif
+#if RESID_CONVOLVE_NEON
+  { "neon", convolve_neon, always },
+#endif
+  { "scalar", convolve_scalar, always }
+};
+
+static const int n_impls = sizeof(impls)/sizeof(*impls);
+
+static int convolve_best()
+{
+  int i = 0;
+  while (!impls[i].available()) {
+    i++;    // the scalar one at the end always is
+  }
+  return i;
+}
+
+// The fastest implementation is picked during static initialization, before
+// any SID thread exists. Picking it on the first call instead would have
+// several threads write the pointer while others call through it.
+static const int best = convolve_best();
+
+static const char* current_name = impls[best].name;
+
+convolve_func convolve = impls[best].func;
+
+bool convolve_select(const char* name)
+{
+  for (int i = 0; i < n_impls; i++) {
+    if (name && strcmp(name, impls[i].name) != 0) {
+      continue;
+    }
+    if (impls[i].available()) {
+      current_name = impls[i].name;
+      convolve = impls[i].func;
+      return true;
+    }
+    if (name) {
+      return false;
+    }
+  }
+  return false;
+}
+
+const char* convolve_name()
+{
+  return current_name;
+}
+
+} // namespace reSID
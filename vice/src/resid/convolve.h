@@ -0,0 +1,46 @@
+//  ---------------------------------------------------------------------------
+//  This file is part of reSID, a MOS6581 SID emulator engine.
+//  Copyright (C) 2010  Dag Lem <resid@nimrod.no>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//  ---------------------------------------------------------------------------
+
+#ifndef RESID_CONVOLVE_H
+#define RESID_CONVOLVE_H
+
+namespace reSID
+{
+
+// Dot product of two vectors of n shorts, i.e. one output sample of the
+// resampling FIR filter. Every implementation returns exactly what the plain
+// scalar loop returns (with 32-bit wraparound), so the choice never changes
+// the audio output.
+typedef int (*convolve_func)(const short* a, const short* b, int n);
+
+extern convolve_func convolve;
+
+// The fastest implementation the CPU supports is in use from the start.
+// Select one by name ("scalar", "sse2", "avx2" or "neon"), or the fastest
+// again when name is 0. Returns false, leaving the current choice, when the
+// named one is not available here. Not thread safe: only call it while no
+// SID is being clocked.
+bool convolve_select(const char* name);
+
+// Name of the implementation in use.
+const char* convolve_name();
+
+} // namespace reSID
+
+#endif // not RESID_CONVOLVE_H
@@ -0,0 +1,209 @@
+//  ---------------------------------------------------------------------------
+//  This file is part of reSID, a MOS6581 SID emulator engine.
+//  Copyright (C) 2010  Dag Lem <resid@nimrod.no>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//  ---------------------------------------------------------------------------
+
+// Benchmark for the reSID sampling methods. Plays the same register stream
+// through each method, and through each FIR convolution implementation
+// available on this CPU for the resampling methods, and reports the cost per
+// output sample. The resampled output of every implementation is compared
+// against the scalar one; the exit code is 1 if any of them differ.
+
+#include "sid.h"
+#include "convolve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+using namespace reSID;
+
+static const double clock_freq = 985248.0;    // PAL
+static const cycle_count frame_cycles = 19656; // 312 lines of 63 cycles
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+// Three voices and the filter, swept once per frame like a music player.
+static void play_frame(SID& sid, int frame)
+{
+  static const reg8 init[] = {
+    0x00, 0x10, 0x00, 0x08, 0x41, 0x09, 0xa9,
+    0x00, 0x18, 0x00, 0x04, 0x21, 0x0a, 0xa8,
+    0x00, 0x20, 0x00, 0x02, 0x11, 0x08, 0xc9,
+    0x00, 0x40, 0xf7, 0x1f
+  };
+
+  if (frame == 0) {
+    for (int i = 0; i < 25; i++) {
+      sid.write(i, init[i]);
+    }
+  }
+  sid.write(0x01, frame & 0xff);
+  sid.write(0x08, (frame << 1) & 0xff);
+  sid.write(0x0f, ((frame << 1) ^ 0x5a) & 0xff);
+  sid.write(0x16, frame & 0xff);
+  if ((frame & 0x0f) == 0) {
+    reg8 ctrl = 0x21 | ((frame & 0x10) << 2);
+    sid.write(0x04, ctrl);
+    sid.write(0x0b, ctrl);
+    sid.write(0x12, ctrl);
+  } else if ((frame & 0x0f) == 0x0c) {
+    sid.write(0x04, 0x40);
+    sid.write(0x0b, 0x40);
+    sid.write(0x12, 0x40);
+  }
+}
+
+static void run(chip_model model, sampling_method method, double sample_freq,
+                int frames, std::vector<short>& out,
+                double& ns, unsigned long long& tsc)
+{
+  SID sid;
+  short buf[4096];
+
+  sid.set_chip_model(model);
+  sid.set_sampling_parameters(clock_freq, method, sample_freq);
+  out.clear();
+
+  double start_ns = now_ns();
+#if HAVE_TSC
+  unsigned long long start_tsc = __rdtsc();
+#endif
+  for (int frame = 0; frame < frames; frame++) {
+    play_frame(sid, frame);
+    cycle_count delta_t = frame_cycles;
+    while (delta_t > 0) {
+      int n = sid.clock(delta_t, buf, sizeof(buf)/sizeof(*buf));
+      out.insert(out.end(), buf, buf + n);
+    }
+  }
+#if HAVE_TSC
+  tsc = __rdtsc() - start_tsc;
+#else
+  tsc = 0;
+#endif
+  ns = now_ns() - start_ns;
+}
+
+static void usage(const char* prog)
+{
+  fprintf(stderr,
+          "usage: %s [-s seconds] [-r rate] [-m 6581|8580]\n"
+          "  -s  emulated seconds per run (default 10)\n"
+          "  -r  output sample rate (default 44100)\n"
+          "  -m  chip model (default 8580)\n", prog);
+  exit(2);
+}
+
+int main(int argc, char** argv)
+{
+  static const struct {
+    const char* name;
+    sampling_method method;
+    bool fir;
+  } methods[] = {
+    { "fast", SAMPLE_FAST, false },
+    { "interpolate", SAMPLE_INTERPOLATE, false },
+    { "resample", SAMPLE_RESAMPLE, true },
+    { "resample-fastmem", SAMPLE_RESAMPLE_FASTMEM, true }
+  };
+  static const char* impls[] = { "scalar", "sse2", "avx2", "neon" };
+
+  double seconds = 10.0;
+  double sample_freq = 44100.0;
+  chip_model model = MOS8580;
+  int mismatches = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      sample_freq = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+      model = (atoi(argv[++i]) == 6581) ? MOS6581 : MOS8580;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (seconds <= 0 || sample_freq < 4000) {
+    usage(argv[0]);
+  }
+
+  int frames = int(seconds*clock_freq/frame_cycles);
+
+  printf("%s, %.0f Hz, %.1f emulated seconds, best convolution: %s\n",
+         model == MOS6581 ? "6581" : "8580", sample_freq, seconds,
+         (convolve_select(0), convolve_name()));
+  printf("%-17s %-7s %10s %14s %12s  %s\n",
+         "method", "fir", "ns/sample", "cycles/sample", "x real time", "output");
+
+  for (unsigned m = 0; m < sizeof(methods)/sizeof(*methods); m++) {
+    std::vector<short> reference;
+
+    for (unsigned k = 0; k < sizeof(impls)/sizeof(*impls); k++) {
+      if (k > 0 && !methods[m].fir) {
+        break;
+      }
+      if (!convolve_select(impls[k])) {
+        continue;
+      }
+
+      std::vector<short> out;
+      double ns;
+      unsigned long long tsc;
+      run(model, methods[m].method, sample_freq, frames, out, ns, tsc);
+
+      const char* result = "reference";
+      if (k == 0) {
+        reference.swap(out);
+      } else if (out == reference) {
+        result = "identical";
+      } else {
+        result = "DIFFERS";
+        mismatches++;
+      }
+
+      size_t samples = (k == 0) ? reference.size() : out.size();
+      char cycles[32];
+      if (tsc) {
+        snprintf(cycles, sizeof(cycles), "%.1f", double(tsc)/samples);
+      } else {
+        snprintf(cycles, sizeof(cycles), "n/a");
+      }
+      printf("%-17s %-7s %10.1f %14s %12.1f  %s\n",
+             methods[m].name, methods[m].fir ? impls[k] : "-",
+             ns/samples, cycles, seconds*1e9/ns,
+             methods[m].fir ? result : "-");
+    }
+  }
+
+  convolve_select(0);
+
+  return mismatches ? 1 : 0;
+}
@@ -25,6 +25,7 @@
 #endif
 
 #include "sid.h"
+#include "convolve.h"
 #include <cmath>
 #include <cassert>
 
@@ -1005,10 +1006,7 @@ int SID::clock_resample(cycle_count& delta_t, short* buf, int n, int interleave)
     short* sample_start = sample + sample_index - fir_N - 1 + RINGSIZE;
 
     // Convolution with filter impulse response.
-    int v1 = 0;
-    for (int j = 0; j < fir_N; j++) {
-      v1 += sample_start[j]*fir_start[j];
-    }
+    int v1 = convolve(sample_start, fir_start, fir_N);
 
     // Use next FIR table, wrap around to first FIR table using
     // next sample.
@@ -1019,10 +1017,7 @@ int SID::clock_resample(cycle_count& delta_t, short* buf, int n, int interleave)
     fir_start = fir + fir_offset*fir_N;
 
     // Convolution with filter impulse response.
-    int v2 = 0;
-    for (int k = 0; k < fir_N; k++) {
-      v2 += sample_start[k]*fir_start[k];
-    }
+    int v2 = convolve(sample_start, fir_start, fir_N);
 
     // Linear interpolation.
     // fir_offset_rmd is equal for all samples, it can thus be factorized out:
@@ -1071,10 +1066,7 @@ int SID::clock_resample_fastmem(cycle_count& delta_t, short* buf, int n, int int
     short* sample_start = sample + sample_index - fir_N + RINGSIZE;
 
     // Convolution with filter impulse response.
-    int v = 0;
-    for (int j = 0; j < fir_N; j++) {
-      v += sample_start[j]*fir_start[j];
-    }
+    int v = convolve(sample_start, fir_start, fir_N);
 
     v >>= FIR_SHIFT;
 
@@ -0,0 +1,597 @@
+/*
+ * rewind.c - Keep the recent machine state in memory to step back in time.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/*
+    With RewindEnable set the machine state is captured in memory every
+    RewindInterval frames, right after the vsync. A capture is either a
+    keyframe, a full snapshot, or a delta against the last keyframe (see
+    snapshot_mem_make_delta()). A new keyframe is taken once a delta grows
+    beyond a quarter of the keyframe, so restoring never needs more than the
+    keyframe and one delta.
+
+    The input events (keyboard, joystick, datasette) recorded by event.c are
+    kept in a log alongside. Stepping back restores the newest capture at or
+    before the wanted frame and replays the log in warp mode up to the vsync
+    of that frame, which makes the machine end up in the same state it was
+    in back then. Captures and input after that frame are dropped.
+
+    When the captures and the log use more than RewindMemory MiB the oldest
+    delta is dropped, or the oldest keyframe once all its deltas are gone.
+
+    Disk images and ROMs are not part of the captures.
+*/
+
+#include "vice.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "alarm.h"
+#include "archdep.h"
+#include "cmdline.h"
+#include "datasette.h"
+#include "interrupt.h"
+#include "joystick.h"
+#include "keyboard.h"
+#include "lib.h"
+#include "log.h"
+#include "machine.h"
+#include "maincpu.h"
+#include "resources.h"
+#include "rewind.h"
+#include "snapshot.h"
+#include "types.h"
+#include "vice-event.h"
+#include "vsync.h"
+
+/* A delta larger than 1/REWIND_KEYFRAME_RATIO of its keyframe starts a new
+   keyframe. */
+#define REWIND_KEYFRAME_RATIO   4
+
+typedef struct rewind_state_s {
+    /* Full snapshot (keyframe) or delta against the keyframe before it.  */
+    snapshot_mem_t *mem;
+
+    /* Frame and clock the state was captured at.  */
+    uint64_t frame;
+    CLOCK clk;
+
+    /* First input event recorded after the capture.  */
+    event_list_t *event;
+
+    struct rewind_state_s *next;
+} rewind_state_t;
+
+static log_t rewind_log = LOG_DEFAULT;
+
+static int rewind_enabled = 0;
+static int rewind_interval = 10;
+static int rewind_memory = 64;
+
+/* Captured states from oldest to newest, and the newest keyframe.  */
+static rewind_state_t *states_head = NULL;
+static rewind_state_t *states_tail = NULL;
+static rewind_state_t *keyframe = NULL;
+static int num_states = 0;
+static size_t states_bytes = 0;
+
+/* Input since the oldest state, current is the empty end of the list.  */
+static event_list_state_t input_log = { NULL, NULL };
+static size_t input_log_bytes = 0;
+
+/* Every capture is written here first, so the buffer is reused.  */
+static snapshot_mem_t *scratch = NULL;
+
+/* Frames since rewind was enabled.  */
+static uint64_t frame = 0;
+static uint64_t next_capture = 0;
+static int force_keyframe = 0;
+
+/* Replay after stepping back.  */
+static alarm_t *replay_alarm = NULL;
+static event_list_t *replay_event = NULL;
+static uint64_t replay_target = 0;
+static int replaying = 0;
+static int replay_warp = 0;
+static tick_t replay_start;
+
+/* Capture statistics, logged at shutdown.  */
+static unsigned long captures = 0;
+static unsigned long keyframes = 0;
+static uint64_t capture_ticks = 0;
+static tick_t capture_ticks_max = 0;
+static uint64_t capture_frames = 0;
+
+static void rewind_replay_done_trap(uint16_t addr, void *unused);
+
+/* ------------------------------------------------------------------------- */
+
+static int is_keyframe(const rewind_state_t *state)
+{
+    return !snapshot_mem_is_delta(state->mem);
+}
+
+static void free_event(event_list_t *event)
+{
+    input_log_bytes -= sizeof(event_list_t) + event->size;
+    lib_free(event->data);
+    lib_free(event);
+}
+
+static void free_state(rewind_state_t *state)
+{
+    states_bytes -= snapshot_mem_get_size(state->mem);
+    num_states--;
+    snapshot_mem_free(state->mem);
+    lib_free(state);
+}
+
+/* Drop the input before the oldest state.  */
+static void trim_input_log(void)
+{
+    event_list_t *stop = states_head != NULL ? states_head->event : input_log.current;
+
+    while (input_log.base != stop) {
+        event_list_t *next = input_log.base->next;
+
+        free_event(input_log.base);
+        input_log.base = next;
+    }
+}
+
+/* Drop the input from event on, it becomes the end of the log.  */
+static void cut_input_log(event_list_t *event)
+{
+    event_list_t *next = event->next;
+
+    while (next != NULL) {
+        event_list_t *n = next->next;
+
+        free_event(next);
+        next = n;
+    }
+
+    input_log_bytes -= event->size;
+    lib_free(event->data);
+    event->data = NULL;
+    event->size = 0;
+    event->type = EVENT_LIST_END;
+    event->next = NULL;
+    input_log.current = event;
+}
+
+static void replay_stop(void)
+{
+    if (replay_alarm != NULL) {
+        alarm_unset(replay_alarm);
+    }
+    if (replaying) {
+        replaying = 0;
+        vsync_set_warp_mode(replay_warp);
+    }
+}
+
+static void rewind_clear(void)
+{
+    replay_stop();
+
+    while (states_head != NULL) {
+        rewind_state_t *next = states_head->next;
+
+        free_state(states_head);
+        states_head = next;
+    }
+    states_tail = NULL;
+    keyframe = NULL;
+
+    if (input_log.base != NULL) {
+        event_clear_list(&input_log);
+        input_log.base = NULL;
+        input_log.current = NULL;
+    }
+    input_log_bytes = 0;
+
+    next_capture = frame + 1;
+    force_keyframe = 0;
+}
+
+/* Keep the states and the log within RewindMemory.  */
+static void rewind_evict(void)
+{
+    size_t limit = (size_t)rewind_memory << 20;
+
+    while (states_bytes + input_log_bytes > limit && states_head != states_tail) {
+        rewind_state_t *next = states_head->next;
+
+        if (!is_keyframe(next)) {
+            /* a delta of the oldest keyframe */
+            states_head->next = next->next;
+            if (states_tail == next) {
+                states_tail = states_head;
+            }
+            free_state(next);
+            if (keyframe == states_head) {
+                /* its deltas are the only ones, start the next group */
+                force_keyframe = 1;
+            }
+        } else {
+            free_state(states_head);
+            states_head = next;
+            trim_input_log();
+        }
+    }
+}
+
+/* Drop the states after state.  */
+static void drop_states_after(rewind_state_t *state)
+{
+    rewind_state_t *s;
+
+    while (state->next != NULL) {
+        rewind_state_t *next = state->next->next;
+
+        free_state(state->next);
+        state->next = next;
+    }
+    states_tail = state;
+
+    keyframe = NULL;
+    for (s = states_head; s != NULL; s = s->next) {
+        if (is_keyframe(s)) {
+            keyframe = s;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void rewind_capture_trap(uint16_t addr, void *unused)
+{
+    rewind_state_t *state;
+    tick_t start, elapsed;
+    int key;
+
+    if (!rewind_enabled || replaying
+        || (states_tail != NULL && states_tail->frame >= frame)) {
+        return;
+    }
+
+    /* The clock went back, a snapshot was loaded.  */
+    if (states_tail != NULL && maincpu_clk < states_tail->clk) {
+        rewind_clear();
+    }
+
+    start = tick_now();
+
+    if (rewind_log == LOG_DEFAULT) {
+        rewind_log = log_open("Rewind");
+    }
+    if (scratch == NULL) {
+        scratch = snapshot_mem_new();
+    }
+    if (input_log.base == NULL) {
+        event_register_event_list(&input_log);
+        input_log_bytes = sizeof(event_list_t);
+    }
+
+    key = keyframe == NULL || force_keyframe;
+    if (machine_write_snapshot_mem(scratch, key ? NULL : keyframe->mem, 0, 0, 0) < 0) {
+        log_error(rewind_log, "Cannot capture the machine state, rewind disabled.");
+        resources_set_int("RewindEnable", 0);
+        return;
+    }
+
+    state = lib_calloc(1, sizeof(rewind_state_t));
+    state->mem = snapshot_mem_copy(scratch);
+    state->frame = frame;
+    state->clk = maincpu_clk;
+    state->event = input_log.current;
+
+    if (states_tail != NULL) {
+        states_tail->next = state;
+    } else {
+        states_head = state;
+    }
+    states_tail = state;
+    num_states++;
+    states_bytes += snapshot_mem_get_size(state->mem);
+
+    if (key) {
+        keyframe = state;
+        force_keyframe = 0;
+        keyframes++;
+    } else if (snapshot_mem_get_size(state->mem)
+               > snapshot_mem_get_size(keyframe->mem) / REWIND_KEYFRAME_RATIO) {
+        force_keyframe = 1;
+    }
+
+    rewind_evict();
+
+    elapsed = tick_now_delta(start);
+    captures++;
+    capture_ticks += elapsed;
+    if (elapsed > capture_ticks_max) {
+        capture_ticks_max = elapsed;
+    }
+}
+
+void rewind_vsync_hook(void)
+{
+    if (!rewind_enabled) {
+        if (states_head != NULL) {
+            rewind_clear();
+        }
+        return;
+    }
+
+    frame++;
+    capture_frames++;
+
+    if (replaying) {
+        if (frame == replay_target) {
+            interrupt_maincpu_trigger_trap(rewind_replay_done_trap, NULL);
+        }
+        return;
+    }
+
+    if (frame >= next_capture) {
+        next_capture = frame + (uint64_t)rewind_interval;
+        interrupt_maincpu_trigger_trap(rewind_capture_trap, NULL);
+    }
+}
+
+void rewind_reset(void)
+{
+    rewind_clear();
+}
+
+void rewind_event_record(unsigned int type, void *data, unsigned int size)
+{
+    if (!rewind_enabled || replaying || states_head == NULL) {
+        return;
+    }
+
+    switch (type) {
+        case EVENT_KEYBOARD_MATRIX:
+        case EVENT_KEYBOARD_RESTORE:
+        case EVENT_JOYSTICK_VALUE:
+        case EVENT_DATASETTE:
+            event_record_in_list(&input_log, type, data, size);
+            input_log_bytes += sizeof(event_list_t) + size;
+            break;
+        default:
+            /* Resets and attached images are not replayed */
+            break;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void replay_alarm_handler(CLOCK offset, void *data)
+{
+    alarm_unset(replay_alarm);
+
+    switch (replay_event->type) {
+        case EVENT_KEYBOARD_MATRIX:
+            keyboard_event_playback(offset, replay_event->data);
+            break;
+        case EVENT_KEYBOARD_RESTORE:
+            keyboard_restore_event_playback(offset, replay_event->data);
+            break;
+        case EVENT_JOYSTICK_VALUE:
+            joystick_event_playback(offset, replay_event->data);
+            break;
+        case EVENT_DATASETTE:
+            datasette_event_playback_port1(offset, replay_event->data);
+            break;
+        default:
+            break;
+    }
+
+    replay_event = replay_event->next;
+    if (replay_event->type != EVENT_LIST_END) {
+        alarm_set(replay_alarm, replay_event->clk);
+    }
+}
+
+/* Run as a trap like the capture, so the machine is where it was when the
+   state of the target frame was captured. */
+static void rewind_replay_done_trap(uint16_t addr, void *unused)
+{
+    tick_t elapsed = tick_now_delta(replay_start);
+
+    replay_stop();
+
+    /* What was recorded after this frame has not happened now */
+    cut_input_log(replay_event);
+
+    log_message(rewind_log, "Stepped back to frame %"PRIu64", %.1f ms.",
+                frame, (double)TICK_TO_MICRO(elapsed) / 1000.0);
+}
+
+static void rewind_step_back_trap(uint16_t addr, void *data)
+{
+    uint64_t back = (uint64_t)vice_ptr_to_int(data);
+    uint64_t target;
+    rewind_state_t *state;
+
+    if (states_head == NULL || replaying) {
+        return;
+    }
+
+    replay_start = tick_now();
+
+    target = frame > back ? frame - back : 0;
+    if (target < states_head->frame) {
+        target = states_head->frame;
+    }
+
+    /* Newest state at or before the target */
+    for (state = states_head;
+         state->next != NULL && state->next->frame <= target;
+         state = state->next) {
+    }
+    drop_states_after(state);
+
+    if (replay_alarm == NULL) {
+        replay_alarm = alarm_new(maincpu_alarm_context, "Rewind", replay_alarm_handler, NULL);
+    }
+    alarm_unset(replay_alarm);
+
+    if (machine_read_snapshot_mem(state->mem, 0) < 0) {
+        log_error(rewind_log, "Cannot restore the machine state of frame %"PRIu64".", state->frame);
+        rewind_clear();
+        return;
+    }
+
+    frame = state->frame;
+    next_capture = frame + (uint64_t)rewind_interval;
+    replay_event = state->event;
+    replay_target = target;
+
+    if (frame == target) {
+        rewind_replay_done_trap(addr, NULL);
+        return;
+    }
+
+    replaying = 1;
+    replay_warp = vsync_get_warp_mode();
+    vsync_set_warp_mode(1);
+
+    if (replay_event->type != EVENT_LIST_END) {
+        alarm_set(replay_alarm, replay_event->clk);
+    }
+}
+
+int rewind_step_back(int frames)
+{
+    if (!rewind_enabled || frames <= 0 || replaying
+        || event_record_active() || event_playback_active()) {
+        return -1;
+    }
+
+    interrupt_maincpu_trigger_trap(rewind_step_back_trap, vice_int_to_ptr(frames));
+
+    return 0;
+}
+
+int rewind_replay_active(void)
+{
+    return replaying;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void rewind_shutdown(void)
+{
+    if (captures > 0) {
+        double frames = capture_frames ? (double)capture_frames : 1.0;
+
+        log_message(rewind_log, "%lu captures every %d frames (%lu keyframes): %.1f us on average, %.1f us at most, %.1f us per frame.",
+                    captures, rewind_interval, keyframes,
+                    (double)TICK_TO_MICRO(capture_ticks) / captures,
+                    (double)TICK_TO_MICRO(capture_ticks_max),
+                    (double)TICK_TO_MICRO(capture_ticks) / frames);
+        if (states_head != NULL) {
+            log_message(rewind_log, "%d states covering %.1f s in %.1f MiB.",
+                        num_states,
+                        (double)(states_tail->frame - states_head->frame) / vsync_get_refresh_frequency(),
+                        (double)(states_bytes + input_log_bytes) / (1024.0 * 1024.0));
+        }
+    }
+
+    rewind_clear();
+    snapshot_mem_free(scratch);
+    scratch = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int set_rewind_enabled(int val, void *param)
+{
+    rewind_enabled = val ? 1 : 0;
+
+    /* The states are dropped by the next vsync when disabled */
+    next_capture = frame + 1;
+
+    return 0;
+}
+
+static int set_rewind_interval(int val, void *param)
+{
+    if (val < 1 || val > 250) {
+        return -1;
+    }
+
+    rewind_interval = val;
+
+    return 0;
+}
+
+static int set_rewind_memory(int val, void *param)
+{
+    if (val < 1 || val > 4096) {
+        return -1;
+    }
+
+    rewind_memory = val;
+
+    return 0;
+}
+
+static const resource_int_t resources_int[] = {
+    { "RewindEnable", 0, RES_EVENT_NO, NULL,
+      &rewind_enabled, set_rewind_enabled, NULL },
+    { "RewindInterval", 10, RES_EVENT_NO, NULL,
+      &rewind_interval, set_rewind_interval, NULL },
+    { "RewindMemory", 64, RES_EVENT_NO, NULL,
+      &rewind_memory, set_rewind_memory, NULL },
+    RESOURCE_INT_LIST_END
+};
+
+int rewind_resources_init(void)
+{
+    return resources_register_int(resources_int);
+}
+
+static const cmdline_option_t cmdline_options[] =
+{
+    { "-rewind", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "RewindEnable", (resource_value_t)1,
+      NULL, "Keep the recent machine state in memory to step back in time" },
+    { "+rewind", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "RewindEnable", (resource_value_t)0,
+      NULL, "Do not keep the recent machine state in memory (default)" },
+    { "-rewindinterval", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "RewindInterval", NULL,
+      "<frames>", "Capture the machine state every <frames> frames (1-250, default 10)" },
+    { "-rewindmemory", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "RewindMemory", NULL,
+      "<MiB>", "Memory used for the rewind buffer (1-4096, default 64)" },
+    CMDLINE_LIST_END
+};
+
+int rewind_cmdline_options_init(void)
+{
+    return cmdline_register_options(cmdline_options);
+}
@@ -0,0 +1,47 @@
+/*
+ * rewind.h - Keep the recent machine state in memory to step back in time.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_REWIND_H
+#define VICE_REWIND_H
+
+int rewind_resources_init(void);
+int rewind_cmdline_options_init(void);
+void rewind_shutdown(void);
+
+/* Called by vsync_do_vsync() at the end of every frame. */
+void rewind_vsync_hook(void);
+
+/* Forget everything, the clock of the machine starts again. */
+void rewind_reset(void);
+
+/* Called by event_record() for every input event. */
+void rewind_event_record(unsigned int type, void *data, unsigned int size);
+
+/* Go back the given number of frames, -1 if that is not possible now. */
+int rewind_step_back(int frames);
+
+/* Non-zero while the input is replayed up to the frame that was stepped
+   back to; the input of the user is ignored meanwhile. */
+int rewind_replay_active(void);
+
+#endif
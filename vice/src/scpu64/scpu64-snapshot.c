@@ -68,6 +68,9 @@ int scpu64_snapshot_write(const char *name, int save_roms, int save_disks, int e
 
     sound_snapshot_prepare();
 
+    /* no drive worker thread may run while the drive state is saved */
+    drive_cpu_park_all();
+
     /* Execute drive CPUs to get in sync with the main CPU.  */
     drive_cpu_execute_all(maincpu_clk);
 
@@ -114,6 +117,9 @@ int scpu64_snapshot_read(const char *name, int event_mode)
 
     joyport_clear_devices();
 
+    /* no drive worker thread may run while the machine state is replaced */
+    drive_cpu_park_all();
+
     if (maincpu_snapshot_read_module(s) < 0
         || scpu64_snapshot_read_module(s) < 0
         || ciacore_snapshot_read_module(machine_context.cia1, s) < 0
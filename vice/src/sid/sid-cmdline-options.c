@@ -210,6 +210,9 @@ static const cmdline_option_t resid_cmdline_options[] =
       NULL, NULL, "SidResidEnableRawOutput", (void *)1, NULL, "Enable writing raw reSID output to resid.raw, 16bit little endian data (WARNING: 1MiB per second)." },
     { "+residrawoutput", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
       NULL, NULL, "SidResidEnableRawOutput", (void *)0, NULL, "Disable writing raw reSID output to resid.raw." },
+    { "-residthreads", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "SidResidThreads", NULL,
+      "<number>", "Number of worker threads that render the extra SIDs of a multi-SID setup (0: render all SIDs on the emulation thread)" },
     CMDLINE_LIST_END
 };
 #endif
@@ -34,12 +34,17 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef HAVE_WORKER_THREADS
+#include <pthread.h>
+#endif
+
 #include "alarm.h"
 #include "catweaselmkiii.h"
 #include "fastsid.h"
 #include "hardsid.h"
 #include "joyport.h"
 #include "lib.h"
+#include "log.h"
 #include "machine.h"
 #include "maincpu.h"
 #include "parsid.h"
@@ -120,6 +125,362 @@ uint8_t *sid_get_siddata(unsigned int channel)
 
 /* ------------------------------------------------------------------------- */
 
+/*
+    Parallel rendering of multi-SID setups (SidResidThreads).
+
+    Normally every store to a SID first runs sound_run_sound(), which renders
+    all SIDs up to the current cycle, and then hands the byte to the engine.
+    With worker threads enabled the stores are instead queued per chip, with
+    the cycle they happened on. When the sound code next asks for samples,
+    each chip replays its own queue: render up to the cycle of a store, apply
+    the store, and so on up to the end of the requested period. The chips
+    are independent of each other, so they are rendered in parallel, one
+    share of the chips per thread, with the calling thread taking a share
+    as well. The rendered chip streams are then mixed on the calling thread
+    exactly like in the sequential case, so the output does not depend on
+    the number of threads.
+
+    Anything that looks at the engine state outside of sample calculation
+    (reads go through sound_read(), which renders first; reset, dumps and
+    snapshots apply the queued stores first) sees all stores.
+*/
+
+#if defined(HAVE_WORKER_THREADS) && defined(HAVE_RESID) && !defined(SOUND_SYSTEM_FLOAT)
+#define SID_THREADS
+#endif
+
+#ifdef SID_THREADS
+
+/* a fragment never holds more than a frame worth of stores */
+#define SID_QUEUE_SIZE  8192
+
+typedef struct sid_queue_entry_s {
+    CLOCK clk;
+    uint8_t addr;
+    uint8_t val;
+} sid_queue_entry_t;
+
+/* -1: not checked since the engine was (re)initialized, 0: off, 1: running */
+static int sid_threads_state = -1;
+static int sid_threads_scc = 0;
+static int sid_threads_workers = 0;
+
+static pthread_t sid_threads_thread[SOUND_SIDS_MAX];
+static int sid_threads_share[SOUND_SIDS_MAX];
+static pthread_mutex_t sid_threads_lock;
+static pthread_cond_t sid_threads_work_cond;
+static pthread_cond_t sid_threads_done_cond;
+static unsigned int sid_threads_generation = 0;
+static int sid_threads_outstanding = 0;
+static int sid_threads_quit = 0;
+
+static sid_queue_entry_t *sid_queue[SOUND_SIDS_MAX];
+static int sid_queue_len[SOUND_SIDS_MAX];
+
+/* the period being rendered */
+static sound_t *render_psid[SOUND_SIDS_MAX];
+static int render_nr;
+static CLOCK render_start;
+static CLOCK render_delta;
+
+/* the rendered chip streams, valid while sid_threads_rendered is set */
+static int16_t *render_buf[SOUND_SIDS_MAX];
+static int render_buf_len = 0;
+static int render_count[SOUND_SIDS_MAX];
+static CLOCK render_left[SOUND_SIDS_MAX];
+static int sid_threads_rendered = 0;
+
+static void sid_threads_render_chip(int chipno)
+{
+    sound_t *psid = render_psid[chipno];
+    int16_t *buf = render_buf[chipno];
+    sid_queue_entry_t *entry;
+    CLOCK pos = 0;
+    CLOCK left = 0;
+    CLOCK delta;
+    CLOCK at;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < sid_queue_len[chipno]; i++) {
+        entry = &sid_queue[chipno][i];
+        /* stores queued while sound was not rendered (warp) come first */
+        at = (entry->clk > render_start) ? entry->clk - render_start : 0;
+        if (at > render_delta) {
+            at = render_delta;
+        }
+        if (at > pos) {
+            delta = at - pos;
+            n += sid_engine.calculate_samples(psid, buf + n, render_nr - n, SOUND_OUTPUT_MONO, &delta);
+            left += delta;
+            pos = at;
+        }
+        sid_engine.store(psid, entry->addr, entry->val);
+    }
+    sid_queue_len[chipno] = 0;
+
+    delta = render_delta - pos;
+    n += sid_engine.calculate_samples(psid, buf + n, render_nr - n, SOUND_OUTPUT_MONO, &delta);
+    left += delta;
+
+    render_count[chipno] = n;
+    render_left[chipno] = left;
+}
+
+static void sid_threads_render_share(int share)
+{
+    int chipno;
+
+    for (chipno = share; chipno < sid_threads_scc; chipno += sid_threads_workers + 1) {
+        sid_threads_render_chip(chipno);
+    }
+}
+
+static void *sid_threads_main(void *arg)
+{
+    int share = *(int *)arg;
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&sid_threads_lock);
+    for (;;) {
+        while (!sid_threads_quit && sid_threads_generation == seen) {
+            pthread_cond_wait(&sid_threads_work_cond, &sid_threads_lock);
+        }
+        if (sid_threads_quit) {
+            break;
+        }
+        seen = sid_threads_generation;
+        pthread_mutex_unlock(&sid_threads_lock);
+
+        sid_threads_render_share(share);
+
+        pthread_mutex_lock(&sid_threads_lock);
+        if (--sid_threads_outstanding == 0) {
+            pthread_cond_signal(&sid_threads_done_cond);
+        }
+    }
+    pthread_mutex_unlock(&sid_threads_lock);
+
+    return NULL;
+}
+
+/* Hand all queued stores to the engine right away. */
+static void sid_threads_apply_queues(void)
+{
+    sound_t *psid;
+    int chipno;
+    int i;
+
+    for (chipno = 0; chipno < sid_threads_scc; chipno++) {
+        psid = sound_get_psid(chipno);
+        if (psid != NULL) {
+            for (i = 0; i < sid_queue_len[chipno]; i++) {
+                sid_engine.store(psid, sid_queue[chipno][i].addr, sid_queue[chipno][i].val);
+            }
+        }
+        sid_queue_len[chipno] = 0;
+    }
+}
+
+static void sid_threads_stop(void)
+{
+    int i;
+
+    if (sid_threads_state > 0) {
+        sid_threads_apply_queues();
+
+        pthread_mutex_lock(&sid_threads_lock);
+        sid_threads_quit = 1;
+        pthread_cond_broadcast(&sid_threads_work_cond);
+        pthread_mutex_unlock(&sid_threads_lock);
+
+        for (i = 0; i < sid_threads_workers; i++) {
+            pthread_join(sid_threads_thread[i], NULL);
+        }
+        pthread_cond_destroy(&sid_threads_done_cond);
+        pthread_cond_destroy(&sid_threads_work_cond);
+        pthread_mutex_destroy(&sid_threads_lock);
+
+        for (i = 0; i < sid_threads_scc; i++) {
+            lib_free(sid_queue[i]);
+            sid_queue[i] = NULL;
+            lib_free(render_buf[i]);
+            render_buf[i] = NULL;
+        }
+        render_buf_len = 0;
+        sid_threads_workers = 0;
+        sid_threads_scc = 0;
+    }
+    sid_threads_state = -1;
+}
+
+static void sid_threads_start(int scc)
+{
+    const char *device = NULL;
+    int threads = 0;
+    int rawoutput = 0;
+    int i;
+
+    sid_threads_state = 0;
+
+    if (scc < 2 || sid_engine_type != SID_ENGINE_RESID || sid_store_func != sound_store) {
+        return;
+    }
+    if (resources_get_int("SidResidThreads", &threads) < 0 || threads <= 0) {
+        return;
+    }
+    /* the raw output file is shared by all chips */
+    resources_get_int("SidResidEnableRawOutput", &rawoutput);
+    if (rawoutput) {
+        return;
+    }
+    /* the dump device wants to see every store as it happens */
+    resources_get_string("SoundDeviceName", &device);
+    if (device != NULL && strcmp(device, "dump") == 0) {
+        return;
+    }
+
+    sid_threads_scc = scc;
+    sid_threads_workers = (threads < scc - 1) ? threads : scc - 1;
+    for (i = 0; i < scc; i++) {
+        sid_queue[i] = lib_malloc(SID_QUEUE_SIZE * sizeof(sid_queue_entry_t));
+        sid_queue_len[i] = 0;
+    }
+
+    pthread_mutex_init(&sid_threads_lock, NULL);
+    pthread_cond_init(&sid_threads_work_cond, NULL);
+    pthread_cond_init(&sid_threads_done_cond, NULL);
+    sid_threads_generation = 0;
+    sid_threads_outstanding = 0;
+    sid_threads_quit = 0;
+
+    for (i = 0; i < sid_threads_workers; i++) {
+        sid_threads_share[i] = i + 1;
+        if (pthread_create(&sid_threads_thread[i], NULL, sid_threads_main, &sid_threads_share[i]) != 0) {
+            log_error(LOG_DEFAULT, "SID: could not start render thread %d.", i + 1);
+            break;
+        }
+    }
+    if (i < sid_threads_workers) {
+        /* stop the ones that did start, and render on this thread */
+        sid_threads_workers = i;
+        sid_threads_state = 1;
+        sid_threads_stop();
+        sid_threads_state = 0;
+        return;
+    }
+
+    log_message(LOG_DEFAULT, "SID: rendering %d SIDs on %d threads.", scc, sid_threads_workers + 1);
+    sid_threads_state = 1;
+}
+
+/* Render all chips of the period ending at maincpu_clk, replaying their
+   queued stores. Returns 0 if the stores were not queued. */
+static int sid_threads_render(sound_t **psid, int nr, int scc, CLOCK delta_t)
+{
+    int i;
+
+    if (sid_threads_state < 0) {
+        sid_threads_start(scc);
+    }
+    if (sid_threads_state <= 0 || scc != sid_threads_scc) {
+        return 0;
+    }
+
+    if (render_buf_len < nr) {
+        for (i = 0; i < scc; i++) {
+            render_buf[i] = lib_realloc(render_buf[i], nr * sizeof(int16_t));
+        }
+        render_buf_len = nr;
+    }
+    for (i = 0; i < scc; i++) {
+        render_psid[i] = psid[i];
+    }
+    render_nr = nr;
+    render_delta = delta_t;
+    render_start = maincpu_clk - delta_t;
+
+    pthread_mutex_lock(&sid_threads_lock);
+    sid_threads_generation++;
+    sid_threads_outstanding = sid_threads_workers;
+    pthread_cond_broadcast(&sid_threads_work_cond);
+    pthread_mutex_unlock(&sid_threads_lock);
+
+    sid_threads_render_share(0);
+
+    pthread_mutex_lock(&sid_threads_lock);
+    while (sid_threads_outstanding > 0) {
+        pthread_cond_wait(&sid_threads_done_cond, &sid_threads_lock);
+    }
+    pthread_mutex_unlock(&sid_threads_lock);
+
+    sid_threads_rendered = 1;
+
+    return 1;
+}
+
+#endif /* SID_THREADS */
+
+/* Queue a store for the render threads, or pass it on as usual. */
+static void sid_store_engine(uint16_t addr, uint8_t byte, int chipno)
+{
+#ifdef SID_THREADS
+    sid_queue_entry_t *entry;
+
+    if (sid_threads_state > 0 && chipno < sid_threads_scc && sid_store_func == sound_store) {
+        if (sid_queue_len[chipno] == SID_QUEUE_SIZE) {
+            sid_threads_apply_queues();
+        }
+        entry = &sid_queue[chipno][sid_queue_len[chipno]++];
+        entry->clk = maincpu_clk;
+        entry->addr = (uint8_t)addr;
+        entry->val = byte;
+        return;
+    }
+#endif
+    sid_store_func(addr, byte, chipno);
+}
+
+/* Make sure the engine has seen all stores before its state is used. */
+static void sid_engine_sync(void)
+{
+#ifdef SID_THREADS
+    if (sid_threads_state > 0) {
+        sid_threads_apply_queues();
+    }
+#endif
+}
+
+/* Get the samples of one chip, from the engine or from the streams the
+   render threads produced. */
+#ifndef SOUND_SYSTEM_FLOAT
+static int sid_calculate_chip(sound_t *psid, int16_t *pbuf, int nr, int interleave, CLOCK *delta_t)
+{
+#ifdef SID_THREADS
+    int chipno;
+    int n;
+    int i;
+
+    if (sid_threads_rendered) {
+        for (chipno = 0; chipno < sid_threads_scc - 1; chipno++) {
+            if (render_psid[chipno] == psid) {
+                break;
+            }
+        }
+        n = (render_count[chipno] < nr) ? render_count[chipno] : nr;
+        for (i = 0; i < n; i++) {
+            pbuf[i * interleave] = render_buf[chipno][i];
+        }
+        *delta_t = render_left[chipno];
+        return n;
+    }
+#endif
+    return sid_engine.calculate_samples(psid, pbuf, nr, interleave, delta_t);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
 static int sid_read_off(uint16_t addr, int chipno)
 {
     uint8_t val;
@@ -251,11 +612,11 @@ static void sid_store_chip(uint16_t addr, uint8_t byte, int chipno)
 
     if (maincpu_rmw_flag) {
         maincpu_clk--;
-        sid_store_func(addr, lastsidread, chipno);
+        sid_store_engine(addr, lastsidread, chipno);
         maincpu_clk++;
     }
 
-    sid_store_func(addr, byte, chipno);
+    sid_store_engine(addr, byte, chipno);
 }
 
 static int sid_dump_chip(int chipno)
@@ -568,16 +929,26 @@ GETBUFx(7)
 
 int sid_sound_machine_init_vbr(sound_t *psid, int speed, int cycles_per_sec, int factor)
 {
+#ifdef SID_THREADS
+    sid_threads_stop();
+#endif
     return sid_engine.init(psid, speed * factor / 1000, cycles_per_sec, factor);
 }
 
 int sid_sound_machine_init(sound_t *psid, int speed, int cycles_per_sec)
 {
+#ifdef SID_THREADS
+    /* the setup may have changed, check again on the next fragment */
+    sid_threads_stop();
+#endif
     return sid_engine.init(psid, speed, cycles_per_sec, 1000);
 }
 
 void sid_sound_machine_close(sound_t *psid)
 {
+#ifdef SID_THREADS
+    sid_threads_stop();
+#endif
     sid_engine.close(psid);
 #ifndef SOUND_SYSTEM_FLOAT
     /* free the temp. buffers */
@@ -631,6 +1002,7 @@ void sid_sound_machine_store(sound_t *psid, uint16_t addr, uint8_t byte)
 
 void sid_sound_machine_reset(sound_t *psid, CLOCK cpu_clk)
 {
+    sid_engine_sync();
     sid_engine.reset(psid, cpu_clk);
 }
 
@@ -641,7 +1013,7 @@ int sid_sound_machine_calculate_samples(sound_t **psid, float *pbuf, int nr, int
     return sid_engine.calculate_samples(psid[scc], pbuf, nr, delta_t);
 }
 #else
-int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, int soc, int scc, CLOCK *delta_t)
+static int sid_mix_samples(sound_t **psid, int16_t *pbuf, int nr, int soc, int scc, CLOCK *delta_t)
 {
     int i;
     int16_t *tmp_buf1;
@@ -655,12 +1027,12 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
     CLOCK tmp_delta_t = *delta_t;
 
     if (soc == SOUND_OUTPUT_MONO && scc == SOUND_1_DEVICE) {
-        return sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
+        return sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
     }
     if (soc == SOUND_OUTPUT_MONO && scc == SOUND_2_DEVICES) {
         tmp_buf1 = getbuf1(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf1[i]);
         }
@@ -669,10 +1041,10 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
     if (soc == SOUND_OUTPUT_MONO && scc == SOUND_3_DEVICES) {
         tmp_buf1 = getbuf1(2 * nr);
         tmp_buf2 = getbuf2(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf1[i]);
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf2[i]);
@@ -683,12 +1055,12 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         tmp_buf1 = getbuf1(2 * nr);
         tmp_buf2 = getbuf2(2 * nr);
         tmp_buf3 = getbuf3(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf1[i]);
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf2[i]);
@@ -701,14 +1073,14 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         tmp_buf2 = getbuf2(2 * nr);
         tmp_buf3 = getbuf3(2 * nr);
         tmp_buf4 = getbuf4(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[4], tmp_buf4, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[4], tmp_buf4, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf1[i]);
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf2[i]);
@@ -723,16 +1095,16 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         tmp_buf3 = getbuf3(2 * nr);
         tmp_buf4 = getbuf4(2 * nr);
         tmp_buf5 = getbuf5(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[4], tmp_buf4, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[4], tmp_buf4, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[5], tmp_buf5, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[5], tmp_buf5, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf1[i]);
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf2[i]);
@@ -749,18 +1121,18 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         tmp_buf4 = getbuf4(2 * nr);
         tmp_buf5 = getbuf5(2 * nr);
         tmp_buf6 = getbuf6(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[4], tmp_buf4, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[4], tmp_buf4, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[5], tmp_buf5, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[5], tmp_buf5, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[6], tmp_buf6, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[6], tmp_buf6, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf1[i]);
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf2[i]);
@@ -779,20 +1151,20 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         tmp_buf5 = getbuf5(2 * nr);
         tmp_buf6 = getbuf6(2 * nr);
         tmp_buf7 = getbuf7(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[4], tmp_buf4, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[4], tmp_buf4, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[5], tmp_buf5, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[5], tmp_buf5, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[6], tmp_buf6, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[6], tmp_buf6, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[7], tmp_buf7, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[7], tmp_buf7, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf, nr, SOUND_OUTPUT_MONO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf1[i]);
             pbuf[i] = sound_audio_mix(pbuf[i], tmp_buf2[i]);
@@ -805,23 +1177,23 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         return tmp_nr;
     }
     if (soc == SOUND_OUTPUT_STEREO && scc == SOUND_1_DEVICE) {
-        tmp_nr = sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[(i * 2) + 1] = pbuf[i * 2];
         }
         return tmp_nr;
     }
     if (soc == SOUND_OUTPUT_STEREO && scc == SOUND_2_DEVICES) {
-        tmp_nr = sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
         return tmp_nr;
     }
     if (soc == SOUND_OUTPUT_STEREO && scc == SOUND_3_DEVICES) {
         tmp_buf1 = getbuf1(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf1, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf1[i]);
             pbuf[(i * 2) + 1] = sound_audio_mix(pbuf[(i * 2) + 1], tmp_buf1[i]);
@@ -829,12 +1201,12 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
     }
     if (soc == SOUND_OUTPUT_STEREO && scc == SOUND_4_DEVICES) {
         tmp_buf1 = getbuf1(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf1[i * 2]);
             pbuf[(i * 2) + 1] = sound_audio_mix(pbuf[(i * 2) + 1], tmp_buf1[(i * 2) + 1]);
@@ -843,14 +1215,14 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
     if (soc == SOUND_OUTPUT_STEREO && scc == SOUND_5_DEVICES) {
         tmp_buf1 = getbuf1(2 * nr);
         tmp_buf2 = getbuf2(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[4], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[4], tmp_buf2, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf1[i * 2]);
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf2[i]);
@@ -861,16 +1233,16 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
     if (soc == SOUND_OUTPUT_STEREO && scc == SOUND_6_DEVICES) {
         tmp_buf1 = getbuf1(2 * nr);
         tmp_buf2 = getbuf2(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[4], tmp_buf2, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[4], tmp_buf2, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[5], tmp_buf2 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[5], tmp_buf2 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf1[i * 2]);
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf2[i * 2]);
@@ -882,18 +1254,18 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         tmp_buf1 = getbuf1(2 * nr);
         tmp_buf2 = getbuf2(2 * nr);
         tmp_buf3 = getbuf3(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[4], tmp_buf2, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[4], tmp_buf2, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[5], tmp_buf2 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[5], tmp_buf2 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[6], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[6], tmp_buf3, nr, SOUND_OUTPUT_MONO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf1[i * 2]);
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf2[i * 2]);
@@ -907,20 +1279,20 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         tmp_buf1 = getbuf1(2 * nr);
         tmp_buf2 = getbuf2(2 * nr);
         tmp_buf3 = getbuf3(2 * nr);
-        tmp_nr = sid_engine.calculate_samples(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[2], tmp_buf1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[3], tmp_buf1 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[4], tmp_buf2, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[4], tmp_buf2, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[5], tmp_buf2 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[5], tmp_buf2 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[6], tmp_buf3, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[6], tmp_buf3, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[7], tmp_buf3 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[7], tmp_buf3 + 1, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
         tmp_delta_t = *delta_t;
-        tmp_nr = sid_engine.calculate_samples(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
-        tmp_nr = sid_engine.calculate_samples(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
+        tmp_nr = sid_calculate_chip(psid[0], pbuf, nr, SOUND_OUTPUT_STEREO, &tmp_delta_t);
+        tmp_nr = sid_calculate_chip(psid[1], pbuf + 1, nr, SOUND_OUTPUT_STEREO, delta_t);
         for (i = 0; i < tmp_nr; i++) {
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf1[i * 2]);
             pbuf[i * 2] = sound_audio_mix(pbuf[i * 2], tmp_buf2[i * 2]);
@@ -932,10 +1304,25 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
     }
     return tmp_nr;
 }
+
+int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, int soc, int scc, CLOCK *delta_t)
+{
+#ifdef SID_THREADS
+    int retval;
+
+    if (sid_threads_render(psid, nr, scc, *delta_t)) {
+        retval = sid_mix_samples(psid, pbuf, nr, soc, scc, delta_t);
+        sid_threads_rendered = 0;
+        return retval;
+    }
+#endif
+    return sid_mix_samples(psid, pbuf, nr, soc, scc, delta_t);
+}
 #endif
 
 char *sid_sound_machine_dump_state(sound_t *psid)
 {
+    sid_engine_sync();
     return sid_engine.dump_state(psid);
 }
 
@@ -1078,6 +1465,7 @@ int sid_engine_set(int engine)
 
 void sid_state_read(unsigned int channel, sid_snapshot_state_t *sid_state)
 {
+    sid_engine_sync();
     sid_engine.state_read(sound_get_psid(channel), sid_state);
 }
 
@@ -1088,6 +1476,7 @@ void sid_state_write(unsigned int channel, sid_snapshot_state_t *sid_state)
                 __FILE__, __LINE__, __func__);
     } else {
         sound_t *psid = sound_get_psid(channel);
+        sid_engine_sync();
         if (psid == NULL) {
             fprintf(stderr, "%s:%d:%s(): sound_get_psid() returned NULL\n",
                     __FILE__, __LINE__, __func__);
@@ -154,6 +154,10 @@ enum {
 #define RESID_8580_FILTER_BIAS_ONE          1000
 #define RESID_8580_FILTER_BIAS_DEFAULT      0
 
+/* worker threads for rendering the SIDs of a multi-SID setup (SidResidThreads) */
+#define RESID_THREADS_MIN                   0
+#define RESID_THREADS_MAX                   (SOUND_SIDS_MAX - 1)
+
 
 void machine_sid2_enable(int val);
 
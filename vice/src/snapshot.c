@@ -67,9 +67,25 @@ static const char snapshot_version_magic_string[] = "VICE Version\032";
 #define SNAPSHOT_MAGIC_LEN              19
 #define SNAPSHOT_VERSION_MAGIC_LEN      13
 
+/* Size of a module header: name, major and minor version, size.  */
+#define SNAPSHOT_MODULE_HEADER_LEN      (SNAPSHOT_MODULE_NAME_LEN + 2 + 4)
+
+/* Modules are compared against the base of a delta in pages of this size.  */
+#define SNAPSHOT_MEM_PAGE_SIZE          256
+
+/* Number of bytes converted at once by the word and dword array functions.  */
+#define SNAPSHOT_CHUNK_SIZE             256
+
+/* Delta operations, each followed by the length as uint32_t.  */
+#define SNAPSHOT_DELTA_COPY             0   /* uint32_t offset in the base */
+#define SNAPSHOT_DELTA_LITERAL          1   /* the bytes themselves */
+#define SNAPSHOT_DELTA_XOR              2   /* uint32_t offset in the base */
+
+#define SNAPSHOT_DELTA_OP_LEN           (1 + 2 * sizeof(uint32_t))
+
 struct snapshot_module_s {
-    /* File descriptor.  */
-    FILE *file;
+    /* Snapshot the module belongs to.  */
+    snapshot_t *snapshot;
 
     /* Flag: are we writing it?  */
     int write_mode;
@@ -85,9 +101,22 @@ struct snapshot_module_s {
 };
 
 struct snapshot_s {
-    /* File descriptor.  */
+    /* File descriptor, NULL for a snapshot in memory.  */
     FILE *file;
 
+    /* Buffer a snapshot in memory is written to.  */
+    snapshot_mem_t *mem;
+
+    /* Image a snapshot in memory is read from.  */
+    const uint8_t *image;
+    size_t image_len;
+
+    /* Image rebuilt from a delta, freed on close.  */
+    uint8_t *delta_image;
+
+    /* Current offset, tracked instead of asking ftell() every time.  */
+    long pos;
+
     /* Offset of the first module.  */
     long first_module_offset;
 
@@ -95,79 +124,198 @@ struct snapshot_s {
     int write_mode;
 };
 
+/* Page hashes of a module in a snapshot that is used as base of a delta.  */
+typedef struct snapshot_mem_module_s {
+    char name[SNAPSHOT_MODULE_NAME_LEN];
+    size_t offset;
+    size_t size;
+    size_t first_page;
+} snapshot_mem_module_t;
+
+struct snapshot_mem_s {
+    /* The snapshot image, or the delta operations if base is set.  */
+    uint8_t *data;
+    size_t len;
+    size_t size;
+
+    /* Offset of the first module in the image.  */
+    size_t first_module_offset;
+
+    /* Base of a delta, NULL for a full snapshot.  */
+    snapshot_mem_t *base;
+
+    /* Length of the image a delta rebuilds.  */
+    size_t image_len;
+
+    /* Buffer of the full image while the snapshot is a delta.  */
+    uint8_t *spare;
+    size_t spare_size;
+
+    /* Modules and their page hashes, built the first time the snapshot is
+       used as base of a delta.  */
+    snapshot_mem_module_t *modules;
+    int num_modules;
+    uint64_t *page_hash;
+};
+
+/* Where snapshot_create() and snapshot_open() go instead of a file.  */
+static snapshot_mem_t *mem_target = NULL;
+
 /* ------------------------------------------------------------------------- */
 
-static int snapshot_write_byte(FILE *f, uint8_t data)
+static void snapshot_mem_reserve(snapshot_mem_t *mem, size_t len)
 {
-    current_fpos = ftell(f);
-    if (fputc(data, f) == EOF) {
-        snapshot_error = SNAPSHOT_WRITE_EOF_ERROR;
-        return -1;
+    size_t size = mem->size ? mem->size : 0x10000;
+
+    while (size < len) {
+        size *= 2;
+    }
+    if (size != mem->size) {
+        mem->data = lib_realloc(mem->data, size);
+        mem->size = size;
+    }
+}
+
+static int snapshot_put(snapshot_t *s, const uint8_t *data, size_t num)
+{
+    current_fpos = (size_t)s->pos;
+
+    if (s->file != NULL) {
+        if (num > 0 && fwrite(data, num, 1, s->file) < 1) {
+            return -1;
+        }
+    } else {
+        snapshot_mem_t *mem = s->mem;
+        size_t end = (size_t)s->pos + num;
+
+        if (end > mem->size) {
+            snapshot_mem_reserve(mem, end);
+        }
+        memcpy(mem->data + s->pos, data, num);
+        if (end > mem->len) {
+            mem->len = end;
+        }
     }
 
+    s->pos += (long)num;
     return 0;
 }
 
-static int snapshot_write_word(FILE *f, uint16_t data)
+static int snapshot_get(snapshot_t *s, uint8_t *data, size_t num)
 {
-    current_fpos = ftell(f);
-    if (snapshot_write_byte(f, (uint8_t)(data & 0xff)) < 0
-        || snapshot_write_byte(f, (uint8_t)(data >> 8)) < 0) {
-        return -1;
+    current_fpos = (size_t)s->pos;
+
+    if (s->file != NULL) {
+        if (num > 0 && fread(data, num, 1, s->file) < 1) {
+            return -1;
+        }
+    } else {
+        if ((size_t)s->pos + num > s->image_len) {
+            return -1;
+        }
+        memcpy(data, s->image + s->pos, num);
     }
 
+    s->pos += (long)num;
     return 0;
 }
 
-static int snapshot_write_dword(FILE *f, uint32_t data)
+static int snapshot_seek(snapshot_t *s, long offset)
 {
-    current_fpos = ftell(f);
-    if (snapshot_write_word(f, (uint16_t)(data & 0xffff)) < 0
-        || snapshot_write_word(f, (uint16_t)(data >> 16)) < 0) {
+    if (s->file != NULL) {
+        if (fseek(s->file, offset, SEEK_SET) < 0) {
+            return -1;
+        }
+    } else if (offset < 0) {
         return -1;
     }
 
+    s->pos = offset;
     return 0;
 }
 
-static int snapshot_write_qword(FILE *f, uint64_t data)
+/* Write the lowest num bytes of data in little endian order.  */
+static int snapshot_put_le(snapshot_t *s, uint64_t data, int num)
 {
-    current_fpos = ftell(f);
-    if (snapshot_write_dword(f, (uint32_t)(data & 0xffffffff)) < 0
-        || snapshot_write_dword(f, (uint32_t)(data >> 32)) < 0) {
+    uint8_t buf[8];
+    int i;
+
+    for (i = 0; i < num; i++) {
+        buf[i] = (uint8_t)(data >> (i * 8));
+    }
+    if (snapshot_put(s, buf, (size_t)num) < 0) {
+        snapshot_error = SNAPSHOT_WRITE_EOF_ERROR;
         return -1;
     }
 
     return 0;
 }
 
-static int snapshot_write_double(FILE *f, double data)
+static int snapshot_get_le(snapshot_t *s, uint64_t *data, int num)
 {
-    uint8_t *byte_data = (uint8_t *)&data;
+    uint8_t buf[8];
+    uint64_t val = 0;
     int i;
 
-    current_fpos = ftell(f);
-    for (i = 0; i < sizeof(double); i++) {
-        if (snapshot_write_byte(f, byte_data[i]) < 0) {
-            return -1;
-        }
+    if (snapshot_get(s, buf, (size_t)num) < 0) {
+        snapshot_error = SNAPSHOT_READ_EOF_ERROR;
+        return -1;
+    }
+    for (i = num - 1; i >= 0; i--) {
+        val = (val << 8) | buf[i];
     }
+    *data = val;
+
     return 0;
 }
 
-static int snapshot_write_padded_string(FILE *f, const char *s, uint8_t pad_char,
-                                        int len)
+/* ------------------------------------------------------------------------- */
+
+static int snapshot_write_byte(snapshot_t *s, uint8_t data)
+{
+    return snapshot_put_le(s, data, 1);
+}
+
+static int snapshot_write_word(snapshot_t *s, uint16_t data)
 {
-    int i, found_zero;
-    uint8_t c;
+    return snapshot_put_le(s, data, 2);
+}
+
+static int snapshot_write_dword(snapshot_t *s, uint32_t data)
+{
+    return snapshot_put_le(s, data, 4);
+}
+
+static int snapshot_write_qword(snapshot_t *s, uint64_t data)
+{
+    return snapshot_put_le(s, data, 8);
+}
+
+static int snapshot_write_double(snapshot_t *s, double data)
+{
+    if (snapshot_put(s, (const uint8_t *)&data, sizeof(double)) < 0) {
+        snapshot_error = SNAPSHOT_WRITE_EOF_ERROR;
+        return -1;
+    }
+    return 0;
+}
 
-    current_fpos = ftell(f);
-    for (i = found_zero = 0; i < len; i++) {
-        if (!found_zero && s[i] == 0) {
-            found_zero = 1;
+static int snapshot_write_padded_string(snapshot_t *s, const char *str, uint8_t pad_char,
+                                        int len)
+{
+    uint8_t buf[SNAPSHOT_CHUNK_SIZE];
+    int i, j, n, found_zero;
+
+    for (i = found_zero = 0; i < len; i += n) {
+        n = len - i < SNAPSHOT_CHUNK_SIZE ? len - i : SNAPSHOT_CHUNK_SIZE;
+        for (j = 0; j < n; j++) {
+            if (!found_zero && str[i + j] == 0) {
+                found_zero = 1;
+            }
+            buf[j] = found_zero ? pad_char : (uint8_t)str[i + j];
         }
-        c = found_zero ? (uint8_t)pad_char : (uint8_t) s[i];
-        if (snapshot_write_byte(f, c) < 0) {
+        if (snapshot_put(s, buf, (size_t)n) < 0) {
+            snapshot_error = SNAPSHOT_WRITE_EOF_ERROR;
             return -1;
         }
     }
@@ -175,10 +323,9 @@ static int snapshot_write_padded_string(FILE *f, const char *s, uint8_t pad_char
     return 0;
 }
 
-static int snapshot_write_byte_array(FILE *f, const uint8_t *data, unsigned int num)
+static int snapshot_write_byte_array(snapshot_t *s, const uint8_t *data, unsigned int num)
 {
-    current_fpos = ftell(f);
-    if (num > 0 && fwrite(data, (size_t)num, 1, f) < 1) {
+    if (snapshot_put(s, data, (size_t)num) < 0) {
         snapshot_error = SNAPSHOT_WRITE_BYTE_ARRAY_ERROR;
         return -1;
     }
@@ -186,13 +333,19 @@ static int snapshot_write_byte_array(FILE *f, const uint8_t *data, unsigned int
     return 0;
 }
 
-static int snapshot_write_word_array(FILE *f, const uint16_t *data, unsigned int num)
+static int snapshot_write_word_array(snapshot_t *s, const uint16_t *data, unsigned int num)
 {
-    unsigned int i;
-
-    current_fpos = ftell(f);
-    for (i = 0; i < num; i++) {
-        if (snapshot_write_word(f, data[i]) < 0) {
+    uint8_t buf[SNAPSHOT_CHUNK_SIZE];
+    unsigned int i, j, n;
+
+    for (i = 0; i < num; i += n) {
+        n = num - i < SNAPSHOT_CHUNK_SIZE / 2 ? num - i : SNAPSHOT_CHUNK_SIZE / 2;
+        for (j = 0; j < n; j++) {
+            buf[j * 2] = (uint8_t)(data[i + j] & 0xff);
+            buf[j * 2 + 1] = (uint8_t)(data[i + j] >> 8);
+        }
+        if (snapshot_put(s, buf, n * 2) < 0) {
+            snapshot_error = SNAPSHOT_WRITE_EOF_ERROR;
             return -1;
         }
     }
@@ -200,13 +353,21 @@ static int snapshot_write_word_array(FILE *f, const uint16_t *data, unsigned int
     return 0;
 }
 
-static int snapshot_write_dword_array(FILE *f, const uint32_t *data, unsigned int num)
+static int snapshot_write_dword_array(snapshot_t *s, const uint32_t *data, unsigned int num)
 {
-    unsigned int i;
-
-    current_fpos = ftell(f);
-    for (i = 0; i < num; i++) {
-        if (snapshot_write_dword(f, data[i]) < 0) {
+    uint8_t buf[SNAPSHOT_CHUNK_SIZE];
+    unsigned int i, j, n;
+
+    for (i = 0; i < num; i += n) {
+        n = num - i < SNAPSHOT_CHUNK_SIZE / 4 ? num - i : SNAPSHOT_CHUNK_SIZE / 4;
+        for (j = 0; j < n; j++) {
+            buf[j * 4] = (uint8_t)(data[i + j] & 0xff);
+            buf[j * 4 + 1] = (uint8_t)(data[i + j] >> 8);
+            buf[j * 4 + 2] = (uint8_t)(data[i + j] >> 16);
+            buf[j * 4 + 3] = (uint8_t)(data[i + j] >> 24);
+        }
+        if (snapshot_put(s, buf, n * 4) < 0) {
+            snapshot_error = SNAPSHOT_WRITE_EOF_ERROR;
             return -1;
         }
     }
@@ -215,103 +376,77 @@ static int snapshot_write_dword_array(FILE *f, const uint32_t *data, unsigned in
 }
 
 
-static int snapshot_write_string(FILE *f, const char *s)
+static int snapshot_write_string(snapshot_t *s, const char *str)
 {
-    size_t len, i;
+    size_t len;
 
-    len = s ? (strlen(s) + 1) : 0;      /* length includes nullbyte */
+    len = str ? (strlen(str) + 1) : 0;      /* length includes nullbyte */
 
-    current_fpos = ftell(f);
-    if (snapshot_write_word(f, (uint16_t)len) < 0) {
+    if (snapshot_write_word(s, (uint16_t)len) < 0) {
         return -1;
     }
 
-    for (i = 0; i < len; i++) {
-        if (snapshot_write_byte(f, s[i]) < 0) {
-            return -1;
-        }
+    if (snapshot_put(s, (const uint8_t *)str, len) < 0) {
+        snapshot_error = SNAPSHOT_WRITE_EOF_ERROR;
+        return -1;
     }
 
     return (int)(len + sizeof(uint16_t));
 }
 
-static int snapshot_read_byte(FILE *f, uint8_t *b_return)
+static int snapshot_read_byte(snapshot_t *s, uint8_t *b_return)
 {
-    int c;
+    uint64_t val;
 
-    current_fpos = ftell(f);
-    c = fgetc(f);
-    if (c == EOF) {
-        snapshot_error = SNAPSHOT_READ_EOF_ERROR;
+    if (snapshot_get_le(s, &val, 1) < 0) {
         return -1;
     }
-    *b_return = (uint8_t)c;
+    *b_return = (uint8_t)val;
     return 0;
 }
 
-static int snapshot_read_word(FILE *f, uint16_t *w_return)
+static int snapshot_read_word(snapshot_t *s, uint16_t *w_return)
 {
-    uint8_t lo, hi;
+    uint64_t val;
 
-    current_fpos = ftell(f);
-    if (snapshot_read_byte(f, &lo) < 0 || snapshot_read_byte(f, &hi) < 0) {
+    if (snapshot_get_le(s, &val, 2) < 0) {
         return -1;
     }
-
-    *w_return = lo | (hi << 8);
+    *w_return = (uint16_t)val;
     return 0;
 }
 
-static int snapshot_read_dword(FILE *f, uint32_t *dw_return)
+static int snapshot_read_dword(snapshot_t *s, uint32_t *dw_return)
 {
-    uint16_t lo, hi;
+    uint64_t val;
 
-    current_fpos = ftell(f);
-    if (snapshot_read_word(f, &lo) < 0 || snapshot_read_word(f, &hi) < 0) {
+    if (snapshot_get_le(s, &val, 4) < 0) {
         return -1;
     }
-
-    *dw_return = lo | (hi << 16);
+    *dw_return = (uint32_t)val;
     return 0;
 }
 
-static int snapshot_read_qword(FILE *f, uint64_t *qw_return)
+static int snapshot_read_qword(snapshot_t *s, uint64_t *qw_return)
 {
-    uint32_t lo, hi;
-
-    current_fpos = ftell(f);
-    if (snapshot_read_dword(f, &lo) < 0 || snapshot_read_dword(f, &hi) < 0) {
-        return -1;
-    }
-
-    *qw_return = lo | ((uint64_t)hi << 32);
-    return 0;
+    return snapshot_get_le(s, qw_return, 8);
 }
 
-static int snapshot_read_double(FILE *f, double *d_return)
+static int snapshot_read_double(snapshot_t *s, double *d_return)
 {
-    int i;
-    int c;
     double val;
-    uint8_t *byte_val = (uint8_t *)&val;
 
-    current_fpos = ftell(f);
-    for (i = 0; i < sizeof(double); i++) {
-        c = fgetc(f);
-        if (c == EOF) {
-            snapshot_error = SNAPSHOT_READ_EOF_ERROR;
-            return -1;
-        }
-        byte_val[i] = (uint8_t)c;
+    if (snapshot_get(s, (uint8_t *)&val, sizeof(double)) < 0) {
+        snapshot_error = SNAPSHOT_READ_EOF_ERROR;
+        return -1;
     }
     *d_return = val;
     return 0;
 }
 
-static int snapshot_read_byte_array(FILE *f, uint8_t *b_return, unsigned int num)
+static int snapshot_read_byte_array(snapshot_t *s, uint8_t *b_return, unsigned int num)
 {
-    current_fpos = ftell(f);
-    if (num > 0 && fread(b_return, (size_t)num, 1, f) < 1) {
+    if (snapshot_get(s, b_return, (size_t)num) < 0) {
         snapshot_error = SNAPSHOT_READ_BYTE_ARRAY_ERROR;
         return -1;
     }
@@ -319,46 +454,58 @@ static int snapshot_read_byte_array(FILE *f, uint8_t *b_return, unsigned int num
     return 0;
 }
 
-static int snapshot_read_word_array(FILE *f, uint16_t *w_return, unsigned int num)
+static int snapshot_read_word_array(snapshot_t *s, uint16_t *w_return, unsigned int num)
 {
-    unsigned int i;
+    uint8_t buf[SNAPSHOT_CHUNK_SIZE];
+    unsigned int i, j, n;
 
-    current_fpos = ftell(f);
-    for (i = 0; i < num; i++) {
-        if (snapshot_read_word(f, w_return + i) < 0) {
+    for (i = 0; i < num; i += n) {
+        n = num - i < SNAPSHOT_CHUNK_SIZE / 2 ? num - i : SNAPSHOT_CHUNK_SIZE / 2;
+        if (snapshot_get(s, buf, n * 2) < 0) {
+            snapshot_error = SNAPSHOT_READ_EOF_ERROR;
             return -1;
         }
+        for (j = 0; j < n; j++) {
+            w_return[i + j] = (uint16_t)(buf[j * 2] | (buf[j * 2 + 1] << 8));
+        }
     }
 
     return 0;
 }
 
-static int snapshot_read_dword_array(FILE *f, uint32_t *dw_return, unsigned int num)
+static int snapshot_read_dword_array(snapshot_t *s, uint32_t *dw_return, unsigned int num)
 {
-    unsigned int i;
+    uint8_t buf[SNAPSHOT_CHUNK_SIZE];
+    unsigned int i, j, n;
 
-    current_fpos = ftell(f);
-    for (i = 0; i < num; i++) {
-        if (snapshot_read_dword(f, dw_return + i) < 0) {
+    for (i = 0; i < num; i += n) {
+        n = num - i < SNAPSHOT_CHUNK_SIZE / 4 ? num - i : SNAPSHOT_CHUNK_SIZE / 4;
+        if (snapshot_get(s, buf, n * 4) < 0) {
+            snapshot_error = SNAPSHOT_READ_EOF_ERROR;
             return -1;
         }
+        for (j = 0; j < n; j++) {
+            dw_return[i + j] = (uint32_t)buf[j * 4]
+                               | ((uint32_t)buf[j * 4 + 1] << 8)
+                               | ((uint32_t)buf[j * 4 + 2] << 16)
+                               | ((uint32_t)buf[j * 4 + 3] << 24);
+        }
     }
 
     return 0;
 }
 
-static int snapshot_read_string(FILE *f, char **s)
+static int snapshot_read_string(snapshot_t *s, char **str)
 {
-    int i, len;
+    int len;
     uint16_t w;
     char *p = NULL;
 
     /* first free the previous string */
-    lib_free(*s);
-    *s = NULL;      /* don't leave a bogus pointer */
+    lib_free(*str);
+    *str = NULL;      /* don't leave a bogus pointer */
 
-    current_fpos = ftell(f);
-    if (snapshot_read_word(f, &w) < 0) {
+    if (snapshot_read_word(s, &w) < 0) {
         return -1;
     }
 
@@ -366,13 +513,12 @@ static int snapshot_read_string(FILE *f, char **s)
 
     if (len) {
         p = lib_malloc(len);
-        *s = p;
+        *str = p;
 
-        for (i = 0; i < len; i++) {
-            if (snapshot_read_byte(f, (uint8_t *)(p + i)) < 0) {
-                p[0] = 0;
-                return -1;
-            }
+        if (snapshot_get(s, (uint8_t *)p, (size_t)len) < 0) {
+            snapshot_error = SNAPSHOT_READ_EOF_ERROR;
+            p[0] = 0;
+            return -1;
         }
         p[len - 1] = 0;   /* just to be save */
     }
@@ -383,7 +529,7 @@ static int snapshot_read_string(FILE *f, char **s)
 
 int snapshot_module_write_byte(snapshot_module_t *m, uint8_t b)
 {
-    if (snapshot_write_byte(m->file, b) < 0) {
+    if (snapshot_write_byte(m->snapshot, b) < 0) {
         return -1;
     }
 
@@ -393,7 +539,7 @@ int snapshot_module_write_byte(snapshot_module_t *m, uint8_t b)
 
 int snapshot_module_write_word(snapshot_module_t *m, uint16_t w)
 {
-    if (snapshot_write_word(m->file, w) < 0) {
+    if (snapshot_write_word(m->snapshot, w) < 0) {
         return -1;
     }
 
@@ -403,7 +549,7 @@ int snapshot_module_write_word(snapshot_module_t *m, uint16_t w)
 
 int snapshot_module_write_dword(snapshot_module_t *m, uint32_t dw)
 {
-    if (snapshot_write_dword(m->file, dw) < 0) {
+    if (snapshot_write_dword(m->snapshot, dw) < 0) {
         return -1;
     }
 
@@ -413,7 +559,7 @@ int snapshot_module_write_dword(snapshot_module_t *m, uint32_t dw)
 
 int snapshot_module_write_qword(snapshot_module_t *m, uint64_t qw)
 {
-    if (snapshot_write_qword(m->file, qw) < 0) {
+    if (snapshot_write_qword(m->snapshot, qw) < 0) {
         return -1;
     }
 
@@ -423,7 +569,7 @@ int snapshot_module_write_qword(snapshot_module_t *m, uint64_t qw)
 
 int snapshot_module_write_double(snapshot_module_t *m, double db)
 {
-    if (snapshot_write_double(m->file, db) < 0) {
+    if (snapshot_write_double(m->snapshot, db) < 0) {
         return -1;
     }
 
@@ -433,7 +579,7 @@ int snapshot_module_write_double(snapshot_module_t *m, double db)
 
 int snapshot_module_write_padded_string(snapshot_module_t *m, const char *s, uint8_t pad_char, int len)
 {
-    if (snapshot_write_padded_string(m->file, s, (uint8_t)pad_char, len) < 0) {
+    if (snapshot_write_padded_string(m->snapshot, s, (uint8_t)pad_char, len) < 0) {
         return -1;
     }
 
@@ -443,7 +589,7 @@ int snapshot_module_write_padded_string(snapshot_module_t *m, const char *s, uin
 
 int snapshot_module_write_byte_array(snapshot_module_t *m, const uint8_t *b, unsigned int num)
 {
-    if (snapshot_write_byte_array(m->file, b, num) < 0) {
+    if (snapshot_write_byte_array(m->snapshot, b, num) < 0) {
         return -1;
     }
 
@@ -453,7 +599,7 @@ int snapshot_module_write_byte_array(snapshot_module_t *m, const uint8_t *b, uns
 
 int snapshot_module_write_word_array(snapshot_module_t *m, const uint16_t *w, unsigned int num)
 {
-    if (snapshot_write_word_array(m->file, w, num) < 0) {
+    if (snapshot_write_word_array(m->snapshot, w, num) < 0) {
         return -1;
     }
 
@@ -463,7 +609,7 @@ int snapshot_module_write_word_array(snapshot_module_t *m, const uint16_t *w, un
 
 int snapshot_module_write_dword_array(snapshot_module_t *m, const uint32_t *dw, unsigned int num)
 {
-    if (snapshot_write_dword_array(m->file, dw, num) < 0) {
+    if (snapshot_write_dword_array(m->snapshot, dw, num) < 0) {
         return -1;
     }
 
@@ -474,7 +620,7 @@ int snapshot_module_write_dword_array(snapshot_module_t *m, const uint32_t *dw,
 int snapshot_module_write_string(snapshot_module_t *m, const char *s)
 {
     int len;
-    len = snapshot_write_string(m->file, s);
+    len = snapshot_write_string(m->snapshot, s);
     if (len < 0) {
         snapshot_error = SNAPSHOT_ILLEGAL_STRING_LENGTH_ERROR;
         return -1;
@@ -488,100 +634,100 @@ int snapshot_module_write_string(snapshot_module_t *m, const char *s)
 
 int snapshot_module_read_byte(snapshot_module_t *m, uint8_t *b_return)
 {
-    current_fpos = ftell(m->file);
-    if (ftell(m->file) + sizeof(uint8_t) > m->offset + m->size) {
+    current_fpos = (size_t)m->snapshot->pos;
+    if (m->snapshot->pos + sizeof(uint8_t) > m->offset + m->size) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_byte(m->file, b_return);
+    return snapshot_read_byte(m->snapshot, b_return);
 }
 
 int snapshot_module_read_word(snapshot_module_t *m, uint16_t *w_return)
 {
-    current_fpos = ftell(m->file);
-    if (ftell(m->file) + sizeof(uint16_t) > m->offset + m->size) {
+    current_fpos = (size_t)m->snapshot->pos;
+    if (m->snapshot->pos + sizeof(uint16_t) > m->offset + m->size) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_word(m->file, w_return);
+    return snapshot_read_word(m->snapshot, w_return);
 }
 
 int snapshot_module_read_dword(snapshot_module_t *m, uint32_t *dw_return)
 {
-    current_fpos = ftell(m->file);
-    if (ftell(m->file) + sizeof(uint32_t) > m->offset + m->size) {
+    current_fpos = (size_t)m->snapshot->pos;
+    if (m->snapshot->pos + sizeof(uint32_t) > m->offset + m->size) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_dword(m->file, dw_return);
+    return snapshot_read_dword(m->snapshot, dw_return);
 }
 
 int snapshot_module_read_qword(snapshot_module_t *m, uint64_t *qw_return)
 {
-    current_fpos = ftell(m->file);
-    if (ftell(m->file) + sizeof(uint64_t) > m->offset + m->size) {
+    current_fpos = (size_t)m->snapshot->pos;
+    if (m->snapshot->pos + sizeof(uint64_t) > m->offset + m->size) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_qword(m->file, qw_return);
+    return snapshot_read_qword(m->snapshot, qw_return);
 }
 
 int snapshot_module_read_double(snapshot_module_t *m, double *db_return)
 {
-    current_fpos = ftell(m->file);
-    if (ftell(m->file) + sizeof(double) > m->offset + m->size) {
+    current_fpos = (size_t)m->snapshot->pos;
+    if (m->snapshot->pos + sizeof(double) > m->offset + m->size) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_double(m->file, db_return);
+    return snapshot_read_double(m->snapshot, db_return);
 }
 
 int snapshot_module_read_byte_array(snapshot_module_t *m, uint8_t *b_return, unsigned int num)
 {
-    current_fpos = ftell(m->file);
-    if ((long)(ftell(m->file) + num) > (long)(m->offset + m->size)) {
+    current_fpos = (size_t)m->snapshot->pos;
+    if ((long)(m->snapshot->pos + num) > (long)(m->offset + m->size)) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_byte_array(m->file, b_return, num);
+    return snapshot_read_byte_array(m->snapshot, b_return, num);
 }
 
 int snapshot_module_read_word_array(snapshot_module_t *m, uint16_t *w_return, unsigned int num)
 {
-    if ((long)(ftell(m->file) + num * sizeof(uint16_t)) > (long)(m->offset + m->size)) {
+    if ((long)(m->snapshot->pos + num * sizeof(uint16_t)) > (long)(m->offset + m->size)) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_word_array(m->file, w_return, num);
+    return snapshot_read_word_array(m->snapshot, w_return, num);
 }
 
 int snapshot_module_read_dword_array(snapshot_module_t *m, uint32_t *dw_return, unsigned int num)
 {
-    current_fpos = ftell(m->file);
-    if ((long)(ftell(m->file) + num * sizeof(uint32_t)) > (long)(m->offset + m->size)) {
+    current_fpos = (size_t)m->snapshot->pos;
+    if ((long)(m->snapshot->pos + num * sizeof(uint32_t)) > (long)(m->offset + m->size)) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_dword_array(m->file, dw_return, num);
+    return snapshot_read_dword_array(m->snapshot, dw_return, num);
 }
 
 int snapshot_module_read_string(snapshot_module_t *m, char **charp_return)
 {
-    current_fpos = ftell(m->file);
-    if (ftell(m->file) + sizeof(uint16_t) > m->offset + m->size) {
+    current_fpos = (size_t)m->snapshot->pos;
+    if (m->snapshot->pos + sizeof(uint16_t) > m->offset + m->size) {
         snapshot_error = SNAPSHOT_READ_OUT_OF_BOUNDS_ERROR;
         return -1;
     }
 
-    return snapshot_read_string(m->file, charp_return);
+    return snapshot_read_string(m->snapshot, charp_return);
 }
 
 int snapshot_module_read_byte_into_int(snapshot_module_t *m, int *value_return)
@@ -681,24 +827,20 @@ snapshot_module_t *snapshot_module_create(snapshot_t *s, const char *name, uint8
     current_module = (char *)name;
 
     m = lib_malloc(sizeof(snapshot_module_t));
-    m->file = s->file;
-    m->offset = ftell(s->file);
-    if (m->offset == -1) {
-        snapshot_error = SNAPSHOT_ILLEGAL_OFFSET_ERROR;
-        lib_free(m);
-        return NULL;
-    }
+    m->snapshot = s;
+    m->offset = s->pos;
     m->write_mode = 1;
 
-    if (snapshot_write_padded_string(s->file, name, (uint8_t)0, SNAPSHOT_MODULE_NAME_LEN) < 0
-        || snapshot_write_byte(s->file, major_version) < 0
-        || snapshot_write_byte(s->file, minor_version) < 0
-        || snapshot_write_dword(s->file, 0) < 0) {
+    if (snapshot_write_padded_string(s, name, (uint8_t)0, SNAPSHOT_MODULE_NAME_LEN) < 0
+        || snapshot_write_byte(s, major_version) < 0
+        || snapshot_write_byte(s, minor_version) < 0
+        || snapshot_write_dword(s, 0) < 0) {
+        lib_free(m);
         return NULL;
     }
 
-    m->size = (uint32_t)(ftell(s->file) - m->offset);
-    m->size_offset = ftell(s->file) - sizeof(uint32_t);
+    m->size = (uint32_t)(s->pos - m->offset);
+    m->size_offset = s->pos - sizeof(uint32_t);
 
     return m;
 }
@@ -711,14 +853,14 @@ snapshot_module_t *snapshot_module_open(snapshot_t *s, const char *name, uint8_t
 
     current_module = (char *)name;
 
-    if (fseek(s->file, s->first_module_offset, SEEK_SET) < 0) {
+    if (snapshot_seek(s, s->first_module_offset) < 0) {
         snapshot_error = SNAPSHOT_FIRST_MODULE_NOT_FOUND_ERROR;
         DBG(("snapshot_module_open error: name: '%s' NOT found", name));
         return NULL;
     }
 
     m = lib_malloc(sizeof(snapshot_module_t));
-    m->file = s->file;
+    m->snapshot = s;
     m->write_mode = 0;
 
     m->offset = s->first_module_offset;
@@ -728,11 +870,11 @@ snapshot_module_t *snapshot_module_open(snapshot_t *s, const char *name, uint8_t
     /* Search for the module name.  This is quite inefficient, but I don't
        think we care.  */
     while (1) {
-        if (snapshot_read_byte_array(s->file, (uint8_t *)n,
+        if (snapshot_read_byte_array(s, (uint8_t *)n,
                                      SNAPSHOT_MODULE_NAME_LEN) < 0
-            || snapshot_read_byte(s->file, major_version_return) < 0
-            || snapshot_read_byte(s->file, minor_version_return) < 0
-            || snapshot_read_dword(s->file, &m->size)) {
+            || snapshot_read_byte(s, major_version_return) < 0
+            || snapshot_read_byte(s, minor_version_return) < 0
+            || snapshot_read_dword(s, &m->size)) {
             snapshot_error = SNAPSHOT_MODULE_HEADER_READ_ERROR;
             goto fail;
         }
@@ -744,13 +886,13 @@ snapshot_module_t *snapshot_module_open(snapshot_t *s, const char *name, uint8_t
         }
 
         m->offset += m->size;
-        if (fseek(s->file, m->offset, SEEK_SET) < 0) {
+        if (snapshot_seek(s, m->offset) < 0) {
             snapshot_error = SNAPSHOT_MODULE_NOT_FOUND_ERROR;
             goto fail;
         }
     }
 
-    m->size_offset = ftell(s->file) - sizeof(uint32_t);
+    m->size_offset = s->pos - sizeof(uint32_t);
 #if 0
     /* HACK: if any of the errors *this* function can produce is still pending
              in snapshot_error, clear it out - else we might fail for no reason
@@ -766,7 +908,7 @@ snapshot_module_t *snapshot_module_open(snapshot_t *s, const char *name, uint8_t
     return m;
 
 fail:
-    fseek(s->file, s->first_module_offset, SEEK_SET);
+    snapshot_seek(s, s->first_module_offset);
     lib_free(m);
     DBG(("snapshot_module_open error: name: '%s' NOT found", name));
     return NULL;
@@ -777,15 +919,15 @@ int snapshot_module_close(snapshot_module_t *m)
     DBG(("snapshot_module_close name: '%s'", current_module));
     /* Backpatch module size if writing.  */
     if (m->write_mode
-        && (fseek(m->file, m->size_offset, SEEK_SET) < 0
-            || snapshot_write_dword(m->file, m->size) < 0)) {
+        && (snapshot_seek(m->snapshot, m->size_offset) < 0
+            || snapshot_write_dword(m->snapshot, m->size) < 0)) {
         snapshot_error = SNAPSHOT_MODULE_CLOSE_ERROR;
         DBG(("snapshot_module_close error"));
         return -1;
     }
 
     /* Skip module.  */
-    if (fseek(m->file, m->offset + m->size, SEEK_SET) < 0) {
+    if (snapshot_seek(m->snapshot, m->offset + m->size) < 0) {
         snapshot_error = SNAPSHOT_MODULE_SKIP_ERROR;
         DBG(("snapshot_module_close error"));
         return -1;
@@ -798,68 +940,84 @@ int snapshot_module_close(snapshot_module_t *m)
 
 /* ------------------------------------------------------------------------- */
 
+static void snapshot_mem_forget(snapshot_mem_t *mem);
+static uint8_t *snapshot_mem_rebuild(const snapshot_mem_t *mem);
+
 snapshot_t *snapshot_create(const char *filename, uint8_t major_version, uint8_t minor_version, const char *snapshot_machine_name)
 {
-    FILE *f;
+    FILE *f = NULL;
     snapshot_t *s;
     unsigned char viceversion[4] = { VERSION_RC_NUMBER };
 
-    current_filename = (char *)filename;
+    if (mem_target != NULL) {
+        current_filename = "(memory)";
+        snapshot_mem_forget(mem_target);
+    } else {
+        current_filename = (char *)filename;
 
-    f = fopen(filename, MODE_WRITE);
-    if (f == NULL) {
-        snapshot_error = SNAPSHOT_CANNOT_CREATE_SNAPSHOT_ERROR;
-        return NULL;
+        f = fopen(filename, MODE_WRITE);
+        if (f == NULL) {
+            snapshot_error = SNAPSHOT_CANNOT_CREATE_SNAPSHOT_ERROR;
+            return NULL;
+        }
     }
 
+    s = lib_calloc(1, sizeof(snapshot_t));
+    s->file = f;
+    s->mem = mem_target;
+    s->write_mode = 1;
+
     /* Magic string.  */
-    if (snapshot_write_padded_string(f, snapshot_magic_string, (uint8_t)0, SNAPSHOT_MAGIC_LEN) < 0) {
+    if (snapshot_write_padded_string(s, snapshot_magic_string, (uint8_t)0, SNAPSHOT_MAGIC_LEN) < 0) {
         snapshot_error = SNAPSHOT_CANNOT_WRITE_MAGIC_STRING_ERROR;
         goto fail;
     }
 
     /* Version number.  */
-    if (snapshot_write_byte(f, major_version) < 0
-        || snapshot_write_byte(f, minor_version) < 0) {
+    if (snapshot_write_byte(s, major_version) < 0
+        || snapshot_write_byte(s, minor_version) < 0) {
         snapshot_error = SNAPSHOT_CANNOT_WRITE_VERSION_ERROR;
         goto fail;
     }
 
     /* Machine.  */
-    if (snapshot_write_padded_string(f, snapshot_machine_name, (uint8_t)0, SNAPSHOT_MACHINE_NAME_LEN) < 0) {
+    if (snapshot_write_padded_string(s, snapshot_machine_name, (uint8_t)0, SNAPSHOT_MACHINE_NAME_LEN) < 0) {
         snapshot_error = SNAPSHOT_CANNOT_WRITE_MACHINE_NAME_ERROR;
         goto fail;
     }
 
     /* VICE version and revision */
-    if (snapshot_write_padded_string(f, snapshot_version_magic_string, (uint8_t)0, SNAPSHOT_VERSION_MAGIC_LEN) < 0) {
+    if (snapshot_write_padded_string(s, snapshot_version_magic_string, (uint8_t)0, SNAPSHOT_VERSION_MAGIC_LEN) < 0) {
         snapshot_error = SNAPSHOT_CANNOT_WRITE_MAGIC_STRING_ERROR;
         goto fail;
     }
 
-    if (snapshot_write_byte(f, viceversion[0]) < 0
-        || snapshot_write_byte(f, viceversion[1]) < 0
-        || snapshot_write_byte(f, viceversion[2]) < 0
-        || snapshot_write_byte(f, viceversion[3]) < 0
+    if (snapshot_write_byte(s, viceversion[0]) < 0
+        || snapshot_write_byte(s, viceversion[1]) < 0
+        || snapshot_write_byte(s, viceversion[2]) < 0
+        || snapshot_write_byte(s, viceversion[3]) < 0
 #ifdef USE_SVN_REVISION
-        || snapshot_write_dword(f, VICE_SVN_REV_NUMBER) < 0) {
+        || snapshot_write_dword(s, VICE_SVN_REV_NUMBER) < 0) {
 #else
-        || snapshot_write_dword(f, 0) < 0) {
+        || snapshot_write_dword(s, 0) < 0) {
 #endif
         snapshot_error = SNAPSHOT_CANNOT_WRITE_VERSION_ERROR;
         goto fail;
     }
 
-    s = lib_malloc(sizeof(snapshot_t));
-    s->file = f;
-    s->first_module_offset = ftell(f);
-    s->write_mode = 1;
+    s->first_module_offset = s->pos;
+    if (s->mem != NULL) {
+        s->mem->first_module_offset = (size_t)s->pos;
+    }
 
     return s;
 
 fail:
-    fclose(f);
-    archdep_remove(filename);
+    lib_free(s);
+    if (f != NULL) {
+        fclose(f);
+        archdep_remove(filename);
+    }
     return NULL;
 }
 
@@ -869,38 +1027,62 @@ static uint32_t snapshot_vicerevision;
 
 snapshot_t *snapshot_open(const char *filename, uint8_t *major_version_return, uint8_t *minor_version_return, const char *snapshot_machine_name)
 {
-    FILE *f;
+    FILE *f = NULL;
     char magic[SNAPSHOT_MAGIC_LEN];
     snapshot_t *s = NULL;
     int machine_name_len;
-    size_t offs;
+    long offs;
 
     current_machine_name = (char *)snapshot_machine_name;
-    current_filename = (char *)filename;
     current_module = NULL;
 
-    f = zfile_fopen(filename, MODE_READ);
-    if (f == NULL) {
-        snapshot_error = SNAPSHOT_CANNOT_OPEN_FOR_READ_ERROR;
-        return NULL;
+    if (mem_target != NULL) {
+        current_filename = "(memory)";
+        if (mem_target->len == 0) {
+            snapshot_error = SNAPSHOT_CANNOT_OPEN_FOR_READ_ERROR;
+            return NULL;
+        }
+    } else {
+        current_filename = (char *)filename;
+
+        f = zfile_fopen(filename, MODE_READ);
+        if (f == NULL) {
+            snapshot_error = SNAPSHOT_CANNOT_OPEN_FOR_READ_ERROR;
+            return NULL;
+        }
+    }
+
+    s = lib_calloc(1, sizeof(snapshot_t));
+    s->file = f;
+    s->write_mode = 0;
+
+    if (mem_target != NULL) {
+        if (mem_target->base != NULL) {
+            s->delta_image = snapshot_mem_rebuild(mem_target);
+            s->image = s->delta_image;
+            s->image_len = mem_target->image_len;
+        } else {
+            s->image = mem_target->data;
+            s->image_len = mem_target->len;
+        }
     }
 
     /* Magic string.  */
-    if (snapshot_read_byte_array(f, (uint8_t *)magic, SNAPSHOT_MAGIC_LEN) < 0
+    if (snapshot_read_byte_array(s, (uint8_t *)magic, SNAPSHOT_MAGIC_LEN) < 0
         || memcmp(magic, snapshot_magic_string, SNAPSHOT_MAGIC_LEN) != 0) {
         snapshot_error = SNAPSHOT_MAGIC_STRING_MISMATCH_ERROR;
         goto fail;
     }
 
     /* Version number.  */
-    if (snapshot_read_byte(f, major_version_return) < 0
-        || snapshot_read_byte(f, minor_version_return) < 0) {
+    if (snapshot_read_byte(s, major_version_return) < 0
+        || snapshot_read_byte(s, minor_version_return) < 0) {
         snapshot_error = SNAPSHOT_CANNOT_READ_VERSION_ERROR;
         goto fail;
     }
 
     /* Machine.  */
-    if (snapshot_read_byte_array(f, (uint8_t *)read_name, SNAPSHOT_MACHINE_NAME_LEN) < 0) {
+    if (snapshot_read_byte_array(s, (uint8_t *)read_name, SNAPSHOT_MACHINE_NAME_LEN) < 0) {
         snapshot_error = SNAPSHOT_CANNOT_READ_MACHINE_NAME_ERROR;
         goto fail;
     }
@@ -917,55 +1099,55 @@ snapshot_t *snapshot_open(const char *filename, uint8_t *major_version_return, u
     /* VICE version and revision */
     memset(snapshot_viceversion, 0, 4);
     snapshot_vicerevision = 0;
-    offs = ftell(f);
+    offs = s->pos;
 
-    if (snapshot_read_byte_array(f, (uint8_t *)magic, SNAPSHOT_VERSION_MAGIC_LEN) < 0
+    if (snapshot_read_byte_array(s, (uint8_t *)magic, SNAPSHOT_VERSION_MAGIC_LEN) < 0
         || memcmp(magic, snapshot_version_magic_string, SNAPSHOT_VERSION_MAGIC_LEN) != 0) {
         /* old snapshots do not contain VICE version */
-        fseek(f, offs, SEEK_SET);
+        snapshot_seek(s, offs);
         log_warning(LOG_DEFAULT, "attempting to load pre 2.4.30 snapshot");
     } else {
         /* actually read the version */
-        if (snapshot_read_byte(f, &snapshot_viceversion[0]) < 0
-            || snapshot_read_byte(f, &snapshot_viceversion[1]) < 0
-            || snapshot_read_byte(f, &snapshot_viceversion[2]) < 0
-            || snapshot_read_byte(f, &snapshot_viceversion[3]) < 0
-            || snapshot_read_dword(f, &snapshot_vicerevision) < 0) {
+        if (snapshot_read_byte(s, &snapshot_viceversion[0]) < 0
+            || snapshot_read_byte(s, &snapshot_viceversion[1]) < 0
+            || snapshot_read_byte(s, &snapshot_viceversion[2]) < 0
+            || snapshot_read_byte(s, &snapshot_viceversion[3]) < 0
+            || snapshot_read_dword(s, &snapshot_vicerevision) < 0) {
             snapshot_error = SNAPSHOT_CANNOT_READ_VERSION_ERROR;
             goto fail;
         }
     }
 
-    s = lib_malloc(sizeof(snapshot_t));
-    s->file = f;
-    s->first_module_offset = ftell(f);
-    s->write_mode = 0;
+    s->first_module_offset = s->pos;
 
     vsync_suspend_speed_eval();
     return s;
 
 fail:
-    fclose(f);
+    if (f != NULL) {
+        fclose(f);
+    }
+    lib_free(s->delta_image);
+    lib_free(s);
     return NULL;
 }
 
 int snapshot_close(snapshot_t *s)
 {
-    int retval;
+    int retval = 0;
 
-    if (!s->write_mode) {
+    if (s->file == NULL) {
+        /* in memory, nothing can fail */
+        lib_free(s->delta_image);
+    } else if (!s->write_mode) {
         if (zfile_fclose(s->file) == EOF) {
             snapshot_error = SNAPSHOT_READ_CLOSE_EOF_ERROR;
             retval = -1;
-        } else {
-            retval = 0;
         }
     } else {
         if (fclose(s->file) == EOF) {
             snapshot_error = SNAPSHOT_WRITE_CLOSE_EOF_ERROR;
             retval = -1;
-        } else {
-            retval = 0;
         }
     }
 
@@ -973,6 +1155,445 @@ int snapshot_close(snapshot_t *s)
     return retval;
 }
 
+/* ------------------------------------------------------------------------- */
+
+/*
+    Snapshots in memory
+
+    snapshot_mem_select() makes snapshot_create() and snapshot_open() use a
+    growable buffer instead of a file, so the machine snapshot code writes
+    and reads it unchanged. The buffer is kept when the snapshot is written
+    again, so after the first time no memory is allocated.
+
+    A full snapshot in memory can be turned into a delta against an earlier
+    full snapshot, the base. Every module is split into pages, and a page
+    that is equal to the page at the same offset of the module with the
+    same name in the base is replaced by a reference to it. Pages are
+    compared by hash first and then byte by byte. A page that
+    differs is stored as the runs of non-zero bytes of its XOR with the base
+    page, unless that is not shorter than the page itself. Modules that are
+    new or changed in size are stored completely. The hashes of the base
+    are computed once, the first time it is used, so a delta only hashes its
+    own pages.
+
+    The base must not be written again or freed while deltas refer to it.
+*/
+
+/* 64 bit hash of a page, 8 bytes at a time. */
+static uint64_t snapshot_page_hash(const uint8_t *p, size_t len)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    uint64_t w;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&w, p + i, 8);
+        w *= 0x87c37b91114253d5ULL;
+        w = (w << 31) | (w >> 33);
+        w *= 0x4cf5ad432745937fULL;
+        h ^= w;
+        h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+    }
+    for (; i < len; i++) {
+        h ^= p[i] * 0xc6a4a7935bd1e995ULL;
+        h = ((h << 23) | (h >> 41)) * 5 + 0x52dce729;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/* Size of the module at offset, 0 if there is no valid module header.  */
+static size_t snapshot_mem_module_size(const uint8_t *image, size_t len, size_t offset)
+{
+    const uint8_t *p = image + offset + SNAPSHOT_MODULE_NAME_LEN + 2;
+    size_t size;
+
+    if (offset + SNAPSHOT_MODULE_HEADER_LEN > len) {
+        return 0;
+    }
+
+    size = (size_t)p[0] | ((size_t)p[1] << 8) | ((size_t)p[2] << 16) | ((size_t)p[3] << 24);
+    if (size < SNAPSHOT_MODULE_HEADER_LEN || offset + size > len) {
+        return 0;
+    }
+
+    return size;
+}
+
+static void snapshot_mem_forget(snapshot_mem_t *mem)
+{
+    lib_free(mem->modules);
+    lib_free(mem->page_hash);
+    mem->modules = NULL;
+    mem->page_hash = NULL;
+    mem->num_modules = 0;
+    mem->base = NULL;
+    mem->image_len = 0;
+    mem->len = 0;
+
+    if (mem->spare_size > mem->size) {
+        uint8_t *data = mem->data;
+        size_t size = mem->size;
+
+        mem->data = mem->spare;
+        mem->size = mem->spare_size;
+        mem->spare = data;
+        mem->spare_size = size;
+    }
+}
+
+/* Build the module list and the page hashes of a full snapshot.  */
+static void snapshot_mem_hash(snapshot_mem_t *mem)
+{
+    size_t offset, size, pages = 0;
+    int num = 0, max = 32;
+    int i;
+
+    mem->modules = lib_malloc(max * sizeof(snapshot_mem_module_t));
+
+    for (offset = mem->first_module_offset;
+         (size = snapshot_mem_module_size(mem->data, mem->len, offset)) != 0;
+         offset += size) {
+        if (num == max) {
+            max *= 2;
+            mem->modules = lib_realloc(mem->modules, max * sizeof(snapshot_mem_module_t));
+        }
+        memcpy(mem->modules[num].name, mem->data + offset, SNAPSHOT_MODULE_NAME_LEN);
+        mem->modules[num].offset = offset;
+        mem->modules[num].size = size;
+        mem->modules[num].first_page = pages;
+        pages += (size + SNAPSHOT_MEM_PAGE_SIZE - 1) / SNAPSHOT_MEM_PAGE_SIZE;
+        num++;
+    }
+
+    mem->num_modules = num;
+    mem->page_hash = lib_malloc((pages ? pages : 1) * sizeof(uint64_t));
+
+    for (i = 0; i < num; i++) {
+        const snapshot_mem_module_t *mm = &mem->modules[i];
+        size_t page = mm->first_page;
+
+        for (offset = 0; offset < mm->size; offset += SNAPSHOT_MEM_PAGE_SIZE) {
+            size_t n = mm->size - offset;
+
+            if (n > SNAPSHOT_MEM_PAGE_SIZE) {
+                n = SNAPSHOT_MEM_PAGE_SIZE;
+            }
+            mem->page_hash[page++] = snapshot_page_hash(mem->data + mm->offset + offset, n);
+        }
+    }
+}
+
+/* Find a module of the base, trying the one at the same index first.  */
+static const snapshot_mem_module_t *snapshot_mem_find_module(const snapshot_mem_t *base, const uint8_t *name, int hint)
+{
+    int i;
+
+    if (hint < base->num_modules
+        && memcmp(base->modules[hint].name, name, SNAPSHOT_MODULE_NAME_LEN) == 0) {
+        return &base->modules[hint];
+    }
+    for (i = 0; i < base->num_modules; i++) {
+        if (memcmp(base->modules[i].name, name, SNAPSHOT_MODULE_NAME_LEN) == 0) {
+            return &base->modules[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Delta operations being built, merging adjacent ones of the same kind.  */
+typedef struct snapshot_delta_s {
+    snapshot_mem_t *out;
+    const snapshot_mem_t *base;
+    size_t last_op;     /* offset of the last operation, or SIZE_MAX */
+    uint32_t last_end;  /* base offset following the last copy */
+} snapshot_delta_t;
+
+static void snapshot_delta_op(snapshot_delta_t *d, uint8_t op, uint32_t len, uint32_t arg)
+{
+    snapshot_mem_t *out = d->out;
+
+    if (out->len + SNAPSHOT_DELTA_OP_LEN > out->size) {
+        snapshot_mem_reserve(out, out->len + SNAPSHOT_DELTA_OP_LEN);
+    }
+    d->last_op = out->len;
+    out->data[out->len] = op;
+    memcpy(out->data + out->len + 1, &len, sizeof(uint32_t));
+    memcpy(out->data + out->len + 1 + sizeof(uint32_t), &arg, sizeof(uint32_t));
+    out->len += SNAPSHOT_DELTA_OP_LEN;
+}
+
+static void snapshot_delta_grow(snapshot_delta_t *d, uint32_t len)
+{
+    uint8_t *p = d->out->data + d->last_op + 1;
+    uint32_t n;
+
+    memcpy(&n, p, sizeof(uint32_t));
+    n += len;
+    memcpy(p, &n, sizeof(uint32_t));
+}
+
+static void snapshot_delta_copy(snapshot_delta_t *d, size_t base_offset, size_t len)
+{
+    if (d->last_op != SIZE_MAX
+        && d->out->data[d->last_op] == SNAPSHOT_DELTA_COPY
+        && d->last_end == base_offset) {
+        snapshot_delta_grow(d, (uint32_t)len);
+    } else {
+        snapshot_delta_op(d, SNAPSHOT_DELTA_COPY, (uint32_t)len, (uint32_t)base_offset);
+    }
+    d->last_end = (uint32_t)(base_offset + len);
+}
+
+static void snapshot_delta_literal(snapshot_delta_t *d, const uint8_t *data, size_t len)
+{
+    snapshot_mem_t *out = d->out;
+
+    if (d->last_op != SIZE_MAX
+        && out->data[d->last_op] == SNAPSHOT_DELTA_LITERAL) {
+        snapshot_delta_grow(d, (uint32_t)len);
+    } else {
+        snapshot_delta_op(d, SNAPSHOT_DELTA_LITERAL, (uint32_t)len, 0);
+    }
+
+    if (out->len + len > out->size) {
+        snapshot_mem_reserve(out, out->len + len);
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+}
+
+/*
+    XOR of a page with the base page as (skip, count, count bytes) runs, the
+    skipped bytes are unchanged. Returns the encoded length, or 0 if it is not
+    shorter than the page.
+*/
+static size_t snapshot_delta_xor_encode(uint8_t *out, const uint8_t *page, const uint8_t *base, size_t len)
+{
+    size_t pos = 0, n = 0;
+
+    while (pos < len) {
+        size_t skip = 0, count = 0;
+
+        while (pos + skip < len && skip < 255 && page[pos + skip] == base[pos + skip]) {
+            skip++;
+        }
+        pos += skip;
+        while (pos + count < len && count < 255 && page[pos + count] != base[pos + count]) {
+            count++;
+        }
+
+        if (n + 2 + count + SNAPSHOT_DELTA_OP_LEN >= len) {
+            return 0;
+        }
+        out[n++] = (uint8_t)skip;
+        out[n++] = (uint8_t)count;
+        while (count--) {
+            out[n++] = page[pos] ^ base[pos];
+            pos++;
+        }
+    }
+
+    return n;
+}
+
+static void snapshot_delta_xor(snapshot_delta_t *d, const uint8_t *page, size_t base_offset, size_t len)
+{
+    uint8_t buf[SNAPSHOT_MEM_PAGE_SIZE];
+    snapshot_mem_t *out = d->out;
+    size_t n = snapshot_delta_xor_encode(buf, page, d->base->data + base_offset, len);
+
+    if (n == 0) {
+        snapshot_delta_literal(d, page, len);
+        return;
+    }
+
+    snapshot_delta_op(d, SNAPSHOT_DELTA_XOR, (uint32_t)len, (uint32_t)base_offset);
+    if (out->len + n > out->size) {
+        snapshot_mem_reserve(out, out->len + n);
+    }
+    memcpy(out->data + out->len, buf, n);
+    out->len += n;
+}
+
+/* Rebuild the full image of a delta, free it with lib_free().  */
+static uint8_t *snapshot_mem_rebuild(const snapshot_mem_t *mem)
+{
+    uint8_t *image = lib_malloc(mem->image_len ? mem->image_len : 1);
+    const uint8_t *p = mem->data;
+    const uint8_t *end = mem->data + mem->len;
+    size_t pos = 0;
+
+    while (p < end) {
+        uint32_t len, arg;
+
+        memcpy(&len, p + 1, sizeof(uint32_t));
+        memcpy(&arg, p + 1 + sizeof(uint32_t), sizeof(uint32_t));
+
+        if (p[0] == SNAPSHOT_DELTA_COPY) {
+            memcpy(image + pos, mem->base->data + arg, len);
+            p += SNAPSHOT_DELTA_OP_LEN;
+        } else if (p[0] == SNAPSHOT_DELTA_XOR) {
+            size_t i = 0;
+
+            memcpy(image + pos, mem->base->data + arg, len);
+            p += SNAPSHOT_DELTA_OP_LEN;
+            while (i < len) {
+                size_t count = p[1];
+
+                i += p[0];
+                p += 2;
+                while (count--) {
+                    image[pos + i++] ^= *p++;
+                }
+            }
+        } else {
+            memcpy(image + pos, p + SNAPSHOT_DELTA_OP_LEN, len);
+            p += SNAPSHOT_DELTA_OP_LEN + len;
+        }
+        pos += len;
+    }
+
+    return image;
+}
+
+snapshot_mem_t *snapshot_mem_new(void)
+{
+    return lib_calloc(1, sizeof(snapshot_mem_t));
+}
+
+void snapshot_mem_free(snapshot_mem_t *mem)
+{
+    if (mem == NULL) {
+        return;
+    }
+
+    if (mem_target == mem) {
+        mem_target = NULL;
+    }
+    snapshot_mem_forget(mem);
+    lib_free(mem->data);
+    lib_free(mem->spare);
+    lib_free(mem);
+}
+
+/* Bytes used by the snapshot, for a delta without the base.  */
+size_t snapshot_mem_get_size(const snapshot_mem_t *mem)
+{
+    return mem->len;
+}
+
+int snapshot_mem_is_delta(const snapshot_mem_t *mem)
+{
+    return mem->base != NULL;
+}
+
+/* Make snapshot_create() and snapshot_open() use mem, NULL for files again. */
+void snapshot_mem_select(snapshot_mem_t *mem)
+{
+    mem_target = mem;
+}
+
+/* Turn the full snapshot mem into a delta against the full snapshot base. */
+int snapshot_mem_make_delta(snapshot_mem_t *mem, snapshot_mem_t *base)
+{
+    snapshot_delta_t d;
+    snapshot_mem_t *out;
+    size_t offset, size;
+    int index = 0;
+
+    if (mem == base || mem->base != NULL || base->base != NULL || base->len == 0) {
+        return -1;
+    }
+
+    if (base->modules == NULL) {
+        snapshot_mem_hash(base);
+    }
+
+    out = snapshot_mem_new();
+    snapshot_mem_reserve(out, mem->len / 16 + SNAPSHOT_DELTA_OP_LEN * 64);
+
+    d.out = out;
+    d.base = base;
+    d.last_op = SIZE_MAX;
+    d.last_end = 0;
+
+    /* The header is tiny, always store it */
+    snapshot_delta_literal(&d, mem->data, mem->first_module_offset);
+
+    for (offset = mem->first_module_offset;
+         (size = snapshot_mem_module_size(mem->data, mem->len, offset)) != 0;
+         offset += size, index++) {
+        const uint8_t *module = mem->data + offset;
+        const snapshot_mem_module_t *bm = snapshot_mem_find_module(base, module, index);
+        size_t pos, page;
+
+        if (bm == NULL || bm->size != size) {
+            snapshot_delta_literal(&d, module, size);
+            continue;
+        }
+
+        for (pos = 0, page = bm->first_page; pos < size; pos += SNAPSHOT_MEM_PAGE_SIZE, page++) {
+            size_t n = size - pos;
+
+            if (n > SNAPSHOT_MEM_PAGE_SIZE) {
+                n = SNAPSHOT_MEM_PAGE_SIZE;
+            }
+            /* the hash only rules pages out, equal hashes are checked */
+            if (snapshot_page_hash(module + pos, n) == base->page_hash[page]
+                && memcmp(module + pos, base->data + bm->offset + pos, n) == 0) {
+                snapshot_delta_copy(&d, bm->offset + pos, n);
+            } else {
+                snapshot_delta_xor(&d, module + pos, bm->offset + pos, n);
+            }
+        }
+    }
+
+    /* Anything that does not parse as a module */
+    if (offset < mem->len) {
+        snapshot_delta_literal(&d, mem->data + offset, mem->len - offset);
+    }
+
+    /* Keep the buffer of the full image for the next snapshot */
+    lib_free(mem->spare);
+    mem->spare = mem->data;
+    mem->spare_size = mem->size;
+    mem->image_len = mem->len;
+    mem->data = out->data;
+    mem->len = out->len;
+    mem->size = out->size;
+    mem->base = base;
+    lib_free(out);
+
+    return 0;
+}
+
+/*
+    Copy of the snapshot that takes just the bytes it needs, without the
+    buffers kept for writing it again. A copy of a delta has the same base.
+*/
+snapshot_mem_t *snapshot_mem_copy(const snapshot_mem_t *mem)
+{
+    snapshot_mem_t *copy = snapshot_mem_new();
+
+    copy->data = lib_malloc(mem->len ? mem->len : 1);
+    memcpy(copy->data, mem->data, mem->len);
+    copy->len = mem->len;
+    copy->size = mem->len;
+    copy->first_module_offset = mem->first_module_offset;
+    copy->base = mem->base;
+    copy->image_len = mem->image_len;
+
+    return copy;
+}
+
 static void display_error_with_vice_version(char *text, char *filename)
 {
     char *vmessage = lib_malloc(0x100);
@@ -67,6 +67,7 @@
 
 typedef struct snapshot_module_s snapshot_module_t;
 typedef struct snapshot_s snapshot_t;
+typedef struct snapshot_mem_s snapshot_mem_t;
 
 void snapshot_display_error(void);
 
@@ -136,6 +137,17 @@ snapshot_t *snapshot_create(const char *filename, uint8_t major_version, uint8_t
 snapshot_t *snapshot_open(const char *filename, uint8_t *major_version_return, uint8_t *minor_version_return, const char *snapshot_machine_name);
 int snapshot_close(snapshot_t *s);
 
+/* Name passed to the machine snapshot code while a snapshot in memory is selected. */
+#define SNAPSHOT_MEM_NAME   ""
+
+snapshot_mem_t *snapshot_mem_new(void);
+void snapshot_mem_free(snapshot_mem_t *mem);
+size_t snapshot_mem_get_size(const snapshot_mem_t *mem);
+int snapshot_mem_is_delta(const snapshot_mem_t *mem);
+void snapshot_mem_select(snapshot_mem_t *mem);
+int snapshot_mem_make_delta(snapshot_mem_t *mem, snapshot_mem_t *base);
+snapshot_mem_t *snapshot_mem_copy(const snapshot_mem_t *mem);
+
 void snapshot_set_error(int error);
 int snapshot_get_error(void);
 
@@ -56,6 +56,10 @@
 
 #include "socketimpl.h"
 
+#ifdef HAVE_WORKER_THREADS
+#include <pthread.h>
+#endif
+
 /* Fix Windows' definition of 'INVALID_SOCKET (SOCKET)(~0)', which breaks the
  * code further down. Any 'normal' OS uses -1, but Microsft had to use an
  * unsigned int with INVALID_SOCKET being the largest value for that unsigned
@@ -220,6 +224,20 @@ static vice_network_socket_t socket_pool[16];
 /*! \internal \brief usage bit pattern for socket_pool */
 static unsigned int socket_pool_usage = 0;
 
+#ifdef HAVE_WORKER_THREADS
+/*! \internal \brief protects the usage bit patterns of both pools
+
+  Sockets are opened and closed from the emulation thread, the binary
+  monitor I/O thread and the Idun cartridge connect thread.
+*/
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+# define POOL_LOCK()   pthread_mutex_lock(&pool_lock)
+# define POOL_UNLOCK() pthread_mutex_unlock(&pool_lock)
+#else
+# define POOL_LOCK()
+# define POOL_UNLOCK()
+#endif
+
 /*! \internal \brief Get the next free entry of a pool
 
   \param PoolUsage
@@ -235,6 +253,9 @@ static unsigned int socket_pool_usage = 0;
   \remark
      In the current implementation, this function is restricted
      to 16 entries.
+
+  \remark
+     Takes pool_lock, the caller must not hold it.
 */
 static int get_new_pool_entry(unsigned int * PoolUsage)
 {
@@ -245,6 +266,7 @@ static int get_new_pool_entry(unsigned int * PoolUsage)
         0, 1, 0, 2, 0, 1, 0, -1
     };
 
+    POOL_LOCK();
     next_free = nextentry[*PoolUsage & 0x0f];
     if (next_free < 0) {
         next_free = nextentry[(*PoolUsage >> 4) & 0x0f];
@@ -266,6 +288,7 @@ static int get_new_pool_entry(unsigned int * PoolUsage)
     if (next_free >= 0) {
         *PoolUsage |= 1u << next_free;
     }
+    POOL_UNLOCK();
 
     return next_free;
 }
@@ -753,7 +776,6 @@ static int vice_network_address_generate_ipv6(vice_network_socket_address_t * so
 #endif /* #ifdef HAVE_IPV6 */
 }
 
-#if 0
 /*! \internal \brief Generate a unix domain socket address
 
   Initialises a socket address with a unix domain socket address
@@ -812,7 +834,6 @@ static int vice_network_address_generate_local(vice_network_socket_address_t * s
     return -1;
 #endif /* #ifdef HAVE_UNIX_DOMAIN_SOCKETS */
 }
-#endif
 
 /*! \brief Generate a socket address
 
@@ -835,8 +856,8 @@ static int vice_network_address_generate_local(vice_network_socket_address_t * s
      NULL in case of an error.
 
   \remark
-     If address_string starts with a pipe ('|'), then the
-     address_string is treated as a unix domain socket.
+     If address_string starts with unix:, then the rest of
+     address_string is the path of a unix domain socket.
      Otherwise, address_string can be prepended with ip6://
      or ip4://, in which case address_string is treated
      exactly as an IPv6 or IPv4 address, respectively.
@@ -855,15 +876,13 @@ vice_network_socket_address_t * vice_network_address_generate(const char * addre
         if (socket_address == NULL) {
             break;
         }
-#if 0 /* FIXME: "|" as first character indicates that we want to pipe through an external process - if we
-                want to support unix domain socket, this has to use another syntax! */
-        if (address_string && address_string[0] == '|') {
-            if (vice_network_address_generate_local(socket_address, &address_string[1])) {
+        /* "|" as first character indicates that we want to pipe through an
+           external process, so unix domain sockets use a prefix instead */
+        if (address_string && strncmp("unix:", address_string, sizeof "unix:" - 1) == 0) {
+            if (vice_network_address_generate_local(socket_address, &address_string[sizeof "unix:" - 1])) {
                 break;
             }
-        } else
-#endif
-        if (address_string && strncmp("ip6://", address_string, sizeof "ip6://" - 1) == 0) {
+        } else if (address_string && strncmp("ip6://", address_string, sizeof "ip6://" - 1) == 0) {
             if (vice_network_address_generate_ipv6(socket_address, &address_string[sizeof "ip6://" - 1], port)) {
                 break;
             }
@@ -908,11 +927,13 @@ vice_network_socket_address_t * vice_network_address_generate(const char * addre
 void vice_network_address_close(vice_network_socket_address_t * address)
 {
     if (address) {
+        POOL_LOCK();
         assert(address->used == 1);
         assert(((address_pool_usage & (1u << (address - address_pool))) != 0));
 
         address->used = 0;
         address_pool_usage &= ~(1u << (address - address_pool));
+        POOL_UNLOCK();
     }
 }
 
@@ -958,11 +979,13 @@ int vice_network_socket_close(vice_network_socket_t * sockfd)
     if (sockfd) {
         localsockfd = sockfd->sockfd;
 
+        POOL_LOCK();
         assert(sockfd->used == 1);
         assert(((socket_pool_usage & (1u << (sockfd - socket_pool))) != 0));
 
         sockfd->used = 0;
         socket_pool_usage &= ~(1u << (sockfd - socket_pool));
+        POOL_UNLOCK();
 
         error = closesocket(localsockfd);
     }
@@ -1014,6 +1037,63 @@ ssize_t vice_network_send(vice_network_socket_t *sockfd,
     return ret;
 }
 
+/*! \brief Send data on a connected socket without blocking
+
+  This function sends as much of the outgoing data as the socket takes
+  right now. It never waits for the peer to read.
+
+  \param sockfd
+     The connected socket to send to
+
+  \param buffer
+     Pointer to the buffer which holds the data to send
+
+  \param buffer_length
+     The length of the buffer pointed to by buffer.
+
+  \return
+     the number of bytes sent, which can be less than buffer_length,
+     0 if the socket takes no data at the moment, and -1 in case of
+     an error.
+
+  \note Where send() has no MSG_DONTWAIT flag, the data is only sent
+        once select() reports the socket writable, and the send itself
+        may still wait for the rest of the buffer.
+*/
+ssize_t vice_network_send_nonblocking(vice_network_socket_t *sockfd,
+                                      const void            *buffer,
+                                      size_t                 buffer_length)
+{
+    TIMEVAL timeout = { 0, 0 };
+    fd_set fdsockset;
+    ssize_t ret;
+    int flags = 0;
+
+    FD_ZERO(&fdsockset);
+    FD_SET(sockfd->sockfd, &fdsockset);
+
+    ret = select(sockfd->sockfd + 1, NULL, &fdsockset, NULL, &timeout);
+    if (ret <= 0) {
+        return ret;
+    }
+
+#ifdef MSG_DONTWAIT
+    flags = MSG_DONTWAIT;
+#endif
+
+    signals_pipe_set();
+    ret = send(sockfd->sockfd, buffer, buffer_length, flags);
+    signals_pipe_unset();
+
+#if defined(EAGAIN) && defined(EWOULDBLOCK)
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        ret = 0;
+    }
+#endif
+
+    return ret;
+}
+
 /*! \brief Receive data from a connected socket
 
   This function receives incoming data from a connected socket.
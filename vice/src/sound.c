@@ -52,6 +52,7 @@
 #include "monitor.h"
 #include "resources.h"
 #include "sound.h"
+#include "soundthread.h"
 #include "types.h"
 #include "uiapi.h"
 #include "util.h"
@@ -532,6 +533,7 @@ static int amp;
 static int fragment_size;
 static int output_option;
 static int sound_emulation_enabled_on_warp;
+static int device_thread_enabled;
 
 /* divisors for fragment size calculation */
 static const int fragment_divisor[] = {
@@ -586,6 +588,17 @@ static int set_sound_emulation_enabled_on_warp(int value, void *param)
     return 0;
 }
 
+static int set_device_thread_enabled(int value, void *param)
+{
+    int val = value ? 1 : 0;
+
+    if (device_thread_enabled != val) {
+        device_thread_enabled = val;
+        sound_playdev_reopen = TRUE;
+    }
+    return 0;
+}
+
 static int set_playback_enabled(int value, void *param)
 {
     int val = value ? 1 : 0;
@@ -718,6 +731,8 @@ static const resource_int_t resources_int[] = {
       (void *)&output_option, set_output_option, NULL },
     { "SoundEmulateOnWarp", 1, RES_EVENT_NO, NULL,
       (void *)&sound_emulation_enabled_on_warp, set_sound_emulation_enabled_on_warp, NULL },
+    { "SoundDeviceThread", 0, RES_EVENT_NO, NULL,
+      (void *)&device_thread_enabled, set_device_thread_enabled, NULL },
     RESOURCE_INT_LIST_END
 };
 
@@ -776,6 +791,12 @@ static const cmdline_option_t cmdline_options[] =
     { "-soundwarpmode", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "SoundEmulateOnWarp", NULL,
       "<mode>", "Specify how to handle sound emulation in warp mode: (0: do not emulate the sound chips, 1: keep emulating the sound chips)" },
+    { "-soundthread", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "SoundDeviceThread", (resource_value_t)1,
+      NULL, "Write to the sound device from a separate thread" },
+    { "+soundthread", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "SoundDeviceThread", (resource_value_t)0,
+      NULL, "Write to the sound device from the emulation thread" },
     CMDLINE_LIST_END
 };
 
@@ -1006,7 +1027,11 @@ static void fill_buffer(int size, int rise)
         }
     }
 
-    i = snddata.playdev->write(p, size * snddata.sound_output_channels);
+    if (soundthread_active()) {
+        i = soundthread_write(p, size);
+    } else {
+        i = snddata.playdev->write(p, size * snddata.sound_output_channels);
+    }
     if (i) {
         sound_error("write to sound device failed.");
     }
@@ -1250,6 +1275,12 @@ int sound_open(void)
                 fill_buffer(j, 0);
             }
         }
+
+        /* Only realtime devices are worth a thread. */
+        if (device_thread_enabled && pdev->is_timing_source) {
+            soundthread_open(pdev, speed, snddata.fragsize, snddata.fragnr,
+                             snddata.sound_output_channels);
+        }
     } else {
         err = lib_msprintf("device '%s' not found or not supported.", playname);
         sound_error(err);
@@ -1309,6 +1340,9 @@ int sound_open(void)
 static void sounddev_close(const sound_device_t **dev)
 {
     if (*dev) {
+        if (dev == &snddata.playdev) {
+            soundthread_close();
+        }
         log_message(sound_log, "Closing device `%s'", (*dev)->name);
         if ((*dev)->close) {
             (*dev)->close();
@@ -1512,6 +1546,7 @@ bool sound_flush(void)
 
     if (warp_mode_enabled && snddata.recdev == NULL) {
         snddata.bufptr = 0;
+        soundthread_idle();
         goto done;
     }
     sound_resume();
@@ -1540,7 +1575,10 @@ bool sound_flush(void)
 
     while (!warp_mode_enabled) {
 
-        if (snddata.playdev->bufferspace) {
+        if (soundthread_active()) {
+            /* The sound thread drains the ring at the device's pace. */
+            space = soundthread_bufferspace();
+        } else if (snddata.playdev->bufferspace) {
             space = snddata.playdev->bufferspace();
         } else {
             /* We are using a blocking driver like simple pulse - write everything we have. */
@@ -1558,7 +1596,12 @@ bool sound_flush(void)
             mainlock_yield_begin();
 
             /* Flush buffer, all channels are already mixed into it. */
-            if (snddata.playdev->write(snddata.buffer, nr * snddata.sound_output_channels)) {
+            if (soundthread_active()) {
+                i = soundthread_write(snddata.buffer, nr);
+            } else {
+                i = snddata.playdev->write(snddata.buffer, nr * snddata.sound_output_channels);
+            }
+            if (i) {
                 sound_error("write to sound device failed.");
 
                 mainlock_yield_end();
@@ -1610,6 +1653,8 @@ done:
 /* suspend sid (eg. before pause) */
 void sound_suspend(void)
 {
+    int space;
+
     if (!snddata.playdev) {
         return;
     }
@@ -1617,8 +1662,14 @@ void sound_suspend(void)
     if (snddata.playdev->write && !snddata.issuspended
         && snddata.playdev->need_attenuation) {
         /* fill buffer, but avoid overwriting */
-        if (!snddata.playdev->bufferspace
-            || snddata.playdev->bufferspace() >= snddata.fragsize) {
+        if (soundthread_active()) {
+            space = soundthread_bufferspace();
+        } else if (snddata.playdev->bufferspace) {
+            space = snddata.playdev->bufferspace();
+        } else {
+            space = snddata.fragsize;
+        }
+        if (space >= snddata.fragsize) {
             fill_buffer(snddata.fragsize, -1);
         } else {
             log_warning(sound_log, "Buffer full during suspend");
@@ -1629,8 +1680,13 @@ void sound_suspend(void)
         }
     }
 
+    if (!snddata.issuspended) {
+        soundthread_suspend();
+    }
+
     if (snddata.playdev->suspend && !snddata.issuspended) {
         if (snddata.playdev->suspend()) {
+            soundthread_resume();
             return;
         }
     }
@@ -1650,6 +1706,9 @@ void sound_resume(void)
         } else {
             snddata.issuspended = 0;
         }
+        if (!snddata.issuspended) {
+            soundthread_resume();
+        }
 
         if (snddata.playdev->write && !snddata.issuspended
             && snddata.playdev->need_attenuation) {
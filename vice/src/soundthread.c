@@ -0,0 +1,389 @@
+/*
+ * soundthread.c - Feed the sound device from its own thread.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/*
+    Normally sound_flush() writes the mixed fragments to the playback device
+    on the emulation thread, and a slow or blocking device write stalls the
+    emulation. With SoundDeviceThread enabled sound_flush() only copies the
+    fragments into a single producer, single consumer ring buffer, and a
+    separate thread moves them from the ring to the device.
+
+    The emulation is still throttled by the device: sound_flush() waits until
+    the ring is below the latency target, and the ring drains at the rate the
+    device consumes samples. The latency target starts at two fragments and
+    is raised by a fragment whenever the device runs dry (an underrun). After
+    SOUNDTHREAD_ADAPT_SECONDS without an underrun it is lowered again by a
+    fragment, down to a single one.
+
+    Samples that do not fit into the ring are dropped and counted as an
+    overrun. Both counters are logged when the device is closed.
+
+    Only the thread calls write() and bufferspace() of the device while it
+    is running. sound.c suspends the thread before it calls any other
+    function of the device, or closes it first.
+*/
+
+#include "vice.h"
+
+#include <string.h>
+
+#ifdef HAVE_WORKER_THREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#include "archdep.h"
+#include "lib.h"
+#include "log.h"
+#include "sound.h"
+#include "soundthread.h"
+#include "types.h"
+
+#ifdef HAVE_WORKER_THREADS
+
+/* Lower the latency target after this long without an underrun. */
+#define SOUNDTHREAD_ADAPT_SECONDS   10
+
+/* Wait at most this long for the ring to drain before suspending. */
+#define SOUNDTHREAD_DRAIN_USEC      200000
+
+static log_t soundthread_log = LOG_DEFAULT;
+
+static const sound_device_t *device;
+static int16_t *ring;
+static int ring_frames;
+static int channels;
+static int fragsize;
+static int device_frames;
+static int sample_rate;
+static unsigned long sleep_usec;
+
+static atomic_size_t ring_head;     /* written by the emulation thread */
+static atomic_size_t ring_tail;     /* written by the sound thread */
+static atomic_int target;           /* latency target in frames */
+static atomic_int active = 0;
+static atomic_int running = 0;
+static atomic_int paused = 0;
+static atomic_int idle = 0;
+static atomic_int failed = 0;
+static atomic_uint underruns;
+static atomic_uint overruns;
+
+static pthread_t thread;
+static pthread_mutex_t device_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void soundthread_raise_target(void)
+{
+    int t = atomic_load(&target) + fragsize;
+
+    if (t <= ring_frames) {
+        atomic_store(&target, t);
+    }
+}
+
+static void soundthread_lower_target(void)
+{
+    int t = atomic_load(&target) - fragsize;
+
+    if (t >= fragsize) {
+        atomic_store(&target, t);
+    }
+}
+
+static void *soundthread_main(void *unused)
+{
+    int starving = 0;
+    int drained = 0;
+
+    while (atomic_load(&running)) {
+        int wrote = 0;
+
+        pthread_mutex_lock(&device_lock);
+
+        if (!atomic_load(&paused) && !atomic_load(&failed)) {
+            size_t tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+            size_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+            int fill = (int)(head - tail);
+            int space;
+
+            if (device->bufferspace) {
+                space = device->bufferspace();
+            } else {
+                /* Blocking driver like simple pulse - write everything we have. */
+                space = fill;
+            }
+            space -= space % fragsize;
+
+            if (fill >= fragsize && space > 0) {
+                /* Whole fragments only, and only up to the end of the ring. */
+                int offset = (int)(tail % (size_t)ring_frames);
+                int nr = fill - fill % fragsize;
+
+                if (nr > space) {
+                    nr = space;
+                }
+                if (nr > ring_frames - offset) {
+                    nr = ring_frames - offset;
+                }
+
+                if (device->write(ring + offset * channels, nr * channels)) {
+                    atomic_store(&failed, 1);
+                }
+                atomic_store_explicit(&ring_tail, tail + (size_t)nr, memory_order_release);
+
+                starving = 0;
+                wrote = 1;
+                drained += nr;
+                if (drained >= sample_rate * SOUNDTHREAD_ADAPT_SECONDS) {
+                    soundthread_lower_target();
+                    drained = 0;
+                }
+            } else if (space > 0 && !starving && !atomic_load(&idle)) {
+                /* The device wants data but the ring has none. It only
+                   runs dry once it has less than a fragment left. */
+                int queued = device->bufferspace ? device_frames - space : 0;
+
+                if (queued < fragsize) {
+                    atomic_fetch_add(&underruns, 1);
+                    soundthread_raise_target();
+                    starving = 1;
+                    drained = 0;
+                }
+            }
+        }
+
+        pthread_mutex_unlock(&device_lock);
+
+        if (!wrote) {
+            archdep_usleep(sleep_usec);
+        }
+    }
+
+    return NULL;
+}
+
+int soundthread_open(const sound_device_t *dev, int speed, int frag, int fragnr, int nch)
+{
+    if (atomic_load(&active)) {
+        soundthread_close();
+    }
+
+    if (soundthread_log == LOG_DEFAULT) {
+        soundthread_log = log_open("SoundThread");
+    }
+
+    device = dev;
+    fragsize = frag;
+    channels = nch;
+    sample_rate = speed;
+    device_frames = frag * fragnr;
+    ring_frames = frag * (fragnr < 2 ? 2 : fragnr);
+    ring = lib_calloc((size_t)(ring_frames * channels), sizeof(int16_t));
+
+    /* Poll about four times per fragment, but at least every millisecond. */
+    sleep_usec = (unsigned long)(250000.0 * frag / speed);
+    if (sleep_usec > 1000 || sleep_usec == 0) {
+        sleep_usec = 1000;
+    }
+
+    atomic_store(&ring_head, 0);
+    atomic_store(&ring_tail, 0);
+    atomic_store(&target, frag * 2 <= ring_frames ? frag * 2 : ring_frames);
+    atomic_store(&paused, 0);
+    atomic_store(&idle, 1);
+    atomic_store(&failed, 0);
+    atomic_store(&underruns, 0);
+    atomic_store(&overruns, 0);
+    atomic_store(&running, 1);
+
+    if (pthread_create(&thread, NULL, soundthread_main, NULL) != 0) {
+        log_error(soundthread_log, "Could not create the sound device thread.");
+        atomic_store(&running, 0);
+        lib_free(ring);
+        ring = NULL;
+        device = NULL;
+        return -1;
+    }
+
+    atomic_store(&active, 1);
+    log_message(soundthread_log, "Feeding `%s' from a thread, ring %.2fms.",
+                dev->name, 1000.0 * ring_frames / speed);
+
+    return 0;
+}
+
+void soundthread_close(void)
+{
+    if (!atomic_load(&active)) {
+        return;
+    }
+
+    atomic_store(&active, 0);
+    atomic_store(&running, 0);
+    pthread_join(thread, NULL);
+
+    log_message(soundthread_log, "%u underruns, %u overruns, final latency target %.2fms.",
+                atomic_load(&underruns), atomic_load(&overruns),
+                1000.0 * atomic_load(&target) / sample_rate);
+
+    lib_free(ring);
+    ring = NULL;
+    device = NULL;
+}
+
+int soundthread_active(void)
+{
+    return atomic_load(&active);
+}
+
+/* Number of frames the emulation may queue before it has to wait. */
+int soundthread_bufferspace(void)
+{
+    size_t tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    int space = atomic_load(&target) - (int)(head - tail);
+
+    return space > 0 ? space : 0;
+}
+
+int soundthread_write(const int16_t *pbuf, int nr)
+{
+    size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    int space = ring_frames - (int)(head - tail);
+    int offset = (int)(head % (size_t)ring_frames);
+    int first;
+
+    if (nr > space) {
+        atomic_fetch_add(&overruns, 1);
+        nr = space;
+    }
+
+    first = ring_frames - offset;
+    if (first > nr) {
+        first = nr;
+    }
+    memcpy(ring + offset * channels, pbuf, (size_t)(first * channels) * sizeof(int16_t));
+    memcpy(ring, pbuf + first * channels, (size_t)((nr - first) * channels) * sizeof(int16_t));
+
+    atomic_store_explicit(&ring_head, head + (size_t)nr, memory_order_release);
+    atomic_store(&idle, 0);
+
+    return atomic_load(&failed) ? -1 : 0;
+}
+
+/* The emulation stops feeding the ring for a while (warp), so running dry
+   is expected and not an underrun. */
+void soundthread_idle(void)
+{
+    atomic_store(&idle, 1);
+}
+
+void soundthread_suspend(void)
+{
+    unsigned long waited = 0;
+
+    if (!atomic_load(&active)) {
+        return;
+    }
+
+    /* Let the device play what is queued, like the fade out. */
+    while (soundthread_bufferspace() < atomic_load(&target)
+           && !atomic_load(&failed)
+           && waited < SOUNDTHREAD_DRAIN_USEC) {
+        archdep_usleep(1000);
+        waited += 1000;
+    }
+
+    /* Once the lock was taken the thread has seen the flag. */
+    atomic_store(&paused, 1);
+    pthread_mutex_lock(&device_lock);
+    pthread_mutex_unlock(&device_lock);
+}
+
+void soundthread_resume(void)
+{
+    atomic_store(&idle, 1);
+    atomic_store(&paused, 0);
+}
+
+double soundthread_get_fill(void)
+{
+    size_t tail, head;
+
+    if (!atomic_load(&active)) {
+        return -1.0;
+    }
+
+    tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    head = atomic_load_explicit(&ring_head, memory_order_acquire);
+
+    return 100.0 * (double)(head - tail) / atomic_load(&target);
+}
+
+#else /* HAVE_WORKER_THREADS */
+
+/* Without threads sound.c writes to the device itself */
+
+int soundthread_open(const sound_device_t *dev, int speed, int frag, int fragnr, int nch)
+{
+    return -1;
+}
+
+void soundthread_close(void)
+{
+}
+
+int soundthread_active(void)
+{
+    return 0;
+}
+
+int soundthread_bufferspace(void)
+{
+    return 0;
+}
+
+int soundthread_write(const int16_t *pbuf, int nr)
+{
+    return -1;
+}
+
+void soundthread_idle(void)
+{
+}
+
+void soundthread_suspend(void)
+{
+}
+
+void soundthread_resume(void)
+{
+}
+
+double soundthread_get_fill(void)
+{
+    return -1.0;
+}
+
+#endif /* HAVE_WORKER_THREADS */
@@ -0,0 +1,48 @@
+/*
+ * soundthread.h - Feed the sound device from its own thread.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_SOUNDTHREAD_H
+#define VICE_SOUNDTHREAD_H
+
+#include "types.h"
+
+struct sound_device_s;
+
+/* All sizes are in sample frames (one sample for every output channel). */
+
+int soundthread_open(const struct sound_device_s *dev, int speed, int fragsize, int fragnr, int channels);
+void soundthread_close(void);
+int soundthread_active(void);
+
+int soundthread_bufferspace(void);
+int soundthread_write(const int16_t *pbuf, int nr);
+void soundthread_idle(void);
+
+/* Keep the thread away from the device while it is suspended. */
+void soundthread_suspend(void);
+void soundthread_resume(void);
+
+/* Fill level in percent of the latency target, -1 if the thread is not used. */
+double soundthread_get_fill(void);
+
+#endif
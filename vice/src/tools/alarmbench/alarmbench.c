@@ -0,0 +1,314 @@
+/*
+ * alarmbench.c - Alarm scheduler micro benchmark.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/*
+    Drives src/alarm.c with the alarm traffic of an emulated machine and
+    reports the cost per emulated second. It is built twice, as
+    alarmbench-linear and alarmbench-heap, so both pending alarm layouts
+    can be compared on the same workload; `make alarmbench` at the top
+    level runs both.
+
+    The workload approximates x64sc with a true drive emulated 1541 and a
+    REU, using the alarms those register:
+
+    - main context: VIC-II raster, fetch and IRQ alarms, five alarms each
+      for CIA 1 and 2 (timer A and B, TOD, SDR, idle), SID, keyboard,
+      joystick, datasette and two cartridge alarms. The REU itself has no
+      alarm; its DMA shows up as CPU accesses to the CIAs moving their
+      idle alarms.
+    - drive context: five alarms each for the two VIAs of the 1541.
+
+    Periodic alarms re-arm themselves when dispatched. Register accesses,
+    at a rate per context, move a pending alarm or unset and set it again,
+    which is what alarm_set()/alarm_unset() see from CIA and VIA code.
+    The -x option adds idle alarms to show how both layouts scale.
+*/
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alarm.h"
+#include "lib.h"
+#include "log.h"
+
+/* compiled in, so that ALARM_FORCE_* applies to alarm_unset() as well */
+#include "alarm.c"
+
+#define CYCLES_PER_SECOND 985248
+
+#ifdef ALARM_HEAP
+#define VARIANT "heap"
+#else
+#define VARIANT "linear"
+#endif
+
+typedef struct bench_alarm_s {
+    const char *name;
+    CLOCK period;       /* re-armed this far ahead when dispatched, 0 if not */
+    CLOCK first;        /* first due, 0 if not pending at start */
+    int touched;        /* moved by register accesses */
+} bench_alarm_t;
+
+static const bench_alarm_t main_alarms[] = {
+    { "VicIIRaster",   63,     63,      0 },
+    { "VicIIFetch",    19656,  1000,    0 },
+    { "VicIIIrq",      19656,  12000,   0 },
+    { "CIA1TimerA",    16421,  16421,   1 },
+    { "CIA1TimerB",    0,      0,       1 },
+    { "CIA1TOD",       98525,  98525,   0 },
+    { "CIA1SDR",       0,      0,       0 },
+    { "CIA1Idle",      0,      2000000, 1 },
+    { "CIA2TimerA",    0,      0,       1 },
+    { "CIA2TimerB",    0,      0,       1 },
+    { "CIA2TOD",       98525,  98525,   0 },
+    { "CIA2SDR",       0,      0,       0 },
+    { "CIA2Idle",      0,      2000000, 1 },
+    { "SID",           19656,  19656,   0 },
+    { "Keyboard",      0,      0,       0 },
+    { "Joystick",      0,      0,       0 },
+    { "Datasette",     0,      0,       0 },
+    { "Cart1",         0,      0,       0 },
+    { "Cart2",         0,      0,       0 },
+    { NULL,            0,      0,       0 }
+};
+
+static const bench_alarm_t drive_alarms[] = {
+    { "VIA1TimerA",    0,      0,       1 },
+    { "VIA1TimerB",    0,      0,       1 },
+    { "VIA1Idle",      0,      1000000, 1 },
+    { "VIA1Sr",        0,      0,       0 },
+    { "VIA1Ca2",       0,      0,       0 },
+    { "VIA2TimerA",    20000,  20000,   1 },
+    { "VIA2TimerB",    0,      0,       1 },
+    { "VIA2Idle",      0,      1000000, 1 },
+    { "VIA2Sr",        0,      0,       0 },
+    { "VIA2Ca2",       0,      0,       0 },
+    { NULL,            0,      0,       0 }
+};
+
+typedef struct bench_context_s {
+    alarm_context_t *context;
+    alarm_t *alarms[ALARM_CONTEXT_MAX_PENDING_ALARMS];
+    const bench_alarm_t *desc[ALARM_CONTEXT_MAX_PENDING_ALARMS];
+    int num;
+    CLOCK *clk;
+    unsigned int access_rate;   /* register accesses per 1024 cycles */
+} bench_context_t;
+
+static CLOCK main_clk = 0;
+static CLOCK drive_clk = 0;
+static unsigned long dispatches = 0;
+static unsigned long sets = 0;
+static unsigned int seed = 1;
+
+static const bench_alarm_t idle_alarm = { "Idle", 0, 0, 1 };
+
+/* ------------------------------------------------------------------------- */
+
+/* alarm.c only needs these from the rest of VICE */
+
+#ifdef LIB_DEBUG_PINPOINT
+void *lib_malloc_pinpoint(size_t size, const char *name, unsigned int line)
+{
+    return malloc(size);
+}
+
+void lib_free_pinpoint(void *p, const char *name, unsigned int line)
+{
+    free(p);
+}
+
+char *lib_strdup_pinpoint(const char *str, const char *name, unsigned int line)
+{
+    return strcpy(malloc(strlen(str) + 1), str);
+}
+#else
+void *lib_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void lib_free(void *ptr)
+{
+    free(ptr);
+}
+
+char *lib_strdup(const char *str)
+{
+    return strcpy(malloc(strlen(str) + 1), str);
+}
+#endif
+
+int log_error(log_t log, const char *format, ...)
+{
+    fprintf(stderr, "%s\n", format);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static unsigned int bench_random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+static void bench_callback(CLOCK offset, void *data)
+{
+    bench_context_t *bc = data;
+    alarm_t *alarm = bc->context->pending_alarms[bc->context->next_pending_alarm_idx].alarm;
+    int i;
+
+    dispatches++;
+    for (i = 0; i < bc->num; i++) {
+        if (bc->alarms[i] == alarm) {
+            break;
+        }
+    }
+    if (bc->desc[i]->period) {
+        alarm_set(alarm, *bc->clk - offset + bc->desc[i]->period);
+    } else {
+        alarm_unset(alarm);
+    }
+    sets++;
+}
+
+static void bench_context_init(bench_context_t *bc, const char *name, const bench_alarm_t *desc,
+                               CLOCK *clk, unsigned int access_rate, int extra)
+{
+    int i;
+
+    memset(bc, 0, sizeof(*bc));
+    bc->context = alarm_context_new(name);
+    bc->clk = clk;
+    bc->access_rate = access_rate;
+
+    for (i = 0; desc[i].name != NULL; i++) {
+        bc->desc[bc->num] = &desc[i];
+        bc->alarms[bc->num] = alarm_new(bc->context, desc[i].name, bench_callback, bc);
+        if (desc[i].first) {
+            alarm_set(bc->alarms[bc->num], desc[i].first);
+        }
+        bc->num++;
+    }
+    for (i = 0; i < extra && bc->num < ALARM_CONTEXT_MAX_PENDING_ALARMS; i++) {
+        bc->desc[bc->num] = &idle_alarm;
+        bc->alarms[bc->num] = alarm_new(bc->context, idle_alarm.name, bench_callback, bc);
+        alarm_set(bc->alarms[bc->num], (CLOCK)(3000000 + bench_random()));
+        bc->num++;
+    }
+}
+
+/* A register access: a timer or idle alarm is moved, or restarted */
+static void bench_access(bench_context_t *bc)
+{
+    int i = (int)(bench_random() % (unsigned int)bc->num);
+    CLOCK clk = *bc->clk;
+
+    if (!bc->desc[i]->touched) {
+        return;
+    }
+    if (bc->alarms[i]->pending_idx >= 0 && (bench_random() & 7) == 0) {
+        alarm_unset(bc->alarms[i]);
+    } else if (bc->desc[i]->first == 0 && bc->desc[i]->period == 0) {
+        /* a timer started by the program, due soon */
+        alarm_set(bc->alarms[i], clk + 64 + (bench_random() & 0x3ff));
+    } else {
+        alarm_set(bc->alarms[i], clk + 1000 + bench_random());
+    }
+    sets++;
+}
+
+/* Run one emulated cycle slice of about one instruction */
+static void bench_step(bench_context_t *bc, CLOCK cycles)
+{
+    *bc->clk += cycles;
+    while (*bc->clk >= alarm_context_next_pending_clk(bc->context)) {
+        alarm_context_dispatch(bc->context, *bc->clk);
+    }
+    if ((bench_random() & 1023) < bc->access_rate * cycles) {
+        bench_access(bc);
+    }
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-s seconds] [-x alarms]\n"
+            "  -s seconds  emulated seconds to run (default 60)\n"
+            "  -x alarms   extra pending idle alarms per context (default 0)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    bench_context_t main_ctx, drive_ctx;
+    int seconds = 60, extra = 0, i;
+    double start, elapsed;
+    CLOCK end;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-x") && i + 1 < argc) {
+            extra = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /* the drive CPU polls its VIAs far more often than the C64 its CIAs */
+    bench_context_init(&main_ctx, "MainCPU", main_alarms, &main_clk, 8, extra);
+    bench_context_init(&drive_ctx, "Drive8", drive_alarms, &drive_clk, 64, extra);
+
+    end = (CLOCK)seconds * CYCLES_PER_SECOND;
+    start = bench_now();
+    while (main_clk < end) {
+        /* 2-7 cycle instructions, drive and main CPU in lock step */
+        CLOCK cycles = 2 + (bench_random() % 6);
+        bench_step(&main_ctx, cycles);
+        bench_step(&drive_ctx, cycles);
+    }
+    elapsed = bench_now() - start;
+
+    printf("%-6s  %d s emulated, %d+%d alarms, %u+%u pending at end: %lu dispatches, %lu set/unset,"
+           " %.1f ms per emulated second, %.1f ns per operation\n",
+           VARIANT, seconds, main_ctx.num, drive_ctx.num,
+           main_ctx.context->num_pending_alarms, drive_ctx.context->num_pending_alarms,
+           dispatches, sets, elapsed * 1000.0 / seconds,
+           elapsed * 1e9 / (double)(dispatches + sets));
+    return 0;
+}
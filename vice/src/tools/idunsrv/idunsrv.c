@@ -0,0 +1,656 @@
+/*
+ * idunsrv.c - Stand-in Idun service for testing and benchmarking the
+ *             Idun cartridge emulation.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/*
+ * The real Idun service runs on the cartridge's companion computer. This
+ * program speaks just enough of its socket protocol to drive the emulated
+ * cartridge without one:
+ *
+ *  - ERAM lives in memory: 256 blocks of 64 pages each, all zero at start.
+ *    With -m it lives in a file that the emulator maps too (-iduneramshm).
+ *  - LISTEN #0 + CMD_LOAD_BLOCK / CMD_FREEMAP select a block and queue its
+ *    pages for the following TALK #0 sequence (or one bulk TALK).
+ *  - LISTEN #0 + CMD_UPDATE_PAGE / CMD_UPDATE_RUN store pages.
+ *  - Every other byte is $DE00 output and is echoed straight back, so a
+ *    6502 program can measure the data channel round trip.
+ *
+ * It listens on 127.0.0.1, or on a unix domain socket with -u, which the
+ * emulator reaches through -idunhost unix:<path>.
+ *
+ * When a connection closes (or on SIGINT) the program prints byte counts,
+ * throughput and per-command latency. Latency is measured from the end of
+ * a command to the UNTALK that acknowledges the last page of its reply,
+ * which is what the emulated CPU waits for.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEFAULT_PORT 25232
+
+#define SYSTEM_BLOCK 255
+#define NUM_BLOCKS 256
+#define PAGES_PER_BLOCK 64
+#define BLOCK_SIZE (PAGES_PER_BLOCK * 256)
+
+/* these must match iduncore.c */
+#define CMD_LOAD_BLOCK 0xfc
+#define CMD_UPDATE_PAGE 0xfd
+#define CMD_UPDATE_RUN 0xfe
+#define CMD_FREEMAP 0xf7
+#define BULK_TALK_SA 0x7e
+#define BULK_PAGES_FLAG 0x80
+
+#define LISTEN0 0x20
+#define TALK0 0x40
+#define UNTALK 0x5f
+#define SA0 0x7f
+
+#define IN_BUF_SIZE 65536
+#define OUT_BUF_SIZE 65536
+
+enum {
+    STAT_LOAD_BLOCK = 0,
+    STAT_FREEMAP,
+    STAT_UPDATE_PAGE,
+    STAT_UPDATE_RUN,
+    STAT_NUM
+};
+
+typedef struct cmd_stats_s {
+    const char *name;
+    unsigned long count;
+    unsigned long pages;
+    double total_us;
+    double max_us;
+} cmd_stats_t;
+
+static cmd_stats_t cmd_stats[STAT_NUM];
+
+static const char *cmd_names[STAT_NUM] = {
+    "LOAD_BLOCK",
+    "FREEMAP",
+    "UPDATE_PAGE",
+    "UPDATE_RUN"
+};
+
+static uint8_t *eram[NUM_BLOCKS];
+static uint8_t *eram_map = NULL;    /* shared ERAM file, all blocks */
+static int cur_block = SYSTEM_BLOCK;
+
+/* options */
+static int serve_pages = PAGES_PER_BLOCK - 1;
+static int advertise_bulk = 0;
+static int verbose = 0;
+
+/* connection state */
+static int conn = -1;
+static uint8_t in_buf[IN_BUF_SIZE];
+static size_t in_len = 0;
+static size_t in_pos = 0;
+static uint8_t out_buf[OUT_BUF_SIZE];
+static size_t out_len = 0;
+
+/* reply queued by the last block command */
+static int reply_stat = -1;
+static const uint8_t *reply_data = NULL;
+static int reply_sent = -1;     /* pages sent so far, -1 before the count byte */
+static int reply_bulk = 0;
+static double reply_start;
+
+static unsigned long bytes_in;
+static unsigned long bytes_out;
+static unsigned long bytes_echoed;
+static double session_start;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000000.0 + (double)ts.tv_nsec / 1000.0;
+}
+
+static void on_sigint(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static uint8_t *block_data(int block)
+{
+    if (eram_map != NULL) {
+        return eram_map + (size_t)block * BLOCK_SIZE;
+    }
+    if (eram[block] == NULL) {
+        eram[block] = calloc(1, BLOCK_SIZE);
+        if (eram[block] == NULL) {
+            fprintf(stderr, "idunsrv: out of memory\n");
+            exit(1);
+        }
+    }
+    return eram[block];
+}
+
+static void stats_reset(void)
+{
+    int i;
+
+    for (i = 0; i < STAT_NUM; i++) {
+        memset(&cmd_stats[i], 0, sizeof(cmd_stats_t));
+        cmd_stats[i].name = cmd_names[i];
+    }
+    bytes_in = 0;
+    bytes_out = 0;
+    bytes_echoed = 0;
+    session_start = now_us();
+}
+
+static void stats_add(int stat, int pages, double start)
+{
+    double us = now_us() - start;
+    cmd_stats_t *s = &cmd_stats[stat];
+
+    s->count++;
+    s->pages += (unsigned long)pages;
+    s->total_us += us;
+    if (us > s->max_us) {
+        s->max_us = us;
+    }
+}
+
+static void stats_report(void)
+{
+    double secs = (now_us() - session_start) / 1000000.0;
+    int i;
+
+    if (secs <= 0.0) {
+        secs = 1e-6;
+    }
+    printf("idunsrv: session %.3f s, %lu bytes in, %lu bytes out, %.0f bytes/s\n",
+           secs, bytes_in, bytes_out, (double)(bytes_in + bytes_out) / secs);
+    printf("idunsrv: $DE00 data echoed: %lu bytes, %.0f bytes/s\n",
+           bytes_echoed, (double)bytes_echoed / secs);
+    printf("idunsrv: %-12s %8s %8s %10s %10s\n",
+           "command", "count", "pages", "avg us", "max us");
+    for (i = 0; i < STAT_NUM; i++) {
+        cmd_stats_t *s = &cmd_stats[i];
+
+        if (s->count == 0) {
+            continue;
+        }
+        printf("idunsrv: %-12s %8lu %8lu %10.1f %10.1f\n", s->name, s->count, s->pages,
+               s->total_us / (double)s->count, s->max_us);
+    }
+    fflush(stdout);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static int out_flush(void)
+{
+    size_t done = 0;
+
+    while (done < out_len) {
+        ssize_t n = send(conn, out_buf + done, out_len - done, 0);
+
+        if (n < 0) {
+            if (errno == EINTR && !interrupted) {
+                continue;
+            }
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    bytes_out += (unsigned long)out_len;
+    out_len = 0;
+    return 0;
+}
+
+static int out_put(const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        size_t n = OUT_BUF_SIZE - out_len;
+
+        if (n > len) {
+            n = len;
+        }
+        memcpy(out_buf + out_len, data, n);
+        out_len += n;
+        data += n;
+        len -= n;
+        if (out_len == OUT_BUF_SIZE && out_flush() < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Return the next input byte, or -1 when the connection is gone. Output is
+   flushed before blocking, so replies never wait for more input. */
+static int in_get(void)
+{
+    while (in_pos == in_len) {
+        ssize_t n;
+
+        if (out_len > 0 && out_flush() < 0) {
+            return -1;
+        }
+        n = recv(conn, in_buf, IN_BUF_SIZE, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR && !interrupted) {
+                continue;
+            }
+            return -1;
+        }
+        in_len = (size_t)n;
+        in_pos = 0;
+        bytes_in += (unsigned long)n;
+    }
+    return in_buf[in_pos++];
+}
+
+static int in_peek(void)
+{
+    int c = in_get();
+
+    if (c >= 0) {
+        in_pos--;
+    }
+    return c;
+}
+
+static int in_read(uint8_t *dest, size_t len)
+{
+    while (len > 0) {
+        int c = in_get();
+
+        if (c < 0) {
+            return -1;
+        }
+        *dest++ = (uint8_t)c;
+        len--;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void reply_queue(int stat, int block)
+{
+    reply_stat = stat;
+    reply_data = block_data(block);
+    reply_sent = -1;
+    reply_bulk = 0;
+    reply_start = now_us();
+}
+
+static void reply_done(void)
+{
+    stats_add(reply_stat, serve_pages, reply_start);
+    reply_stat = -1;
+    reply_data = NULL;
+}
+
+static int handle_talk(void)
+{
+    uint8_t count = (uint8_t)serve_pages;
+
+    if (reply_data == NULL) {
+        return 0;
+    }
+    if (reply_sent < 0) {
+        if (advertise_bulk) {
+            count |= BULK_PAGES_FLAG;
+        }
+        reply_sent = 0;
+        if (out_put(&count, 1) < 0) {
+            return -1;
+        }
+    }
+    if (reply_sent < serve_pages) {
+        if (out_put(reply_data + reply_sent * 256, 256) < 0) {
+            return -1;
+        }
+        reply_sent++;
+    }
+    return 0;
+}
+
+static int handle_bulk_talk(void)
+{
+    uint8_t count = (uint8_t)serve_pages | BULK_PAGES_FLAG;
+
+    if (reply_data == NULL) {
+        return 0;
+    }
+    reply_bulk = 1;
+    reply_sent = serve_pages;
+    if (out_put(&count, 1) < 0) {
+        return -1;
+    }
+    return out_put(reply_data, (size_t)serve_pages * 256);
+}
+
+static void handle_untalk(void)
+{
+    if (reply_data != NULL && (reply_bulk || reply_sent >= serve_pages)) {
+        reply_done();
+    }
+}
+
+static int handle_command(int cmd)
+{
+    uint8_t args[2];
+    double start = now_us();
+
+    switch (cmd) {
+        case CMD_LOAD_BLOCK:
+        case CMD_FREEMAP:
+            if (in_read(args, 1) < 0) {
+                return -1;
+            }
+            cur_block = (cmd == CMD_FREEMAP) ? SYSTEM_BLOCK : args[0];
+            if (verbose) {
+                printf("idunsrv: %s %d\n", cmd == CMD_FREEMAP ? "FREEMAP" : "LOAD_BLOCK", cur_block);
+            }
+            reply_queue(cmd == CMD_FREEMAP ? STAT_FREEMAP : STAT_LOAD_BLOCK, cur_block);
+            break;
+        case CMD_UPDATE_PAGE:
+            if (in_read(args, 1) < 0) {
+                return -1;
+            }
+            if (in_read(block_data(cur_block) + (args[0] & 0x3f) * 256, 256) < 0) {
+                return -1;
+            }
+            if (verbose) {
+                printf("idunsrv: UPDATE_PAGE %d/%d\n", cur_block, args[0]);
+            }
+            stats_add(STAT_UPDATE_PAGE, 1, start);
+            break;
+        case CMD_UPDATE_RUN:
+            if (in_read(args, 2) < 0) {
+                return -1;
+            }
+            if (args[0] + args[1] > PAGES_PER_BLOCK) {
+                fprintf(stderr, "idunsrv: bad UPDATE_RUN %d+%d\n", args[0], args[1]);
+                return -1;
+            }
+            if (in_read(block_data(cur_block) + args[0] * 256, (size_t)args[1] * 256) < 0) {
+                return -1;
+            }
+            if (verbose) {
+                printf("idunsrv: UPDATE_RUN %d/%d+%d\n", cur_block, args[0], args[1]);
+            }
+            stats_add(STAT_UPDATE_RUN, args[1], start);
+            break;
+        default:
+            if (verbose) {
+                printf("idunsrv: ignoring command $%02x\n", (unsigned int)cmd);
+            }
+            break;
+    }
+    return 0;
+}
+
+static void serve(void)
+{
+    int c;
+
+    in_len = in_pos = out_len = 0;
+    reply_data = NULL;
+    reply_stat = -1;
+    stats_reset();
+
+    while ((c = in_get()) >= 0) {
+        uint8_t b = (uint8_t)c;
+        int next;
+        int rc = 0;
+
+        if (b == LISTEN0 || b == TALK0) {
+            next = in_peek();
+            if (next < 0) {
+                break;
+            }
+            if (b == LISTEN0 && next == SA0) {
+                in_pos++;
+                next = in_get();
+                if (next < 0) {
+                    break;
+                }
+                rc = handle_command(next);
+            } else if (b == TALK0 && next == SA0) {
+                in_pos++;
+                rc = handle_talk();
+            } else if (b == TALK0 && next == BULK_TALK_SA) {
+                in_pos++;
+                rc = handle_bulk_talk();
+            } else {
+                rc = out_put(&b, 1);
+                bytes_echoed++;
+            }
+        } else if (b == UNTALK) {
+            handle_untalk();
+        } else {
+            rc = out_put(&b, 1);
+            bytes_echoed++;
+        }
+        if (rc < 0) {
+            break;
+        }
+    }
+}
+
+/* Create (or reuse) the shared ERAM file and map it */
+static int map_eram(const char *path)
+{
+    size_t size = (size_t)NUM_BLOCKS * BLOCK_SIZE;
+    void *p;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0 || ftruncate(fd, (off_t)size) < 0) {
+        perror("idunsrv: ERAM file");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("idunsrv: mmap");
+        return -1;
+    }
+    eram_map = p;
+    return 0;
+}
+
+static int listen_tcp(int port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        perror("idunsrv: socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        perror("idunsrv: bind");
+        close(fd);
+        return -1;
+    }
+    printf("idunsrv: listening on 127.0.0.1:%d\n", port);
+    return fd;
+}
+
+static int listen_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "idunsrv: socket path too long\n");
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("idunsrv: socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        perror("idunsrv: bind");
+        close(fd);
+        return -1;
+    }
+    printf("idunsrv: listening on unix:%s\n", path);
+    return fd;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-p port | -u path] [-m file] [-n pages] [-b] [-v]\n"
+           "  -p port   TCP port to listen on (default %d)\n"
+           "  -u path   listen on a unix domain socket instead\n"
+           "  -m file   keep ERAM in a file the emulator can map\n"
+           "  -n pages  pages returned per block load, 0-%d (default %d)\n"
+           "  -b        advertise bulk ERAM transfers\n"
+           "  -v        log every ERAM command\n",
+           prog, DEFAULT_PORT, PAGES_PER_BLOCK - 1, PAGES_PER_BLOCK - 1);
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction sa;
+    int port = DEFAULT_PORT;
+    const char *unix_path = NULL;
+    const char *eram_path = NULL;
+    int listener;
+    int one = 1;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "p:u:m:n:bvh")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'u':
+                unix_path = optarg;
+                break;
+            case 'm':
+                eram_path = optarg;
+                break;
+            case 'n':
+                serve_pages = atoi(optarg);
+                if (serve_pages < 0 || serve_pages >= PAGES_PER_BLOCK) {
+                    fprintf(stderr, "idunsrv: pages must be 0-%d\n", PAGES_PER_BLOCK - 1);
+                    return 1;
+                }
+                break;
+            case 'b':
+                advertise_bulk = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (eram_path != NULL && map_eram(eram_path) < 0) {
+        return 1;
+    }
+    listener = unix_path ? listen_unix(unix_path) : listen_tcp(port);
+    if (listener < 0) {
+        return 1;
+    }
+    fflush(stdout);
+
+    while (!interrupted) {
+        conn = accept(listener, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("idunsrv: accept");
+            break;
+        }
+        if (unix_path == NULL) {
+            setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        printf("idunsrv: connected\n");
+        serve();
+        close(conn);
+        conn = -1;
+        printf("idunsrv: disconnected\n");
+        stats_report();
+    }
+
+    close(listener);
+    if (unix_path != NULL) {
+        unlink(unix_path);
+    }
+    if (eram_map != NULL) {
+        munmap(eram_map, (size_t)NUM_BLOCKS * BLOCK_SIZE);
+    }
+    for (i = 0; i < NUM_BLOCKS; i++) {
+        free(eram[i]);
+    }
+    return 0;
+}
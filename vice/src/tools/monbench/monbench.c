@@ -0,0 +1,307 @@
+/*
+ * monbench.c - Binary monitor command turnaround benchmark.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/*
+ * Connects to the binary monitor of a running emulator and measures the
+ * turnaround of MON_CMD_PING, from sending the command to receiving its
+ * response, in two situations:
+ *
+ *  - stopped: the machine stays in the monitor and the pings are sent
+ *    back to back. This is the cost of reading and answering a command.
+ *  - running: every ping stops the machine and an exit command resumes
+ *    it. The ping is only seen at the next vsync, so this includes up to
+ *    a frame of waiting; the pings are sent at random points of the frame.
+ *
+ * Events (request ID 0xffffffff) that arrive meanwhile are skipped. At the
+ * end the machine is left running.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define DEFAULT_PORT 6502
+#define DEFAULT_COUNT 1000
+
+/* these must match monitor_binary.c */
+#define ASC_STX 0x02
+#define API_VERSION 0x02
+#define MON_CMD_PING 0x81
+#define MON_CMD_EXIT 0xaa
+#define MON_EVENT_ID 0xffffffffu
+
+static int conn = -1;
+static uint32_t next_request_id = 1;
+
+static uint64_t now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static int send_all(const unsigned char *buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = send(conn, buffer, length, 0);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("monbench: send");
+            return -1;
+        }
+        buffer += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static int receive_all(unsigned char *buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = recv(conn, buffer, length, 0);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "monbench: connection lost\n");
+            return -1;
+        }
+        buffer += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static uint32_t get_uint32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_uint32(uint32_t value, unsigned char *p)
+{
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+/* Send a command without a body and wait for its response. */
+static int command(uint8_t type)
+{
+    unsigned char frame[11];
+    unsigned char header[12];
+    uint32_t request_id = next_request_id++;
+
+    frame[0] = ASC_STX;
+    frame[1] = API_VERSION;
+    put_uint32(0, &frame[2]);
+    put_uint32(request_id, &frame[6]);
+    frame[10] = type;
+
+    if (send_all(frame, sizeof(frame)) < 0) {
+        return -1;
+    }
+
+    while (1) {
+        uint32_t length;
+
+        if (receive_all(header, sizeof(header)) < 0) {
+            return -1;
+        }
+        if (header[0] != ASC_STX) {
+            fprintf(stderr, "monbench: bad response\n");
+            return -1;
+        }
+        length = get_uint32(&header[2]);
+        while (length > 0) {
+            unsigned char skip[256];
+            size_t n = length < sizeof(skip) ? length : sizeof(skip);
+
+            if (receive_all(skip, n) < 0) {
+                return -1;
+            }
+            length -= (uint32_t)n;
+        }
+        if (get_uint32(&header[8]) == request_id) {
+            if (header[6] != type || header[7] != 0) {
+                fprintf(stderr, "monbench: command $%02x failed, error $%02x\n", type, header[7]);
+                return -1;
+            }
+            return 0;
+        }
+    }
+}
+
+static int compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *what, uint64_t *samples, int count)
+{
+    uint64_t total = 0;
+    int i;
+
+    qsort(samples, (size_t)count, sizeof(uint64_t), compare);
+    for (i = 0; i < count; i++) {
+        total += samples[i];
+    }
+    printf("monbench: %s: %d pings, turnaround usec min %llu avg %llu p50 %llu p99 %llu max %llu\n",
+           what, count,
+           (unsigned long long)samples[0],
+           (unsigned long long)(total / (uint64_t)count),
+           (unsigned long long)samples[count / 2],
+           (unsigned long long)samples[(count * 99) / 100],
+           (unsigned long long)samples[count - 1]);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-H address] [-p port] [-n count] [-s | -r]\n"
+           "  -H address  IPv4 address of the emulator (default 127.0.0.1)\n"
+           "  -p port     binary monitor port (default %d)\n"
+           "  -n count    pings per measurement (default %d)\n"
+           "  -s          only measure with the machine stopped\n"
+           "  -r          only measure with the machine running\n",
+           prog, DEFAULT_PORT, DEFAULT_COUNT);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in addr;
+    const char *host = "127.0.0.1";
+    int port = DEFAULT_PORT;
+    int count = DEFAULT_COUNT;
+    int stopped = 1;
+    int running = 1;
+    uint64_t *samples;
+    int one = 1;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "H:p:n:srh")) != -1) {
+        switch (opt) {
+            case 'H':
+                host = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                if (count < 1) {
+                    fprintf(stderr, "monbench: count must be at least 1\n");
+                    return 1;
+                }
+                break;
+            case 's':
+                running = 0;
+                break;
+            case 'r':
+                stopped = 0;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "monbench: bad address %s\n", host);
+        return 1;
+    }
+
+    conn = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn < 0 || connect(conn, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("monbench: connect");
+        return 1;
+    }
+    setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    samples = malloc(sizeof(uint64_t) * (size_t)count);
+    if (samples == NULL) {
+        return 1;
+    }
+    srand((unsigned int)now_usec());
+
+    if (stopped) {
+        /* enter the monitor first */
+        if (command(MON_CMD_PING) < 0) {
+            return 1;
+        }
+        for (i = 0; i < count; i++) {
+            uint64_t start = now_usec();
+
+            if (command(MON_CMD_PING) < 0) {
+                return 1;
+            }
+            samples[i] = now_usec() - start;
+        }
+        if (command(MON_CMD_EXIT) < 0) {
+            return 1;
+        }
+        report("stopped", samples, count);
+    }
+
+    if (running) {
+        for (i = 0; i < count; i++) {
+            uint64_t start;
+
+            usleep((useconds_t)(rand() % 20000));
+            start = now_usec();
+            if (command(MON_CMD_PING) < 0) {
+                return 1;
+            }
+            samples[i] = now_usec() - start;
+            if (command(MON_CMD_EXIT) < 0) {
+                return 1;
+            }
+        }
+        report("running", samples, count);
+    }
+
+    free(samples);
+    close(conn);
+
+    return 0;
+}
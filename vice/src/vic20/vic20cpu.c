@@ -37,6 +37,8 @@
 CLOCK maincpu_clk = 0L;
 /* if != 0, exit when this many cycles have been executed */
 CLOCK maincpu_clk_limit = 0L;
+/* this core has no idle loop detection */
+CLOCK maincpu_idle_skipped = 0;
 
 #define REWIND_FETCH_OPCODE(clock) /*clock-=2*/
 
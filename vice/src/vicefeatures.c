@@ -56,6 +56,13 @@ static const feature_list_t featurelist[] = {
 #else
         1 },
 #endif
+/* all */
+    { "FEATURE_ALARM_HEAP", "Keep pending alarms in a binary heap.",
+#ifndef FEATURE_ALARM_HEAP
+        0 },
+#else
+        1 },
+#endif
 #ifdef MACOS_COMPILE /* (osx) */
     { "HAS_HIDMGR", "Enable Mac IOHIDManager Joystick driver.",
 #ifndef HAS_HIDMGR
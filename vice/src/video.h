@@ -278,6 +278,9 @@ void video_canvas_map(struct video_canvas_s *canvas);
 void video_canvas_unmap(struct video_canvas_s *canvas);
 void video_canvas_resize(struct video_canvas_s *canvas, char resize_canvas);
 void video_canvas_render(struct video_canvas_s *canvas, uint8_t *trg, int width, int height, int xs, int ys, int xt, int yt, int pitcht);
+void video_canvas_check_palette(struct video_canvas_s *canvas);
+void video_canvas_render_from(struct video_canvas_s *canvas, uint8_t *src, uint8_t *trg, int width, int height, int xs, int ys, int xt, int yt, int pitcht);
+void video_canvas_render_sync(struct video_canvas_s *canvas);
 void video_canvas_refresh_all(struct video_canvas_s *canvas);
 char video_canvas_can_resize(struct video_canvas_s *canvas);
 void video_viewport_get(struct video_canvas_s *canvas, struct viewport_s **viewport, struct geometry_s **geometry);
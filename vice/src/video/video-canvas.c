@@ -114,12 +114,16 @@ void video_canvas_shutdown(video_canvas_t *canvas)
 void video_canvas_render(video_canvas_t *canvas, uint8_t *trg, int width,
                          int height, int xs, int ys, int xt, int yt,
                          int pitcht)
+{
+    video_canvas_check_palette(canvas);
+    video_canvas_render_from(canvas, canvas->draw_buffer->draw_buffer, trg,
+                             width, height, xs, ys, xt, yt, pitcht);
+}
+
+/* Recalculate the palette if the colors or the color encoding changed. */
+void video_canvas_check_palette(video_canvas_t *canvas)
 {
     viewport_t *viewport = canvas->viewport;
-#ifdef VIDEO_SCALE_SOURCE
-    xs /= canvas->videoconfig->scalex;
-    ys /= canvas->videoconfig->scaley;
-#endif
 
     /* when the color encoding changed, the palette must be recalculated */
     if (viewport->crt_type != canvas->crt_type) {
@@ -130,12 +134,38 @@ void video_canvas_render(video_canvas_t *canvas, uint8_t *trg, int width,
     if (!canvas->videoconfig->color_tables.updated) { /* update colors as necessary */
         video_color_update_palette(canvas);
     }
-    video_render_main(canvas->videoconfig, canvas->draw_buffer->draw_buffer,
+}
+
+/* Like video_canvas_render(), but from a copy of the draw buffer with the
+   same layout, so it can be rendered while the emulation draws the next
+   frame. The palette is left alone, the caller must have called
+   video_canvas_check_palette() first. */
+void video_canvas_render_from(video_canvas_t *canvas, uint8_t *src, uint8_t *trg,
+                              int width, int height, int xs, int ys, int xt, int yt,
+                              int pitcht)
+{
+    viewport_t *viewport = canvas->viewport;
+#ifdef VIDEO_SCALE_SOURCE
+    xs /= canvas->videoconfig->scalex;
+    ys /= canvas->videoconfig->scaley;
+#endif
+
+    video_render_main(canvas->videoconfig, src,
                       trg, width, height, xs, ys, xt, yt,
                       canvas->draw_buffer->draw_buffer_width, pitcht,
                       viewport);
 }
 
+/* Wait until no frame of the canvas is being rendered off the emulation
+   thread. Called before the color tables or the render configuration of
+   the canvas change. */
+void video_canvas_render_sync(video_canvas_t *canvas)
+{
+#ifdef USE_SDL2UI
+    sdl_video_render_sync();
+#endif
+}
+
 /** \brief Force refresh all tracked canvases.
  *
  * Added to enable visible updates each time the monitor
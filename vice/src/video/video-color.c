@@ -897,6 +897,7 @@ int video_color_update_palette(struct video_canvas_s *canvas)
     if (canvas == NULL) {
         return 0;
     }
+    video_canvas_render_sync(canvas);
     canvas->videoconfig->color_tables.updated = 1;
 
     DBG(("video_color_update_palette cbm palette:%d extern: %d",
@@ -91,6 +91,8 @@ static int set_double_size_enabled(int double_size, void *canvas)
     video_chip_cap_t *video_chip_cap = cv->videoconfig->cap;
     int val = double_size ? 1 : 0;
 
+    video_canvas_render_sync(cv);
+
     if (val) {
         cap_render = &video_chip_cap->double_mode;
     } else {
@@ -160,6 +162,8 @@ static int set_double_scan_enabled(int double_scan, void *canvas)
 {
     video_canvas_t *cv = canvas;
 
+    video_canvas_render_sync(cv);
+
     cv->videoconfig->doublescan = double_scan ? 1 : 0;
     cv->videoconfig->color_tables.updated = 0;
 
@@ -198,6 +202,8 @@ static int set_chip_rendermode(int filter, void *canvas)
     int err;
     video_canvas_t *cv = canvas;
 
+    video_canvas_render_sync(cv);
+
     switch (filter) {
         case VIDEO_FILTER_NONE:
         case VIDEO_FILTER_CRT:
@@ -359,6 +365,8 @@ static int set_palette_is_external(int external, void *canvas)
 {
     video_canvas_t *cv = canvas;
 
+    video_canvas_render_sync(cv);
+
     cv->videoconfig->external_palette = external ? 1 : 0;
     cv->videoconfig->color_tables.updated = 0;
     return 0;
@@ -375,6 +383,8 @@ static int set_palette_file_name(const char *filename, void *canvas)
 {
     video_canvas_t *cv = canvas;
 
+    video_canvas_render_sync(cv);
+
     util_string_set(&(cv->videoconfig->external_palette_name), filename);
     cv->videoconfig->color_tables.updated = 0;
     return 0;
@@ -514,6 +524,8 @@ static resource_string_t resources_chip_gloptions_string[] =
 static int set_color_saturation(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -528,6 +540,8 @@ static int set_color_saturation(int val, void *param)
 static int set_color_contrast(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -542,6 +556,8 @@ static int set_color_contrast(int val, void *param)
 static int set_color_brightness(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -556,6 +572,8 @@ static int set_color_brightness(int val, void *param)
 static int set_color_gamma(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -570,6 +588,8 @@ static int set_color_gamma(int val, void *param)
 static int set_color_tint(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -608,6 +628,8 @@ static resource_int_t resources_chip_colors[] =
 static int set_pal_scanlineshade(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -622,6 +644,8 @@ static int set_pal_scanlineshade(int val, void *param)
 static int set_pal_oddlinesphase(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -636,6 +660,8 @@ static int set_pal_oddlinesphase(int val, void *param)
 static int set_pal_oddlinesoffset(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -650,6 +676,8 @@ static int set_pal_oddlinesoffset(int val, void *param)
 static int set_pal_blur(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     if (val < 0) {
         val = 0;
     }
@@ -664,6 +692,8 @@ static int set_pal_blur(int val, void *param)
 static int set_delaylinetype(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     canvas->videoconfig->video_resources.delaylinetype = val ? 1 : 0;
     return 0;
 }
@@ -671,6 +701,8 @@ static int set_delaylinetype(int val, void *param)
 static int set_audioleak(int val, void *param)
 {
     video_canvas_t *canvas = (video_canvas_t *)param;
+
+    video_canvas_render_sync(canvas);
     canvas->videoconfig->video_resources.audioleak = val ? 1 : 0;
     return 0;
 }
@@ -52,6 +52,7 @@
 #include "archdep.h"
 #include "cmdline.h"
 #include "debug.h"
+#include "drive.h"
 #include "joystick.h"
 #include "kbdbuf.h"
 #include "lib.h"
@@ -64,7 +65,9 @@
 #endif
 #include "network.h"
 #include "resources.h"
+#include "rewind.h"
 #include "sound.h"
+#include "soundthread.h"
 #include "types.h"
 #include "videoarch.h"
 #include "vsync.h"
@@ -79,6 +82,7 @@
 /* public metrics, updated every vsync */
 static double vsync_metric_cpu_percent;
 static double vsync_metric_emulated_fps;
+static double vsync_metric_idle_cycles;
 
 #ifdef USE_VICE_THREAD
 #   include <pthread.h>
@@ -161,6 +165,13 @@ static int initial_warp_mode_cmdline = -1;
 /* When the next frame should be rendered, not skipped, during warp. */
 static tick_t warp_render_tick_interval;
 
+/* "Batch mode". If nonzero, never render and never throttle. */
+static int batch_enabled;
+
+/* Host time and emulated clock when the batch run started. */
+static tick_t batch_start_tick;
+static CLOCK batch_start_clk;
+
 /* Triggers the vice thread to update its priorty */
 static volatile int update_thread_priority = 1;
 
@@ -193,6 +204,20 @@ int vsync_get_warp_mode(void)
     return warp_enabled;
 }
 
+/* Batch mode is meant for unattended test runs: frames are never rendered
+   (the draw buffer is still updated, so exit screenshots work) and the
+   emulation is never synchronised to the host. Must be set before
+   vsync_init(). */
+void vsync_set_batch_mode(int val)
+{
+    batch_enabled = val ? 1 : 0;
+}
+
+int vsync_get_batch_mode(void)
+{
+    return batch_enabled;
+}
+
 static int set_initial_warp_mode_resource(int val, void *param)
 {
     initial_warp_mode_resource = val ? 1 : 0;
@@ -341,6 +366,12 @@ void vsync_init(void (*hook)(void))
 
     vsync_hook = hook;
     vsync_suspend_speed_eval();
+
+    if (batch_enabled) {
+        log_message(vsync_log, "Batch mode: no rendering, no speed limit.");
+        batch_start_tick = tick_now();
+        batch_start_clk = maincpu_clk;
+    }
 }
 
 void vsync_shutdown(void)
@@ -355,6 +386,28 @@ void vsync_shutdown(void)
     }
 }
 
+/* Log the emulated speed of the batch run, call before the logs are closed. */
+void vsync_batch_report(void)
+{
+    double seconds;
+    CLOCK cycles;
+
+    if (!batch_enabled || batch_start_tick == 0) {
+        return;
+    }
+
+    seconds = (double)(tick_now() - batch_start_tick) / tick_per_second();
+    cycles = maincpu_clk - batch_start_clk;
+
+    if (seconds <= 0.0 || cycles_per_sec == 0) {
+        return;
+    }
+
+    log_message(vsync_log, "Batch: %"PRIu64" cycles in %.3f s, %.2f MHz emulated (%.1fx real time).",
+                (uint64_t)cycles, seconds, cycles / seconds / 1000000.0,
+                cycles / seconds / cycles_per_sec);
+}
+
 /* This should be called whenever something that has nothing to do with the
    emulation happens, so that we don't display bogus speed values. */
 void vsync_suspend_speed_eval(void)
@@ -372,15 +425,19 @@ void vsync_reset_hook(void)
     vsync_suspend_speed_eval();
 }
 
-void vsyncarch_get_metrics(double *cpu_percent, double *emulated_fps, int *is_warp_enabled)
+void vsyncarch_get_metrics(double *cpu_percent, double *emulated_fps, int *is_warp_enabled, double *audio_fill, double *idle_cycles)
 {
     METRIC_LOCK();
 
     *cpu_percent = vsync_metric_cpu_percent;
     *emulated_fps = vsync_metric_emulated_fps;
+    *idle_cycles = vsync_metric_idle_cycles;
     *is_warp_enabled = warp_enabled;
 
     METRIC_UNLOCK();
+
+    /* The sound thread ring only uses atomics, no need for the lock */
+    *audio_fill = soundthread_get_fill();
 }
 
 /*
@@ -403,6 +460,11 @@ static CLOCK last_clock;
 static CLOCK clock_deltas[MEASUREMENT_FRAME_WINDOW];
 static uint64_t cumulative_clock_delta;
 
+/* For measuring cycles skipped by the idle loop detector */
+static CLOCK last_idle_clock;
+static CLOCK idle_deltas[MEASUREMENT_FRAME_WINDOW];
+static uint64_t cumulative_idle_delta;
+
 static void reset_performance_metrics(tick_t frame_tick)
 {
     /*
@@ -412,12 +474,14 @@ static void reset_performance_metrics(tick_t frame_tick)
 
     last_tick = frame_tick;
     last_clock = maincpu_clk;
+    last_idle_clock = maincpu_idle_skipped;
 
     measurement_count = 0;
     next_measurement_index = 0;
 
     cumulative_tick_delta = 0;
     cumulative_clock_delta = 0;
+    cumulative_idle_delta = 0;
 
     METRIC_LOCK();
 
@@ -429,6 +493,7 @@ static void reset_performance_metrics(tick_t frame_tick)
         vsync_metric_emulated_fps = (0.0 - timer_speed);
         vsync_metric_cpu_percent  = (0.0 - timer_speed) / refresh_frequency * 100;
     }
+    vsync_metric_idle_cycles = 0.0;
 
     METRIC_UNLOCK();
 }
@@ -442,6 +507,7 @@ static void update_performance_metrics(tick_t frame_tick)
     double clock_delta_seconds;
 
     CLOCK main_cpu_clock = maincpu_clk;
+    CLOCK idle_clock = maincpu_idle_skipped;
 
     if (metrics_reset) {
         metrics_reset = false;
@@ -453,6 +519,7 @@ static void update_performance_metrics(tick_t frame_tick)
         /* Remove the oldest measurement */
         cumulative_tick_delta -= tick_deltas[next_measurement_index];
         cumulative_clock_delta -= clock_deltas[next_measurement_index];
+        cumulative_idle_delta -= idle_deltas[next_measurement_index];
     } else {
         measurement_count++;
     }
@@ -460,12 +527,15 @@ static void update_performance_metrics(tick_t frame_tick)
     /* Add this frame's measurement */
     tick_deltas[next_measurement_index] = frame_tick - last_tick;
     clock_deltas[next_measurement_index] = main_cpu_clock - last_clock;
+    idle_deltas[next_measurement_index] = idle_clock - last_idle_clock;
 
     cumulative_tick_delta += tick_deltas[next_measurement_index];
     cumulative_clock_delta += clock_deltas[next_measurement_index];
+    cumulative_idle_delta += idle_deltas[next_measurement_index];
 
     last_tick = frame_tick;
     last_clock = main_cpu_clock;
+    last_idle_clock = idle_clock;
 
     /* Calculate our final metrics */
     frame_timespan_seconds = (double)cumulative_tick_delta / tick_per_second();
@@ -476,6 +546,7 @@ static void update_performance_metrics(tick_t frame_tick)
     /* smooth and make public */
     vsync_metric_cpu_percent  = (MEASUREMENT_SMOOTH_FACTOR * vsync_metric_cpu_percent)  + (1.0 - MEASUREMENT_SMOOTH_FACTOR) * (clock_delta_seconds / frame_timespan_seconds * 100.0);
     vsync_metric_emulated_fps = (MEASUREMENT_SMOOTH_FACTOR * vsync_metric_emulated_fps) + (1.0 - MEASUREMENT_SMOOTH_FACTOR) * ((double)measurement_count / frame_timespan_seconds);
+    vsync_metric_idle_cycles  = (MEASUREMENT_SMOOTH_FACTOR * vsync_metric_idle_cycles)  + (1.0 - MEASUREMENT_SMOOTH_FACTOR) * ((double)cumulative_idle_delta / frame_timespan_seconds);
 
     /* printf("%.3f seconds - %0.3f%% cpu, %.3f fps (CLOCK delta: %u)\n", frame_timespan_seconds, vsync_metric_cpu_percent, vsync_metric_emulated_fps, clock_deltas[next_measurement_index]); fflush(stdout); */
 
@@ -522,6 +593,11 @@ void vsync_do_end_of_line(void)
     /* deal with any accumulated sound immediately */
     tick_based_sync_timing = sound_flush();
 
+    if (batch_enabled) {
+        /* Nothing to wait for and nobody to yield to */
+        return;
+    }
+
     tick_now = tick_now_after(last_sync_tick);
 
     if (sync_reset) {
@@ -543,6 +619,9 @@ void vsync_do_end_of_line(void)
     /* is it time to consider keyboard, joystick ? */
     if (tick_delta >= tick_between_sync) {
 
+        /* the UI may touch the drives while it has the mainlock */
+        drive_cpu_park_all();
+
         if (warp_enabled) {
             /* During warp we need to periodically allow the UI a chance with the mainlock */
             mainlock_yield();
@@ -631,6 +710,10 @@ bool vsync_should_skip_frame(struct video_canvas_s *canvas)
         return true;
     }
 
+    if (batch_enabled) {
+        return true;
+    }
+
     /*
      * Limit rendering fps if we're in warp mode.
      * It's ugly enough for dqh to weep but makes warp faster.
@@ -703,6 +786,8 @@ void vsync_do_vsync(struct video_canvas_s *c)
 
     vsyncarch_postsync();
 
+    rewind_vsync_hook();
+
 #ifdef VSYNC_DEBUG
     log_debug(LOG_DEFAULT, "vsync: start:%lu  delay:%ld  sound-delay:%lf  end:%lu  next-frame:%lu  frame-ticks:%lu",
                 now, delay, sound_delay * 1000000, tick_now(), next_frame_start, ticks_per_frame);
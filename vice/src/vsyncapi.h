@@ -33,8 +33,9 @@ struct video_canvas_s;
 
 typedef void (*void_hook_t)(void);
 
-/* current performance metrics */
-void vsyncarch_get_metrics(double *cpu_percent, double *emulated_fps, int *warp_enabled);
+/* current performance metrics, audio_fill is -1 without a sound thread,
+   idle_cycles are the cycles per second skipped in idle loops */
+void vsyncarch_get_metrics(double *cpu_percent, double *emulated_fps, int *warp_enabled, double *audio_fill, double *idle_cycles);
 
 /* this is called before vsync_do_vsync does the synchroniation */
 void vsyncarch_presync(void);